@@ -1456,6 +1456,193 @@ static void test_reg_unload_key(void)
     DeleteFileA("saved_key.LOG");
 }
 
+static char *(CDECL *pwine_get_unix_file_name)(LPCWSTR);
+static WCHAR *(CDECL *pwine_get_dos_file_name)(LPCSTR);
+
+/* build a copy of the environment with WINEPREFIX pointing to a different prefix */
+static char *build_prefix_env(const char *prefix)
+{
+    char *env = GetEnvironmentStringsA(), *ret, *dst, *p;
+    DWORD len = sizeof("WINEPREFIX=") + strlen(prefix) + 1;
+
+    for (p = env; *p; p += strlen(p) + 1) len += strlen(p) + 1;
+    ret = HeapAlloc(GetProcessHeap(), 0, len);
+    dst = ret + sprintf(ret, "WINEPREFIX=%s", prefix) + 1;
+    for (p = env; *p; p += strlen(p) + 1)
+    {
+        if (!strncmp(p, "WINEPREFIX=", sizeof("WINEPREFIX=") - 1)) continue;
+        strcpy(dst, p);
+        dst += strlen(p) + 1;
+    }
+    *dst = 0;
+    FreeEnvironmentStringsA(env);
+    return ret;
+}
+
+/* run a Unix program with the given input and return its output */
+/* the output pipe is also inherited by the wineserver started for another prefix, */
+/* so reading it to the end waits until that server has exited and saved the registry */
+static char *run_unix_program(const char *program, const char *args, char *env,
+                              const char *input, DWORD *size)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE in_read, in_write, out_read, out_write;
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si;
+    char app[MAX_PATH], cmdline[2 * MAX_PATH], *output;
+    WCHAR *appW;
+    DWORD count;
+    BOOL ret;
+
+    if (!(appW = pwine_get_dos_file_name(program))) return NULL;
+    WideCharToMultiByte(CP_ACP, 0, appW, -1, app, sizeof(app), NULL, NULL);
+    HeapFree(GetProcessHeap(), 0, appW);
+    sprintf(cmdline, "\"%s\" %s", program, args);
+
+    CreatePipe(&in_read, &in_write, &sa, 0);
+    CreatePipe(&out_read, &out_write, &sa, 0);
+    if (input) WriteFile(in_write, input, strlen(input), &count, NULL);
+    CloseHandle(in_write);
+
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = in_read;
+    si.hStdOutput = out_write;
+    si.hStdError = out_write;
+    memset(&pi, 0, sizeof(pi));
+    ret = CreateProcessA(app, cmdline, NULL, NULL, TRUE, 0, env, NULL, &si, &pi);
+    ok(ret, "failed to run %s, error %u\n", cmdline, GetLastError());
+    CloseHandle(in_read);
+    CloseHandle(out_write);
+
+    output = HeapAlloc(GetProcessHeap(), 0, 1);
+    *size = 0;
+    if (ret)
+    {
+        char buffer[1024];
+
+        while (ReadFile(out_read, buffer, sizeof(buffer), &count, NULL) && count)
+        {
+            output = HeapReAlloc(GetProcessHeap(), 0, output, *size + count + 1);
+            memcpy(output + *size, buffer, count);
+            *size += count;
+        }
+        if (pi.hProcess) CloseHandle(pi.hProcess);
+        if (pi.hThread) CloseHandle(pi.hThread);
+    }
+    output[*size] = 0;
+    CloseHandle(out_read);
+    return output;
+}
+
+static const char *find_data(const char *data, DWORD size, const void *pattern, DWORD len)
+{
+    const char *p;
+
+    for (p = data; p + len <= data + size; p++)
+        if (!memcmp(p, pattern, len)) return p;
+    return NULL;
+}
+
+/* overwrite the data following a pattern in a file, keeping the file itself */
+static BOOL patch_file(const char *path, const void *pattern, DWORD len, const void *data, DWORD size)
+{
+    const char *p;
+    char *buffer;
+    DWORD file_size, count;
+    HANDLE file;
+    BOOL ret = FALSE;
+
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    file_size = GetFileSize(file, NULL);
+    buffer = HeapAlloc(GetProcessHeap(), 0, file_size);
+    if (ReadFile(file, buffer, file_size, &count, NULL) && count == file_size &&
+        (p = find_data(buffer, file_size, pattern, len)) && p + len + size <= buffer + file_size)
+    {
+        SetFilePointer(file, p + len - buffer, NULL, FILE_BEGIN);
+        ret = WriteFile(file, data, size, &count, NULL) && count == size;
+    }
+    HeapFree(GetProcessHeap(), 0, buffer);
+    CloseHandle(file);
+    return ret;
+}
+
+static void test_registry_image(void)
+{
+    static const char import[] =
+        "REGEDIT4\n\n[HKEY_CURRENT_USER\\Software\\Wine\\RegImageTest\\Sub]\n\"Marker\"=\"image marker 1\"\n";
+    static const char export_args[] = "regedit /E - HKEY_CURRENT_USER\\Software\\Wine\\RegImageTest";
+    static const WCHAR markerW[] = {'i','m','a','g','e',' ','m','a','r','k','e','r',' '};
+    static const WCHAR twoW[] = {'2'};
+    char dir[MAX_PATH], path[MAX_PATH], loader[MAX_PATH], args[MAX_PATH + 8], *prefix, *env, *output;
+    WCHAR dirW[MAX_PATH];
+    DWORD size;
+    HANDLE file;
+
+    pwine_get_unix_file_name = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "wine_get_unix_file_name");
+    pwine_get_dos_file_name = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "wine_get_dos_file_name");
+    if (!pwine_get_unix_file_name || !pwine_get_dos_file_name)
+    {
+        win_skip("registry images are specific to Wine\n");
+        return;
+    }
+    if (!GetEnvironmentVariableA("WINELOADER", loader, sizeof(loader)))
+    {
+        skip("WINELOADER not set, cannot start another wineserver\n");
+        return;
+    }
+
+    /* the registry files are only loaded when a server starts, so use a separate prefix */
+    GetTempPathA(MAX_PATH, path);
+    GetTempFileNameA(path, "reg", 0, dir);
+    DeleteFileA(dir);
+    if (!CreateDirectoryA(dir, NULL))
+    {
+        skip("cannot create the prefix directory, error %u\n", GetLastError());
+        return;
+    }
+    /* keep wineboot from installing the whole prefix */
+    sprintf(path, "%s\\.update-timestamp", dir);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError());
+    WriteFile(file, "disable\n", 8, &size, NULL);
+    CloseHandle(file);
+
+    MultiByteToWideChar(CP_ACP, 0, dir, -1, dirW, MAX_PATH);
+    prefix = pwine_get_unix_file_name(dirW);
+    env = build_prefix_env(prefix);
+
+    /* the values are saved to user.reg, and to an image matching it */
+    output = run_unix_program(loader, "regedit -", env, import, &size);
+    HeapFree(GetProcessHeap(), 0, output);
+    sprintf(path, "%s\\user.reg.bin", dir);
+    ok(GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES, "image not saved\n");
+
+    /* the text file still matches the image, the keys are loaded from the image */
+    ok(patch_file(path, markerW, sizeof(markerW), twoW, sizeof(twoW)), "value not found in the image\n");
+    output = run_unix_program(loader, export_args, env, NULL, &size);
+    ok(find_data(output, size, "\"Marker\"=\"image marker 2\"", 25) != NULL,
+       "value not loaded from the image:\n%s\n", output);
+    HeapFree(GetProcessHeap(), 0, output);
+
+    /* modifying the text file makes the image out of date, even with the same size */
+    sprintf(path, "%s\\user.reg", dir);
+    ok(patch_file(path, "\"image marker ", 14, "3", 1), "value not found in the text file\n");
+    output = run_unix_program(loader, export_args, env, NULL, &size);
+    ok(find_data(output, size, "\"Marker\"=\"image marker 3\"", 25) != NULL,
+       "value not loaded from the text file:\n%s\n", output);
+    HeapFree(GetProcessHeap(), 0, output);
+
+    /* rm doesn't follow the dosdevices symlinks */
+    sprintf(args, "-rf \"%s\"", prefix);
+    output = run_unix_program("/bin/rm", args, env, NULL, &size);
+    HeapFree(GetProcessHeap(), 0, output);
+    HeapFree(GetProcessHeap(), 0, env);
+    HeapFree(GetProcessHeap(), 0, prefix);
+}
+
 static BOOL set_privileges(LPCSTR privilege, BOOL set)
 {
     TOKEN_PRIVILEGES tp;
@@ -2983,6 +3170,7 @@ START_TEST(registry)
     test_deleted_key();
     test_delete_value();
     test_delete_key_value();
+    test_registry_image();
 
     /* cleanup */
     delete_key( hkey_main );
@@ -1043,6 +1043,33 @@ BOOL WINAPI SetFileInformationByHandle( HANDLE file, FILE_INFO_BY_HANDLE_CLASS c
     return FALSE;
 }
 
+
+/**************************************************************************
+ *           SetFileCompletionNotificationModes   (KERNEL32.@)
+ *
+ * Sets how the I/O manager notifies the completion of operations on a file.
+ *
+ * PARAMS
+ *  file  [I] File handle.
+ *  flags [I] FILE_SKIP_COMPLETION_PORT_ON_SUCCESS and/or FILE_SKIP_SET_EVENT_ON_HANDLE.
+ *
+ * RETURNS
+ *  Success: TRUE.
+ *  Failure: FALSE, check GetLastError().
+ */
+BOOL WINAPI SetFileCompletionNotificationModes( HANDLE file, UCHAR flags )
+{
+    FILE_IO_COMPLETION_NOTIFICATION_INFORMATION info;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+
+    info.Flags = flags;
+    status = NtSetInformationFile( file, &io, &info, sizeof(info), FileIoCompletionNotificationInformation );
+    if (status == STATUS_SUCCESS) return TRUE;
+    SetLastError( RtlNtStatusToDosError(status) );
+    return FALSE;
+}
+
 /***********************************************************************
  *           SetFilePointer   (KERNEL32.@)
  */
@@ -367,7 +367,9 @@ void WINAPI MakeCriticalSectionGlobal( CRITICAL_SECTION *crit )
     HANDLE sem = crit->LockSemaphore;
     if (!sem) NtCreateSemaphore( &sem, SEMAPHORE_ALL_ACCESS, NULL, 0, 1 );
     crit->LockSemaphore = ConvertToGlobalHandle( sem );
-    RtlFreeHeap( GetProcessHeap(), 0, crit->DebugInfo );
+    /* sections created with RTL_CRITICAL_SECTION_FLAG_NO_DEBUG_INFO use ~0 as DebugInfo */
+    if (crit->DebugInfo != (RTL_CRITICAL_SECTION_DEBUG *)~(ULONG_PTR)0)
+        RtlFreeHeap( GetProcessHeap(), 0, crit->DebugInfo );
     crit->DebugInfo = NULL;
 }
 
@@ -2233,6 +2235,29 @@ BOOL WINAPI GetQueuedCompletionStatus( HANDLE CompletionPort, LPDWORD lpNumberOf
 }
 
 
+/******************************************************************************
+ *		GetQueuedCompletionStatusEx (KERNEL32.@)
+ */
+BOOL WINAPI GetQueuedCompletionStatusEx( HANDLE CompletionPort, OVERLAPPED_ENTRY *entries, ULONG count,
+                                         ULONG *removed, DWORD dwMilliseconds, BOOL alertable )
+{
+    NTSTATUS status;
+    LARGE_INTEGER wait_time;
+
+    TRACE("(%p,%p,%u,%p,%d,%d)\n", CompletionPort, entries, count, removed, dwMilliseconds, alertable);
+
+    /* OVERLAPPED_ENTRY has the same layout as FILE_IO_COMPLETION_INFORMATION */
+    status = NtRemoveIoCompletionEx( CompletionPort, (FILE_IO_COMPLETION_INFORMATION *)entries, count,
+                                     removed, get_nt_timeout( &wait_time, dwMilliseconds ), alertable );
+    if (status == STATUS_SUCCESS) return TRUE;
+
+    if (status == STATUS_TIMEOUT) SetLastError( WAIT_TIMEOUT );
+    else if (status == STATUS_USER_APC) SetLastError( WAIT_IO_COMPLETION );
+    else SetLastError( RtlNtStatusToDosError(status) );
+    return FALSE;
+}
+
+
 /******************************************************************************
  *		PostQueuedCompletionStatus (KERNEL32.@)
  */
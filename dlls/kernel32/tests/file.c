@@ -46,6 +46,7 @@ static HANDLE (WINAPI *pOpenFileById)(HANDLE, LPFILE_ID_DESCRIPTOR, DWORD, DWORD
 static BOOL (WINAPI *pSetFileValidData)(HANDLE, LONGLONG);
 static HRESULT (WINAPI *pCopyFile2)(PCWSTR,PCWSTR,COPYFILE2_EXTENDED_PARAMETERS*);
 static HANDLE (WINAPI *pCreateFile2)(LPCWSTR, DWORD, DWORD, DWORD, CREATEFILE2_EXTENDED_PARAMETERS*);
+static BOOL (WINAPI *pSetFileCompletionNotificationModes)(HANDLE, UCHAR);
 
 static const char filename[] = "testfile.xxx";
 static const char sillytext[] =
@@ -83,6 +84,7 @@ static void InitFunctionPointers(void)
     pSetFileValidData = (void *) GetProcAddress(hkernel32, "SetFileValidData");
     pCopyFile2 = (void *) GetProcAddress(hkernel32, "CopyFile2");
     pCreateFile2 = (void *) GetProcAddress(hkernel32, "CreateFile2");
+    pSetFileCompletionNotificationModes = (void *) GetProcAddress(hkernel32, "SetFileCompletionNotificationModes");
 }
 
 static void test__hread( void )
@@ -4053,6 +4055,83 @@ static void test_WriteFileGather(void)
     DeleteFileA( filename );
 }
 
+static void test_SetFileCompletionNotificationModes(void)
+{
+    char temp_path[MAX_PATH], filename[MAX_PATH], buf[16];
+    HANDLE hfile, hiocp;
+    DWORD ret, size;
+    ULONG_PTR key;
+    OVERLAPPED ovl, *povl;
+
+    if (!pSetFileCompletionNotificationModes)
+    {
+        win_skip( "SetFileCompletionNotificationModes is not available\n" );
+        return;
+    }
+
+    ret = GetTempPathA( MAX_PATH, temp_path );
+    ok( ret != 0, "GetTempPathA error %d\n", GetLastError() );
+    ret = GetTempFileNameA( temp_path, "sfc", 0, filename );
+    ok( ret != 0, "GetTempFileNameA error %d\n", GetLastError() );
+
+    hfile = CreateFileA( filename, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                         FILE_FLAG_OVERLAPPED | FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "CreateFile failed err %u\n", GetLastError() );
+    if (hfile == INVALID_HANDLE_VALUE) return;
+
+    hiocp = CreateIoCompletionPort( hfile, NULL, 123, 0 );
+    ok( hiocp != 0, "CreateIoCompletionPort failed err %u\n", GetLastError() );
+
+    /* without skip mode every operation queues a packet */
+    memset( &ovl, 0, sizeof(ovl) );
+    ret = WriteFile( hfile, "abcdefgh", 8, NULL, &ovl );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "WriteFile failed err %u\n", GetLastError() );
+    povl = NULL;
+    ret = GetQueuedCompletionStatus( hiocp, &size, &key, &povl, 1000 );
+    ok( ret, "GetQueuedCompletionStatus failed err %u\n", GetLastError() );
+    ok( povl == &ovl, "wrong ovl %p\n", povl );
+    ok( key == 123, "wrong key %lu\n", key );
+    ok( size == 8, "wrong size %u\n", size );
+
+    ret = pSetFileCompletionNotificationModes( hfile, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE );
+    ok( ret, "SetFileCompletionNotificationModes failed err %u\n", GetLastError() );
+
+    /* operations completing immediately don't, pending ones still do */
+    memset( &ovl, 0, sizeof(ovl) );
+    ret = ReadFile( hfile, buf, 8, NULL, &ovl );
+    if (!ret) ok( GetLastError() == ERROR_IO_PENDING, "ReadFile failed err %u\n", GetLastError() );
+    povl = NULL;
+    SetLastError( 0xdeadbeef );
+    if (ret)
+    {
+        ret = GetQueuedCompletionStatus( hiocp, &size, &key, &povl, 0 );
+        ok( !ret, "GetQueuedCompletionStatus succeeded\n" );
+        ok( GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError() );
+        ok( povl == NULL, "wrong ovl %p\n", povl );
+        ok( !memcmp( buf, "abcdefgh", 8 ), "wrong data\n" );
+    }
+    else
+    {
+        ret = GetQueuedCompletionStatus( hiocp, &size, &key, &povl, 1000 );
+        ok( ret, "GetQueuedCompletionStatus failed err %u\n", GetLastError() );
+        ok( povl == &ovl, "wrong ovl %p\n", povl );
+    }
+
+    CloseHandle( hfile );
+    CloseHandle( hiocp );
+
+    /* synchronous handles can't use skip mode */
+    hfile = CreateFileA( filename, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "CreateFile failed err %u\n", GetLastError() );
+    SetLastError( 0xdeadbeef );
+    ret = pSetFileCompletionNotificationModes( hfile, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS );
+    ok( !ret, "SetFileCompletionNotificationModes succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_PARAMETER, "wrong error %u\n", GetLastError() );
+    CloseHandle( hfile );
+
+    DeleteFileA( filename );
+}
+
 static unsigned file_map_access(unsigned access)
 {
     if (access & GENERIC_READ)    access |= FILE_GENERIC_READ;
@@ -4233,5 +4312,6 @@ START_TEST(file)
     test_OpenFileById();
     test_SetFileValidData();
     test_WriteFileGather();
+    test_SetFileCompletionNotificationModes();
     test_file_access();
 }
@@ -39,6 +39,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
 struct heap_layout
@@ -853,6 +854,82 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static void test_low_fragmentation_heap(void)
+{
+    PROCESS_HEAP_ENTRY entry;
+    HANDLE heap;
+    ULONG info;
+    BYTE *ptrs[256];
+    SIZE_T size;
+    BOOL ret;
+    int i, j;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    for (j = 0; j < 4; j++)
+    {
+        for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++)
+        {
+            size = (i * 7) % 700;
+            ptrs[i] = HeapAlloc( heap, HEAP_ZERO_MEMORY, size );
+            ok( ptrs[i] != NULL, "HeapAlloc failed for size %lu\n", size );
+            ok( !size || !ptrs[i][size - 1], "memory not zeroed for size %lu\n", size );
+            ok( HeapSize( heap, 0, ptrs[i] ) == size, "wrong size %lu/%lu\n",
+                HeapSize( heap, 0, ptrs[i] ), size );
+            memset( ptrs[i], 0xcc, size );
+        }
+        ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+        for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i += 2)
+        {
+            ret = HeapFree( heap, 0, ptrs[i] );
+            ok( ret, "HeapFree failed\n" );
+        }
+        for (i = 1; i < sizeof(ptrs) / sizeof(ptrs[0]); i += 2)
+        {
+            ptrs[i] = HeapReAlloc( heap, 0, ptrs[i], 40 );
+            ok( ptrs[i] != NULL, "HeapReAlloc failed\n" );
+            ok( HeapSize( heap, 0, ptrs[i] ) == 40, "wrong size %lu\n", HeapSize( heap, 0, ptrs[i] ) );
+            ret = HeapFree( heap, 0, ptrs[i] );
+            ok( ret, "HeapFree failed\n" );
+        }
+        ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+    }
+
+    for (i = 0; i < 16; i++) ptrs[i] = HeapAlloc( heap, 0, 32 );
+    for (i = 0; i < 16; i++) HeapFree( heap, 0, ptrs[i] );
+
+    /* freed blocks must not be reported as busy, even if the front end keeps them */
+    memset( &entry, 0, sizeof(entry) );
+    for (i = 0; i < 100000; i++)
+    {
+        if (!HeapWalk( heap, &entry )) break;
+        if (!(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY)) continue;
+        for (j = 0; j < 16; j++)
+            ok( entry.lpData != ptrs[j], "freed block %p reported as busy\n", ptrs[j] );
+    }
+    ok( GetLastError() == ERROR_NO_MORE_ITEMS, "wrong error %u\n", GetLastError() );
+
+    ret = HeapDestroy( heap );
+    ok( ret, "HeapDestroy failed\n" );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1173,6 +1250,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), (2 << 20));
     test_sized_HeapReAlloc((1 << 20), 1);
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
 
     if (pRtlGetNtGlobalFlags)
     {
@@ -57,6 +57,7 @@ static VOID   (WINAPI *pReleaseSRWLockShared)(PSRWLOCK);
 static BOOLEAN (WINAPI *pTryAcquireSRWLockExclusive)(PSRWLOCK);
 static BOOLEAN (WINAPI *pTryAcquireSRWLockShared)(PSRWLOCK);
 static NTSTATUS (WINAPI *pNtWaitForMultipleObjects)(ULONG,const HANDLE*,BOOLEAN,BOOLEAN,const LARGE_INTEGER*);
+static BOOL   (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE,OVERLAPPED_ENTRY*,ULONG,ULONG*,DWORD,BOOL);
 
 static void test_signalandwait(void)
 {
@@ -738,6 +739,82 @@ static void CALLBACK timer_queue_cb6(PVOID p, BOOLEAN timedOut)
     }
 }
 
+static int completion_apc_count;
+
+static void CALLBACK completion_apc( ULONG_PTR arg )
+{
+    completion_apc_count++;
+}
+
+static void test_completion_port_batch(void)
+{
+    OVERLAPPED_ENTRY entries[128];
+    HANDLE port;
+    ULONG removed, i;
+    DWORD ret;
+    BOOL retb;
+
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        win_skip("GetQueuedCompletionStatusEx not available\n");
+        return;
+    }
+
+    port = CreateIoCompletionPort( INVALID_HANDLE_VALUE, NULL, 0, 0 );
+    ok( port != NULL, "CreateIoCompletionPort failed %u\n", GetLastError() );
+
+    SetLastError( 0xdeadbeef );
+    retb = pGetQueuedCompletionStatusEx( port, entries, 4, &removed, 0, FALSE );
+    ok( !retb, "GetQueuedCompletionStatusEx succeeded\n" );
+    ok( GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError() );
+
+    for (i = 0; i < 100; i++)
+    {
+        retb = PostQueuedCompletionStatus( port, i * 2, i, (OVERLAPPED *)(ULONG_PTR)(i + 1) );
+        ok( retb, "PostQueuedCompletionStatus failed %u\n", GetLastError() );
+    }
+
+    memset( entries, 0xcc, sizeof(entries) );
+    removed = 0xdeadbeef;
+    retb = pGetQueuedCompletionStatusEx( port, entries, 30, &removed, 0, FALSE );
+    ok( retb, "GetQueuedCompletionStatusEx failed %u\n", GetLastError() );
+    ok( removed == 30, "got %u entries\n", removed );
+    for (i = 0; i < removed; i++)
+    {
+        ok( entries[i].lpCompletionKey == i, "%u: wrong key %lx\n", i, entries[i].lpCompletionKey );
+        ok( entries[i].lpOverlapped == (OVERLAPPED *)(ULONG_PTR)(i + 1), "%u: wrong overlapped %p\n",
+            i, entries[i].lpOverlapped );
+        ok( entries[i].dwNumberOfBytesTransferred == i * 2, "%u: wrong size %u\n",
+            i, entries[i].dwNumberOfBytesTransferred );
+    }
+    ok( entries[30].lpCompletionKey == (ULONG_PTR)0xcccccccccccccccc, "entry 30 modified\n" );
+
+    /* only the available entries are returned */
+    removed = 0xdeadbeef;
+    retb = pGetQueuedCompletionStatusEx( port, entries, sizeof(entries)/sizeof(entries[0]), &removed, 1000, FALSE );
+    ok( retb, "GetQueuedCompletionStatusEx failed %u\n", GetLastError() );
+    ok( removed == 70, "got %u entries\n", removed );
+    for (i = 0; i < removed; i++)
+        ok( entries[i].lpCompletionKey == i + 30, "%u: wrong key %lx\n", i, entries[i].lpCompletionKey );
+
+    SetLastError( 0xdeadbeef );
+    retb = pGetQueuedCompletionStatusEx( port, entries, 4, &removed, 10, FALSE );
+    ok( !retb, "GetQueuedCompletionStatusEx succeeded\n" );
+    ok( GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError() );
+
+    /* alertable wait */
+    completion_apc_count = 0;
+    ret = QueueUserAPC( completion_apc, GetCurrentThread(), 0 );
+    ok( ret, "QueueUserAPC failed %u\n", GetLastError() );
+    SetLastError( 0xdeadbeef );
+    retb = pGetQueuedCompletionStatusEx( port, entries, 4, &removed, 1000, TRUE );
+    ok( !retb, "GetQueuedCompletionStatusEx succeeded\n" );
+    ok( GetLastError() == WAIT_IO_COMPLETION, "wrong error %u\n", GetLastError() );
+    ok( completion_apc_count == 1, "APC called %u times\n", completion_apc_count );
+
+    CloseHandle( port );
+}
+
 static void test_timer_queue(void)
 {
     HANDLE q, t0, t1, t2, t3, t4, t5;
@@ -1724,6 +1801,77 @@ static DWORD WINAPI condvar_base_consumer(LPVOID x) {
     return 0;
 }
 
+static CONDITION_VARIABLE condvar_wake = CONDITION_VARIABLE_INIT;
+static CRITICAL_SECTION condvar_wake_crit;
+static LONG condvar_wake_sleepers;
+
+static DWORD WINAPI condvar_wake_sleeper(void *arg)
+{
+    BOOL ret;
+
+    EnterCriticalSection(&condvar_wake_crit);
+    condvar_wake_sleepers++;
+    ret = pSleepConditionVariableCS(&condvar_wake, &condvar_wake_crit, 5000);
+    ok(ret, "SleepConditionVariableCS failed, error %u\n", GetLastError());
+    LeaveCriticalSection(&condvar_wake_crit);
+    return 0;
+}
+
+static void test_condvars_wake(void)
+{
+    HANDLE threads[2];
+    DWORD ret;
+    int i;
+
+    if (!pInitializeConditionVariable)
+    {
+        win_skip("no condition variable support.\n");
+        return;
+    }
+
+    InitializeCriticalSection(&condvar_wake_crit);
+
+    /* a sleeper that timed out must not use up a later wake-up */
+    EnterCriticalSection(&condvar_wake_crit);
+    ret = pSleepConditionVariableCS(&condvar_wake, &condvar_wake_crit, 10);
+    ok(!ret, "SleepConditionVariableCS should time out\n");
+    ok(GetLastError() == ERROR_TIMEOUT, "wrong error %u\n", GetLastError());
+    LeaveCriticalSection(&condvar_wake_crit);
+
+    for (i = 0; i < 2; i++)
+        threads[i] = CreateThread(NULL, 0, condvar_wake_sleeper, NULL, 0, NULL);
+
+    for (;;)
+    {
+        EnterCriticalSection(&condvar_wake_crit);
+        i = condvar_wake_sleepers;
+        LeaveCriticalSection(&condvar_wake_crit);
+        if (i == 2) break;
+        Sleep(1);
+    }
+
+    /* each wake-up releases at least one of the sleepers */
+    pWakeConditionVariable(&condvar_wake);
+    ret = WaitForMultipleObjects(2, threads, FALSE, 1000);
+    ok(ret == WAIT_OBJECT_0 || ret == WAIT_OBJECT_0 + 1, "WaitForMultipleObjects returned %u\n", ret);
+    pWakeConditionVariable(&condvar_wake);
+    ret = WaitForMultipleObjects(2, threads, TRUE, 1000);
+    ok(ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", ret);
+    CloseHandle(threads[0]);
+    CloseHandle(threads[1]);
+
+    /* wake-ups without sleepers are not remembered */
+    pWakeAllConditionVariable(&condvar_wake);
+    pWakeConditionVariable(&condvar_wake);
+    EnterCriticalSection(&condvar_wake_crit);
+    ret = pSleepConditionVariableCS(&condvar_wake, &condvar_wake_crit, 10);
+    ok(!ret, "SleepConditionVariableCS should time out\n");
+    ok(GetLastError() == ERROR_TIMEOUT, "wrong error %u\n", GetLastError());
+    LeaveCriticalSection(&condvar_wake_crit);
+
+    DeleteCriticalSection(&condvar_wake_crit);
+}
+
 static void test_condvars_base(void) {
     HANDLE hp, hc;
     DWORD dummy;
@@ -2334,6 +2482,7 @@ START_TEST(sync)
     pTryAcquireSRWLockExclusive = (void *)GetProcAddress(hdll, "TryAcquireSRWLockExclusive");
     pTryAcquireSRWLockShared = (void *)GetProcAddress(hdll, "TryAcquireSRWLockShared");
     pNtWaitForMultipleObjects = (void *)GetProcAddress(hntdll, "NtWaitForMultipleObjects");
+    pGetQueuedCompletionStatusEx = (void *)GetProcAddress(hdll, "GetQueuedCompletionStatusEx");
 
     test_signalandwait();
     test_mutex();
@@ -2342,12 +2491,14 @@ START_TEST(sync)
     test_semaphore();
     test_waitable_timer();
     test_iocp_callback();
+    test_completion_port_batch();
     test_timer_queue();
     test_WaitForSingleObject();
     test_WaitForMultipleObjects();
     test_initonce();
     test_condvars_base();
     test_condvars_consumer_producer();
+    test_condvars_wake();
     test_srwlock_base();
     test_srwlock_example();
 }
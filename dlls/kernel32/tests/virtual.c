@@ -3425,6 +3425,79 @@ static void test_shared_memory_ro(BOOL is_child, DWORD child_access)
     CloseHandle(mapping);
 }
 
+static void test_many_views(void)
+{
+    static const SIZE_T granularity = 0x10000;
+    MEMORY_BASIC_INFORMATION info;
+    char *base, *addr;
+    SIZE_T size;
+    DWORD i;
+    BOOL ret;
+
+    /* find a free area and split it into 64 separate allocations */
+    base = VirtualAlloc(NULL, 64 * granularity, MEM_RESERVE, PAGE_NOACCESS);
+    ok(base != NULL, "VirtualAlloc failed %u\n", GetLastError());
+    ret = VirtualFree(base, 0, MEM_RELEASE);
+    ok(ret, "VirtualFree failed %u\n", GetLastError());
+
+    for (i = 0; i < 64; i++)
+    {
+        addr = VirtualAlloc(base + i * granularity, granularity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        ok(addr == base + i * granularity, "%u: VirtualAlloc returned %p, expected %p, error %u\n",
+           i, addr, base + i * granularity, GetLastError());
+    }
+
+    /* punch holes into every other allocation */
+    for (i = 0; i < 64; i += 2)
+    {
+        ret = VirtualFree(base + i * granularity, 0, MEM_RELEASE);
+        ok(ret, "%u: VirtualFree failed %u\n", i, GetLastError());
+    }
+
+    for (i = 1; i < 63; i++)
+    {
+        /* the query address is rounded down to its page */
+        addr = base + i * granularity + 0x1234;
+        size = VirtualQuery(addr, &info, sizeof(info));
+        ok(size == sizeof(info), "%u: VirtualQuery returned %lu\n", i, size);
+        ok(info.BaseAddress == base + i * granularity + 0x1000, "%u: got BaseAddress %p, expected %p\n",
+           i, info.BaseAddress, base + i * granularity + 0x1000);
+        ok(info.RegionSize == granularity - 0x1000, "%u: got RegionSize %lx\n", i, info.RegionSize);
+        if (i & 1)
+        {
+            ok(info.AllocationBase == base + i * granularity, "%u: got AllocationBase %p\n",
+               i, info.AllocationBase);
+            ok(info.State == MEM_COMMIT, "%u: got State %x\n", i, info.State);
+            ok(info.Protect == PAGE_READWRITE, "%u: got Protect %x\n", i, info.Protect);
+        }
+        else
+            ok(info.State == MEM_FREE, "%u: got State %x\n", i, info.State);
+    }
+
+    /* allocations overlapping an existing view fail, the holes can be reused */
+    addr = VirtualAlloc(base + 2 * granularity, 2 * granularity, MEM_RESERVE, PAGE_NOACCESS);
+    ok(!addr, "VirtualAlloc succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_ADDRESS, "got error %u\n", GetLastError());
+
+    for (i = 0; i < 64; i += 2)
+    {
+        addr = VirtualAlloc(base + i * granularity, granularity, MEM_RESERVE, PAGE_NOACCESS);
+        ok(addr == base + i * granularity, "%u: VirtualAlloc returned %p, expected %p, error %u\n",
+           i, addr, base + i * granularity, GetLastError());
+    }
+
+    for (i = 0; i < 64; i++)
+    {
+        ret = VirtualFree(base + i * granularity, 0, MEM_RELEASE);
+        ok(ret, "%u: VirtualFree failed %u\n", i, GetLastError());
+    }
+
+    size = VirtualQuery(base, &info, sizeof(info));
+    ok(size == sizeof(info), "VirtualQuery returned %lu\n", size);
+    ok(info.State == MEM_FREE, "got State %x\n", info.State);
+    ok(info.RegionSize >= 64 * granularity, "got RegionSize %lx\n", info.RegionSize);
+}
+
 START_TEST(virtual)
 {
     int argc;
@@ -3488,6 +3561,7 @@ START_TEST(virtual)
     test_VirtualProtect();
     test_VirtualAllocEx();
     test_VirtualAlloc();
+    test_many_views();
     test_MapViewOfFile();
     test_NtMapViewOfSection();
     test_NtAreMappedFilesTheSame();
@@ -82,6 +82,9 @@ static char utf16_bom[2] = { 0xff, 0xfe };
 #define MSVCRT_FD_BLOCK_SIZE 32
 
 #define MSVCRT_INTERNAL_BUFSIZ 4096
+/* buffers of streams on disk files grow up to this size when they keep filling up */
+#define MSVCRT_MAX_INTERNAL_BUFSIZ 0x10000
+#define MSVCRT_BUFFER_GROW_COUNT 4
 
 /* ioinfo structure size is different in msvcrXX.dll's */
 typedef struct {
@@ -117,12 +120,28 @@ ioinfo MSVCRT___badioinfo = { INVALID_HANDLE_VALUE, WX_TEXT };
 static int MSVCRT_fdstart = 3; /* first unallocated fd */
 static int MSVCRT_fdend = 3; /* highest allocated fd */
 
+/* A stream is locked by storing the id of the locking thread in owner.
+ * As long as a single thread uses the stream, that is all _lock_file does.
+ * Once another thread finds the stream locked, the stream is marked shared
+ * and every thread queues on the stream critical section before waiting
+ * for owner to be cleared.
+ */
+typedef struct {
+    volatile LONG   owner;          /* thread holding the stream */
+    LONG            count;          /* recursion count of the owner */
+    BOOL            crit;           /* the owner holds the critical section */
+    volatile BOOL   shared;         /* other threads have used the stream */
+    unsigned int    full_buffers;   /* number of consecutive full buffers */
+} stream_ext;
+
 typedef struct {
     MSVCRT_FILE file;
     CRITICAL_SECTION crit;
+    stream_ext ext;
 } file_crit;
 
 MSVCRT_FILE MSVCRT__iob[_IOB_ENTRIES] = { { 0 } };
+static stream_ext MSVCRT_iob_ext[_IOB_ENTRIES];
 static file_crit* MSVCRT_fstream[MSVCRT_MAX_FILES/MSVCRT_FD_BLOCK_SIZE];
 static int MSVCRT_max_streams = 512, MSVCRT_stream_idx;
 
@@ -297,6 +316,13 @@ static inline MSVCRT_FILE* msvcrt_get_file(int i)
     return &ret->file;
 }
 
+static inline stream_ext* msvcrt_get_stream_ext(MSVCRT_FILE *file)
+{
+    if(file>=MSVCRT__iob && file<MSVCRT__iob+_IOB_ENTRIES)
+        return &MSVCRT_iob_ext[file-MSVCRT__iob];
+    return &((file_crit*)file)->ext;
+}
+
 static inline BOOL msvcrt_is_valid_fd(int fd)
 {
     return fd >= 0 && fd < MSVCRT_fdend && (get_ioinfo_nolock(fd)->wxflag & WX_OPEN);
@@ -456,6 +482,7 @@ static MSVCRT_FILE* msvcrt_alloc_fp(void)
           }
           MSVCRT_stream_idx++;
       }
+      memset(msvcrt_get_stream_ext(file), 0, sizeof(stream_ext));
       return file;
     }
   }
@@ -654,6 +681,40 @@ static BOOL msvcrt_alloc_buffer(MSVCRT_FILE* file)
     return TRUE;
 }
 
+/* INTERNAL: Count the consecutive reads or flushes of a whole buffer */
+static inline void msvcrt_buffer_filled(MSVCRT_FILE* file, BOOL full)
+{
+    stream_ext *ext = msvcrt_get_stream_ext(file);
+
+    if(full)
+        ext->full_buffers++;
+    else
+        ext->full_buffers = 0;
+}
+
+/* INTERNAL: Grow the buffer of a stream on a disk file that keeps filling it up */
+/* Only call this function when the buffer is empty */
+static void msvcrt_grow_buffer(MSVCRT_FILE* file)
+{
+    stream_ext *ext = msvcrt_get_stream_ext(file);
+    char *base;
+
+    if(ext->full_buffers < MSVCRT_BUFFER_GROW_COUNT)
+        return;
+    ext->full_buffers = 0;
+
+    if(!(file->_flag & MSVCRT__IOMYBUF)
+            || file->_bufsiz >= MSVCRT_MAX_INTERNAL_BUFSIZ
+            || (get_ioinfo_nolock(file->_file)->wxflag & (WX_TTY | WX_PIPE)))
+        return;
+
+    if(!(base = MSVCRT_calloc(file->_bufsiz * 2, 1)))
+        return;
+    MSVCRT_free(file->_base);
+    file->_ptr = file->_base = base;
+    file->_bufsiz *= 2;
+}
+
 /* INTERNAL: Allocate temporary buffer for stdout and stderr */
 static BOOL add_std_buffer(MSVCRT_FILE *file)
 {
@@ -1234,10 +1295,31 @@ LONG CDECL MSVCRT__lseek(int fd, LONG offset, int whence)
  */
 void CDECL MSVCRT__lock_file(MSVCRT_FILE *file)
 {
+    stream_ext *ext = msvcrt_get_stream_ext(file);
+    LONG tid = GetCurrentThreadId();
+
+    if(ext->owner == tid) {
+        ext->count++;
+        return;
+    }
+
+    if(!ext->shared && !InterlockedCompareExchange(&ext->owner, tid, 0)) {
+        ext->count = 1;
+        ext->crit = FALSE;
+        return;
+    }
+    ext->shared = TRUE;
+
     if(file>=MSVCRT__iob && file<MSVCRT__iob+_IOB_ENTRIES)
         _lock(_STREAM_LOCKS+(file-MSVCRT__iob));
     else
         EnterCriticalSection(&((file_crit*)file)->crit);
+
+    /* wait for a thread that locked the stream before it was shared */
+    while(InterlockedCompareExchange(&ext->owner, tid, 0))
+        Sleep(1);
+    ext->count = 1;
+    ext->crit = TRUE;
 }
 
 /*********************************************************************
@@ -1245,6 +1327,15 @@ void CDECL MSVCRT__lock_file(MSVCRT_FILE *file)
  */
 void CDECL MSVCRT__unlock_file(MSVCRT_FILE *file)
 {
+    stream_ext *ext = msvcrt_get_stream_ext(file);
+    BOOL crit = ext->crit;
+
+    if(--ext->count)
+        return;
+    InterlockedExchange(&ext->owner, 0);
+    if(!crit)
+        return;
+
     if(file>=MSVCRT__iob && file<MSVCRT__iob+_IOB_ENTRIES)
         _unlock(_STREAM_LOCKS+(file-MSVCRT__iob));
     else
@@ -3268,6 +3359,33 @@ int CDECL _wutime(const MSVCRT_wchar_t* path, struct MSVCRT___utimbuf32 *t)
 }
 #endif
 
+/* INTERNAL: Write to the handle of a file descriptor, disk files are
+ * written with NtWriteFile directly. */
+static BOOL msvcrt_write_file(ioinfo *info, const void *buf, DWORD count, DWORD *written)
+{
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+
+    if((info->wxflag & (WX_TTY|WX_PIPE))
+            || ((ULONG_PTR)info->handle & 3) == 3)
+        return WriteFile(info->handle, buf, count, written, NULL);
+
+    io.Status = STATUS_PENDING;
+    io.Information = 0;
+    status = NtWriteFile(info->handle, NULL, NULL, NULL, &io, buf, count, NULL, NULL);
+    if(status == STATUS_PENDING) {
+        NtWaitForSingleObject(info->handle, FALSE, NULL);
+        status = io.Status;
+    }
+
+    *written = io.Information;
+    if(status) {
+        SetLastError(RtlNtStatusToDosError(status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
 /*********************************************************************
  *		_write (MSVCRT.@)
  */
@@ -3300,7 +3418,7 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
 
     if (!(info->wxflag & WX_TEXT))
     {
-        if (WriteFile(hand, buf, count, &num_written, NULL)
+        if (msvcrt_write_file(info, buf, count, &num_written)
                 &&  (num_written == count))
             return num_written;
         TRACE("WriteFile (fd %d, hand %p) failed-last error (%d)\n", fd,
@@ -3422,7 +3540,7 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
             }
         }
 
-        if (!WriteFile(hand, q, size, &num_written, NULL))
+        if (!msvcrt_write_file(info, q, size, &num_written))
             num_written = -1;
         if(p)
             MSVCRT_free(p);
@@ -3540,7 +3658,9 @@ int CDECL MSVCRT__filbuf(MSVCRT_FILE* file)
 
         return c;
     } else {
+        msvcrt_grow_buffer(file);
         file->_cnt = read_i(file->_file, file->_base, file->_bufsiz);
+        msvcrt_buffer_filled(file, file->_cnt == file->_bufsiz);
         if(file->_cnt<=0) {
             file->_flag |= (file->_cnt == 0) ? MSVCRT__IOEOF : MSVCRT__IOERR;
             file->_cnt = 0;
@@ -3797,9 +3917,13 @@ int CDECL MSVCRT__flsbuf(int c, MSVCRT_FILE* file)
         int res = 0;
 
         if(file->_cnt <= 0) {
+            BOOL full = file->_ptr - file->_base == file->_bufsiz;
+
             res = msvcrt_flush_buffer(file);
             if(res)
                 return res;
+            msvcrt_buffer_filled(file, full);
+            msvcrt_grow_buffer(file);
             file->_flag |= MSVCRT__IOWRT;
             file->_cnt=file->_bufsiz;
         }
@@ -42,6 +42,104 @@ WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
 
 static HANDLE heap, sb_heap;
 
+/* Every block of the heap starts with a header holding the requested size,
+ * so that free and _msize don't need to ask the heap.
+ *
+ * Blocks of up to HEAP_CACHE_MAX_SIZE bytes are rounded up to a size class
+ * of HEAP_CACHE_ALIGN bytes.  Freed blocks are kept in per thread lists, one
+ * for each size class, so that most malloc/free pairs don't have to lock the
+ * heap.  The cached blocks remain allocated in the heap, so _heapchk and
+ * _heapwalk keep working.
+ */
+#define HEAP_CACHE_ALIGN      16
+#define HEAP_CACHE_MAX_SIZE   256
+#define HEAP_CACHE_CLASSES    (HEAP_CACHE_MAX_SIZE / HEAP_CACHE_ALIGN)
+#define HEAP_CACHE_CLASS_MAX  32    /* blocks kept per thread and size class */
+
+#define BLOCK_MAGIC           ((MSVCRT_size_t)0x4b4c4243)  /* "CBLK" */
+#define BLOCK_MAGIC_CACHED    ((MSVCRT_size_t)0x48434143)  /* "CACH" */
+
+struct block_header
+{
+    MSVCRT_size_t   size;   /* requested size */
+    MSVCRT_size_t   magic;  /* also keeps the block aligned like heap blocks */
+};
+
+struct heap_cache
+{
+    struct block_header *blocks[HEAP_CACHE_CLASSES];
+    unsigned int         count[HEAP_CACHE_CLASSES];
+};
+
+static inline struct block_header *get_block_header(void *ptr)
+{
+    return (struct block_header *)ptr - 1;
+}
+
+static inline unsigned int get_block_class(MSVCRT_size_t size)
+{
+    return size ? (size - 1) / HEAP_CACHE_ALIGN : 0;
+}
+
+/* size of the heap block holding the given requested size */
+static inline MSVCRT_size_t get_block_alloc_size(MSVCRT_size_t size)
+{
+    if (size <= HEAP_CACHE_MAX_SIZE)
+        size = (get_block_class(size) + 1) * HEAP_CACHE_ALIGN;
+    return size + sizeof(struct block_header);
+}
+
+static void *heap_cache_alloc(DWORD flags, MSVCRT_size_t size)
+{
+    struct heap_cache *cache = msvcrt_get_thread_data()->heap_cache;
+    unsigned int class = get_block_class(size);
+    struct block_header *block;
+
+    if (!cache || !(block = cache->blocks[class])) return NULL;
+    cache->blocks[class] = *(struct block_header **)(block + 1);
+    cache->count[class]--;
+
+    block->size = size;
+    block->magic = BLOCK_MAGIC;
+    if (flags & HEAP_ZERO_MEMORY) memset(block + 1, 0, size);
+    return block + 1;
+}
+
+static BOOL heap_cache_free(struct block_header *block)
+{
+    thread_data_t *data = msvcrt_get_thread_data();
+    unsigned int class = get_block_class(block->size);
+    struct heap_cache *cache;
+
+    if (!(cache = data->heap_cache) &&
+        !(cache = data->heap_cache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache))))
+        return FALSE;
+    if (cache->count[class] == HEAP_CACHE_CLASS_MAX) return FALSE;
+
+    block->magic = BLOCK_MAGIC_CACHED;
+    *(struct block_header **)(block + 1) = cache->blocks[class];
+    cache->blocks[class] = block;
+    cache->count[class]++;
+    return TRUE;
+}
+
+/* give the blocks cached by a thread back to the heap */
+static void heap_cache_flush(struct heap_cache *cache)
+{
+    struct block_header *block;
+    unsigned int i;
+
+    for (i = 0; i < HEAP_CACHE_CLASSES; i++)
+    {
+        while ((block = cache->blocks[i]))
+        {
+            cache->blocks[i] = *(struct block_header **)(block + 1);
+            HeapFree(heap, 0, block);
+        }
+        cache->count[i] = 0;
+    }
+}
+
 typedef int (CDECL *MSVCRT_new_handler_func)(MSVCRT_size_t size);
 
 static MSVCRT_new_handler_func MSVCRT_new_handler;
@@ -54,6 +152,8 @@ static MSVCRT_size_t MSVCRT_sbh_threshold = 0;
 
 static void* msvcrt_heap_alloc(DWORD flags, MSVCRT_size_t size)
 {
+    struct block_header *block;
+
     if(size < MSVCRT_sbh_threshold)
     {
         void *memblock, *temp, **saved;
@@ -67,16 +167,31 @@ static void* msvcrt_heap_alloc(DWORD flags, MSVCRT_size_t size)
         return memblock;
     }
 
-    return HeapAlloc(heap, flags, size);
+    if(size <= HEAP_CACHE_MAX_SIZE)
+    {
+        void *ret = heap_cache_alloc(flags, size);
+        if(ret) return ret;
+    }
+    else if(size > ~(MSVCRT_size_t)0 - sizeof(struct block_header))
+        return NULL;
+
+    block = HeapAlloc(heap, flags, get_block_alloc_size(size));
+    if(!block) return NULL;
+    block->size = size;
+    block->magic = BLOCK_MAGIC;
+    return block + 1;
 }
 
 static void* msvcrt_heap_realloc(DWORD flags, void *ptr, MSVCRT_size_t size)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
+    struct block_header *block;
+    MSVCRT_size_t old_size;
+
+    if(sb_heap && ptr && !HeapValidate(heap, 0, get_block_header(ptr)))
     {
         /* TODO: move data to normal heap if it exceeds sbh_threshold limit */
         void *memblock, *temp, **saved;
-        MSVCRT_size_t old_padding, new_padding, old_size;
+        MSVCRT_size_t old_padding, new_padding;
 
         saved = SAVED_PTR(ptr);
         old_padding = (char*)ptr - (char*)*saved;
@@ -99,29 +214,72 @@ static void* msvcrt_heap_realloc(DWORD flags, void *ptr, MSVCRT_size_t size)
         return memblock;
     }
 
-    return HeapReAlloc(heap, flags, ptr, size);
+    if(!ptr) return NULL;
+    block = get_block_header(ptr);
+    if(block->magic != BLOCK_MAGIC)
+    {
+        WARN("invalid block %p\n", ptr);
+        return NULL;
+    }
+    if(size > ~(MSVCRT_size_t)0 - sizeof(struct block_header)) return NULL;
+
+    old_size = block->size;
+    if(get_block_alloc_size(size) != get_block_alloc_size(old_size))
+    {
+        block = HeapReAlloc(heap, flags & ~HEAP_ZERO_MEMORY, block, get_block_alloc_size(size));
+        if(!block) return NULL;
+    }
+    if((flags & HEAP_ZERO_MEMORY) && size > old_size)
+        memset((char *)(block + 1) + old_size, 0, size - old_size);
+    block->size = size;
+    return block + 1;
 }
 
 static BOOL msvcrt_heap_free(void *ptr)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
+    struct block_header *block;
+
+    if(!ptr) return TRUE;
+
+    if(sb_heap && !HeapValidate(heap, 0, get_block_header(ptr)))
     {
         void **saved = SAVED_PTR(ptr);
         return HeapFree(sb_heap, 0, *saved);
     }
 
-    return HeapFree(heap, 0, ptr);
+    block = get_block_header(ptr);
+    if(block->magic != BLOCK_MAGIC)
+    {
+        if(block->magic == BLOCK_MAGIC_CACHED)
+        {
+            WARN("block %p freed twice\n", ptr);
+            return FALSE;
+        }
+        /* let the heap report the invalid pointer */
+        return HeapFree(heap, 0, block);
+    }
+
+    if(block->size <= HEAP_CACHE_MAX_SIZE && heap_cache_free(block))
+        return TRUE;
+
+    block->magic = 0;
+    return HeapFree(heap, 0, block);
 }
 
 static MSVCRT_size_t msvcrt_heap_size(void *ptr)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
+    struct block_header *block;
+
+    if(sb_heap && ptr && !HeapValidate(heap, 0, get_block_header(ptr)))
     {
         void **saved = SAVED_PTR(ptr);
         return HeapSize(sb_heap, 0, *saved);
     }
 
-    return HeapSize(heap, 0, ptr);
+    if(!ptr) return ~(MSVCRT_size_t)0;
+    block = get_block_header(ptr);
+    if(block->magic != BLOCK_MAGIC) return ~(MSVCRT_size_t)0;
+    return block->size;
 }
 
 /*********************************************************************
@@ -266,6 +424,9 @@ int CDECL _heapchk(void)
  */
 int CDECL _heapmin(void)
 {
+  struct heap_cache *cache = msvcrt_get_thread_data()->heap_cache;
+
+  if (cache) heap_cache_flush(cache);
   if (!HeapCompact( heap, 0 ) ||
           (sb_heap && !HeapCompact( sb_heap, 0 )))
   {
@@ -816,6 +977,14 @@ BOOL msvcrt_init_heap(void)
     return heap != NULL;
 }
 
+void msvcrt_free_heap_cache(thread_data_t *data)
+{
+    if (!data->heap_cache) return;
+    heap_cache_flush(data->heap_cache);
+    HeapFree(GetProcessHeap(), 0, data->heap_cache);
+    data->heap_cache = NULL;
+}
+
 void msvcrt_destroy_heap(void)
 {
     HeapDestroy(heap);
@@ -578,13 +578,15 @@ int FUNC_NAME(pf_printf)(FUNC_NAME(puts_clbk) pf_puts, void *puts_ctx, const API
             if(!tmp)
                 return -1;
 
-            FUNC_NAME(pf_rebuild_format_string)(float_fmt, &flags);
             if(val < 0) {
                 flags.Sign = '-';
                 val = -val;
             }
 
-            sprintf(tmp, float_fmt, val);
+            if(!msvcrt_format_double(tmp, val, flags.Format, flags.Precision, flags.Alternate != 0)) {
+                FUNC_NAME(pf_rebuild_format_string)(float_fmt, &flags);
+                sprintf(tmp, float_fmt, val);
+            }
             if(toupper(flags.Format)=='E' || toupper(flags.Format)=='G')
                 FUNC_NAME(pf_fixup_exponent)(tmp);
 
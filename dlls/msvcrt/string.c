@@ -304,16 +304,640 @@ void CDECL MSVCRT__swab(char* src, char* dst, int len)
   }
 }
 
+/* Floating point numbers are printed and parsed exactly with big numbers
+ * made of 9 decimal digit limbs.  The decimal point is just below
+ * data[BNUM_POINT], and the limbs below data[b] that were dropped are
+ * only remembered as being nonzero.
+ */
+#define LIMB_DIGITS 9
+#define LIMB_MAX 1000000000
+#define BNUM_LIMBS 164
+#define BNUM_POINT 122
+#define BNUM_DIGITS (BNUM_LIMBS * LIMB_DIGITS)
+/* more digits don't change the rounding of a double */
+#define MAX_PARSE_DIGITS 768
+
+#define DBL_MANT_MASK (((ULONGLONG)1 << 52) - 1)
+#define DBL_INF_BITS  ((ULONGLONG)0x7ff << 52)
+
+struct bnum {
+    int b, e;       /* data[b] to data[e-1] are used */
+    BOOL sticky;    /* nonzero limbs were dropped below data[b] */
+    DWORD data[BNUM_LIMBS];
+};
+
+static inline ULONGLONG double_bits(double d)
+{
+    union { double d; ULONGLONG i; } u;
+
+    u.d = d;
+    return u.i;
+}
+
+static inline double bits_double(ULONGLONG i)
+{
+    union { double d; ULONGLONG i; } u;
+
+    u.i = i;
+    return u.d;
+}
+
+static inline int floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void bnum_init(struct bnum *bn, ULONGLONG m)
+{
+    bn->b = bn->e = BNUM_POINT;
+    bn->sticky = FALSE;
+    do {
+        bn->data[bn->e++] = m % LIMB_MAX;
+        m /= LIMB_MAX;
+    } while(m);
+}
+
+/* multiply by 2^shift */
+static void bnum_lshift(struct bnum *bn, int shift)
+{
+    while(shift) {
+        int i, s = min(shift, 29);
+        ULONGLONG carry = 0;
+
+        for(i=bn->b; i<bn->e; i++) {
+            ULONGLONG v = ((ULONGLONG)bn->data[i] << s) + carry;
+
+            carry = v / LIMB_MAX;
+            bn->data[i] = v - carry * LIMB_MAX;
+        }
+        if(carry)
+            bn->data[bn->e++] = carry;
+        shift -= s;
+    }
+}
+
+/* divide by 2^shift, limbs below data[min_limb] are dropped */
+static void bnum_rshift(struct bnum *bn, int shift, int min_limb)
+{
+    if(min_limb < 0)
+        min_limb = 0;
+
+    while(shift) {
+        int i, s = min(shift, 9);
+        DWORD rem = 0;
+
+        for(i=bn->e-1; i>=bn->b; i--) {
+            ULONGLONG v = (ULONGLONG)rem * LIMB_MAX + bn->data[i];
+
+            bn->data[i] = v >> s;
+            rem = v & ((1 << s) - 1);
+        }
+        if(rem) {
+            /* 2^s divides LIMB_MAX so the remainder has an exact expansion */
+            if(bn->b > min_limb)
+                bn->data[--bn->b] = rem * (LIMB_MAX >> s);
+            else
+                bn->sticky = TRUE;
+        }
+        while(bn->e > bn->b+1 && !bn->data[bn->e-1])
+            bn->e--;
+        shift -= s;
+    }
+}
+
+/* get the digits of bn, the value is 0.digits * 10^dexp */
+static int bnum_to_digits(const struct bnum *bn, char *digits, int *dexp)
+{
+    DWORD v = bn->data[bn->e-1];
+    int i, j, n = 0;
+
+    if(bn->e == bn->b+1 && !v)
+        return 0;
+
+    for(j=LIMB_MAX/10; j>v; j/=10);
+    for(; j; j/=10)
+        digits[n++] = '0' + v / j % 10;
+    *dexp = (bn->e - 1 - BNUM_POINT) * LIMB_DIGITS + n;
+
+    for(i=bn->e-2; i>=bn->b; i--) {
+        v = bn->data[i];
+        for(j=LIMB_DIGITS-1; j>=0; j--) {
+            digits[n+j] = '0' + v % 10;
+            v /= 10;
+        }
+        n += LIMB_DIGITS;
+    }
+    return n;
+}
+
+/* get the exact decimal expansion of a positive double, digits below
+ * 10^lowest may be dropped and are then reported in sticky */
+static int double_to_digits(double d, int lowest, char *digits, int *dexp, BOOL *sticky)
+{
+    ULONGLONG bits = double_bits(d), m = bits & DBL_MANT_MASK;
+    int e = bits >> 52;
+    struct bnum bn;
+
+    if(e) {
+        m |= (ULONGLONG)1 << 52;
+        e -= 1075;
+    } else {
+        e = -1074;
+    }
+
+    bnum_init(&bn, m);
+    if(e > 0)
+        bnum_lshift(&bn, e);
+    else if(e < 0)
+        bnum_rshift(&bn, -e, BNUM_POINT + floor_div(lowest, LIMB_DIGITS));
+    *sticky = bn.sticky;
+    return bnum_to_digits(&bn, digits, dexp);
+}
+
+/* round to keep digits, lower digits are truncated */
+static void round_digits(char *digits, int *n, int *dexp, int keep, BOOL sticky)
+{
+    BOOL up;
+    int i;
+
+    if(keep >= *n)
+        return;
+    if(keep < 0) {
+        *n = 0;
+        return;
+    }
+
+    up = digits[keep] > '5';
+    if(digits[keep] == '5') {
+        /* ties are rounded to even */
+        up = sticky || (keep && ((digits[keep-1] - '0') & 1));
+        for(i=keep+1; !up && i<*n; i++)
+            up = digits[i] != '0';
+    }
+
+    if(!up) {
+        *n = keep;
+        return;
+    }
+
+    for(i=keep-1; i>=0 && digits[i]=='9'; i--);
+    if(i >= 0) {
+        digits[i]++;
+        *n = i+1;
+    } else {
+        digits[0] = '1';
+        *n = 1;
+        (*dexp)++;
+    }
+}
+
+static char* format_fixed(char *p, const char *digits, int n, int dexp, int prec, BOOL alternate)
+{
+    int i;
+
+    if(n && dexp > 0) {
+        for(i=0; i<dexp; i++)
+            *p++ = i < n ? digits[i] : '0';
+    } else {
+        *p++ = '0';
+    }
+
+    if(prec || alternate)
+        *p++ = '.';
+    for(i=dexp; i<dexp+prec; i++)
+        *p++ = n && i >= 0 && i < n ? digits[i] : '0';
+    return p;
+}
+
+static char* format_exp(char *p, const char *digits, int n, int dexp, int prec, BOOL alternate)
+{
+    int i;
+
+    *p++ = n ? digits[0] : '0';
+    if(prec || alternate)
+        *p++ = '.';
+    for(i=1; i<=prec; i++)
+        *p++ = i < n ? digits[i] : '0';
+    return p;
+}
+
+static char* format_exp_suffix(char *p, int x, BOOL upper)
+{
+    *p++ = upper ? 'E' : 'e';
+    if(x < 0) {
+        *p++ = '-';
+        x = -x;
+    } else {
+        *p++ = '+';
+    }
+    if(x >= 100)
+        *p++ = '0' + x / 100;
+    *p++ = '0' + x / 10 % 10;
+    *p++ = '0' + x % 10;
+    return p;
+}
+
+static char* strip_zeros(char *p)
+{
+    while(p[-1] == '0')
+        p--;
+    if(p[-1] == '.')
+        p--;
+    return p;
+}
+
+/* Print d with the %e, %f or %g format like the C library does, the
+ * caller checks that the buffer is large enough. */
+BOOL msvcrt_format_double(char *buf, double d, char format, int prec, BOOL alternate)
+{
+    char digits[BNUM_DIGITS], *p = buf;
+    int n = 0, dexp = 0, lowest, x;
+    BOOL sticky = FALSE;
+
+    if(!strchr("eEfgG", format))
+        return FALSE;
+
+    if(double_bits(d) >> 63) {
+        *p++ = '-';
+        d = -d;
+    }
+    if(prec < 0)
+        prec = 6;
+    if(prec == 0 && (format == 'g' || format == 'G'))
+        prec = 1;
+
+    if(d != 0) {
+        if(format == 'f') {
+            lowest = -prec - 1;
+        } else {
+            ULONGLONG bits = double_bits(d);
+            int e = bits >> 52;
+
+            /* lower bound of the decimal exponent */
+            if(!e) {
+                for(e=-1023; !(bits >> 52); e--)
+                    bits <<= 1;
+            } else {
+                e -= 1023;
+            }
+            lowest = floor_div(e * 1233, 4096) - 1 - prec - 1;
+        }
+        n = double_to_digits(d, lowest, digits, &dexp, &sticky);
+    }
+
+    switch(format) {
+    case 'f':
+        round_digits(digits, &n, &dexp, dexp + prec, sticky);
+        p = format_fixed(p, digits, n, dexp, prec, alternate);
+        break;
+    case 'e':
+    case 'E':
+        round_digits(digits, &n, &dexp, prec + 1, sticky);
+        p = format_exp(p, digits, n, dexp, prec, alternate);
+        p = format_exp_suffix(p, n ? dexp-1 : 0, format == 'E');
+        break;
+    default:
+        round_digits(digits, &n, &dexp, prec, sticky);
+        x = n ? dexp-1 : 0;
+        if(x < -4 || x >= prec) {
+            p = format_exp(p, digits, n, dexp, prec-1, alternate);
+            if(!alternate && prec > 1)
+                p = strip_zeros(p);
+            p = format_exp_suffix(p, x, format == 'G');
+        } else {
+            p = format_fixed(p, digits, n, dexp, prec-1-x, alternate);
+            if(!alternate && prec-1-x > 0)
+                p = strip_zeros(p);
+        }
+        break;
+    }
+    *p = 0;
+    return TRUE;
+}
+
+/* 5^q is about hi:lo * 2^exp, the values are truncated */
+static const struct { ULONGLONG hi, lo; int exp; } pow5_table[] = {
+    { 0xa87fea27a539e9a5, 0x3f2398d747b36224,  -276 }, /* 5^-64 */
+    { 0xd29fe4b18e88640e, 0x8eec7f0d19a03aad,  -274 }, /* 5^-63 */
+    { 0x83a3eeeef9153e89, 0x1953cf68300424ac,  -271 }, /* 5^-62 */
+    { 0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7,  -269 }, /* 5^-61 */
+    { 0xcdb02555653131b6, 0x3792f412cb06794d,  -267 }, /* 5^-60 */
+    { 0x808e17555f3ebf11, 0xe2bbd88bbee40bd0,  -264 }, /* 5^-59 */
+    { 0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4,  -262 }, /* 5^-58 */
+    { 0xc8de047564d20a8b, 0xf245825a5a445275,  -260 }, /* 5^-57 */
+    { 0xfb158592be068d2e, 0xeed6e2f0f0d56712,  -258 }, /* 5^-56 */
+    { 0x9ced737bb6c4183d, 0x55464dd69685606b,  -255 }, /* 5^-55 */
+    { 0xc428d05aa4751e4c, 0xaa97e14c3c26b886,  -253 }, /* 5^-54 */
+    { 0xf53304714d9265df, 0xd53dd99f4b3066a8,  -251 }, /* 5^-53 */
+    { 0x993fe2c6d07b7fab, 0xe546a8038efe4029,  -248 }, /* 5^-52 */
+    { 0xbf8fdb78849a5f96, 0xde98520472bdd033,  -246 }, /* 5^-51 */
+    { 0xef73d256a5c0f77c, 0x963e66858f6d4440,  -244 }, /* 5^-50 */
+    { 0x95a8637627989aad, 0xdde7001379a44aa8,  -241 }, /* 5^-49 */
+    { 0xbb127c53b17ec159, 0x5560c018580d5d52,  -239 }, /* 5^-48 */
+    { 0xe9d71b689dde71af, 0xaab8f01e6e10b4a6,  -237 }, /* 5^-47 */
+    { 0x9226712162ab070d, 0xcab3961304ca70e8,  -234 }, /* 5^-46 */
+    { 0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22,  -232 }, /* 5^-45 */
+    { 0xe45c10c42a2b3b05, 0x8cb89a7db77c506a,  -230 }, /* 5^-44 */
+    { 0x8eb98a7a9a5b04e3, 0x77f3608e92adb242,  -227 }, /* 5^-43 */
+    { 0xb267ed1940f1c61c, 0x55f038b237591ed3,  -225 }, /* 5^-42 */
+    { 0xdf01e85f912e37a3, 0x6b6c46dec52f6688,  -223 }, /* 5^-41 */
+    { 0x8b61313bbabce2c6, 0x2323ac4b3b3da015,  -220 }, /* 5^-40 */
+    { 0xae397d8aa96c1b77, 0xabec975e0a0d081a,  -218 }, /* 5^-39 */
+    { 0xd9c7dced53c72255, 0x96e7bd358c904a21,  -216 }, /* 5^-38 */
+    { 0x881cea14545c7575, 0x7e50d64177da2e54,  -213 }, /* 5^-37 */
+    { 0xaa242499697392d2, 0xdde50bd1d5d0b9e9,  -211 }, /* 5^-36 */
+    { 0xd4ad2dbfc3d07787, 0x955e4ec64b44e864,  -209 }, /* 5^-35 */
+    { 0x84ec3c97da624ab4, 0xbd5af13bef0b113e,  -206 }, /* 5^-34 */
+    { 0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e,  -204 }, /* 5^-33 */
+    { 0xcfb11ead453994ba, 0x67de18eda5814af2,  -202 }, /* 5^-32 */
+    { 0x81ceb32c4b43fcf4, 0x80eacf948770ced7,  -199 }, /* 5^-31 */
+    { 0xa2425ff75e14fc31, 0xa1258379a94d028d,  -197 }, /* 5^-30 */
+    { 0xcad2f7f5359a3b3e, 0x096ee45813a04330,  -195 }, /* 5^-29 */
+    { 0xfd87b5f28300ca0d, 0x8bca9d6e188853fc,  -193 }, /* 5^-28 */
+    { 0x9e74d1b791e07e48, 0x775ea264cf55347d,  -190 }, /* 5^-27 */
+    { 0xc612062576589dda, 0x95364afe032a819d,  -188 }, /* 5^-26 */
+    { 0xf79687aed3eec551, 0x3a83ddbd83f52204,  -186 }, /* 5^-25 */
+    { 0x9abe14cd44753b52, 0xc4926a9672793542,  -183 }, /* 5^-24 */
+    { 0xc16d9a0095928a27, 0x75b7053c0f178293,  -181 }, /* 5^-23 */
+    { 0xf1c90080baf72cb1, 0x5324c68b12dd6338,  -179 }, /* 5^-22 */
+    { 0x971da05074da7bee, 0xd3f6fc16ebca5e03,  -176 }, /* 5^-21 */
+    { 0xbce5086492111aea, 0x88f4bb1ca6bcf584,  -174 }, /* 5^-20 */
+    { 0xec1e4a7db69561a5, 0x2b31e9e3d06c32e5,  -172 }, /* 5^-19 */
+    { 0x9392ee8e921d5d07, 0x3aff322e62439fcf,  -169 }, /* 5^-18 */
+    { 0xb877aa3236a4b449, 0x09befeb9fad487c2,  -167 }, /* 5^-17 */
+    { 0xe69594bec44de15b, 0x4c2ebe687989a9b3,  -165 }, /* 5^-16 */
+    { 0x901d7cf73ab0acd9, 0x0f9d37014bf60a10,  -162 }, /* 5^-15 */
+    { 0xb424dc35095cd80f, 0x538484c19ef38c94,  -160 }, /* 5^-14 */
+    { 0xe12e13424bb40e13, 0x2865a5f206b06fb9,  -158 }, /* 5^-13 */
+    { 0x8cbccc096f5088cb, 0xf93f87b7442e45d3,  -155 }, /* 5^-12 */
+    { 0xafebff0bcb24aafe, 0xf78f69a51539d748,  -153 }, /* 5^-11 */
+    { 0xdbe6fecebdedd5be, 0xb573440e5a884d1b,  -151 }, /* 5^-10 */
+    { 0x89705f4136b4a597, 0x31680a88f8953030,  -148 }, /* 5^-9 */
+    { 0xabcc77118461cefc, 0xfdc20d2b36ba7c3d,  -146 }, /* 5^-8 */
+    { 0xd6bf94d5e57a42bc, 0x3d32907604691b4c,  -144 }, /* 5^-7 */
+    { 0x8637bd05af6c69b5, 0xa63f9a49c2c1b10f,  -141 }, /* 5^-6 */
+    { 0xa7c5ac471b478423, 0x0fcf80dc33721d53,  -139 }, /* 5^-5 */
+    { 0xd1b71758e219652b, 0xd3c36113404ea4a8,  -137 }, /* 5^-4 */
+    { 0x83126e978d4fdf3b, 0x645a1cac083126e9,  -134 }, /* 5^-3 */
+    { 0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a3,  -132 }, /* 5^-2 */
+    { 0xcccccccccccccccc, 0xcccccccccccccccc,  -130 }, /* 5^-1 */
+    { 0x8000000000000000, 0x0000000000000000,  -127 }, /* 5^0 */
+    { 0xa000000000000000, 0x0000000000000000,  -125 }, /* 5^1 */
+    { 0xc800000000000000, 0x0000000000000000,  -123 }, /* 5^2 */
+    { 0xfa00000000000000, 0x0000000000000000,  -121 }, /* 5^3 */
+    { 0x9c40000000000000, 0x0000000000000000,  -118 }, /* 5^4 */
+    { 0xc350000000000000, 0x0000000000000000,  -116 }, /* 5^5 */
+    { 0xf424000000000000, 0x0000000000000000,  -114 }, /* 5^6 */
+    { 0x9896800000000000, 0x0000000000000000,  -111 }, /* 5^7 */
+    { 0xbebc200000000000, 0x0000000000000000,  -109 }, /* 5^8 */
+    { 0xee6b280000000000, 0x0000000000000000,  -107 }, /* 5^9 */
+    { 0x9502f90000000000, 0x0000000000000000,  -104 }, /* 5^10 */
+    { 0xba43b74000000000, 0x0000000000000000,  -102 }, /* 5^11 */
+    { 0xe8d4a51000000000, 0x0000000000000000,  -100 }, /* 5^12 */
+    { 0x9184e72a00000000, 0x0000000000000000,   -97 }, /* 5^13 */
+    { 0xb5e620f480000000, 0x0000000000000000,   -95 }, /* 5^14 */
+    { 0xe35fa931a0000000, 0x0000000000000000,   -93 }, /* 5^15 */
+    { 0x8e1bc9bf04000000, 0x0000000000000000,   -90 }, /* 5^16 */
+    { 0xb1a2bc2ec5000000, 0x0000000000000000,   -88 }, /* 5^17 */
+    { 0xde0b6b3a76400000, 0x0000000000000000,   -86 }, /* 5^18 */
+    { 0x8ac7230489e80000, 0x0000000000000000,   -83 }, /* 5^19 */
+    { 0xad78ebc5ac620000, 0x0000000000000000,   -81 }, /* 5^20 */
+    { 0xd8d726b7177a8000, 0x0000000000000000,   -79 }, /* 5^21 */
+    { 0x878678326eac9000, 0x0000000000000000,   -76 }, /* 5^22 */
+    { 0xa968163f0a57b400, 0x0000000000000000,   -74 }, /* 5^23 */
+    { 0xd3c21bcecceda100, 0x0000000000000000,   -72 }, /* 5^24 */
+    { 0x84595161401484a0, 0x0000000000000000,   -69 }, /* 5^25 */
+    { 0xa56fa5b99019a5c8, 0x0000000000000000,   -67 }, /* 5^26 */
+    { 0xcecb8f27f4200f3a, 0x0000000000000000,   -65 }, /* 5^27 */
+    { 0x813f3978f8940984, 0x4000000000000000,   -62 }, /* 5^28 */
+    { 0xa18f07d736b90be5, 0x5000000000000000,   -60 }, /* 5^29 */
+    { 0xc9f2c9cd04674ede, 0xa400000000000000,   -58 }, /* 5^30 */
+    { 0xfc6f7c4045812296, 0x4d00000000000000,   -56 }, /* 5^31 */
+    { 0x9dc5ada82b70b59d, 0xf020000000000000,   -53 }, /* 5^32 */
+    { 0xc5371912364ce305, 0x6c28000000000000,   -51 }, /* 5^33 */
+    { 0xf684df56c3e01bc6, 0xc732000000000000,   -49 }, /* 5^34 */
+    { 0x9a130b963a6c115c, 0x3c7f400000000000,   -46 }, /* 5^35 */
+    { 0xc097ce7bc90715b3, 0x4b9f100000000000,   -44 }, /* 5^36 */
+    { 0xf0bdc21abb48db20, 0x1e86d40000000000,   -42 }, /* 5^37 */
+    { 0x96769950b50d88f4, 0x1314448000000000,   -39 }, /* 5^38 */
+    { 0xbc143fa4e250eb31, 0x17d955a000000000,   -37 }, /* 5^39 */
+    { 0xeb194f8e1ae525fd, 0x5dcfab0800000000,   -35 }, /* 5^40 */
+    { 0x92efd1b8d0cf37be, 0x5aa1cae500000000,   -32 }, /* 5^41 */
+    { 0xb7abc627050305ad, 0xf14a3d9e40000000,   -30 }, /* 5^42 */
+    { 0xe596b7b0c643c719, 0x6d9ccd05d0000000,   -28 }, /* 5^43 */
+    { 0x8f7e32ce7bea5c6f, 0xe4820023a2000000,   -25 }, /* 5^44 */
+    { 0xb35dbf821ae4f38b, 0xdda2802c8a800000,   -23 }, /* 5^45 */
+    { 0xe0352f62a19e306e, 0xd50b2037ad200000,   -21 }, /* 5^46 */
+    { 0x8c213d9da502de45, 0x4526f422cc340000,   -18 }, /* 5^47 */
+    { 0xaf298d050e4395d6, 0x9670b12b7f410000,   -16 }, /* 5^48 */
+    { 0xdaf3f04651d47b4c, 0x3c0cdd765f114000,   -14 }, /* 5^49 */
+    { 0x88d8762bf324cd0f, 0xa5880a69fb6ac800,   -11 }, /* 5^50 */
+    { 0xab0e93b6efee0053, 0x8eea0d047a457a00,    -9 }, /* 5^51 */
+    { 0xd5d238a4abe98068, 0x72a4904598d6d880,    -7 }, /* 5^52 */
+    { 0x85a36366eb71f041, 0x47a6da2b7f864750,    -4 }, /* 5^53 */
+    { 0xa70c3c40a64e6c51, 0x999090b65f67d924,    -2 }, /* 5^54 */
+    { 0xd0cf4b50cfe20765, 0xfff4b4e3f741cf6d,     0 }, /* 5^55 */
+    { 0x82818f1281ed449f, 0xbff8f10e7a8921a4,     3 }, /* 5^56 */
+    { 0xa321f2d7226895c7, 0xaff72d52192b6a0d,     5 }, /* 5^57 */
+    { 0xcbea6f8ceb02bb39, 0x9bf4f8a69f764490,     7 }, /* 5^58 */
+    { 0xfee50b7025c36a08, 0x02f236d04753d5b4,     9 }, /* 5^59 */
+    { 0x9f4f2726179a2245, 0x01d762422c946590,    12 }, /* 5^60 */
+    { 0xc722f0ef9d80aad6, 0x424d3ad2b7b97ef5,    14 }, /* 5^61 */
+    { 0xf8ebad2b84e0d58b, 0xd2e0898765a7deb2,    16 }, /* 5^62 */
+    { 0x9b934c3b330c8577, 0x63cc55f49f88eb2f,    19 }, /* 5^63 */
+    { 0xc2781f49ffcfa6d5, 0x3cbf6b71c76b25fb,    21 }, /* 5^64 */
+};
+
+static void umul128(ULONGLONG a, ULONGLONG b, ULONGLONG *hi, ULONGLONG *lo)
+{
+    ULONGLONG a0 = (DWORD)a, a1 = a >> 32, b0 = (DWORD)b, b1 = b >> 32;
+    ULONGLONG p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    ULONGLONG mid = (p00 >> 32) + (DWORD)p01 + (DWORD)p10;
+
+    *lo = (mid << 32) | (DWORD)p00;
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+/* Compute w * 10^q rounded to nearest with a 128-bit approximation of 5^q
+ * (Eisel-Lemire).  Returns FALSE if the result is not known to be exact, bits
+ * is then set to an approximation when one was found. */
+static BOOL fast_strtod(ULONGLONG w, int q, ULONGLONG *bits)
+{
+    ULONGLONG hi, p0, p1, p2, m, mask;
+    BOOL exact = (q >= 0 && q <= 55), rem;
+    int lz = 0, e, shift;
+
+    *bits = 0;
+    if(q < -64 || q > 64 || !w)
+        return FALSE;
+
+    if(!(w >> 32)) { w <<= 32; lz += 32; }
+    if(!(w >> 48)) { w <<= 16; lz += 16; }
+    if(!(w >> 56)) { w <<= 8; lz += 8; }
+    if(!(w >> 60)) { w <<= 4; lz += 4; }
+    if(!(w >> 62)) { w <<= 2; lz += 2; }
+    if(!(w >> 63)) { w <<= 1; lz += 1; }
+
+    /* 192-bit product p2:p1:p0, it's below the exact one by less than 2^64 */
+    umul128(w, pow5_table[q+64].lo, &hi, &p0);
+    umul128(w, pow5_table[q+64].hi, &p2, &p1);
+    p1 += hi;
+    p2 += (p1 < hi);
+
+    shift = (p2 >> 63) ? 10 : 9;
+    mask = ((ULONGLONG)1 << shift) - 1;
+    m = p2 >> shift;
+    rem = (p2 & mask) || p1 || p0;
+    e = 128 + shift + pow5_table[q+64].exp + q - lz;
+
+    /* the error could carry into the bits that are kept */
+    if(!exact && (p2 & mask) == mask && p1 == ~(ULONGLONG)0)
+        return FALSE;
+    /* or hide that the value is exactly halfway */
+    if(!exact && (m & 1) && !rem)
+        return FALSE;
+
+    if((m & 1) && (rem || (m & 2)))
+        m += 2;
+    m >>= 1;
+    e++;
+    if(m >> 53) {
+        m >>= 1;
+        e++;
+    }
+
+    e += 1075;
+    if(e <= 0 || e >= 2047)
+        return FALSE;
+    *bits = ((ULONGLONG)e << 52) | (m & DBL_MANT_MASK);
+    return TRUE;
+}
+
+/* compare the decimal number 0.digits * 10^dexp with m * 2^e */
+static int compare_digits(const char *digits, int nd, int dexp, ULONGLONG m, int e)
+{
+    char buf[BNUM_DIGITS];
+    struct bnum bn;
+    int i, n, bexp;
+
+    bnum_init(&bn, m);
+    if(e > 0)
+        bnum_lshift(&bn, e);
+    else if(e < 0)
+        bnum_rshift(&bn, -e, 0);
+    n = bnum_to_digits(&bn, buf, &bexp);
+
+    if(dexp != bexp)
+        return dexp > bexp ? 1 : -1;
+    for(i=0; i<nd || i<n; i++) {
+        char a = i < nd ? digits[i] : '0', b = i < n ? buf[i] : '0';
+
+        if(a != b)
+            return a > b ? 1 : -1;
+    }
+    return 0;
+}
+
+/* Round 0.digits * 10^dexp to a double, starting from an approximation. */
+static double exact_strtod(const char *digits, int nd, int dexp, ULONGLONG bits)
+{
+    if(dexp > 310)
+        return bits_double(DBL_INF_BITS);
+    if(dexp < -324)
+        return 0;
+    if(bits >= DBL_INF_BITS)
+        bits = DBL_INF_BITS - 1;
+
+    for(;;) {
+        int e = bits >> 52, c;
+        ULONGLONG m = bits & DBL_MANT_MASK;
+
+        if(e)
+            m |= (ULONGLONG)1 << 52;
+        c = compare_digits(digits, nd, dexp, 2*m+1, (e ? e-1075 : -1074) - 1);
+        if(c > 0) {
+            if(++bits == DBL_INF_BITS)
+                break;
+            continue;
+        }
+        if(!c) {
+            if(m & 1)
+                bits++;
+            break;
+        }
+
+        if(!bits)
+            break;
+        if(e > 1 && m == (ULONGLONG)1 << 52)
+            c = compare_digits(digits, nd, dexp, 4*m-1, e-1075-2);
+        else
+            c = compare_digits(digits, nd, dexp, 2*m-1, (e ? e-1075 : -1074) - 1);
+        if(c < 0) {
+            bits--;
+            continue;
+        }
+        if(!c && (m & 1))
+            bits--;
+        break;
+    }
+    return bits_double(bits);
+}
+
+static double approx_strtod(ULONGLONG d, int exp)
+{
+    long double lret = 1, expcnt = 10;
+    BOOL negexp = (exp < 0);
+
+    if(negexp)
+        exp = -exp;
+    while(exp) {
+        if(exp & 1)
+            lret *= expcnt;
+        exp /= 2;
+        expcnt = expcnt*expcnt;
+    }
+    return negexp ? d/lret : d*lret;
+}
+
+/* convert 0.digits * 10^dexp to the nearest double */
+static double digits_to_double(const char *digits, int nd, int dexp)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    ULONGLONG w = 0, bits;
+    double ret;
+    int i, q;
+
+    for(i=0; i<nd && i<19; i++)
+        w = w*10 + digits[i] - '0';
+    q = dexp - i;
+
+    if(nd <= 15 && q >= -22 && q <= 22) {
+        /* both operands are exact, the result is rounded once */
+        _control87(MSVCRT__PC_53, MSVCRT__MCW_PC);
+        ret = q < 0 ? (double)w / pow10[-q] : (double)w * pow10[q];
+        _control87(MSVCRT__PC_64, MSVCRT__MCW_PC);
+        return ret;
+    }
+
+    if(fast_strtod(w, q, &bits) && nd <= 19)
+        return bits_double(bits);
+    if(!bits)
+        bits = double_bits(approx_strtod(w, q));
+    return exact_strtod(digits, nd, dexp, bits);
+}
+
 static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale, int *err)
 {
     MSVCRT_pthreadlocinfo locinfo;
-    unsigned __int64 d=0, hlp;
+    char digits[MAX_PARSE_DIGITS+1];
     unsigned fpcontrol;
-    int exp=0, sign=1;
+    int sign=1, nd=0, dexp=0;
     const char *p;
     double ret;
-    long double lret=1, expcnt = 10;
-    BOOL found_digit = FALSE, negexp;
+    BOOL found_digit = FALSE, sticky = FALSE;
 
     if(err)
         *err = 0;
@@ -336,17 +960,16 @@ static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale
     } else  if(*p == '+')
         p++;
 
+    /* the significant digits are stored as 0.digits * 10^dexp */
     while(isdigit(*p)) {
         found_digit = TRUE;
-        hlp = d*10+*(p++)-'0';
-        if(d>MSVCRT_UI64_MAX/10 || hlp<d) {
-            exp++;
-            break;
-        } else
-            d = hlp;
-    }
-    while(isdigit(*p)) {
-        exp++;
+        if(nd || *p!='0') {
+            if(nd < MAX_PARSE_DIGITS)
+                digits[nd++] = *p;
+            else if(*p != '0')
+                sticky = TRUE;
+            dexp++;
+        }
         p++;
     }
 
@@ -355,15 +978,16 @@ static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale
 
     while(isdigit(*p)) {
         found_digit = TRUE;
-        hlp = d*10+*(p++)-'0';
-        if(d>MSVCRT_UI64_MAX/10 || hlp<d)
-            break;
-
-        d = hlp;
-        exp--;
-    }
-    while(isdigit(*p))
+        if(nd || *p!='0') {
+            if(nd < MAX_PARSE_DIGITS)
+                digits[nd++] = *p;
+            else if(*p != '0')
+                sticky = TRUE;
+        } else {
+            dexp--;
+        }
         p++;
+    }
 
     if(!found_digit) {
         if(end)
@@ -371,6 +995,12 @@ static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale
         return 0.0;
     }
 
+    /* a nonzero digit past the ones that are kept only matters for rounding */
+    if(sticky)
+        digits[nd++] = '1';
+    while(nd && digits[nd-1]=='0')
+        nd--;
+
     if(*p=='e' || *p=='E' || *p=='d' || *p=='D') {
         int e=0, s=1;
 
@@ -389,9 +1019,9 @@ static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale
             }
             e *= s;
 
-            if(exp<0 && e<0 && exp+e>=0) exp = INT_MIN;
-            else if(exp>0 && e>0 && exp+e<0) exp = INT_MAX;
-            else exp += e;
+            if(dexp<0 && e<0 && dexp+e>=0) dexp = INT_MIN;
+            else if(dexp>0 && e>0 && dexp+e<0) dexp = INT_MAX;
+            else dexp += e;
         } else {
             if(*p=='-' || *p=='+')
                 p--;
@@ -399,24 +1029,26 @@ static double strtod_helper(const char *str, char **end, MSVCRT__locale_t locale
         }
     }
 
+    /* anything out of this range is 0 or infinity anyway */
+    if(dexp > 100000)
+        dexp = 100000;
+    else if(dexp < -100000)
+        dexp = -100000;
+
     fpcontrol = _control87(0, 0);
     _control87(MSVCRT__EM_DENORMAL|MSVCRT__EM_INVALID|MSVCRT__EM_ZERODIVIDE
             |MSVCRT__EM_OVERFLOW|MSVCRT__EM_UNDERFLOW|MSVCRT__EM_INEXACT, 0xffffffff);
 
-    negexp = (exp < 0);
-    if(negexp)
-        exp = -exp;
-    while(exp) {
-        if(exp & 1)
-            lret *= expcnt;
-        exp /= 2;
-        expcnt = expcnt*expcnt;
+    if(!nd) {
+        ret = 0;
+    } else {
+        ret = digits_to_double(digits, nd, dexp);
     }
-    ret = (long double)sign * (negexp ? d/lret : d*lret);
+    ret *= sign;
 
     _control87(fpcontrol, 0xffffffff);
 
-    if((d && ret==0.0) || isinf(ret)) {
+    if((nd && ret==0.0) || isinf(ret)) {
         if(err)
             *err = MSVCRT_ERANGE;
         else
@@ -2312,6 +2312,86 @@ static void test_write_flush(void)
     free(tempf);
 }
 
+#define STREAM_LINES 2000
+
+static DWORD WINAPI stream_writer_thread(void *arg)
+{
+    FILE *file = arg;
+    int i;
+
+    for (i = 0; i < STREAM_LINES; i++)
+        fputs("BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB\n", file);
+    return 0;
+}
+
+static void test_stream_threads(void)
+{
+    char line[64];
+    int i, count_a = 0, count_b = 0;
+    char *tempf;
+    HANDLE thread;
+    FILE *file;
+
+    tempf = _tempnam(".","wne");
+    file = fopen(tempf, "wb+");
+    ok(file != NULL, "unable to create test file\n");
+
+    fputs("AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n", file);
+    thread = CreateThread(NULL, 0, stream_writer_thread, file, 0, NULL);
+    for (i = 1; i < STREAM_LINES; i++)
+        fputs("AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n", file);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+
+    rewind(file);
+    while (fgets(line, sizeof(line), file))
+    {
+        ok(strlen(line) == 40, "got line %s\n", line);
+        if (line[0] == 'A') count_a++;
+        else if (line[0] == 'B') count_b++;
+        ok(!strcmp(line + 1, line[0] == 'A' ? "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n" :
+                   "BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB\n"), "got line %s\n", line);
+    }
+    ok(count_a == STREAM_LINES, "got %d A lines\n", count_a);
+    ok(count_b == STREAM_LINES, "got %d B lines\n", count_b);
+    fclose(file);
+    unlink(tempf);
+    free(tempf);
+}
+
+static void test_large_stream(void)
+{
+    int i, c, size = 1024 * 1024;
+    char *tempf;
+    FILE *file;
+
+    tempf = _tempnam(".","wne");
+    file = fopen(tempf, "wb+");
+    ok(file != NULL, "unable to create test file\n");
+
+    for (i = 0; i < size; i++)
+        fputc(i % 251, file);
+    ok(ftell(file) == size, "ftell returned %d\n", ftell(file));
+
+    rewind(file);
+    for (i = 0; i < size; i++)
+    {
+        c = fgetc(file);
+        if (c != i % 251) break;
+        if (i == size / 2 + 7)
+            ok(ftell(file) == i + 1, "ftell returned %d, expected %d\n", ftell(file), i + 1);
+    }
+    ok(i == size, "got %x at offset %d\n", c, i);
+    ok(fgetc(file) == EOF, "expected EOF\n");
+
+    ok(!fseek(file, size / 3, SEEK_SET), "fseek failed\n");
+    c = fgetc(file);
+    ok(c == (size / 3) % 251, "got %x at offset %d\n", c, size / 3);
+    fclose(file);
+    unlink(tempf);
+    free(tempf);
+}
+
 START_TEST(file)
 {
     int arg_c;
@@ -2378,6 +2458,8 @@ START_TEST(file)
     test_mktemp();
     test__open_osfhandle();
     test_write_flush();
+    test_stream_threads();
+    test_large_stream();
 
     /* Wait for the (_P_NOWAIT) spawned processes to finish to make sure the report
      * file contains lines in the correct order
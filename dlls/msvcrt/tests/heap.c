@@ -19,6 +19,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
 #include <errno.h>
 #include "wine/test.h"
@@ -456,6 +457,115 @@ static void test_sbheap(void)
     free(mem);
 }
 
+static void test_small_blocks(void)
+{
+    unsigned char *mem[300], *ptr;
+    _HEAPINFO info;
+    size_t size;
+    int i, found;
+
+    for (i = 0; i < sizeof(mem)/sizeof(mem[0]); i++)
+    {
+        mem[i] = malloc(i);
+        ok(mem[i] != NULL, "malloc(%d) failed\n", i);
+        if (!mem[i]) return;
+        size = _msize(mem[i]);
+        ok(size == i, "_msize returned %d, expected %d\n", (int)size, i);
+        memset(mem[i], i, i);
+    }
+
+    /* all the blocks are part of the heap */
+    memset(&info, 0, sizeof(info));
+    found = 0;
+    while (_heapwalk(&info) == _HEAPOK)
+    {
+        if (info._useflag != _USEDENTRY) continue;
+        for (i = 1; i < sizeof(mem)/sizeof(mem[0]); i++)
+            if (mem[i] >= (unsigned char *)info._pentry &&
+                mem[i] < (unsigned char *)info._pentry + info._size) found++;
+    }
+    ok(found == sizeof(mem)/sizeof(mem[0]) - 1, "found %d blocks\n", found);
+    for (i = 0; i < sizeof(mem)/sizeof(mem[0]); i += 2)
+        free(mem[i]);
+    ok(_heapchk() == _HEAPOK, "_heapchk failed\n");
+    for (i = 1; i < sizeof(mem)/sizeof(mem[0]); i += 2)
+    {
+        size_t j;
+        for (j = 0; j < i; j++) if (mem[i][j] != (unsigned char)i) break;
+        ok(j == i, "block %d was overwritten at offset %d\n", i, (int)j);
+    }
+
+    ptr = calloc(7, 9);
+    ok(ptr != NULL, "calloc failed\n");
+    for (i = 0; i < 63; i++) if (ptr[i]) break;
+    ok(i == 63, "calloc didn't zero the block at offset %d\n", i);
+    memset(ptr, 0x55, 63);
+
+    ptr = realloc(ptr, 70);
+    ok(ptr != NULL, "realloc failed\n");
+    size = _msize(ptr);
+    ok(size == 70, "_msize returned %d\n", (int)size);
+    ptr = realloc(ptr, 5000);
+    ok(ptr != NULL, "realloc failed\n");
+    for (i = 0; i < 63; i++) if (ptr[i] != 0x55) break;
+    ok(i == 63, "realloc lost the data at offset %d\n", i);
+    free(ptr);
+
+    for (i = 1; i < sizeof(mem)/sizeof(mem[0]); i += 2)
+        free(mem[i]);
+}
+
+#define CHURN_ITERATIONS 200000
+#define CHURN_LIVE       256
+
+/* mimic the allocation pattern of containers of short strings */
+static DWORD WINAPI churn_thread(void *arg)
+{
+    void *live[CHURN_LIVE];
+    unsigned int seed = (UINT_PTR)arg, i;
+
+    memset(live, 0, sizeof(live));
+    for (i = 0; i < CHURN_ITERATIONS; i++)
+    {
+        unsigned int index;
+        seed = seed * 1103515245 + 12345;
+        index = (seed >> 16) % CHURN_LIVE;
+        free(live[index]);
+        live[index] = malloc(8 + (seed >> 8) % 120);
+    }
+    for (i = 0; i < CHURN_LIVE; i++) free(live[i]);
+    return 0;
+}
+
+static void test_malloc_performance(void)
+{
+    LARGE_INTEGER freq, start, end;
+    HANDLE threads[16];
+    int count, i;
+
+    if (!winetest_interactive)
+    {
+        skip("malloc benchmark only runs in interactive mode\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    for (count = 1; count <= 16; count *= 2)
+    {
+        QueryPerformanceCounter(&start);
+        for (i = 0; i < count; i++)
+            threads[i] = CreateThread(NULL, 0, churn_thread, (void *)(UINT_PTR)(i + 1), 0, NULL);
+        for (i = 0; i < count; i++)
+        {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+        QueryPerformanceCounter(&end);
+        trace("%2d threads, %.0f malloc/free pairs/s\n", count,
+              (double)count * CHURN_ITERATIONS * freq.QuadPart / (end.QuadPart - start.QuadPart));
+    }
+}
+
 START_TEST(heap)
 {
     void *mem;
@@ -480,4 +590,6 @@ START_TEST(heap)
 
     test_aligned();
     test_sbheap();
+    test_small_blocks();
+    test_malloc_performance();
 }
@@ -1424,6 +1424,275 @@ static void test__get_output_format(void)
     ok(ret == _TWO_DIGIT_EXPONENT, "got %d\n", ret);
 }
 
+static void test_float_conv(void)
+{
+    static const struct {
+        const char *format;
+        double value;
+        const char *out;
+    } tests[] = {
+        { "%f", 3.14159265358979, "3.141593" },
+        { "%.10f", 1.0 / 3, "0.3333333333" },
+        { "%.0f", 1e15, "1000000000000000" },
+        { "%#.0f", 2.0, "2." },
+        { "%e", 6.02214076e23, "6.022141e+023" },
+        { "%.3e", 9.9996, "1.000e+001" },
+        { "%.15e", 1e-300, "1.000000000000000e-300" },
+        { "%.16e", 4.9406564584124654e-324, "4.9406564584124654e-324" },
+        { "%g", 0.0001, "0.0001" },
+        { "%g", 0.00001, "1e-005" },
+        { "%g", 123456.0, "123456" },
+        { "%g", 1234567.0, "1.23457e+006" },
+        { "%G", 1e-10, "1E-010" },
+        { "%.17g", 0.1, "0.10000000000000001" },
+        { "%.16g", 1.7976931348623157e308, "1.797693134862316e+308" },
+    };
+    unsigned int i, seed = 12345, errors = 0;
+    char buf[64];
+    double d, back;
+
+    for(i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+        sprintf(buf, tests[i].format, tests[i].value);
+        ok(!strcmp(buf, tests[i].out), "%s: got %s, expected %s\n",
+           tests[i].format, buf, tests[i].out);
+    }
+
+    /* printing 17 significant digits gives back the same value */
+    for(i=0; i<10000; i++) {
+        seed = seed * 1103515245 + 12345;
+        d = (double)(seed >> 4) * 0x10000000 + (seed & 0xfffffff);
+        seed = seed * 1103515245 + 12345;
+        d *= pow(10, (int)(seed % 600) - 300);
+
+        sprintf(buf, "%.17g", d);
+        back = strtod(buf, NULL);
+        if(back != d && errors++ < 5)
+            ok(0, "%s was read back as %.17g\n", buf, back);
+    }
+    ok(!errors, "%u values didn't survive a round trip\n", errors);
+}
+
+static void test_float_conv_old(void)
+{
+    /* outputs of the previous implementation, which went through the host sprintf */
+    static const struct {
+        const char *format;
+        double value;
+        const char *out;
+    } tests[] = {
+        { "%f", 2.0 / 3, "0.666667" },
+        { "%.0f", 2.0 / 3, "1" },
+        { "%.12f", 2.0 / 3, "0.666666666667" },
+        { "%#.0f", 2.0 / 3, "1." },
+        { "%.16e", 2.0 / 3, "6.6666666666666663e-001" },
+        { "%.17g", 2.0 / 3, "0.66666666666666663" },
+        { "%10.4f", -1.5, "   -1.5000" },
+        { "%010.3f", -1.5, "-00001.500" },
+        { "%.0e", -1.5, "-2e+000" },
+        { "%#.3g", -1.5, "-1.50" },
+        { "%-10.2f", 123.456, "123.46    " },
+        { "%+f", 123.456, "+123.456000" },
+        { "% .2f", 123.456, " 123.46" },
+        { "%+.4E", 123.456, "+1.2346E+002" },
+        { "%.1g", 123.456, "1e+002" },
+        { "%#.3g", 123.456, "123." },
+        { "%f", 1e-5, "0.000010" },
+        { "%.16e", 1e-5, "1.0000000000000001e-005" },
+        { "%#g", 1e-5, "1.00000e-005" },
+        { "%.16e", 6.02214076e23, "6.0221407599999999e+023" },
+        { "%.10g", 6.02214076e23, "6.02214076e+023" },
+        { "%.0e", 1.7976931348623157e308, "2e+308" },
+        { "%.3g", 1.7976931348623157e308, "1.8e+308" },
+        { "%#.3g", 1.7976931348623157e308, "1.80e+308" },
+        { "%.10g", 1.7976931348623157e308, "1.797693135e+308" },
+        { "%f", 4.9406564584124654e-324, "0.000000" },
+        { "%+.4E", 4.9406564584124654e-324, "+4.9407E-324" },
+        { "%G", 4.9406564584124654e-324, "4.94066E-324" },
+        { "%.2e", 2.2250738585072014e-308, "2.23e-308" },
+        { "%.10g", 2.2250738585072014e-308, "2.225073859e-308" },
+        { "%#.0e", 1e21, "1.e+021" },
+        { "%.17g", 1e21, "1e+021" },
+        { "%.0f", 12345678.9, "12345679" },
+        { "%10.4f", 12345678.9, "12345678.9000" },
+        { "%.10g", 12345678.9, "12345678.9" },
+        { "%G", 12345678.9, "1.23457E+007" },
+        { "%10.4f", 0.000123456, "    0.0001" },
+        { "%.1g", 0.000123456, "0.0001" },
+        { "%.17g", 0.000123456, "0.00012345600000000001" },
+        { "%.0f", 99.995, "100" },
+        { "%-10.2f", 99.995, "100.00    " },
+        { "%.2e", 99.995, "1.00e+002" },
+        { "%.3g", 99.995, "100" },
+        { "%#g", 99.995, "99.9950" },
+        { "%#.3g", 99.995, "100." },
+        { "%.12f", -271.828182845904, "-271.828182845904" },
+        { "%.16e", -271.828182845904, "-2.7182818284590400e+002" },
+        { "%.10g", -271.828182845904, "-271.8281828" },
+        { "%.12f", 5e-7, "0.000000500000" },
+        { "%.16e", 5e-7, "4.9999999999999998e-007" },
+        { "%#.3g", 5e-7, "5.00e-007" },
+        { "%.16e", 1e300, "1.0000000000000001e+300" },
+        { "%.17g", 1e300, "1.0000000000000001e+300" },
+    };
+    unsigned int i;
+    char buf[64];
+
+    for(i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+        sprintf(buf, tests[i].format, tests[i].value);
+        ok(!strcmp(buf, tests[i].out), "%s %.17g: got %s, expected %s\n",
+           tests[i].format, tests[i].value, buf, tests[i].out);
+    }
+}
+
+static ULONGLONG double_bits(double d)
+{
+    ULONGLONG bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+static void check_strtod(const char *str, double expected, unsigned int line)
+{
+    ULONGLONG bits, expected_bits = double_bits(expected);
+    double d;
+
+    d = strtod(str, NULL);
+    bits = double_bits(d);
+    /* older msvcrt versions can be off by one unit in the last place */
+    ok_(__FILE__, line)(bits == expected_bits ||
+                        broken(bits == expected_bits + 1 || bits + 1 == expected_bits),
+                        "%.40s: got %.17g, expected %.17g\n", str, d, expected);
+}
+
+static void test_strtod_exact(void)
+{
+    static const struct {
+        const char *str;
+        double expected;
+    } tests[] = {
+        /* halfway between two doubles, rounded to even */
+        { "9007199254740993", 9007199254740992.0 },
+        { "9007199254740995", 9007199254740996.0 },
+        { "9007199254740993.0000000000000001", 9007199254740994.0 },
+        { "1.00000000000000011102230246251565404236316680908203125", 1.0 },
+        { "1.00000000000000011102230246251565404236316680908203124", 1.0 },
+        { "1.00000000000000011102230246251565404236316680908203126", 1.0000000000000002 },
+        { "1.00000000000000033306690738754696212708950042724609375", 1.0000000000000004 },
+        /* 16 to 19 digits */
+        { "1234567890123456", 1234567890123456.0 },
+        { "12345678901234567", 12345678901234568.0 },
+        { "123456789012345678", 123456789012345680.0 },
+        { "1234567890123456789", 1234567890123456800.0 },
+        { "1844674407370955161e-3", 1844674407370955.2 },
+        { "7.2057594037927933e16", 72057594037927936.0 },
+        { "9.999999999999999e22", 1e23 },
+        { "8.98846567431158e307", 8.98846567431158e307 },
+        /* subnormals */
+        { "4.9406564584124654e-324", 4.9406564584124654e-324 },
+        { "2.4703282292062328e-324", 4.9406564584124654e-324 },
+        { "2.4703282292062327e-324", 0.0 },
+        { "2.2250738585072011e-308", 2.2250738585072009e-308 },
+        { "2.2250738585072012e-308", 2.2250738585072014e-308 },
+        { "2.225073858507201136057409796709131975934819546351645648e-308", 2.2250738585072009e-308 },
+        { "1e-320", 9.9998886718268301e-321 },
+        { "123456789012345678e-330", 1.2345678901e-313 },
+        { "4.35679845e-310", 4.35679845e-310 },
+    };
+    unsigned char digits[800];
+    char *str;
+    int i, len, n;
+
+    for(i=0; i<sizeof(tests)/sizeof(tests[0]); i++)
+        check_strtod(tests[i].str, tests[i].expected, __LINE__);
+
+    str = malloc(2048);
+
+    /* 2^-1075 is exactly halfway between 0 and the smallest subnormal, it
+     * has 752 significant digits: 5^1075 shifted right by 1075 digits */
+    digits[0] = 1;
+    n = 1;
+    for(i=0; i<1075; i++) {
+        int j, carry = 0;
+        for(j=0; j<n; j++) {
+            carry += digits[j] * 5;
+            digits[j] = carry % 10;
+            carry /= 10;
+        }
+        if(carry) digits[n++] = carry;
+    }
+    strcpy(str, "0.");
+    len = 2 + 1075 - n;
+    memset(str + 2, '0', len - 2);
+    for(i=0; i<n; i++)
+        str[len++] = '0' + digits[n - 1 - i];
+    memset(str + len, '0', 100);
+    str[len + 100] = 0;
+    check_strtod(str, 0.0, __LINE__);
+    str[len + 99] = '1';
+    check_strtod(str, 4.9406564584124654e-324, __LINE__);
+
+    /* a halfway case followed by 800 zeros */
+    strcpy(str, "9007199254740993.");
+    len = strlen(str);
+    memset(str + len, '0', 800);
+    str[len + 800] = 0;
+    check_strtod(str, 9007199254740992.0, __LINE__);
+    str[len + 799] = '1';
+    check_strtod(str, 9007199254740994.0, __LINE__);
+
+    strcpy(str, "0.");
+    memset(str + 2, '1', 900);
+    str[902] = 0;
+    check_strtod(str, 0.11111111111111110, __LINE__);
+
+    free(str);
+}
+
+static void benchmark_float_conv(void)
+{
+    static const char *formats[] = { "%f", "%e", "%g", "%.17g" };
+    LARGE_INTEGER freq, start, end;
+    char buf[64], (*strings)[32];
+    double *values, sum = 0;
+    int i, j, count = 100000;
+
+    values = malloc(count * sizeof(*values));
+    strings = malloc(count * sizeof(*strings));
+    for(i=0; i<count; i++) {
+        values[i] = (i * 7919 % 100000) / 1000.0 * pow(10, i % 11 - 5);
+        sprintf(strings[i], "%.17g", values[i]);
+    }
+
+    QueryPerformanceFrequency(&freq);
+    for(j=0; j<sizeof(formats)/sizeof(formats[0]); j++) {
+        QueryPerformanceCounter(&start);
+        for(i=0; i<count; i++)
+            sprintf(buf, formats[j], values[i]);
+        QueryPerformanceCounter(&end);
+        trace("%s %.0f ns/call\n", formats[j],
+              (double)(end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / count);
+    }
+
+    QueryPerformanceCounter(&start);
+    for(i=0; i<count; i++)
+        sum += strtod(strings[i], NULL);
+    QueryPerformanceCounter(&end);
+    trace("strtod %.0f ns/call (%g)\n",
+          (double)(end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / count, sum);
+
+    free(values);
+    free(strings);
+}
+
+static void test_float_conv_performance(void)
+{
+    if(!winetest_interactive) {
+        skip("float conversion benchmark only runs in interactive mode\n");
+        return;
+    }
+    benchmark_float_conv();
+}
+
 START_TEST(printf)
 {
     init();
@@ -1441,4 +1710,8 @@ START_TEST(printf)
     test_vsnwprintf_s();
     test_vsprintf_p();
     test__get_output_format();
+    test_float_conv();
+    test_float_conv_old();
+    test_strtod_exact();
+    test_float_conv_performance();
 }
@@ -59,6 +59,21 @@ static inline void small_pause(void)
 #endif
 }
 
+/* DebugInfo of sections created with RTL_CRITICAL_SECTION_FLAG_NO_DEBUG_INFO; unlike a
+ * NULL DebugInfo, which marks sections made global by MakeCriticalSectionGlobal, these
+ * are still private to the process and can use the fast wait path */
+static RTL_CRITICAL_SECTION_DEBUG * const no_debug_info_marker = (RTL_CRITICAL_SECTION_DEBUG *)(ULONG_PTR)-1;
+
+static inline BOOL crit_section_has_debuginfo( const RTL_CRITICAL_SECTION *crit )
+{
+    return crit->DebugInfo != NULL && crit->DebugInfo != no_debug_info_marker;
+}
+
+static inline ULONG crit_section_spin_count( const RTL_CRITICAL_SECTION *crit )
+{
+    return crit->SpinCount & ~RTL_CRITICAL_SECTION_ALL_FLAG_BITS;
+}
+
 #ifdef __linux__
 
 static int wait_op = 128; /*FUTEX_WAIT|FUTEX_PRIVATE_FLAG*/
@@ -321,11 +336,11 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULON
      * so (e.g.) MakeCriticalSectionGlobal() doesn't free it using HeapFree().
      */
     if (flags & RTL_CRITICAL_SECTION_FLAG_NO_DEBUG_INFO)
-        crit->DebugInfo = NULL;
+        crit->DebugInfo = no_debug_info_marker;
     else
         crit->DebugInfo = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(RTL_CRITICAL_SECTION_DEBUG));
 
-    if (crit->DebugInfo)
+    if (crit_section_has_debuginfo( crit ))
     {
         crit->DebugInfo->Type = 0;
         crit->DebugInfo->CreatorBackTraceIndex = 0;
@@ -399,7 +414,7 @@ NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
     if (crit->DebugInfo)
     {
         /* only free the ones we made in here */
-        if (!crit->DebugInfo->Spare[0])
+        if (crit_section_has_debuginfo( crit ) && !crit->DebugInfo->Spare[0])
         {
             RtlFreeHeap( GetProcessHeap(), 0, crit->DebugInfo );
             crit->DebugInfo = NULL;
@@ -445,7 +460,7 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         if ( status == STATUS_TIMEOUT )
         {
             const char *name = NULL;
-            if (crit->DebugInfo) name = (char *)crit->DebugInfo->Spare[0];
+            if (crit_section_has_debuginfo( crit )) name = (char *)crit->DebugInfo->Spare[0];
             if (!name) name = "?";
             ERR( "section %p %s wait timed out in thread %04x, blocked by %04x, retrying (60 sec)\n",
                  crit, debugstr_a(name), GetCurrentThreadId(), HandleToULong(crit->OwningThread) );
@@ -463,7 +478,7 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         if (status == STATUS_WAIT_0) break;
 
         /* Throw exception only for Wine internal locks */
-        if ((!crit->DebugInfo) || (!crit->DebugInfo->Spare[0])) continue;
+        if (!crit_section_has_debuginfo( crit ) || !crit->DebugInfo->Spare[0]) continue;
 
         /* only throw deadlock exception if configured timeout is reached */
         if (timeout > 0) continue;
@@ -476,7 +491,8 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         rec.ExceptionInformation[0] = (ULONG_PTR)crit;
         RtlRaiseException( &rec );
     }
-    if (crit->DebugInfo) crit->DebugInfo->ContentionCount++;
+    /* we own the section now, so nobody else can be updating the counter */
+    if (crit_section_has_debuginfo( crit )) crit->DebugInfo->ContentionCount++;
     return STATUS_SUCCESS;
 }
 
@@ -538,19 +554,23 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
  */
 NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
-    if (crit->SpinCount)
+    if (crit_section_spin_count( crit ))
     {
-        ULONG count;
+        ULONG count, delay = 1, i;
 
         if (RtlTryEnterCriticalSection( crit )) return STATUS_SUCCESS;
-        for (count = crit->SpinCount; count > 0; count--)
+
+        /* spin while the section is held by a single owner, backing off
+         * exponentially every time another thread grabs it before us */
+        for (count = crit_section_spin_count( crit ); count > 0;)
         {
             if (crit->LockCount > 0) break;  /* more than one waiter, don't bother spinning */
             if (crit->LockCount == -1)       /* try again */
             {
                 if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1) goto done;
+                if (delay < 64) delay *= 2;
             }
-            small_pause();
+            for (i = 0; i < delay && count > 0; i++, count--) small_pause();
         }
     }
 
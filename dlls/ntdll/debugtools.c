@@ -29,6 +29,10 @@
 # include <unistd.h>
 #endif
 #include <ctype.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 #include "wine/debug.h"
 #include "wine/exception.h"
@@ -115,15 +119,479 @@ static const char *NTDLL_dbgstr_wn( const WCHAR *src, int n )
      return res;
 }
 
+/* binary trace ring buffers
+ *
+ * When WINEDEBUGRING is set, trace and warning messages are not formatted but
+ * stored as binary records in per-thread ring buffers of a shared file mapping,
+ * so that they survive a crash; tools/decode-trace turns them back into text.
+ * Each ring has a single writer, so no locking is needed. The rings of the
+ * threads that have exited are given to new threads once all the rings have
+ * been used.
+ */
+
+#define TRACE_RING_MAGIC     0x42525457  /* "WTRB" */
+#define TRACE_RING_VERSION   1
+#define TRACE_RING_COUNT     64          /* max number of threads with a ring */
+#define TRACE_RING_SIZE      (1024 * 1024)
+#define TRACE_STRINGS_SIZE   (1024 * 1024)
+#define TRACE_STRINGS_CACHE  8192        /* must be a power of 2 */
+#define TRACE_MAX_RECORD     2048
+
+enum trace_record_type
+{
+    TRACE_RECORD_PAD,      /* padding up to the end of the ring */
+    TRACE_RECORD_LOG,      /* start of a message, with class, channel and function */
+    TRACE_RECORD_PRINTF    /* continuation of the previous message */
+};
+
+struct trace_file_header
+{
+    unsigned int     magic;          /* TRACE_RING_MAGIC */
+    unsigned int     version;        /* TRACE_RING_VERSION */
+    unsigned int     pid;            /* unix pid of the process */
+    unsigned int     ring_count;     /* number of rings */
+    unsigned int     ring_size;      /* size of the data of each ring */
+    unsigned int     rings_offset;   /* file offset of the first ring */
+    unsigned int     strings_size;   /* size of the string table */
+    unsigned int     strings_offset; /* file offset of the string table */
+    int              strings_used;   /* bytes used in the string table */
+    int              rings_used;     /* number of rings assigned to threads */
+    ULONGLONG        frequency;      /* frequency of the time stamps */
+    ULONGLONG        start_time;     /* time stamp when the file was created */
+};
+
+struct trace_ring
+{
+    unsigned int     tid;            /* thread owning the ring */
+    int              in_line;        /* the last record didn't end with a newline */
+    ULONGLONG        head;           /* total bytes written */
+    ULONGLONG        tail;           /* position of the oldest complete record */
+    char             pad[40];
+    char             data[1];
+};
+
+#define TRACE_RING_HEADER  FIELD_OFFSET( struct trace_ring, data )
+
+struct trace_record
+{
+    unsigned int     size;           /* size of the record, a multiple of 8 */
+    unsigned char    type;           /* enum trace_record_type */
+    unsigned char    cls;            /* debug class for TRACE_RECORD_LOG */
+    unsigned short   pad;
+    ULONGLONG        time;           /* time stamp */
+    unsigned int     channel;        /* string table offset of the channel name */
+    unsigned int     function;       /* string table offset of the function name */
+    unsigned int     format;         /* string table offset of the format, 0 for formatted text */
+    unsigned int     len;            /* length of the argument data or text that follows */
+};
+
+static struct trace_file_header *trace_header;
+static struct trace_ring no_trace_ring;  /* marker for threads without a ring */
+static LONG trace_ring_free[TRACE_RING_COUNT];  /* rings released by exited threads */
+static struct
+{
+    const char  *str;
+    unsigned int offset;
+} trace_strings[TRACE_STRINGS_CACHE];
+
+static ULONGLONG trace_time(void)
+{
+    LARGE_INTEGER counter;
+    NtQueryPerformanceCounter( &counter, NULL );
+    return counter.QuadPart;
+}
+
+/* create the trace file; the header is zero-filled so the rings start empty */
+static void init_trace_rings(void)
+{
+    const char *str = getenv( "WINEDEBUGRING" );
+    struct trace_file_header *header;
+    LARGE_INTEGER counter, frequency;
+    unsigned int ring_size = TRACE_RING_SIZE;
+    size_t size;
+    char *name, *p;
+    int fd;
+
+    if (!str || !*str) return;
+    if (!(name = malloc( strlen(str) + 16 ))) return;
+    strcpy( name, str );
+    if ((p = strrchr( name, ',' )))
+    {
+        ring_size = (strtoul( p + 1, NULL, 0 ) * 1024 + 7) & ~7;
+        ring_size = max( ring_size, TRACE_MAX_RECORD * 2 );
+        *p = 0;
+    }
+    sprintf( name + strlen(name), ".%u", getpid() );
+
+    size = sizeof(*header) + TRACE_STRINGS_SIZE + TRACE_RING_COUNT * (size_t)(TRACE_RING_HEADER + ring_size);
+    if ((fd = open( name, O_RDWR | O_CREAT | O_TRUNC, 0666 )) == -1 || ftruncate( fd, size ) == -1 ||
+        (header = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        fprintf( stderr, "wine: cannot create trace file %s, using text output\n", name );
+        if (fd != -1) close( fd );
+        free( name );
+        return;
+    }
+    close( fd );
+    free( name );
+
+    header->version        = TRACE_RING_VERSION;
+    header->pid            = getpid();
+    header->ring_count     = TRACE_RING_COUNT;
+    header->ring_size      = ring_size;
+    header->strings_offset = sizeof(*header);
+    header->strings_size   = TRACE_STRINGS_SIZE;
+    header->strings_used   = 4;  /* offset 0 means no string */
+    header->rings_offset   = sizeof(*header) + TRACE_STRINGS_SIZE;
+    NtQueryPerformanceCounter( &counter, &frequency );
+    header->frequency      = frequency.QuadPart;
+    header->start_time     = counter.QuadPart;
+    header->magic          = TRACE_RING_MAGIC;
+    trace_header = header;
+}
+
+/* get a ring buffer from its index */
+static inline struct trace_ring *get_trace_ring_ptr( unsigned int index )
+{
+    return (struct trace_ring *)((char *)trace_header + trace_header->rings_offset +
+                                 index * (size_t)(TRACE_RING_HEADER + trace_header->ring_size));
+}
+
+/* get the ring buffer of the current thread, or NULL if it doesn't have one */
+static struct trace_ring *get_trace_ring(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct trace_ring *ring = thread_data->trace_ring;
+    int index;
+
+    if (!trace_header) return NULL;
+    if (!ring)
+    {
+        ring = &no_trace_ring;
+        if (trace_header->rings_used < TRACE_RING_COUNT &&
+            (index = interlocked_xchg_add( &trace_header->rings_used, 1 )) < TRACE_RING_COUNT)
+        {
+            ring = get_trace_ring_ptr( index );
+            ring->tid = GetCurrentThreadId();
+        }
+        else
+        {
+            for (index = 0; index < TRACE_RING_COUNT; index++)
+            {
+                if (!trace_ring_free[index] || !interlocked_cmpxchg( &trace_ring_free[index], 0, 1 )) continue;
+                /* drop the records of the previous owner, they would be attributed to the new one */
+                ring = get_trace_ring_ptr( index );
+                ring->tid = GetCurrentThreadId();
+                ring->in_line = 0;
+                ring->tail = ring->head;
+                break;
+            }
+        }
+        thread_data->trace_ring = ring;
+    }
+    return ring != &no_trace_ring ? ring : NULL;
+}
+
+/***********************************************************************
+ *		debug_exit_thread
+ *
+ * Release the trace ring of the current thread when it exits.
+ */
+void debug_exit_thread(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct trace_ring *ring = thread_data->trace_ring;
+    size_t index;
+
+    if (!ring || ring == &no_trace_ring) return;
+    thread_data->trace_ring = &no_trace_ring;
+    index = ((char *)ring - ((char *)trace_header + trace_header->rings_offset)) /
+            (TRACE_RING_HEADER + trace_header->ring_size);
+    interlocked_xchg( &trace_ring_free[index], 1 );
+}
+
+/* return the string table offset of a static string, adding it to the table if needed */
+/* the cache is indexed by address, so the contents are checked in case the module */
+/* owning the string was unloaded and another one was loaded at the same address */
+static unsigned int get_trace_string( const char *str )
+{
+    const char *strings = (const char *)trace_header + trace_header->strings_offset;
+    unsigned int i, offset, len, size, pos = ((ULONG_PTR)str >> 2) * 0x9e3779b1;
+
+    for (i = 0; i < 16; i++, pos++)
+    {
+        pos &= TRACE_STRINGS_CACHE - 1;
+        if (trace_strings[pos].str == str)
+        {
+            offset = trace_strings[pos].offset;
+            if (offset && !strcmp( strings + offset + sizeof(len), str )) return offset;
+            break;  /* being added by another thread, or stale, add a new copy */
+        }
+        if (!trace_strings[pos].str &&
+            !interlocked_cmpxchg_ptr( (void **)&trace_strings[pos].str, (void *)str, NULL )) break;
+    }
+    if (i == 16) return 0;
+
+    len = strlen( str );
+    size = (sizeof(len) + len + 1 + 3) & ~3;
+    do
+    {
+        offset = trace_header->strings_used;
+        if (size > trace_header->strings_size - offset) return 0;  /* the table is full */
+    }
+    while (interlocked_cmpxchg( &trace_header->strings_used, offset + size, offset ) != offset);
+    memcpy( (char *)strings + offset, &len, sizeof(len) );
+    memcpy( (char *)strings + offset + sizeof(len), str, len + 1 );
+    if (trace_strings[pos].str == str) trace_strings[pos].offset = offset;
+    return offset;
+}
+
+/* store the arguments of a format in binary form; return FALSE if the format isn't supported */
+static BOOL pack_trace_args( const char *format, va_list args, char *data, unsigned int *len, BOOL *newline )
+{
+    char *pos = data, *end = data + TRACE_MAX_RECORD - sizeof(struct trace_record);
+    const char *p;
+    char last = 0;
+
+    for (p = format; *p; p++)
+    {
+        ULONGLONG val;
+        unsigned int size = sizeof(int), n;
+        int precision = -1;
+        char modifier = 0;
+
+        if (*p != '%')
+        {
+            last = *p;
+            continue;
+        }
+        if (*++p == '%')
+        {
+            last = '%';
+            continue;
+        }
+        while (*p && strchr( "-+ #0'", *p )) p++;
+        if (*p == '*')
+        {
+            if (end - pos < sizeof(val)) return FALSE;
+            val = va_arg( args, int );
+            memcpy( pos, &val, sizeof(val) );
+            pos += sizeof(val);
+            p++;
+        }
+        else while (isdigit( (unsigned char)*p )) p++;
+        if (*p == '.')
+        {
+            if (*++p == '*')
+            {
+                if (end - pos < sizeof(val)) return FALSE;
+                precision = va_arg( args, int );
+                val = precision;
+                memcpy( pos, &val, sizeof(val) );
+                pos += sizeof(val);
+                p++;
+            }
+            else for (precision = 0; isdigit( (unsigned char)*p ); p++) precision = precision * 10 + *p - '0';
+        }
+        switch (modifier = *p)
+        {
+        case 'h':
+            size = sizeof(short);
+            if (p[1] == 'h')
+            {
+                size = sizeof(char);
+                p++;
+            }
+            p++;
+            break;
+        case 'l':
+            size = sizeof(long);
+            if (p[1] == 'l')
+            {
+                size = sizeof(LONGLONG);
+                p++;
+            }
+            p++;
+            break;
+        case 'q':
+        case 'j':
+            size = sizeof(LONGLONG);
+            p++;
+            break;
+        case 'z':
+        case 't':
+            size = sizeof(size_t);
+            p++;
+            break;
+        default:
+            modifier = 0;
+            break;
+        }
+
+        if (end - pos < sizeof(val)) return FALSE;
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+            if (size == sizeof(LONGLONG)) val = va_arg( args, LONGLONG );
+            else if (size == sizeof(long)) val = va_arg( args, long );
+            else if (size == sizeof(short)) val = (short)va_arg( args, int );
+            else if (size == sizeof(char)) val = (signed char)va_arg( args, int );
+            else val = va_arg( args, int );
+            last = '0';
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            if (size == sizeof(ULONGLONG)) val = va_arg( args, ULONGLONG );
+            else if (size == sizeof(unsigned long)) val = va_arg( args, unsigned long );
+            else if (size == sizeof(short)) val = (unsigned short)va_arg( args, unsigned int );
+            else if (size == sizeof(char)) val = (unsigned char)va_arg( args, unsigned int );
+            else val = va_arg( args, unsigned int );
+            last = '0';
+            break;
+        case 'c':
+            if (modifier) return FALSE;  /* wide characters */
+            val = (unsigned char)va_arg( args, int );
+            last = val;
+            break;
+        case 'p':
+            val = (ULONG_PTR)va_arg( args, void * );
+            last = '0';
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            double d = va_arg( args, double );
+            memcpy( &val, &d, sizeof(val) );
+            last = '0';
+            break;
+        }
+        case 's':
+        {
+            const char *str = va_arg( args, const char * );
+
+            if (modifier) return FALSE;  /* wide strings */
+            if (!str)
+            {
+                n = ~0u;
+                memcpy( pos, &n, sizeof(n) );
+                pos += sizeof(n);
+                last = ')';
+                continue;
+            }
+            n = precision >= 0 ? strnlen( str, precision ) : strlen( str );
+            if (n > end - pos - sizeof(n)) return FALSE;
+            memcpy( pos, &n, sizeof(n) );
+            memcpy( pos + sizeof(n), str, n );
+            pos += sizeof(n) + n;
+            if (n) last = str[n - 1];
+            continue;
+        }
+        default:
+            return FALSE;
+        }
+        memcpy( pos, &val, sizeof(val) );
+        pos += sizeof(val);
+    }
+    *len = pos - data;
+    *newline = (last == '\n');
+    return TRUE;
+}
+
+/* copy a record to the ring, overwriting the oldest records if needed */
+static void write_trace_record( struct trace_ring *ring, struct trace_record *record )
+{
+    unsigned int ring_size = trace_header->ring_size;
+    unsigned int pos = ring->head % ring_size;
+
+    if (pos + record->size > ring_size)
+    {
+        struct trace_record pad;
+
+        memset( &pad, 0, sizeof(pad) );
+        pad.size = ring_size - pos;
+        pad.type = TRACE_RECORD_PAD;
+        write_trace_record( ring, &pad );
+        pos = 0;
+    }
+    while (ring->head + record->size - ring->tail > ring_size)
+    {
+        const struct trace_record *old = (const struct trace_record *)(ring->data + ring->tail % ring_size);
+        ring->tail += old->size;
+    }
+    memcpy( ring->data + pos, record, min( record->size, sizeof(*record) + record->len ));
+    ring->head += record->size;
+}
+
+/* store a message in the ring buffer; return FALSE if it has to be printed as text */
+static BOOL trace_ring_vlog( struct trace_ring *ring, enum __wine_debug_class cls,
+                             struct __wine_debug_channel *channel, const char *function,
+                             const char *format, va_list args )
+{
+    union
+    {
+        struct trace_record record;
+        char buffer[TRACE_MAX_RECORD];
+    } rec;
+    BOOL newline = FALSE;
+    va_list copy;
+    int ret;
+
+    rec.record.type     = channel ? TRACE_RECORD_LOG : TRACE_RECORD_PRINTF;
+    rec.record.cls      = cls;
+    rec.record.pad      = 0;
+    rec.record.time     = trace_time();
+    rec.record.channel  = channel ? get_trace_string( channel->name ) : 0;
+    rec.record.function = function ? get_trace_string( function ) : 0;
+    rec.record.format   = 0;
+    rec.record.len      = 0;
+    if ((channel && !rec.record.channel) || (function && !rec.record.function)) return FALSE;
+
+    if (format)
+    {
+        va_copy( copy, args );
+        if (!(rec.record.format = get_trace_string( format )) ||
+            !pack_trace_args( format, copy, rec.buffer + sizeof(rec.record), &rec.record.len, &newline ))
+        {
+            /* store the formatted text instead */
+            rec.record.format = 0;
+            ret = vsnprintf( rec.buffer + sizeof(rec.record), sizeof(rec) - sizeof(rec.record), format, args );
+            if (ret < 0) ret = 0;
+            rec.record.len = min( ret + 1, sizeof(rec) - sizeof(rec.record) );
+            rec.buffer[sizeof(rec.record) + rec.record.len - 1] = 0;
+            newline = (rec.record.len > 1 && rec.buffer[sizeof(rec.record) + rec.record.len - 2] == '\n');
+        }
+        va_end( copy );
+    }
+    rec.record.size = (sizeof(rec.record) + rec.record.len + 7) & ~7;
+    write_trace_record( ring, &rec.record );
+    ring->in_line = !newline;
+    return TRUE;
+}
+
 /***********************************************************************
  *		NTDLL_dbg_vprintf
  */
 static int NTDLL_dbg_vprintf( const char *format, va_list args )
 {
     struct debug_info *info = get_info();
-    int end;
+    struct trace_ring *ring;
+    int end, ret;
+
+    /* continue a message that was started in the ring buffer */
+    if (info->out_pos == info->output && (ring = get_trace_ring()) && ring->in_line &&
+        trace_ring_vlog( ring, 0, NULL, NULL, format, args ))
+        return 0;
 
-    int ret = vsnprintf( info->out_pos, sizeof(info->output) - (info->out_pos - info->output),
+    ret = vsnprintf( info->out_pos, sizeof(info->output) - (info->out_pos - info->output),
                          format, args );
 
     /* make sure we didn't exceed the buffer length
@@ -160,8 +628,21 @@ static int NTDLL_dbg_vlog( enum __wine_debug_class cls, struct __wine_debug_chan
 {
     static const char * const classes[] = { "fixme", "err", "warn", "trace" };
     struct debug_info *info = get_info();
+    struct trace_ring *ring;
     int ret = 0;
 
+    /* traces and warnings go to the ring buffer if there is one, unless a text line is pending */
+    if ((cls == __WINE_DBCL_TRACE || cls == __WINE_DBCL_WARN) && info->out_pos == info->output &&
+        (ring = get_trace_ring()))
+    {
+        if (ring->in_line)  /* no header in the middle of a line */
+        {
+            channel = NULL;
+            function = NULL;
+        }
+        if (trace_ring_vlog( ring, cls, channel, function, format, args )) return 0;
+    }
+
     /* only print header if we are at the beginning of the line */
     if (info->out_pos == info->output || info->out_pos[-1] == '\n')
     {
@@ -196,5 +677,6 @@ static const struct __wine_debug_functions funcs =
  */
 void debug_init(void)
 {
+    init_trace_rings();
     __wine_dbg_set_functions( &funcs, &default_funcs, sizeof(funcs) );
 }
@@ -50,6 +50,9 @@
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #ifdef HAVE_LINUX_IOCTL_H
 #include <linux/ioctl.h>
 #endif
@@ -2200,6 +2203,352 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/* Cache of case-insensitive directory listings, so that repeated lookups
+ * in the same directory don't need to read it again. Entries are keyed by
+ * the directory identity and modification time, and invalidated through
+ * inotify when available. */
+
+#define DIR_CACHE_MAX_DIRS  64
+
+struct dir_cache_name
+{
+    struct dir_cache_name *next;        /* next name in the same long name hash bucket */
+    struct dir_cache_name *next_short;  /* next name in the same short name hash bucket */
+    unsigned int           index;       /* position in the directory listing */
+    USHORT                 len;         /* length of the Unicode name */
+    USHORT                 short_len;   /* length of the hashed short name, 0 if none */
+    WCHAR                  short_name[12];
+    char                  *unix_name;
+    WCHAR                  name[1];
+};
+
+struct dir_cache
+{
+    struct list             entry;      /* entry in the global LRU list */
+    struct file_identity    id;
+    time_t                  mtime;
+    long                    mtime_nsec;
+    int                     wd;         /* inotify watch descriptor, -1 if none */
+    unsigned int            count;
+    unsigned int            hash_size;  /* number of hash buckets, a power of 2 */
+    struct dir_cache_name **hash;
+    struct dir_cache_name **short_hash;
+};
+
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+static int dir_cache_inotify_fd = -2;  /* -2 if not initialized yet, -1 if not available */
+
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline long get_mtime_nsec( const struct stat *st )
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return st->st_mtimespec.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+static inline unsigned int hash_dir_cache_name( const WCHAR *name, int length )
+{
+    unsigned int hash = 0;
+    while (length--) hash = hash * 31 + tolowerW( *name++ );
+    return hash;
+}
+
+/***********************************************************************
+ *           free_dir_cache
+ *
+ * dir_cache_section must be held by caller.
+ */
+static void free_dir_cache( struct dir_cache *cache, BOOL watch_removed )
+{
+    unsigned int i;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    if (cache->wd != -1 && !watch_removed) inotify_rm_watch( dir_cache_inotify_fd, cache->wd );
+#endif
+    for (i = 0; i < cache->hash_size; i++)
+    {
+        struct dir_cache_name *name, *next;
+        for (name = cache->hash[i]; name; name = next)
+        {
+            next = name->next;
+            RtlFreeHeap( GetProcessHeap(), 0, name );
+        }
+    }
+    list_remove( &cache->entry );
+    dir_cache_count--;
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/***********************************************************************
+ *           process_dir_cache_events
+ *
+ * Drop the cached directories that have been modified since the last call.
+ * dir_cache_section must be held by caller.
+ */
+static void process_dir_cache_events(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    union
+    {
+        struct inotify_event event;
+        char data[4096];
+    } buffer;
+    struct inotify_event *event;
+    struct dir_cache *cache, *next;
+    ssize_t size, offset;
+
+    if (dir_cache_inotify_fd == -2)
+    {
+        if ((dir_cache_inotify_fd = inotify_init()) != -1)
+        {
+            fcntl( dir_cache_inotify_fd, F_SETFD, FD_CLOEXEC );
+            fcntl( dir_cache_inotify_fd, F_SETFL, O_NONBLOCK );
+        }
+        else WARN( "inotify not available, errno %d\n", errno );
+    }
+    if (dir_cache_inotify_fd == -1) return;
+
+    while ((size = read( dir_cache_inotify_fd, &buffer, sizeof(buffer) )) > 0)
+    {
+        for (offset = 0; offset < size; offset += sizeof(*event) + event->len)
+        {
+            event = (struct inotify_event *)(buffer.data + offset);
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                /* events have been lost, we can't tell which directories changed */
+                TRACE( "event queue overflow, dropping all cached directories\n" );
+                LIST_FOR_EACH_ENTRY_SAFE( cache, next, &dir_cache_list, struct dir_cache, entry )
+                    free_dir_cache( cache, FALSE );
+                continue;
+            }
+            LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+            {
+                if (cache->wd != event->wd) continue;
+                TRACE( "dropping cache for %x:%x\n", (int)cache->id.dev, (int)cache->id.ino );
+                free_dir_cache( cache, (event->mask & IN_IGNORED) != 0 );
+                break;
+            }
+        }
+    }
+#else
+    dir_cache_inotify_fd = -1;
+#endif
+}
+
+/***********************************************************************
+ *           create_dir_cache
+ *
+ * Read a directory and index its names. Returns NULL if the directory
+ * cannot be cached. dir_cache_section must be held by caller.
+ */
+static struct dir_cache *create_dir_cache( const char *unix_name, const struct stat *st )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name *name, **names = NULL;
+    struct dir_cache *cache;
+    unsigned int i, size = 0, hash;
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    struct stat dir_st;
+    struct dirent *de;
+    DIR *dir;
+    int len, unix_len;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*cache) ))) return NULL;
+    cache->id.dev = st->st_dev;
+    cache->id.ino = st->st_ino;
+    cache->wd = -1;
+    cache->count = 0;
+    cache->hash_size = 0;
+    cache->hash = NULL;
+    list_add_head( &dir_cache_list, &cache->entry );
+    dir_cache_count++;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    /* the watch is added before reading, so that no modification can be missed */
+    if (dir_cache_inotify_fd != -1)
+        cache->wd = inotify_add_watch( dir_cache_inotify_fd, unix_name,
+                                       IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                       IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+#endif
+
+    if (!(dir = opendir( unix_name ))) goto failed;
+
+    str.Buffer = buffer;
+    str.MaximumLength = sizeof(buffer);
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (len < 0) continue;
+        unix_len = strlen( de->d_name ) + 1;
+
+        if (cache->count == size)
+        {
+            struct dir_cache_name **new_names;
+            size = max( 64, size * 2 );
+            if (names) new_names = RtlReAllocateHeap( GetProcessHeap(), 0, names, size * sizeof(*names) );
+            else new_names = RtlAllocateHeap( GetProcessHeap(), 0, size * sizeof(*names) );
+            if (!new_names) break;
+            names = new_names;
+        }
+
+        if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct dir_cache_name, name[len] ) +
+                                      unix_len )))
+            break;
+        name->index = cache->count;
+        name->len = len;
+        memcpy( name->name, buffer, len * sizeof(WCHAR) );
+        name->unix_name = (char *)&name->name[len];
+        memcpy( name->unix_name, de->d_name, unix_len );
+
+        str.Length = len * sizeof(WCHAR);
+        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+            name->short_len = hash_short_file_name( &str, name->short_name );
+        else
+            name->short_len = 0;
+
+        names[cache->count++] = name;
+    }
+    if (de)
+    {
+        closedir( dir );
+        goto failed;
+    }
+
+    /* make sure the directory didn't change while we were reading it */
+    if (fstat( dirfd( dir ), &dir_st ) == -1 || !is_same_file( &cache->id, &dir_st ) ||
+        dir_st.st_mtime != st->st_mtime || get_mtime_nsec( &dir_st ) != get_mtime_nsec( st ))
+    {
+        closedir( dir );
+        goto failed;
+    }
+    closedir( dir );
+    cache->mtime = st->st_mtime;
+    cache->mtime_nsec = get_mtime_nsec( st );
+
+    /* without notifications, a modification in the same clock tick would go unnoticed */
+    if (cache->wd == -1 && cache->mtime >= time( NULL ) - 1) goto failed;
+
+    for (cache->hash_size = 16; cache->hash_size < cache->count; cache->hash_size *= 2) ;
+    if (!(cache->hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                         2 * cache->hash_size * sizeof(*cache->hash) )))
+        goto failed;
+    cache->short_hash = cache->hash + cache->hash_size;
+
+    /* insert in reverse order, so that the first name in each bucket is the first one in the directory */
+    for (i = cache->count; i > 0; i--)
+    {
+        name = names[i - 1];
+        hash = hash_dir_cache_name( name->name, name->len ) & (cache->hash_size - 1);
+        name->next = cache->hash[hash];
+        cache->hash[hash] = name;
+        name->next_short = NULL;
+        if (!name->short_len) continue;
+        hash = hash_dir_cache_name( name->short_name, name->short_len ) & (cache->hash_size - 1);
+        name->next_short = cache->short_hash[hash];
+        cache->short_hash[hash] = name;
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, names );
+
+    TRACE( "cached %u names for %s\n", cache->count, debugstr_a(unix_name) );
+    return cache;
+
+failed:
+    if (!cache->hash)
+    {
+        for (i = 0; i < cache->count; i++) RtlFreeHeap( GetProcessHeap(), 0, names[i] );
+        cache->hash_size = 0;
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, names );
+    free_dir_cache( cache, FALSE );
+    return NULL;
+}
+
+/***********************************************************************
+ *           find_file_in_dir_cache
+ *
+ * Look for a file in the cached listing of a directory. The directory
+ * name is in unix_name, the file found is appended to it at pos.
+ * Returns 1 if found, 0 if not found, -1 if the cache cannot be used.
+ */
+static int find_file_in_dir_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                   BOOLEAN check_short )
+{
+    struct dir_cache_name *entry, *found = NULL;
+    struct dir_cache *cache;
+    unsigned int hash;
+    struct stat st;
+    int ret = -1;
+
+    RtlEnterCriticalSection( &dir_cache_section );
+
+    process_dir_cache_events();
+    if (stat( unix_name, &st ) == -1) goto done;
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (!is_same_file( &cache->id, &st )) continue;
+        if (cache->mtime == st.st_mtime && cache->mtime_nsec == get_mtime_nsec( &st ))
+        {
+            list_remove( &cache->entry );
+            list_add_head( &dir_cache_list, &cache->entry );
+            goto lookup;
+        }
+        free_dir_cache( cache, FALSE );
+        break;
+    }
+
+    if (dir_cache_count >= DIR_CACHE_MAX_DIRS)
+        free_dir_cache( LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry ), FALSE );
+    if (!(cache = create_dir_cache( unix_name, &st ))) goto done;
+
+lookup:
+    hash = hash_dir_cache_name( name, length ) & (cache->hash_size - 1);
+    for (entry = cache->hash[hash]; entry; entry = entry->next)
+    {
+        if (entry->len != length || memicmpW( entry->name, name, length )) continue;
+        found = entry;
+        break;
+    }
+    if (check_short)
+    {
+        for (entry = cache->short_hash[hash]; entry; entry = entry->next_short)
+        {
+            if (found && found->index < entry->index) break;
+            if (entry->short_len != length || memicmpW( entry->short_name, name, length )) continue;
+            found = entry;
+            break;
+        }
+    }
+
+    if (found)
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, found->unix_name );
+        ret = 1;
+    }
+    else ret = 0;
+
+done:
+    RtlLeaveCriticalSection( &dir_cache_section );
+    return ret;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2310,6 +2659,12 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+    switch (find_file_in_dir_cache( unix_name, pos, name, length, is_name_8_dot_3 ))
+    {
+    case 1: goto success;
+    case 0: goto not_found;
+    }
+
     if (!(dir = opendir( unix_name )))
     {
         if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
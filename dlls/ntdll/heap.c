@@ -43,6 +43,7 @@
 #include "ntdll_misc.h"
 #include "wine/list.h"
 #include "wine/debug.h"
+#include "wine/heap.h"
 #include "wine/server.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
@@ -86,6 +87,7 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c    /* block cached in the low-fragmentation front end */
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -121,6 +123,8 @@ static const SIZE_T HEAP_freeListSizes[] =
 };
 #define HEAP_NB_FREE_LISTS  (sizeof(HEAP_freeListSizes)/sizeof(HEAP_freeListSizes[0]))
 
+C_ASSERT( HEAP_NB_FREE_LISTS == HEAP_WINE_NB_FREE_LISTS );
+
 typedef union
 {
     ARENA_FREE  arena;
@@ -143,6 +147,50 @@ typedef struct tagSUBHEAP
 
 #define SUBHEAP_MAGIC    ((DWORD)('S' | ('U'<<8) | ('B'<<16) | ('H'<<24)))
 
+/* Low-fragmentation front end: small blocks are cached per size class in a
+ * set of slots selected by thread id, so that most allocations and frees
+ * don't need to take the heap critical section. Cached blocks stay in-use
+ * arenas from the point of view of the free lists. */
+
+#define LFH_MAX_BLOCK_SIZE   0x400   /* largest block size handled by the front end */
+#define LFH_NB_CLASSES       (LFH_MAX_BLOCK_SIZE / ALIGNMENT + 1)
+#define LFH_NB_SLOTS         16      /* number of thread slots, must be a power of 2 */
+#define LFH_MAX_DEPTH        32      /* max number of cached blocks per size class and slot */
+#define LFH_BATCH_SIZE       8       /* number of blocks carved at once when refilling a class */
+
+struct lfh_bin
+{
+    ARENA_INUSE        *head;       /* first cached block, linked through the block data */
+    DWORD               count;      /* number of cached blocks */
+};
+
+struct lfh_slot
+{
+    LONG                lock;       /* try-lock, contention falls back to the main heap */
+    ULONGLONG           alloc_count; /* allocations served by this slot */
+    ULONGLONG           free_count;  /* frees absorbed by this slot */
+    struct lfh_bin      bins[LFH_NB_CLASSES];
+};
+
+struct heap_stats
+{
+    ULONGLONG           alloc_count;   /* allocations served by the main heap */
+    ULONGLONG           free_count;    /* frees done by the main heap */
+    ULONGLONG           realloc_count;
+    ULONGLONG           failed_count;
+    ULONGLONG           large_count;   /* large blocks allocated */
+    LONG                sample_pos;    /* allocation counter for call site sampling */
+};
+
+#define HEAP_NB_SAMPLES      256     /* size of the call site sample table */
+
+struct heap_sample
+{
+    void               *caller;     /* return address of the allocation call */
+    SIZE_T              max_size;   /* upper limit of the size class */
+    ULONG               count;      /* number of samples */
+};
+
 typedef struct tagHEAP
 {
     DWORD_PTR        unknown1[2];
@@ -159,6 +207,9 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    struct lfh_slot *lfh;           /* Low-fragmentation front end slots, if enabled */
+    struct heap_stats stats;        /* Allocation statistics */
+    struct heap_sample *samples;    /* Allocation call site samples, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -167,6 +218,12 @@ typedef struct tagHEAP
 #define COMMIT_MASK          0xffff  /* bitmask for commit/decommit granularity */
 #define MAX_FREE_PENDING     1024    /* max number of free requests to delay */
 
+#ifdef __GNUC__
+#define HEAP_CALLER()        __builtin_return_address(0)
+#else
+#define HEAP_CALLER()        NULL
+#endif
+
 /* some undocumented flags (names are made up) */
 #define HEAP_PAGE_ALLOCS      0x01000000
 #define HEAP_VALIDATE         0x10000000
@@ -175,6 +232,9 @@ typedef struct tagHEAP
 
 static HEAP *processHeap;  /* main process heap */
 
+static BOOL heap_stats_dump;     /* dump the heap statistics at process exit */
+static ULONG heap_sample_rate;   /* sample one allocation call site out of this many, 0 to disable */
+
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
 
 /* mark a block of memory as free for debugging purposes */
@@ -290,7 +350,8 @@ static void subheap_notify_free_all(SUBHEAP const *subheap)
         {
             ARENA_INUSE const *pArena = (ARENA_INUSE const *)ptr;
             if (pArena->magic == ARENA_INUSE_MAGIC) notify_free(pArena + 1);
-            else if (pArena->magic != ARENA_PENDING_MAGIC) ERR("bad inuse_magic @%p\n", pArena);
+            else if (pArena->magic != ARENA_PENDING_MAGIC && pArena->magic != ARENA_LFH_MAGIC)
+                ERR("bad inuse_magic @%p\n", pArena);
             ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
         }
     }
@@ -661,7 +722,8 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
     /* Free the whole sub-heap if it's empty and not the original one */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) &&
+        !subheap->heap->lfh)  /* the front end walks the list without locking */
     {
         void *addr = subheap->base;
 
@@ -729,6 +791,7 @@ static void *allocate_large_block( HEAP *heap, DWORD flags, SIZE_T size )
     arena->magic = ARENA_LARGE_MAGIC;
     mark_block_tail( (char *)(arena + 1) + size, block_size - sizeof(*arena) - size, flags );
     list_add_tail( &heap->large_list, &arena->entry );
+    heap->stats.large_count++;
     notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
     return arena + 1;
 }
@@ -905,7 +968,11 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->commitSize = commitSize;
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
-        list_add_head( &heap->subheap_list, &subheap->entry );
+        /* publish the entry last, the front end may be walking the list */
+        subheap->entry.next = heap->subheap_list.next;
+        subheap->entry.prev = &heap->subheap_list;
+        heap->subheap_list.next->prev = &subheap->entry;
+        interlocked_xchg_ptr( (void **)&heap->subheap_list.next, &subheap->entry );
     }
     else
     {
@@ -1048,6 +1115,193 @@ static ARENA_FREE *HEAP_FindFreeBlock( HEAP *heap, SIZE_T size,
 }
 
 
+/***********************************************************************
+ *           allocate_small_block
+ *
+ * Allocate an in-use block from the free lists. The heap must be locked.
+ */
+static ARENA_INUSE *allocate_small_block( HEAP *heap, SIZE_T rounded_size )
+{
+    ARENA_FREE *pArena;
+    ARENA_INUSE *pInUse;
+    SUBHEAP *subheap;
+
+    if (!(pArena = HEAP_FindFreeBlock( heap, rounded_size, &subheap ))) return NULL;
+
+    /* Remove the arena from the free list */
+
+    list_remove( &pArena->entry );
+
+    /* Build the in-use arena */
+
+    pInUse = (ARENA_INUSE *)pArena;
+
+    /* in-use arena is smaller than free arena,
+     * so we have to add the difference to the size */
+    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
+    pInUse->magic = ARENA_INUSE_MAGIC;
+
+    /* Shrink the block */
+
+    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
+    return pInUse;
+}
+
+
+/***********************************************************************
+ *           lfh_get_slot
+ *
+ * Get the front end slot to use for the current thread.
+ */
+static inline struct lfh_slot *lfh_get_slot( HEAP *heap )
+{
+    ULONG tid = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+    return &heap->lfh[(tid >> 2) & (LFH_NB_SLOTS - 1)];
+}
+
+
+/***********************************************************************
+ *           lfh_enable
+ *
+ * Enable the low-fragmentation front end on a heap.
+ */
+static NTSTATUS lfh_enable( HEAP *heap )
+{
+    void *ptr = NULL;
+    SIZE_T size = LFH_NB_SLOTS * sizeof(struct lfh_slot);
+    NTSTATUS status = STATUS_SUCCESS;
+
+    /* the front end bypasses the arena checks, so it can't be used on debug heaps */
+    if (heap->flags & (HEAP_NO_SERIALIZE | HEAP_SHARED | HEAP_PAGE_ALLOCS | HEAP_VALIDATE |
+                       HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED))
+        return STATUS_UNSUCCESSFUL;
+    if (heap->pending_free || RUNNING_ON_VALGRIND) return STATUS_UNSUCCESSFUL;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    if (heap->critSection.RecursionCount > 1) status = STATUS_UNSUCCESSFUL;  /* locked with RtlLockHeap */
+    else if (!heap->lfh &&
+        !(status = NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 4, &size, MEM_COMMIT, PAGE_READWRITE )))
+        heap->lfh = ptr;
+    RtlLeaveCriticalSection( &heap->critSection );
+    TRACE( "heap %p slots %p status %08x\n", heap, heap->lfh, status );
+    return status;
+}
+
+
+/***********************************************************************
+ *           lfh_lock_slots
+ *
+ * Lock all the front end slots, so that no block is allocated or freed
+ * without the heap lock.
+ */
+static void lfh_lock_slots( HEAP *heap )
+{
+    unsigned int i;
+
+    for (i = 0; i < LFH_NB_SLOTS; i++)
+        while (interlocked_cmpxchg( &heap->lfh[i].lock, 1, 0 )) NtYieldExecution();
+}
+
+
+/***********************************************************************
+ *           lfh_unlock_slots
+ */
+static void lfh_unlock_slots( HEAP *heap )
+{
+    unsigned int i;
+
+    for (i = 0; i < LFH_NB_SLOTS; i++) interlocked_xchg( &heap->lfh[i].lock, 0 );
+}
+
+
+/***********************************************************************
+ *           lfh_alloc_block
+ *
+ * Allocate a block from the front end, refilling the size class from the
+ * free lists if it's empty. Returns NULL if the caller should fall back to
+ * the main heap.
+ */
+static ARENA_INUSE *lfh_alloc_block( HEAP *heap, DWORD flags, SIZE_T rounded_size )
+{
+    struct lfh_slot *slot = lfh_get_slot( heap );
+    struct lfh_bin *bin = &slot->bins[rounded_size / ALIGNMENT];
+    ARENA_INUSE *arena;
+    unsigned int i;
+
+    if (interlocked_cmpxchg( &slot->lock, 1, 0 )) return NULL;
+
+    if (!bin->head)
+    {
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heap->critSection );
+        for (i = 0; i < LFH_BATCH_SIZE; i++)
+        {
+            if (!(arena = allocate_small_block( heap, rounded_size ))) break;
+            if ((arena->size & ARENA_SIZE_MASK) / ALIGNMENT != rounded_size / ALIGNMENT)
+            {
+                /* the block couldn't be split to the class size, give it back */
+                HEAP_MakeInUseBlockFree( HEAP_FindSubHeap( heap, arena ), arena );
+                break;
+            }
+            arena->magic = ARENA_LFH_MAGIC;
+            *(ARENA_INUSE **)(arena + 1) = bin->head;
+            bin->head = arena;
+            bin->count++;
+        }
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heap->critSection );
+    }
+
+    if ((arena = bin->head))
+    {
+        bin->head = *(ARENA_INUSE **)(arena + 1);
+        bin->count--;
+        arena->magic = ARENA_INUSE_MAGIC;
+        slot->alloc_count++;
+    }
+    interlocked_xchg( &slot->lock, 0 );
+    return arena;
+}
+
+
+/***********************************************************************
+ *           lfh_free_block
+ *
+ * Return a block to the front end. Returns FALSE if the caller should
+ * free it through the main heap instead.
+ */
+static BOOL lfh_free_block( HEAP *heap, ARENA_INUSE *arena )
+{
+    struct lfh_slot *slot;
+    struct lfh_bin *bin;
+    SIZE_T size;
+    BOOL ret = FALSE;
+
+    if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET) return FALSE;
+    if (arena->magic != ARENA_INUSE_MAGIC || (arena->size & ARENA_FLAG_FREE)) return FALSE;
+    size = arena->size & ARENA_SIZE_MASK;
+    if (size > LFH_MAX_BLOCK_SIZE) return FALSE;
+
+    /* subheaps are never released once the front end is enabled, so the list
+     * can be walked without the heap lock */
+    if (!HEAP_FindSubHeap( heap, arena )) return FALSE;
+
+    slot = lfh_get_slot( heap );
+    if (interlocked_cmpxchg( &slot->lock, 1, 0 )) return FALSE;
+
+    bin = &slot->bins[size / ALIGNMENT];
+    if (bin->count < LFH_MAX_DEPTH)
+    {
+        arena->magic = ARENA_LFH_MAGIC;
+        *(ARENA_INUSE **)(arena + 1) = bin->head;
+        bin->head = arena;
+        bin->count++;
+        slot->free_count++;
+        ret = TRUE;
+    }
+    interlocked_xchg( &slot->lock, 0 );
+    return ret;
+}
+
+
 /***********************************************************************
  *           HEAP_IsValidArenaPtr
  *
@@ -1204,7 +1458,8 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
     }
 
     /* Check magic number */
-    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC)
+    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC &&
+        pArena->magic != ARENA_LFH_MAGIC)
     {
         if (quiet == NOISY) {
             ERR("Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, pArena->magic, pArena );
@@ -1419,7 +1674,7 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_LFH_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
     else if (arena->magic != ARENA_INUSE_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
@@ -1520,6 +1775,207 @@ void heap_set_debug_flags( HANDLE handle )
 }
 
 
+/***********************************************************************
+ *           heap_init_statistics
+ *
+ * Setting WINEHEAPSTATS in the environment enables the statistics dump at
+ * process exit; a non-zero value N also samples one allocation out of N.
+ */
+static void heap_init_statistics(void)
+{
+    const char *str = getenv( "WINEHEAPSTATS" );
+
+    if (!str) return;
+    heap_stats_dump = TRUE;
+    heap_sample_rate = strtoul( str, NULL, 0 );
+}
+
+
+/***********************************************************************
+ *           heap_get_statistics
+ *
+ * Gather the statistics of a heap. The heap must be locked.
+ */
+static void heap_get_statistics( HEAP *heap, HEAP_WINE_STATISTICS *info )
+{
+    SUBHEAP *subheap;
+    ARENA_LARGE *large;
+    unsigned int i;
+
+    memset( info, 0, sizeof(*info) );
+    info->AllocCount      = heap->stats.alloc_count;
+    info->FreeCount       = heap->stats.free_count;
+    info->ReallocCount    = heap->stats.realloc_count;
+    info->FailedCount     = heap->stats.failed_count;
+    info->LargeAllocCount = heap->stats.large_count;
+    if (heap->critSection.DebugInfo) info->ContentionCount = heap->critSection.DebugInfo->ContentionCount;
+
+    if (heap->lfh)
+    {
+        for (i = 0; i < LFH_NB_SLOTS; i++)
+        {
+            info->AllocCount += heap->lfh[i].alloc_count;
+            info->FreeCount  += heap->lfh[i].free_count;
+        }
+    }
+
+    for (i = 0; i < HEAP_NB_FREE_LISTS; i++) info->FreeListMaxSize[i] = HEAP_freeListSizes[i];
+
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+    {
+        char *ptr = (char *)subheap->base + subheap->headerSize;
+
+        info->SubHeapCount++;
+        info->ReservedSize  += subheap->size;
+        info->CommittedSize += subheap->commitSize;
+        while (ptr < (char *)subheap->base + subheap->size)
+        {
+            if (*(DWORD *)ptr & ARENA_FLAG_FREE)
+            {
+                ARENA_FREE *pArena = (ARENA_FREE *)ptr;
+                SIZE_T size = pArena->size & ARENA_SIZE_MASK;
+
+                i = get_freelist_index( size + sizeof(*pArena) );
+                info->FreeBlocks++;
+                info->FreeSize += size;
+                info->FreeListBlocks[i]++;
+                info->FreeListBytes[i] += size;
+                ptr += sizeof(*pArena) + size;
+            }
+            else
+            {
+                ARENA_INUSE *pArena = (ARENA_INUSE *)ptr;
+                SIZE_T size = pArena->size & ARENA_SIZE_MASK;
+
+                if (pArena->magic == ARENA_INUSE_MAGIC)
+                {
+                    info->InUseBlocks++;
+                    info->InUseSize += size;
+                }
+                else  /* pending or front end block */
+                {
+                    info->CachedBlocks++;
+                    info->CachedSize += size;
+                }
+                ptr += sizeof(*pArena) + size;
+            }
+        }
+    }
+
+    LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+    {
+        info->LargeBlocks++;
+        info->InUseBlocks++;
+        info->InUseSize += large->data_size;
+        info->CommittedSize += large->block_size;
+    }
+}
+
+
+/***********************************************************************
+ *           heap_sample_alloc
+ *
+ * Record the call site of an allocation, if it's selected for sampling.
+ */
+static void heap_sample_alloc( HEAP *heap, DWORD flags, SIZE_T size, void *caller )
+{
+    unsigned int i, index, pos;
+
+    if ((ULONG)interlocked_xchg_add( &heap->stats.sample_pos, 1 ) % heap_sample_rate) return;
+
+    for (index = 0; index < HEAP_NB_FREE_LISTS - 1; index++) if (size <= HEAP_freeListSizes[index]) break;
+    pos = ((ULONG_PTR)caller >> 2) + index * 17;
+
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heap->critSection );
+    for (i = 0; i < HEAP_NB_SAMPLES; i++)
+    {
+        struct heap_sample *sample = &heap->samples[(pos + i) % HEAP_NB_SAMPLES];
+
+        if (!sample->count)
+        {
+            sample->caller = caller;
+            sample->max_size = HEAP_freeListSizes[index];
+        }
+        else if (sample->caller != caller || sample->max_size != HEAP_freeListSizes[index]) continue;
+        sample->count++;
+        break;
+    }
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heap->critSection );
+}
+
+
+static int compare_samples( const void *p1, const void *p2 )
+{
+    const struct heap_sample *s1 = p1, *s2 = p2;
+
+    if (s1->count != s2->count) return s1->count < s2->count ? 1 : -1;
+    return 0;
+}
+
+/***********************************************************************
+ *           dump_heap_statistics
+ */
+static void dump_heap_statistics( HEAP *heap )
+{
+    HEAP_WINE_STATISTICS info;
+    struct heap_sample samples[HEAP_NB_SAMPLES];
+    unsigned int i, count = 0;
+
+    /* other threads are gone at this point, and may have left the heap locked */
+    if (!RtlTryEnterCriticalSection( &heap->critSection ))
+    {
+        MESSAGE( "heap %p: locked, no statistics available\n", heap );
+        return;
+    }
+    heap_get_statistics( heap, &info );
+    if (heap->samples)
+    {
+        for (i = 0; i < HEAP_NB_SAMPLES; i++)
+            if (heap->samples[i].count) samples[count++] = heap->samples[i];
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+
+    MESSAGE( "heap %p: allocs %s frees %s reallocs %s failed %s large %s contention %u\n", heap,
+             wine_dbgstr_longlong( info.AllocCount ), wine_dbgstr_longlong( info.FreeCount ),
+             wine_dbgstr_longlong( info.ReallocCount ), wine_dbgstr_longlong( info.FailedCount ),
+             wine_dbgstr_longlong( info.LargeAllocCount ), info.ContentionCount );
+    MESSAGE( "heap %p: %u sub-heaps reserved %08lx committed %08lx\n",
+             heap, info.SubHeapCount, info.ReservedSize, info.CommittedSize );
+    MESSAGE( "heap %p: in use %08lx (%u blocks, %u large) free %08lx (%u blocks) cached %08lx (%u blocks)\n",
+             heap, info.InUseSize, info.InUseBlocks, info.LargeBlocks,
+             info.FreeSize, info.FreeBlocks, info.CachedSize, info.CachedBlocks );
+    for (i = 0; i < HEAP_NB_FREE_LISTS; i++)
+    {
+        if (!info.FreeListBlocks[i]) continue;
+        MESSAGE( "heap %p: free list %08lx: %u blocks %08lx bytes\n",
+                 heap, info.FreeListMaxSize[i], info.FreeListBlocks[i], info.FreeListBytes[i] );
+    }
+
+    qsort( samples, count, sizeof(samples[0]), compare_samples );
+    for (i = 0; i < min( count, 32 ); i++)
+        MESSAGE( "heap %p: caller %p size <= %08lx: %u samples\n",
+                 heap, samples[i].caller, samples[i].max_size, samples[i].count );
+}
+
+
+/***********************************************************************
+ *           heap_dump_statistics
+ *
+ * Dump the statistics of all heaps at process exit, if requested.
+ */
+void heap_dump_statistics(void)
+{
+    struct list *ptr;
+
+    if (!heap_stats_dump || !processHeap) return;
+
+    MESSAGE( "heap statistics for process %04x\n", GetCurrentProcessId() );
+    dump_heap_statistics( processHeap );
+    LIST_FOR_EACH( ptr, &processHeap->entry )
+        dump_heap_statistics( LIST_ENTRY( ptr, HEAP, entry ));
+}
+
+
 /***********************************************************************
  *           RtlCreateHeap   (NTDLL.@)
  *
@@ -1550,10 +2006,21 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, PVOID addr, SIZE_T totalSize, SIZE_T c
         flags |= HEAP_GROWABLE;
     }
 
+    if (!processHeap) heap_init_statistics();
+
     if (!(subheap = HEAP_CreateSubHeap( NULL, addr, flags, commitSize, totalSize ))) return 0;
 
     heap_set_debug_flags( subheap->heap );
 
+    if (heap_sample_rate)
+    {
+        void *ptr = NULL;
+        SIZE_T size = HEAP_NB_SAMPLES * sizeof(struct heap_sample);
+
+        if (!NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 4, &size, MEM_COMMIT, PAGE_READWRITE ))
+            subheap->heap->samples = ptr;
+    }
+
     /* link it into the per-process heap list */
     if (processHeap)
     {
@@ -1628,6 +2095,18 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
         addr = heapPtr->pending_free;
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
     }
+    if (heapPtr->lfh)
+    {
+        size = 0;
+        addr = heapPtr->lfh;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
+    if (heapPtr->samples)
+    {
+        size = 0;
+        addr = heapPtr->samples;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
     size = 0;
     addr = heapPtr->subheap.base;
     NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -1654,9 +2133,7 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
  */
 PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 {
-    ARENA_FREE *pArena;
     ARENA_INUSE *pInUse;
-    SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SIZE_T rounded_size;
 
@@ -1673,11 +2150,19 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->samples) heap_sample_alloc( heapPtr, flags, size, HEAP_CALLER() );
+
+    if (heapPtr->lfh && rounded_size <= LFH_MAX_BLOCK_SIZE &&
+        (pInUse = lfh_alloc_block( heapPtr, flags, rounded_size )))
+        goto done;
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
     {
         void *ret = allocate_large_block( heap, flags, size );
+        if (ret) heapPtr->stats.alloc_count++;
+        else heapPtr->stats.failed_count++;
         if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
@@ -1686,38 +2171,25 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 
     /* Locate a suitable free block */
 
-    if (!(pArena = HEAP_FindFreeBlock( heapPtr, rounded_size, &subheap )))
+    if (!(pInUse = allocate_small_block( heapPtr, rounded_size )))
     {
         TRACE("(%p,%08x,%08lx): returning NULL\n",
                   heap, flags, size  );
+        heapPtr->stats.failed_count++;
         if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
         return NULL;
     }
 
-    /* Remove the arena from the free list */
-
-    list_remove( &pArena->entry );
-
-    /* Build the in-use arena */
-
-    pInUse = (ARENA_INUSE *)pArena;
-
-    /* in-use arena is smaller than free arena,
-     * so we have to add the difference to the size */
-    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
-    pInUse->magic = ARENA_INUSE_MAGIC;
-
-    /* Shrink the block */
+    heapPtr->stats.alloc_count++;
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
 
-    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
+done:
     pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
 
     notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
     initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
 
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
-
     TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
     return pInUse + 1;
 }
@@ -1756,19 +2228,27 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    pInUse  = (ARENA_INUSE *)ptr - 1;
+    if (heapPtr->lfh && lfh_free_block( heapPtr, pInUse ))
+    {
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
     /* Some sanity checks */
-    pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
     if (!subheap)
         free_large_block( heapPtr, flags, ptr );
     else
         HEAP_MakeInUseBlockFree( subheap, pInUse );
+    heapPtr->stats.free_count++;
 
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
@@ -1911,11 +2391,13 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     ret = pArena + 1;
 done:
+    heapPtr->stats.realloc_count++;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
     return ret;
 
 oom:
+    heapPtr->stats.failed_count++;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
     RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
@@ -1969,6 +2451,9 @@ BOOLEAN WINAPI RtlLockHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
+    /* the slots are taken first, a thread refilling a slot holds it while waiting for the heap lock */
+    if (heapPtr->lfh && heapPtr->critSection.OwningThread != ULongToHandle(GetCurrentThreadId()))
+        lfh_lock_slots( heapPtr );
     RtlEnterCriticalSection( &heapPtr->critSection );
     return TRUE;
 }
@@ -1990,6 +2475,7 @@ BOOLEAN WINAPI RtlUnlockHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
+    if (heapPtr->lfh && heapPtr->critSection.RecursionCount == 1) lfh_unlock_slots( heapPtr );
     RtlLeaveCriticalSection( &heapPtr->critSection );
     return TRUE;
 }
@@ -2123,7 +2609,8 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         }
 
         if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2171,8 +2658,9 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->lpData = pArena + 1;
         entry->cbData = pArena->size & ARENA_SIZE_MASK;
         entry->cbOverhead = sizeof(ARENA_INUSE);
-        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
-                        PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
+        if (pArena->magic == ARENA_LFH_MAGIC) entry->wFlags = 0;  /* free block */
+        else entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
+                             PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
         /* FIXME: can't handle PROCESS_HEAP_ENTRY_MOVEABLE
         and PROCESS_HEAP_ENTRY_DDESHARE yet */
     }
@@ -2236,7 +2724,9 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
-    switch (info_class)
+    HEAP *heapPtr;
+
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
         if (size_out) *size_out = sizeof(ULONG);
@@ -2244,9 +2734,56 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0; /* low-fragmentation or standard heap */
+        return STATUS_SUCCESS;
+
+    case HeapWineStatistics:
+        if (size_out) *size_out = sizeof(HEAP_WINE_STATISTICS);
+
+        if (size_in < sizeof(HEAP_WINE_STATISTICS))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+        heap_get_statistics( heapPtr, info );
+        if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         return STATUS_SUCCESS;
 
+    case HeapWineAllocationSamples:
+    {
+        HEAP_WINE_ALLOCATION_SAMPLES *samples = info;
+        NTSTATUS status = STATUS_SUCCESS;
+        ULONG i, count = 0;
+        SIZE_T needed;
+
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+
+        if (heapPtr->samples)
+            for (i = 0; i < HEAP_NB_SAMPLES; i++) if (heapPtr->samples[i].count) count++;
+
+        needed = FIELD_OFFSET( HEAP_WINE_ALLOCATION_SAMPLES, Samples[count] );
+        if (size_out) *size_out = needed;
+        if (size_in < needed) status = STATUS_BUFFER_TOO_SMALL;
+        else
+        {
+            samples->SampleRate = heapPtr->samples ? heap_sample_rate : 0;
+            samples->Count = 0;
+            for (i = 0; i < HEAP_NB_SAMPLES && samples->Count < count; i++)
+            {
+                if (!heapPtr->samples[i].count) continue;
+                samples->Samples[samples->Count].Caller  = heapPtr->samples[i].caller;
+                samples->Samples[samples->Count].MaxSize = heapPtr->samples[i].max_size;
+                samples->Samples[samples->Count].Count   = heapPtr->samples[i].count;
+                samples->Count++;
+            }
+        }
+
+        if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        return status;
+    }
+
     default:
         FIXME("Unknown heap information class %u\n", info_class);
         return STATUS_INVALID_INFO_CLASS;
@@ -2258,6 +2795,27 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* the front end can't be disabled once enabled */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:
+            return lfh_enable( heapPtr );
+        default:
+            WARN( "%p: unsupported heap type %u\n", heap, *(ULONG *)info );
+            return STATUS_INVALID_PARAMETER;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
@@ -732,8 +732,9 @@ NTSTATUS WINAPI NtSaveKey(IN HANDLE KeyHandle, IN HANDLE FileHandle)
 
     SERVER_START_REQ( save_registry )
     {
-        req->hkey = wine_server_obj_handle( KeyHandle );
-        req->file = wine_server_obj_handle( FileHandle );
+        req->hkey  = wine_server_obj_handle( KeyHandle );
+        req->file  = wine_server_obj_handle( FileHandle );
+        req->flags = REG_STANDARD_FORMAT;
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
@@ -26,12 +26,14 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winternl.h"
 #include "wine/exception.h"
+#include "wine/list.h"
 #include "ntdll_misc.h"
 #include "wine/unicode.h"
 #include "wine/debug.h"
@@ -324,6 +326,315 @@ static void print_timestamp(void)
     DPRINTF( "%3u.%03u:", ticks / 1000, ticks % 1000 );
 }
 
+/* relay statistics */
+
+#define RELAY_STATS_DEPTH  256  /* max number of nested calls timed per thread */
+
+struct relay_call_stats
+{
+    struct relay_private_data *data;      /* dll of the called function */
+    unsigned int               ordinal;   /* ordinal of the called function, without base */
+    const void                *caller;    /* return address of the call */
+    ULONGLONG                  count;     /* number of calls */
+    ULONGLONG                  ticks;     /* inclusive time spent in the function */
+};
+
+struct relay_stats_frame
+{
+    const INT_PTR           *stack;       /* stack pointer of the call */
+    struct relay_call_stats *stats;       /* statistics of the called function */
+    ULONGLONG                start;       /* time of the call */
+};
+
+struct relay_thread_stats
+{
+    struct list              entry;       /* entry in the list of all threads */
+    DWORD                    tid;         /* thread id */
+    unsigned int             count;       /* number of entries in the hash table */
+    unsigned int             size;        /* size of the hash table, a power of 2 */
+    struct relay_call_stats *table;       /* hash table indexed by function and caller */
+    unsigned int             depth;       /* number of pending calls */
+    struct relay_stats_frame frames[RELAY_STATS_DEPTH];
+};
+
+static int relay_stats_limit = -1;        /* number of report lines, 0 for all, -1 when disabled */
+static BOOL relay_stats_checked;          /* whether the environment has been checked already */
+static ULONGLONG relay_stats_start_ticks;
+static LARGE_INTEGER relay_stats_start_time;
+static struct list relay_stats_threads = LIST_INIT( relay_stats_threads );
+
+static RTL_CRITICAL_SECTION relay_stats_section;
+static RTL_CRITICAL_SECTION_DEBUG relay_stats_section_debug =
+{
+    0, 0, &relay_stats_section,
+    { &relay_stats_section_debug.ProcessLocksList, &relay_stats_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": relay_stats_section") }
+};
+static RTL_CRITICAL_SECTION relay_stats_section = { &relay_stats_section_debug, -1, 0, 0, 0, 0 };
+
+static inline ULONGLONG relay_get_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int low, high;
+    __asm__ __volatile__( "rdtsc" : "=a" (low), "=d" (high) );
+    return ((ULONGLONG)high << 32) | low;
+#else
+    LARGE_INTEGER counter;
+    NtQueryPerformanceCounter( &counter, NULL );
+    return counter.QuadPart;
+#endif
+}
+
+/***********************************************************************
+ *           RELAY_InitStatistics
+ *
+ * Setting WINERELAYSTATS in the environment makes the relay thunks count
+ * the calls and the time spent in each function instead of tracing them,
+ * and dumps the result at process exit; a non-zero value N limits the
+ * report to the N most expensive functions.
+ */
+BOOL RELAY_InitStatistics(void)
+{
+    const char *str;
+
+    if (relay_stats_checked) return relay_stats_limit != -1;
+    relay_stats_checked = TRUE;
+    if (!(str = getenv( "WINERELAYSTATS" ))) return FALSE;
+    relay_stats_limit = strtoul( str, NULL, 0 );
+    NtQueryPerformanceCounter( &relay_stats_start_time, NULL );
+    relay_stats_start_ticks = relay_get_ticks();
+    return TRUE;
+}
+
+/* retrieve the statistics of the current thread, allocating them if needed */
+static struct relay_thread_stats *get_relay_thread_stats(void)
+{
+    struct relay_thread_stats *thread = ntdll_get_thread_data()->relay_stats;
+
+    if (thread) return thread;
+    if (!(thread = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*thread) ))) return NULL;
+    thread->tid = GetCurrentThreadId();
+    RtlEnterCriticalSection( &relay_stats_section );
+    list_add_tail( &relay_stats_threads, &thread->entry );
+    RtlLeaveCriticalSection( &relay_stats_section );
+    ntdll_get_thread_data()->relay_stats = thread;
+    return thread;
+}
+
+static inline unsigned int relay_stats_hash( const struct relay_private_data *data,
+                                             unsigned int ordinal, const void *caller )
+{
+    ULONG_PTR hash = (ULONG_PTR)data ^ ordinal ^ ((ULONG_PTR)caller * 0x9e3779b1);
+    return hash ^ (hash >> 16);
+}
+
+/* grow the hash table of a thread; the old table stays valid until the new one is ready */
+static BOOL grow_relay_stats( struct relay_thread_stats *thread )
+{
+    unsigned int i, pos, size = max( 256, thread->size * 2 );
+    struct relay_call_stats *table, *old = thread->table;
+
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*table) )))
+        return FALSE;
+    for (i = 0; i < thread->size; i++)
+    {
+        if (!old[i].data) continue;
+        pos = relay_stats_hash( old[i].data, old[i].ordinal, old[i].caller ) & (size - 1);
+        while (table[pos].data) pos = (pos + 1) & (size - 1);
+        table[pos] = old[i];
+    }
+    thread->table = table;
+    thread->size = size;
+    RtlFreeHeap( GetProcessHeap(), 0, old );
+    return TRUE;
+}
+
+/* find the statistics entry of a function called from a given address */
+static struct relay_call_stats *get_relay_call_stats( struct relay_thread_stats *thread,
+                                                      struct relay_private_data *data,
+                                                      unsigned int ordinal, const void *caller )
+{
+    unsigned int pos;
+
+    if (thread->count * 2 >= thread->size && !grow_relay_stats( thread )) return NULL;
+
+    pos = relay_stats_hash( data, ordinal, caller ) & (thread->size - 1);
+    while (thread->table[pos].data)
+    {
+        struct relay_call_stats *stats = &thread->table[pos];
+        if (stats->data == data && stats->ordinal == ordinal && stats->caller == caller) return stats;
+        pos = (pos + 1) & (thread->size - 1);
+    }
+    thread->table[pos].ordinal = ordinal;
+    thread->table[pos].caller = caller;
+    thread->table[pos].data = data;
+    thread->count++;
+    return &thread->table[pos];
+}
+
+/* count a call and start timing it */
+static void relay_stats_entry( struct relay_private_data *data, unsigned int ordinal,
+                               const INT_PTR *stack, const void *caller )
+{
+    struct relay_thread_stats *thread;
+    struct relay_call_stats *stats;
+    struct relay_stats_frame *frame;
+
+    if (!(thread = get_relay_thread_stats())) return;
+
+    /* frames above the current stack pointer belong to calls that were unwound by an exception */
+    while (thread->depth && thread->frames[thread->depth - 1].stack <= stack) thread->depth--;
+
+    if (!(stats = get_relay_call_stats( thread, data, ordinal, caller ))) return;
+    stats->count++;
+    if (thread->depth == RELAY_STATS_DEPTH) return;
+    frame = &thread->frames[thread->depth++];
+    frame->stack = stack;
+    frame->stats = stats;
+    frame->start = relay_get_ticks();
+}
+
+/* stop timing a call */
+static void relay_stats_exit( const INT_PTR *stack )
+{
+    struct relay_thread_stats *thread = ntdll_get_thread_data()->relay_stats;
+    ULONGLONG now = relay_get_ticks();
+
+    if (!thread) return;
+    while (thread->depth && thread->frames[thread->depth - 1].stack < stack) thread->depth--;
+    if (!thread->depth || thread->frames[thread->depth - 1].stack != stack) return;
+    thread->depth--;
+    thread->frames[thread->depth].stats->ticks += now - thread->frames[thread->depth].start;
+}
+
+/* statistics merged over all threads and call sites of a module */
+struct relay_report_entry
+{
+    struct relay_private_data *data;
+    unsigned int               ordinal;
+    const WCHAR               *caller;    /* name of the calling module */
+    ULONGLONG                  count;
+    ULONGLONG                  ticks;
+};
+
+static int compare_report_function( const void *p1, const void *p2 )
+{
+    const struct relay_report_entry *e1 = p1, *e2 = p2;
+
+    if (e1->data != e2->data) return e1->data < e2->data ? -1 : 1;
+    if (e1->ordinal != e2->ordinal) return e1->ordinal < e2->ordinal ? -1 : 1;
+    if (e1->caller != e2->caller) return e1->caller < e2->caller ? -1 : 1;
+    return 0;
+}
+
+static int compare_report_ticks( const void *p1, const void *p2 )
+{
+    const struct relay_report_entry *e1 = p1, *e2 = p2;
+
+    if (e1->ticks != e2->ticks) return e1->ticks < e2->ticks ? 1 : -1;
+    if (e1->count != e2->count) return e1->count < e2->count ? 1 : -1;
+    return 0;
+}
+
+/***********************************************************************
+ *           RELAY_DumpStatistics
+ *
+ * Print the relay statistics of all threads at process exit, if requested.
+ */
+void RELAY_DumpStatistics(void)
+{
+    static const WCHAR unknownW[] = {'?',0};
+    struct relay_report_entry *report;
+    struct relay_thread_stats *thread;
+    LARGE_INTEGER now, freq;
+    LDR_MODULE *mod;
+    ULONGLONG ticks;
+    double ticks_per_ms;
+    unsigned int i, j, count = 0, threads = 0;
+
+    if (relay_stats_limit == -1) return;
+
+    /* other threads are gone at this point, and may have left the list locked */
+    if (!RtlTryEnterCriticalSection( &relay_stats_section ))
+    {
+        MESSAGE( "relay statistics: locked, no statistics available\n" );
+        return;
+    }
+
+    NtQueryPerformanceCounter( &now, &freq );
+    ticks = relay_get_ticks() - relay_stats_start_ticks;
+    now.QuadPart -= relay_stats_start_time.QuadPart;
+    ticks_per_ms = now.QuadPart ? (double)ticks * freq.QuadPart / now.QuadPart / 1000 : 1;
+
+    LIST_FOR_EACH_ENTRY( thread, &relay_stats_threads, struct relay_thread_stats, entry )
+    {
+        count += thread->count;
+        threads++;
+    }
+    if (!(report = RtlAllocateHeap( GetProcessHeap(), 0, max( count, 1 ) * sizeof(*report) )))
+    {
+        RtlLeaveCriticalSection( &relay_stats_section );
+        return;
+    }
+
+    count = 0;
+    LIST_FOR_EACH_ENTRY( thread, &relay_stats_threads, struct relay_thread_stats, entry )
+    {
+        for (i = 0; i < thread->size; i++)
+        {
+            const struct relay_call_stats *stats = &thread->table[i];
+
+            if (!stats->data) continue;
+            report[count].data    = stats->data;
+            report[count].ordinal = stats->ordinal;
+            report[count].caller  = unknownW;
+            if (!LdrFindEntryForAddress( stats->caller, &mod )) report[count].caller = mod->BaseDllName.Buffer;
+            report[count].count   = stats->count;
+            report[count].ticks   = stats->ticks;
+            count++;
+        }
+    }
+    RtlLeaveCriticalSection( &relay_stats_section );
+
+    /* merge the entries of the same function called from the same module */
+    qsort( report, count, sizeof(*report), compare_report_function );
+    for (i = j = 0; i < count; i++)
+    {
+        if (j && !compare_report_function( &report[j - 1], &report[i] ))
+        {
+            report[j - 1].count += report[i].count;
+            report[j - 1].ticks += report[i].ticks;
+        }
+        else report[j++] = report[i];
+    }
+    count = j;
+    qsort( report, count, sizeof(*report), compare_report_ticks );
+    if (relay_stats_limit) count = min( count, relay_stats_limit );
+
+    MESSAGE( "relay statistics for process %04x (%u threads, %.3f ms)\n", GetCurrentProcessId(),
+             threads, ticks / ticks_per_ms );
+    for (i = 0; i < count; i++)
+    {
+        struct relay_private_data *data = report[i].data;
+        const char *name = NULL;
+
+        /* the function names are stored in the module itself */
+        if (!LdrFindEntryForAddress( data->module, &mod ) && mod->BaseAddress == data->module)
+            name = data->entry_points[report[i].ordinal].name;
+
+        if (name)
+            MESSAGE( "relay: %s.%s from %s: %s calls %.3f ms %.2f us avg\n", data->dllname, name,
+                     debugstr_w(report[i].caller), wine_dbgstr_longlong( report[i].count ),
+                     report[i].ticks / ticks_per_ms, report[i].ticks * 1000 / ticks_per_ms / report[i].count );
+        else
+            MESSAGE( "relay: %s.%u from %s: %s calls %.3f ms %.2f us avg\n", data->dllname,
+                     data->base + report[i].ordinal, debugstr_w(report[i].caller),
+                     wine_dbgstr_longlong( report[i].count ), report[i].ticks / ticks_per_ms,
+                     report[i].ticks * 1000 / ticks_per_ms / report[i].count );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, report );
+}
+
 /***********************************************************************
  *           relay_trace_entry
  *
@@ -336,6 +647,8 @@ void * WINAPI relay_trace_entry( struct relay_descr *descr, unsigned int idx, co
     struct relay_private_data *data = descr->private;
     struct relay_entry_point *entry_point = data->entry_points + ordinal;
 
+    if (relay_stats_limit != -1) relay_stats_entry( data, ordinal, stack, (void *)stack[0] );
+
     if (TRACE_ON(relay))
     {
         if (TRACE_ON(timestamp)) print_timestamp();
@@ -361,6 +674,8 @@ void WINAPI relay_trace_exit( struct relay_descr *descr, unsigned int idx,
     struct relay_private_data *data = descr->private;
     struct relay_entry_point *entry_point = data->entry_points + ordinal;
 
+    if (relay_stats_limit != -1) relay_stats_exit( stack );
+
     if (!TRACE_ON(relay)) return;
 
     if (TRACE_ON(timestamp)) print_timestamp();
@@ -490,6 +805,8 @@ void WINAPI __regs_relay_call_regs( struct relay_descr *descr, unsigned int idx,
     context->Eip = ret_addr;
     context->Esp += nb_args * sizeof(int);
 
+    if (relay_stats_limit != -1) relay_stats_entry( data, ordinal, args - 1, (void *)ret_addr );
+
     if (TRACE_ON(relay))
     {
         if (entry_point->name)
@@ -517,6 +834,8 @@ void WINAPI __regs_relay_call_regs( struct relay_descr *descr, unsigned int idx,
 
     call_entry_point( orig_func + 12 + *(int *)(orig_func + 1), nb_args, args_copy, 0 );
 
+    if (relay_stats_limit != -1) relay_stats_exit( args - 1 );
+
     if (TRACE_ON(relay))
     {
         if (entry_point->name)
@@ -756,6 +1075,15 @@ void RELAY_SetupDLL( HMODULE module )
 {
 }
 
+BOOL RELAY_InitStatistics(void)
+{
+    return FALSE;
+}
+
+void RELAY_DumpStatistics(void)
+{
+}
+
 #endif  /* __i386__ || __x86_64__ || __arm__ */
 
 
@@ -116,6 +116,8 @@ timeout_t server_start_time = 0;  /* time of server startup */
 sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static pid_t server_pid;
+static BOOL use_request_shm = TRUE;   /* whether threads exchange requests through shared memory */
+static int request_shm_spin;     /* number of polls of the shared memory before sleeping on the pipe */
 
 static RTL_CRITICAL_SECTION fd_cache_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -185,6 +187,41 @@ static DECLSPEC_NORETURN void server_protocol_perror( const char *err )
 }
 
 
+/***********************************************************************
+ *           send_shm_request
+ *
+ * Send a request to the server through the thread shared memory; helper for send_request.
+ */
+static unsigned int send_shm_request( struct request_shm *shm, const struct __server_request_info *req )
+{
+    unsigned int i, seq = shm->request_seq + 1;
+    struct iovec vec[__SERVER_MAX_DATA+1];
+    int ret;
+
+    if (!seq) seq = 1;  /* 0 means no request */
+    memcpy( &shm->request, &req->u.req, sizeof(req->u.req) );
+    shm->request_seq = seq;
+
+    /* the data may come from the application, it follows the token on the pipe
+     * so that a bad pointer only makes the write fail with EFAULT */
+    vec[0].iov_base = &seq;
+    vec[0].iov_len = sizeof(seq);
+    for (i = 0; i < req->data_count; i++)
+    {
+        vec[i+1].iov_base = (void *)req->data[i].ptr;
+        vec[i+1].iov_len = req->data[i].size;
+    }
+    if ((ret = writev( ntdll_get_thread_data()->request_fd, vec, i + 1 )) ==
+        sizeof(seq) + req->u.req.request_header.request_size)
+        return STATUS_SUCCESS;
+
+    if (ret >= 0) server_protocol_error( "partial write %d\n", ret );
+    if (errno == EPIPE) abort_thread(0);
+    if (errno == EFAULT) return STATUS_ACCESS_VIOLATION;
+    server_protocol_perror( "write" );
+}
+
+
 /***********************************************************************
  *           send_request
  *
@@ -195,6 +232,9 @@ static unsigned int send_request( const struct __server_request_info *req )
     unsigned int i;
     int ret;
 
+    if (ntdll_get_thread_data()->request_shm)
+        return send_shm_request( ntdll_get_thread_data()->request_shm, req );
+
     if (!req->u.req.request_header.request_size)
     {
         if ((ret = write( ntdll_get_thread_data()->request_fd, &req->u.req,
@@ -250,6 +290,48 @@ static void read_reply_data( void *buffer, size_t size )
 }
 
 
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+/***********************************************************************
+ *           wait_shm_reply
+ *
+ * Wait for a reply in the thread shared memory; helper for wait_reply.
+ */
+static unsigned int wait_shm_reply( struct request_shm *shm, struct __server_request_info *req )
+{
+    volatile unsigned int *reply_seq = &shm->reply_seq;
+    unsigned int token, seq = shm->request_seq;
+    data_size_t size;
+    int i;
+
+    /* the server is often fast enough to make sleeping on the pipe a waste */
+    for (i = 0; i < request_shm_spin && *reply_seq != seq; i++) small_pause();
+
+    /* the server only sends a token if it sees the flag, so either we get it back or we wait */
+    interlocked_xchg( &shm->client_waiting, 1 );
+    if (*reply_seq != seq || !interlocked_xchg( &shm->client_waiting, 0 ))
+    {
+        read_reply_data( &token, sizeof(token) );
+        if (token != seq) server_protocol_error( "bad reply token %u/%u\n", token, seq );
+    }
+
+    memcpy( &req->u.reply, &shm->reply, sizeof(req->u.reply) );
+    if ((size = req->u.reply.reply_header.reply_size))
+    {
+        if (size <= REQUEST_SHM_DATA_SIZE) memcpy( req->reply_data, shm->reply_data, size );
+        else read_reply_data( req->reply_data, size );
+    }
+    return req->u.reply.reply_header.error;
+}
+
+
 /***********************************************************************
  *           wait_reply
  *
@@ -257,6 +339,9 @@ static void read_reply_data( void *buffer, size_t size )
  */
 static inline unsigned int wait_reply( struct __server_request_info *req )
 {
+    if (ntdll_get_thread_data()->request_shm)
+        return wait_shm_reply( ntdll_get_thread_data()->request_shm, req );
+
     read_reply_data( &req->u.reply, sizeof(req->u.reply) );
     if (req->u.reply.reply_header.reply_size)
         read_reply_data( req->reply_data, req->u.reply.reply_header.reply_size );
@@ -795,6 +880,7 @@ struct fd_cache_entry
     enum server_fd_type type : 5;
     unsigned int        access : 3;
     unsigned int        options : 24;
+    unsigned int        comp_flags : 2;
 };
 
 #define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(struct fd_cache_entry))
@@ -817,7 +903,7 @@ static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
  * Caller must hold fd_cache_section.
  */
 static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
-                            unsigned int access, unsigned int options )
+                            unsigned int access, unsigned int options, unsigned int comp_flags )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
     int prev_fd;
@@ -844,6 +930,7 @@ static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
     fd_cache[entry][idx].type = type;
     fd_cache[entry][idx].access = access;
     fd_cache[entry][idx].options = options;
+    fd_cache[entry][idx].comp_flags = comp_flags;
     if (prev_fd != -1) close( prev_fd );
     return TRUE;
 }
@@ -920,8 +1007,8 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
             {
                 assert( wine_server_ptr_handle(fd_handle) == handle );
                 *needs_close = (!reply->cacheable ||
-                                !add_fd_to_cache( handle, fd, reply->type,
-                                                  reply->access, reply->options ));
+                                !add_fd_to_cache( handle, fd, reply->type, reply->access,
+                                                  reply->options, reply->comp_flags ));
             }
             else ret = STATUS_TOO_MANY_OPENED_FILES;
         }
@@ -940,6 +1027,43 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_get_completion_flags
+ *
+ * Return the completion notification modes of a handle, as far as the fd
+ * cache knows them. The server has the final word for uncached handles.
+ */
+unsigned int server_get_completion_flags( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    unsigned int flags = 0;
+    sigset_t sigset;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    if (entry < FD_CACHE_ENTRIES && fd_cache[entry] && fd_cache[entry][idx].fd)
+        flags = fd_cache[entry][idx].comp_flags;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+    return flags;
+}
+
+
+/***********************************************************************
+ *           server_set_completion_flags
+ *
+ * Record completion notification modes just added to a handle.
+ */
+void server_set_completion_flags( HANDLE handle, unsigned int flags )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    sigset_t sigset;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    if (entry < FD_CACHE_ENTRIES && fd_cache[entry] && fd_cache[entry][idx].fd)
+        fd_cache[entry][idx].comp_flags |= flags & (FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE);
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
@@ -1339,6 +1463,7 @@ void server_init_process(void)
 {
     obj_handle_t version;
     const char *env_socket = getenv( "WINESERVERSOCKET" );
+    const char *env_shm = getenv( "WINESERVERSHM" );
 
     server_pid = -1;
     if (env_socket)
@@ -1386,6 +1511,9 @@ void server_init_process(void)
     /* work around Ubuntu's ptrace breakage */
     if (server_pid != -1) prctl( 0x59616d61 /* PR_SET_PTRACER */, server_pid );
 #endif
+
+    if (env_shm && !atoi( env_shm )) use_request_shm = FALSE;
+    if (sysconf( _SC_NPROCESSORS_ONLN ) > 1) request_shm_spin = 2000;
 }
 
 
@@ -1423,6 +1551,48 @@ NTSTATUS server_init_process_done(void)
 }
 
 
+/***********************************************************************
+ *           init_request_shm
+ *
+ * Setup the shared memory used for the server requests of the current thread.
+ */
+static void init_request_shm(void)
+{
+#ifdef __NR_memfd_create
+    struct request_shm *shm;
+    unsigned int status;
+    int fd;
+
+    if (!use_request_shm) return;
+
+    if ((fd = syscall( __NR_memfd_create, "wine-request-shm", 1 /* MFD_CLOEXEC */ )) == -1)
+    {
+        if (errno == ENOSYS) use_request_shm = FALSE;
+        return;
+    }
+    if (ftruncate( fd, REQUEST_SHM_SIZE ) == -1 ||
+        (shm = mmap( NULL, REQUEST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return;
+    }
+
+    wine_server_send_fd( fd );
+    SERVER_START_REQ( set_request_shm )
+    {
+        req->fd   = fd;
+        req->size = REQUEST_SHM_SIZE;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    close( fd );
+
+    if (!status) ntdll_get_thread_data()->request_shm = shm;
+    else munmap( shm, REQUEST_SHM_SIZE );
+#endif
+}
+
+
 /***********************************************************************
  *           server_init_thread
  *
@@ -1487,6 +1657,7 @@ size_t server_init_thread( void *entry_point )
                 fatal_error( "WINEARCH set to win64 but '%s' is a 32-bit installation.\n",
                              wine_get_config_dir() );
         }
+        init_request_shm();
         return info_size;
     case STATUS_INVALID_IMAGE_WIN_64:
         fatal_error( "'%s' is a 32-bit installation, it cannot support 64-bit applications.\n",
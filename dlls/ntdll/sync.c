@@ -42,6 +42,10 @@
 #ifdef HAVE_SCHED_H
 # include <sched.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -1164,6 +1168,72 @@ NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE CompletionPort, PULONG_PTR Completi
     return status;
 }
 
+/******************************************************************
+ *              NtRemoveIoCompletionEx (NTDLL.@)
+ *              ZwRemoveIoCompletionEx (NTDLL.@)
+ *
+ * (Wait for and) retrieve multiple completion messages from completion object's queue
+ *
+ * PARAMS
+ *      CompletionPort  [I] HANDLE to I/O completion object
+ *      info            [O] array receiving the completion messages
+ *      count           [I] number of entries in the array
+ *      written         [O] number of messages retrieved
+ *      timeout         [I] optional wait time in NTDLL format
+ *      alertable       [I] whether the wait is alertable
+ *
+ */
+NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE CompletionPort, FILE_IO_COMPLETION_INFORMATION *info,
+                                        ULONG count, ULONG *written, LARGE_INTEGER *timeout,
+                                        BOOLEAN alertable )
+{
+    struct completion_entry entries[64];
+    NTSTATUS status;
+    ULONG i, n, done = 0;
+
+    TRACE("(%p, %p, %u, %p, %p, %u)\n", CompletionPort, info, count, written, timeout, alertable);
+
+    if (!count) return STATUS_INVALID_PARAMETER;
+
+    for (;;)
+    {
+        /* fetch as many messages as fit in a batch, and more batches while the queue is full */
+        do
+        {
+            SERVER_START_REQ( remove_completions )
+            {
+                req->handle = wine_server_obj_handle( CompletionPort );
+                wine_server_set_reply( req, entries, min( count - done, sizeof(entries)/sizeof(entries[0]) ) *
+                                       sizeof(entries[0]) );
+                status = wine_server_call( req );
+                n = wine_server_reply_size( reply ) / sizeof(entries[0]);
+            }
+            SERVER_END_REQ;
+            if (status) break;
+
+            for (i = 0; i < n; i++, done++)
+            {
+                info[done].CompletionKey             = entries[i].ckey;
+                info[done].CompletionValue           = entries[i].cvalue;
+                info[done].IoStatusBlock.Information = entries[i].information;
+                info[done].IoStatusBlock.u.Status    = entries[i].status;
+            }
+        } while (done < count && n == sizeof(entries)/sizeof(entries[0]));
+
+        if (done)
+        {
+            status = STATUS_SUCCESS;
+            break;
+        }
+        if (status != STATUS_PENDING) break;
+
+        status = NtWaitForSingleObject( CompletionPort, alertable, timeout );
+        if (status != WAIT_OBJECT_0) break;
+    }
+    *written = done;
+    return status;
+}
+
 /******************************************************************
  *              NtOpenIoCompletion (NTDLL.@)
  *              ZwOpenIoCompletion (NTDLL.@)
@@ -1251,16 +1321,21 @@ NTSTATUS WINAPI NtQueryIoCompletion( HANDLE CompletionPort, IO_COMPLETION_INFORM
 }
 
 NTSTATUS NTDLL_AddCompletion( HANDLE hFile, ULONG_PTR CompletionValue,
-                              NTSTATUS CompletionStatus, ULONG Information )
+                              NTSTATUS CompletionStatus, ULONG Information, BOOL async )
 {
     NTSTATUS status;
 
+    /* operations that completed immediately don't need a packet in skip mode */
+    if (!async && (server_get_completion_flags( hFile ) & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( add_fd_completion )
     {
         req->handle      = wine_server_obj_handle( hFile );
         req->cvalue      = CompletionValue;
         req->status      = CompletionStatus;
         req->information = Information;
+        req->async       = async;
         status = wine_server_call( req );
     }
     SERVER_END_REQ;
@@ -1383,6 +1458,361 @@ DWORD WINAPI RtlRunOnceExecuteOnce( RTL_RUN_ONCE *once, PRTL_RUN_ONCE_INIT_FN fu
 }
 
 
+#ifdef __linux__
+
+#define FUTEX_WAIT          0
+#define FUTEX_WAKE          1
+#define FUTEX_WAIT_BITSET   9
+#define FUTEX_WAKE_BITSET   10
+
+static int futex_private = 128; /*FUTEX_PRIVATE_FLAG*/
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAIT | futex_private, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE | futex_private, val, NULL, 0, 0 );
+}
+
+static inline int futex_wait_bitset( int *addr, int val, struct timespec *timeout, int mask )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET | futex_private, val, timeout, 0, mask );
+}
+
+static inline int futex_wake_bitset( int *addr, int val, int mask )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE_BITSET | futex_private, val, NULL, 0, mask );
+}
+
+static inline int use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        futex_wait_bitset( &supported, 10, NULL, ~0 );
+        if (errno == ENOSYS)
+        {
+            futex_private = 0;
+            futex_wait_bitset( &supported, 10, NULL, ~0 );
+        }
+        /* the values don't match, so a working futex returns EAGAIN */
+        supported = (errno == EAGAIN);
+    }
+    return supported;
+}
+
+static void timespec_from_timeout( struct timespec *timespec, const LARGE_INTEGER *timeout )
+{
+    LARGE_INTEGER now;
+    LONGLONG diff;
+
+    if (timeout->QuadPart >= 0)  /* absolute time */
+    {
+        NtQuerySystemTime( &now );
+        diff = timeout->QuadPart - now.QuadPart;
+    }
+    else diff = -timeout->QuadPart;
+
+    if (diff < 0) diff = 0;
+    timespec->tv_sec  = diff / 10000000;
+    timespec->tv_nsec = (diff % 10000000) * 100;
+}
+
+/* Futex-based SRW lock implementation
+ *
+ * The kernel takes care of queuing the waiters, so the lock word only needs
+ * to track the owners and whether anybody has to be woken up:
+ *
+ *    31 - set if the lock is owned exclusively
+ * 30-16 - number of threads waiting for exclusive access
+ *    15 - set if threads are waiting for shared access
+ *  14-0 - number of shared owners
+ *
+ * Waiters block on the lock word itself, using the futex bitset to wake
+ * exclusive and shared waiters separately.
+ */
+
+#define SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT       0x80000000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK   0x7fff0000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC    0x00010000
+#define SRWLOCK_FUTEX_SHARED_WAITERS_BIT       0x00008000
+#define SRWLOCK_FUTEX_SHARED_OWNERS_MASK       0x00007fff
+#define SRWLOCK_FUTEX_SHARED_OWNERS_INC        0x00000001
+
+#define SRWLOCK_FUTEX_BITSET_EXCLUSIVE  1
+#define SRWLOCK_FUTEX_BITSET_SHARED     2
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || (old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+            return STATUS_TIMEOUT;
+        if (interlocked_cmpxchg( (int *)&lock->Ptr, old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT, old ) == old)
+            return STATUS_SUCCESS;
+    }
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    /* uncontended case */
+    if (!interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT, 0 ))
+        return STATUS_SUCCESS;
+
+    /* register as exclusive waiter, so that new shared owners keep out */
+    interlocked_xchg_add( (int *)&lock->Ptr, SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC );
+
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) && !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+        {
+            new = (old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) - SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+            if (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) == old) return STATUS_SUCCESS;
+            continue;
+        }
+        futex_wait_bitset( (int *)&lock->Ptr, old, NULL, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    }
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || (old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+            return STATUS_TIMEOUT;
+        if ((old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) == SRWLOCK_FUTEX_SHARED_OWNERS_MASK)
+            RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+        if (interlocked_cmpxchg( (int *)&lock->Ptr, old + SRWLOCK_FUTEX_SHARED_OWNERS_INC, old ) == old)
+            return STATUS_SUCCESS;
+    }
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) && !(old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        {
+            if ((old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) == SRWLOCK_FUTEX_SHARED_OWNERS_MASK)
+                RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+            if (interlocked_cmpxchg( (int *)&lock->Ptr, old + SRWLOCK_FUTEX_SHARED_OWNERS_INC, old ) == old)
+                return STATUS_SUCCESS;
+            continue;
+        }
+        new = old | SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+        if (new != old && interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old) continue;
+        futex_wait_bitset( (int *)&lock->Ptr, new, NULL, SRWLOCK_FUTEX_BITSET_SHARED );
+    }
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT))
+        {
+            ERR( "lock %p is not owned exclusively (%#x)\n", lock, old );
+            return STATUS_RESOURCE_NOT_OWNED;
+        }
+        new = old & ~SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT;
+        if (!(new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)) new &= ~SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    /* exclusive waiters go first, shared waiters are woken all at once */
+    if (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    else if (old & SRWLOCK_FUTEX_SHARED_WAITERS_BIT)
+        futex_wake_bitset( (int *)&lock->Ptr, INT_MAX, SRWLOCK_FUTEX_BITSET_SHARED );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+        {
+            ERR( "lock %p is not owned shared (%#x)\n", lock, old );
+            return STATUS_RESOURCE_NOT_OWNED;
+        }
+        new = old - SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    /* wake up one exclusive waiter when the last shared owner leaves */
+    if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) && (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    return STATUS_SUCCESS;
+}
+
+/* Futex-based condition variables
+ *
+ * The variable holds a sequence number in the upper 16 bits, bumped on every
+ * wake-up, and the number of sleepers in the lower 16 bits, so that waking a
+ * variable nobody sleeps on doesn't need a system call. Sleepers block until
+ * the sequence number changes, so a wake-up between the release of the lock
+ * and the wait can't be lost. Wakers only bump the sequence number; every
+ * sleeper removes itself from the count when it returns, so the count stays
+ * exact and can never carry into the sequence number. */
+
+#define CV_SLEEPER_MASK 0xffff
+#define CV_SEQ_INC      0x10000
+
+static inline int register_cv_sleeper( RTL_CONDITION_VARIABLE *variable )
+{
+    return interlocked_xchg_add( (int *)&variable->Ptr, 1 ) + 1;
+}
+
+static inline int unregister_cv_sleeper( RTL_CONDITION_VARIABLE *variable )
+{
+    return interlocked_xchg_add( (int *)&variable->Ptr, -1 );
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    struct timespec timespec;
+    LARGE_INTEGER end;
+    int ret, cur;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (timeout && timeout->QuadPart != TIMEOUT_INFINITE)
+    {
+        /* the wait may have to be restarted, so use an absolute time */
+        end = *timeout;
+        if (end.QuadPart < 0)
+        {
+            NtQuerySystemTime( &end );
+            end.QuadPart -= timeout->QuadPart;
+        }
+        timeout = &end;
+    }
+    else timeout = NULL;
+
+    for (;;)
+    {
+        if (timeout)
+        {
+            timespec_from_timeout( &timespec, timeout );
+            ret = futex_wait( (int *)&variable->Ptr, val, &timespec );
+        }
+        else ret = futex_wait( (int *)&variable->Ptr, val, NULL );
+
+        cur = *(volatile int *)&variable->Ptr;
+        if ((cur ^ val) & ~CV_SLEEPER_MASK)
+        {
+            unregister_cv_sleeper( variable );
+            return STATUS_WAIT_0;
+        }
+
+        if (ret == -1 && errno == ETIMEDOUT)
+        {
+            /* a wake-up that got there before we unregistered still counts */
+            cur = unregister_cv_sleeper( variable );
+            return ((cur ^ val) & ~CV_SLEEPER_MASK) ? STATUS_WAIT_0 : STATUS_TIMEOUT;
+        }
+        /* only the number of sleepers changed, wait again */
+        val = cur;
+    }
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (!(*(volatile int *)&variable->Ptr & CV_SLEEPER_MASK)) return STATUS_SUCCESS;  /* nobody to wake */
+    interlocked_xchg_add( (int *)&variable->Ptr, CV_SEQ_INC );
+    futex_wake( (int *)&variable->Ptr, count );
+    return STATUS_SUCCESS;
+}
+
+#else
+
+static inline int use_futexes(void)
+{
+    return 0;
+}
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static inline int register_cv_sleeper( RTL_CONDITION_VARIABLE *variable )
+{
+    return 0;
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif
+
 /* SRW locks implementation
  *
  * The memory layout used by the lock is:
@@ -1510,7 +1940,8 @@ static inline void srwlock_leave_shared( RTL_SRWLOCK *lock, unsigned int val )
  * NOTES
  *  Please note that SRWLocks do not keep track of the owner of a lock.
  *  It doesn't make any difference which thread for example unlocks an
- *  SRWLock (see corresponding tests). This implementation uses two
+ *  SRWLock (see corresponding tests). This implementation blocks on
+ *  a futex on the lock word when available, otherwise it uses two
  *  keyed events (one for the exclusive waiters and one for the shared
  *  waiters) and is limited to 2^15-1 waiting threads.
  */
@@ -1529,6 +1960,9 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_acquire_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (srwlock_lock_exclusive( (unsigned int *)&lock->Ptr, SRWLOCK_RES_EXCLUSIVE ))
         NtWaitForKeyedEvent( keyed_event, srwlock_key_exclusive(lock), FALSE, NULL );
 }
@@ -1543,6 +1977,10 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+
+    if (fast_acquire_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     /* Acquires a shared lock. If it's currently not possible to add elements to
      * the shared queue, then request exclusive access instead. */
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
@@ -1573,6 +2011,9 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_exclusive( lock, srwlock_unlock_exclusive( (unsigned int *)&lock->Ptr,
                              - SRWLOCK_RES_EXCLUSIVE ) - SRWLOCK_RES_EXCLUSIVE );
 }
@@ -1582,6 +2023,9 @@ void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_shared( lock, srwlock_lock_exclusive( (unsigned int *)&lock->Ptr,
                           - SRWLOCK_RES_SHARED ) - SRWLOCK_RES_SHARED );
 }
@@ -1595,6 +2039,11 @@ void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
  */
 BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+        return (ret == STATUS_SUCCESS);
+
     return interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_MASK_IN_EXCLUSIVE |
                                 SRWLOCK_RES_EXCLUSIVE, 0 ) == 0;
 }
@@ -1605,6 +2054,11 @@ BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 BOOLEAN WINAPI RtlTryAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+        return (ret == STATUS_SUCCESS);
+
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
     {
         if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
@@ -1648,6 +2102,9 @@ void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
+    if (fast_wake_cv( variable, 1 ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1659,7 +2116,12 @@ void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
-    int val = interlocked_xchg( (int *)&variable->Ptr, 0 );
+    int val;
+
+    if (fast_wake_cv( variable, INT_MAX ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
+    val = interlocked_xchg( (int *)&variable->Ptr, 0 );
     while (val-- > 0)
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1683,6 +2145,17 @@ NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, R
                                              const LARGE_INTEGER *timeout )
 {
     NTSTATUS status;
+    int val;
+
+    if (use_futexes())
+    {
+        val = register_cv_sleeper( variable );
+        RtlLeaveCriticalSection( crit );
+        status = fast_wait_cv( variable, val, timeout );
+        RtlEnterCriticalSection( crit );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
     RtlLeaveCriticalSection( crit );
 
@@ -1720,6 +2193,26 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
                                               const LARGE_INTEGER *timeout, ULONG flags )
 {
     NTSTATUS status;
+    int val;
+
+    if (use_futexes())
+    {
+        val = register_cv_sleeper( variable );
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlReleaseSRWLockShared( lock );
+        else
+            RtlReleaseSRWLockExclusive( lock );
+
+        status = fast_wait_cv( variable, val, timeout );
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlAcquireSRWLockShared( lock );
+        else
+            RtlAcquireSRWLockExclusive( lock );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
@@ -324,6 +324,76 @@ static void test_redirection(void)
     pRtlWow64EnableFsRedirectionEx( old, &cur );
 }
 
+static void test_case_insensitive_lookup(void)
+{
+    char testdir[MAX_PATH], path[MAX_PATH], path2[MAX_PATH];
+    HANDLE file;
+    DWORD attrs;
+    BOOL ret;
+    int i;
+
+    GetTempPathA(MAX_PATH, testdir);
+    strcat(testdir, "CaseLookup.tmp");
+    ret = CreateDirectoryA(testdir, NULL);
+    ok(ret, "CreateDirectory failed %u\n", GetLastError());
+
+    /* lookups must see changes made right before them */
+    for (i = 0; i < 100; i++)
+    {
+        sprintf(path, "%s\\CASE%u.TXT", testdir, i);
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%d: file already exists\n", i);
+
+        sprintf(path2, "%s\\Case%u.txt", testdir, i);
+        file = CreateFileA(path2, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        ok(file != INVALID_HANDLE_VALUE, "%d: CreateFile failed %u\n", i, GetLastError());
+        CloseHandle(file);
+
+        attrs = GetFileAttributesA(path);
+        ok(attrs != INVALID_FILE_ATTRIBUTES, "%d: file not found after creation\n", i);
+
+        sprintf(path2, "%s\\Moved%u.txt", testdir, i);
+        ret = MoveFileA(path, path2);
+        ok(ret, "%d: MoveFile failed %u\n", i, GetLastError());
+
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%d: file still found after rename\n", i);
+        sprintf(path, "%s\\MOVED%u.TXT", testdir, i);
+        attrs = GetFileAttributesA(path);
+        ok(attrs != INVALID_FILE_ATTRIBUTES, "%d: file not found after rename\n", i);
+
+        ret = DeleteFileA(path);
+        ok(ret, "%d: DeleteFile failed %u\n", i, GetLastError());
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%d: file still found after deletion\n", i);
+    }
+
+    /* a burst of changes between two lookups */
+    sprintf(path, "%s\\FILE0.TXT", testdir);
+    attrs = GetFileAttributesA(path);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "file already exists\n");
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(path2, "%s\\File%u.txt", testdir, i);
+        file = CreateFileA(path2, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        ok(file != INVALID_HANDLE_VALUE, "%d: CreateFile failed %u\n", i, GetLastError());
+        CloseHandle(file);
+    }
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(path, "%s\\FILE%u.TXT", testdir, i);
+        attrs = GetFileAttributesA(path);
+        ok(attrs != INVALID_FILE_ATTRIBUTES, "%d: file not found\n", i);
+        ret = DeleteFileA(path);
+        ok(ret, "%d: DeleteFile failed %u\n", i, GetLastError());
+    }
+    attrs = GetFileAttributesA(path);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "file still found after deletion\n");
+
+    ret = RemoveDirectoryA(testdir);
+    ok(ret, "RemoveDirectory failed %u\n", GetLastError());
+}
+
 START_TEST(directory)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -346,4 +416,5 @@ START_TEST(directory)
 
     test_NtQueryDirectoryFile();
     test_redirection();
+    test_case_insensitive_lookup();
 }
@@ -1032,10 +1032,131 @@ static void test_keyed_events(void)
     NtClose( event );
 }
 
+static void benchmark_server_calls( const char *label )
+{
+    static const int count = 20000;
+    LARGE_INTEGER freq, start, end;
+    char buffer[1024];
+    HANDLE event;
+    NTSTATUS status;
+    double set_rate, wait_rate, query_rate;
+    ULONG len;
+    int i;
+
+    QueryPerformanceFrequency( &freq );
+    event = CreateEventA( NULL, TRUE, TRUE, "om_benchmark_event" );
+    ok( event != NULL, "CreateEvent failed %u\n", GetLastError() );
+
+    /* no request or reply data */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++) SetEvent( event );
+    QueryPerformanceCounter( &end );
+    set_rate = count * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+
+    /* small request data */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++) WaitForSingleObject( event, 0 );
+    QueryPerformanceCounter( &end );
+    wait_rate = count * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+
+    /* reply data */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++)
+    {
+        status = pNtQueryObject( event, ObjectNameInformation, buffer, sizeof(buffer), &len );
+        if (status) break;
+    }
+    QueryPerformanceCounter( &end );
+    ok( !status, "NtQueryObject failed %x\n", status );
+    query_rate = count * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+
+    trace( "%s: SetEvent %.0f/s, WaitForSingleObject %.0f/s, NtQueryObject %.0f/s\n",
+           label, set_rate, wait_rate, query_rate );
+    CloseHandle( event );
+}
+
+static void test_server_call_performance( char **argv )
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH];
+    BOOL ret;
+
+    if (!winetest_interactive)
+    {
+        skip( "server call benchmark only runs in interactive mode\n" );
+        return;
+    }
+    benchmark_server_calls( "shared memory" );
+
+    /* compare with a process that doesn't use the request shared memory in Wine */
+    SetEnvironmentVariableA( "WINESERVERSHM", "0" );
+    sprintf( cmdline, "\"%s\" om benchmark", argv[0] );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess failed %u\n", GetLastError() );
+    SetEnvironmentVariableA( "WINESERVERSHM", NULL );
+    if (!ret) return;
+    winetest_wait_child_process( pi.hProcess );
+    CloseHandle( pi.hProcess );
+    CloseHandle( pi.hThread );
+}
+
+static void test_named_object_performance(void)
+{
+    static const unsigned int count = 100000;
+    LARGE_INTEGER freq, start, end;
+    double create_rate, open_rate;
+    char name[32];
+    HANDLE *events, handle;
+    unsigned int i, created;
+
+    if (!winetest_interactive)
+    {
+        skip( "named object benchmark only runs in interactive mode\n" );
+        return;
+    }
+
+    events = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*events) );
+    QueryPerformanceFrequency( &freq );
+
+    QueryPerformanceCounter( &start );
+    for (created = 0; created < count; created++)
+    {
+        sprintf( name, "om_bench_%u", created );
+        if (!(events[created] = CreateEventA( NULL, TRUE, FALSE, name ))) break;
+    }
+    QueryPerformanceCounter( &end );
+    ok( created == count, "CreateEvent %u failed %u\n", created, GetLastError() );
+    create_rate = created * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < created; i++)
+    {
+        sprintf( name, "om_bench_%u", i );
+        if (!(handle = OpenEventA( EVENT_ALL_ACCESS, FALSE, name ))) break;
+        CloseHandle( handle );
+    }
+    QueryPerformanceCounter( &end );
+    ok( i == created, "OpenEvent %u failed %u\n", i, GetLastError() );
+    open_rate = i * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+
+    trace( "%u named events: CreateEvent %.0f/s, OpenEvent %.0f/s\n", created, create_rate, open_rate );
+
+    for (i = 0; i < created; i++) CloseHandle( events[i] );
+    HeapFree( GetProcessHeap(), 0, events );
+
+    /* the names are gone once the last handle is closed */
+    handle = OpenEventA( EVENT_ALL_ACCESS, FALSE, "om_bench_0" );
+    ok( !handle, "event still exists\n" );
+    ok( GetLastError() == ERROR_FILE_NOT_FOUND, "wrong error %u\n", GetLastError() );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
     HMODULE hkernel32 = GetModuleHandleA("kernel32.dll");
+    char **argv;
+    int argc;
 
     if (!hntdll)
     {
@@ -1072,6 +1193,13 @@ START_TEST(om)
     pNtWaitForKeyedEvent    =  (void *)GetProcAddress(hntdll, "NtWaitForKeyedEvent");
     pNtReleaseKeyedEvent    =  (void *)GetProcAddress(hntdll, "NtReleaseKeyedEvent");
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3 && !strcmp( argv[2], "benchmark" ))
+    {
+        benchmark_server_calls( "pipes only" );
+        return;
+    }
+
     test_case_sensitive();
     test_namespace_pipe();
     test_name_collisions();
@@ -1081,4 +1209,6 @@ START_TEST(om)
     test_type_mismatch();
     test_event();
     test_keyed_events();
+    test_named_object_performance();
+    test_server_call_performance( argv );
 }
@@ -21,10 +21,12 @@
  * windows.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "ntdll_test.h"
 #include "inaddr.h"
+#include "wine/heap.h"
 
 #ifndef __WINE_WINTERNL_H
 
@@ -92,6 +94,8 @@ static NTSTATUS  (WINAPI *pRtlIpv4StringToAddressA)(PCSTR, BOOLEAN, PCSTR *, IN_
 static NTSTATUS  (WINAPI *pLdrAddRefDll)(ULONG, HMODULE);
 static NTSTATUS  (WINAPI *pLdrLockLoaderLock)(ULONG, ULONG*, ULONG_PTR*);
 static NTSTATUS  (WINAPI *pLdrUnlockLoaderLock)(ULONG, ULONG_PTR);
+static NTSTATUS  (WINAPI *pRtlInitializeCriticalSectionEx)(RTL_CRITICAL_SECTION *, ULONG, ULONG);
+static NTSTATUS  (WINAPI *pRtlQueryHeapInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
 
 static HMODULE hkernel32 = 0;
 static BOOL      (WINAPI *pIsWow64Process)(HANDLE, PBOOL);
@@ -139,6 +143,8 @@ static void InitFunctionPtrs(void)
         pLdrAddRefDll = (void *)GetProcAddress(hntdll, "LdrAddRefDll");
         pLdrLockLoaderLock = (void *)GetProcAddress(hntdll, "LdrLockLoaderLock");
         pLdrUnlockLoaderLock = (void *)GetProcAddress(hntdll, "LdrUnlockLoaderLock");
+        pRtlInitializeCriticalSectionEx = (void *)GetProcAddress(hntdll, "RtlInitializeCriticalSectionEx");
+        pRtlQueryHeapInformation = (void *)GetProcAddress(hntdll, "RtlQueryHeapInformation");
     }
     hkernel32 = LoadLibraryA("kernel32.dll");
     ok(hkernel32 != 0, "LoadLibrary failed\n");
@@ -1599,10 +1605,252 @@ static void test_LdrLockLoaderLock(void)
     pLdrUnlockLoaderLock(0, magic);
 }
 
+static DWORD WINAPI crit_section_thread(void *arg)
+{
+    RTL_CRITICAL_SECTION *cs = arg;
+
+    RtlEnterCriticalSection(cs);
+    RtlLeaveCriticalSection(cs);
+    return 0;
+}
+
+static void test_RtlInitializeCriticalSectionEx(void)
+{
+    static RTL_CRITICAL_SECTION_DEBUG *no_debug = (void *)~(ULONG_PTR)0;
+    RTL_CRITICAL_SECTION cs;
+    HANDLE thread;
+    DWORD ret;
+
+    if (!pRtlInitializeCriticalSectionEx)
+    {
+        win_skip("RtlInitializeCriticalSectionEx is not available\n");
+        return;
+    }
+
+    memset(&cs, 0x11, sizeof(cs));
+    pRtlInitializeCriticalSectionEx(&cs, 0, RTL_CRITICAL_SECTION_FLAG_NO_DEBUG_INFO);
+    ok(cs.DebugInfo == no_debug || broken(cs.DebugInfo == NULL) /* < Win8 */,
+       "expected DebugInfo == ~0, got %p\n", cs.DebugInfo);
+    ok(cs.LockCount == -1, "expected LockCount == -1, got %d\n", cs.LockCount);
+    ok(cs.RecursionCount == 0, "expected RecursionCount == 0, got %d\n", cs.RecursionCount);
+    ok(cs.LockSemaphore == NULL, "expected LockSemaphore == NULL, got %p\n", cs.LockSemaphore);
+
+    /* contended sections without debug info work as well */
+    RtlEnterCriticalSection(&cs);
+    thread = CreateThread(NULL, 0, crit_section_thread, &cs, 0, NULL);
+    ret = WaitForSingleObject(thread, 100);
+    ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+    RtlLeaveCriticalSection(&cs);
+    ret = WaitForSingleObject(thread, 1000);
+    ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+    CloseHandle(thread);
+    RtlDeleteCriticalSection(&cs);
+
+    memset(&cs, 0x11, sizeof(cs));
+    pRtlInitializeCriticalSectionEx(&cs, 0, 0);
+    if (!cs.DebugInfo || cs.DebugInfo == no_debug)
+    {
+        win_skip("no debug info allocated\n");
+        RtlDeleteCriticalSection(&cs);
+        return;
+    }
+    ok(cs.DebugInfo->ContentionCount == 0, "got %u\n", cs.DebugInfo->ContentionCount);
+
+    /* uncontended entries don't count */
+    RtlEnterCriticalSection(&cs);
+    RtlEnterCriticalSection(&cs);
+    RtlLeaveCriticalSection(&cs);
+    RtlLeaveCriticalSection(&cs);
+    ok(cs.DebugInfo->ContentionCount == 0, "got %u\n", cs.DebugInfo->ContentionCount);
+
+    RtlEnterCriticalSection(&cs);
+    thread = CreateThread(NULL, 0, crit_section_thread, &cs, 0, NULL);
+    ret = WaitForSingleObject(thread, 100);
+    ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+    RtlLeaveCriticalSection(&cs);
+    ret = WaitForSingleObject(thread, 1000);
+    ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+    CloseHandle(thread);
+    ok(cs.DebugInfo->ContentionCount == 1, "got %u\n", cs.DebugInfo->ContentionCount);
+    RtlDeleteCriticalSection(&cs);
+}
+
+static void test_heap_statistics(void)
+{
+    HEAP_WINE_STATISTICS stats, start;
+    void *ptrs[10], *large;
+    SIZE_T size;
+    NTSTATUS status;
+    HANDLE heap;
+    unsigned int i;
+
+    if (!pRtlQueryHeapInformation)
+    {
+        win_skip("RtlQueryHeapInformation is not available\n");
+        return;
+    }
+
+    heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(heap != NULL, "RtlCreateHeap failed\n");
+
+    size = 0xdeadbeef;
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &start, sizeof(start) - 1, &size);
+    if (status == STATUS_INVALID_INFO_CLASS || status == STATUS_INVALID_PARAMETER)
+    {
+        win_skip("heap statistics are not supported\n");
+        RtlDestroyHeap(heap);
+        return;
+    }
+    ok(status == STATUS_BUFFER_TOO_SMALL, "got %08x\n", status);
+    ok(size == sizeof(start), "got size %lu\n", size);
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &start, sizeof(start), NULL);
+    ok(!status, "got %08x\n", status);
+    ok(start.SubHeapCount == 1, "got %u sub-heaps\n", start.SubHeapCount);
+    ok(start.CommittedSize <= start.ReservedSize, "committed %lu reserved %lu\n",
+       start.CommittedSize, start.ReservedSize);
+
+    for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++)
+    {
+        ptrs[i] = RtlAllocateHeap(heap, 0, 100);
+        ok(ptrs[i] != NULL, "allocation %u failed\n", i);
+    }
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &stats, sizeof(stats), NULL);
+    ok(!status, "got %08x\n", status);
+    ok(stats.AllocCount == start.AllocCount + 10, "got %u allocs\n", (ULONG)stats.AllocCount);
+    ok(stats.FreeCount == start.FreeCount, "got %u frees\n", (ULONG)stats.FreeCount);
+    ok(stats.InUseBlocks == start.InUseBlocks + 10, "got %u blocks\n", stats.InUseBlocks);
+    ok(stats.InUseSize >= start.InUseSize + 10 * 100, "got in use size %lu\n", stats.InUseSize);
+
+    ptrs[0] = RtlReAllocateHeap(heap, 0, ptrs[0], 200);
+    ok(ptrs[0] != NULL, "reallocation failed\n");
+    large = RtlAllocateHeap(heap, 0, 0x100000);
+    ok(large != NULL, "large allocation failed\n");
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &stats, sizeof(stats), NULL);
+    ok(!status, "got %08x\n", status);
+    ok(stats.ReallocCount == start.ReallocCount + 1, "got %u reallocs\n", (ULONG)stats.ReallocCount);
+    ok(stats.LargeAllocCount == start.LargeAllocCount + 1, "got %u large allocs\n",
+       (ULONG)stats.LargeAllocCount);
+    ok(stats.LargeBlocks == start.LargeBlocks + 1, "got %u large blocks\n", stats.LargeBlocks);
+    ok(stats.InUseSize >= start.InUseSize + 0x100000 + 9 * 100 + 200, "got in use size %lu\n", stats.InUseSize);
+    ok(stats.CommittedSize >= start.CommittedSize + 0x100000, "got committed size %lu\n", stats.CommittedSize);
+
+    for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) RtlFreeHeap(heap, 0, ptrs[i]);
+    RtlFreeHeap(heap, 0, large);
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &stats, sizeof(stats), NULL);
+    ok(!status, "got %08x\n", status);
+    ok(stats.AllocCount == start.AllocCount + 11, "got %u allocs\n", (ULONG)stats.AllocCount);
+    ok(stats.FreeCount == start.FreeCount + 11, "got %u frees\n", (ULONG)stats.FreeCount);
+    ok(stats.FailedCount == start.FailedCount, "got %u failures\n", (ULONG)stats.FailedCount);
+    ok(stats.InUseBlocks == start.InUseBlocks, "got %u blocks\n", stats.InUseBlocks);
+    ok(stats.InUseSize == start.InUseSize, "got in use size %lu\n", stats.InUseSize);
+    ok(stats.LargeBlocks == start.LargeBlocks, "got %u large blocks\n", stats.LargeBlocks);
+    ok(stats.FreeBlocks >= 1, "got %u free blocks\n", stats.FreeBlocks);
+    for (i = 0, size = 0; i < HEAP_WINE_NB_FREE_LISTS; i++) size += stats.FreeListBytes[i];
+    ok(size == stats.FreeSize, "free lists hold %lu bytes, free size %lu\n", size, stats.FreeSize);
+    RtlDestroyHeap(heap);
+
+    /* a fixed size heap can't satisfy allocations larger than itself */
+    heap = RtlCreateHeap(0, NULL, 0x10000, 0x10000, NULL, NULL);
+    ok(heap != NULL, "RtlCreateHeap failed\n");
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &start, sizeof(start), NULL);
+    ok(!status, "got %08x\n", status);
+    large = RtlAllocateHeap(heap, 0, 0x20000);
+    ok(large == NULL, "allocation succeeded\n");
+    status = pRtlQueryHeapInformation(heap, HeapWineStatistics, &stats, sizeof(stats), NULL);
+    ok(!status, "got %08x\n", status);
+    ok(stats.FailedCount == start.FailedCount + 1, "got %u failures\n", (ULONG)stats.FailedCount);
+    ok(stats.AllocCount == start.AllocCount, "got %u allocs\n", (ULONG)stats.AllocCount);
+    RtlDestroyHeap(heap);
+}
+
+static void test_heap_samples_child(void)
+{
+    HEAP_WINE_ALLOCATION_SAMPLES *samples;
+    void *ptrs[20];
+    HMODULE module;
+    SIZE_T size;
+    NTSTATUS status;
+    HANDLE heap;
+    unsigned int i;
+
+    heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(heap != NULL, "RtlCreateHeap failed\n");
+    for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) ptrs[i] = RtlAllocateHeap(heap, 0, 24);
+    for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) RtlFreeHeap(heap, 0, ptrs[i]);
+
+    size = 0;
+    status = pRtlQueryHeapInformation(heap, HeapWineAllocationSamples, NULL, 0, &size);
+    ok(status == STATUS_BUFFER_TOO_SMALL, "got %08x\n", status);
+    ok(size == FIELD_OFFSET(HEAP_WINE_ALLOCATION_SAMPLES, Samples[1]), "got size %lu\n", size);
+    samples = HeapAlloc(GetProcessHeap(), 0, size);
+    status = pRtlQueryHeapInformation(heap, HeapWineAllocationSamples, samples, size, NULL);
+    ok(!status, "got %08x\n", status);
+    ok(samples->SampleRate == 1, "got rate %u\n", samples->SampleRate);
+    ok(samples->Count == 1, "got %u samples\n", samples->Count);
+    ok(samples->Samples[0].Count == 20, "got count %u\n", samples->Samples[0].Count);
+    ok(samples->Samples[0].MaxSize >= 24, "got max size %lu\n", samples->Samples[0].MaxSize);
+    /* the call site is the loop above */
+    ok(GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                          samples->Samples[0].Caller, &module) && module == GetModuleHandleA(NULL),
+       "wrong caller %p\n", samples->Samples[0].Caller);
+    HeapFree(GetProcessHeap(), 0, samples);
+    RtlDestroyHeap(heap);
+}
+
+static void test_heap_samples(char **argv)
+{
+    HEAP_WINE_ALLOCATION_SAMPLES samples;
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH];
+    NTSTATUS status;
+    SIZE_T size;
+
+    if (!pRtlQueryHeapInformation)
+    {
+        win_skip("RtlQueryHeapInformation is not available\n");
+        return;
+    }
+    size = 0;
+    status = pRtlQueryHeapInformation(GetProcessHeap(), HeapWineAllocationSamples, &samples, sizeof(samples), &size);
+    if (status == STATUS_INVALID_INFO_CLASS || status == STATUS_INVALID_PARAMETER)
+    {
+        win_skip("heap allocation samples are not supported\n");
+        return;
+    }
+    if (!GetEnvironmentVariableA("WINEHEAPSTATS", NULL, 0))
+    {
+        ok(!status, "got %08x\n", status);
+        ok(size == FIELD_OFFSET(HEAP_WINE_ALLOCATION_SAMPLES, Samples[0]), "got size %lu\n", size);
+        ok(!samples.SampleRate, "got rate %u\n", samples.SampleRate);
+        ok(!samples.Count, "got %u samples\n", samples.Count);
+    }
+
+    /* sampling is only enabled at startup */
+    SetEnvironmentVariableA("WINEHEAPSTATS", "1");
+    sprintf(cmdline, "\"%s\" rtl heapsamples", argv[0]);
+    ok(CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi),
+       "CreateProcess failed, error %u\n", GetLastError());
+    winetest_wait_child_process(pi.hProcess);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    SetEnvironmentVariableA("WINEHEAPSTATS", NULL);
+}
+
 START_TEST(rtl)
 {
+    char **argv;
+    int argc;
+
     InitFunctionPtrs();
 
+    argc = winetest_get_mainargs(&argv);
+    if (argc > 2 && !strcmp(argv[2], "heapsamples"))
+    {
+        test_heap_samples_child();
+        return;
+    }
+
     test_RtlCompareMemory();
     test_RtlCompareMemoryUlong();
     test_RtlMoveMemory();
@@ -1625,4 +1873,7 @@ START_TEST(rtl)
     test_RtlIpv4StringToAddress();
     test_LdrAddRefDll();
     test_LdrLockLoaderLock();
+    test_RtlInitializeCriticalSectionEx();
+    test_heap_statistics();
+    test_heap_samples(argv);
 }
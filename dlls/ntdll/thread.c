@@ -397,6 +397,7 @@ void terminate_thread( int status )
 {
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
     if (interlocked_xchg_add( &nb_threads, -1 ) <= 1) _exit( status );
+    debug_exit_thread();
 
     close( ntdll_get_thread_data()->wait_fd[0] );
     close( ntdll_get_thread_data()->wait_fd[1] );
@@ -437,6 +438,7 @@ void exit_thread( int status )
 
     LdrShutdownThread();
     RtlFreeThreadActivationContextStack();
+    debug_exit_thread();
 
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
 
@@ -455,6 +457,7 @@ void exit_thread( int status )
     close( ntdll_get_thread_data()->wait_fd[1] );
     close( ntdll_get_thread_data()->reply_fd );
     close( ntdll_get_thread_data()->request_fd );
+    if (ntdll_get_thread_data()->request_shm) munmap( ntdll_get_thread_data()->request_shm, REQUEST_SHM_SIZE );
 #if defined(__APPLE__) && defined(__LP64__)
     SIZE_T size=0;
     NtFreeVirtualMemory(NtCurrentProcess(), (void **)&(ntdll_get_thread_data()->thunk_stack_base), &size, MEM_RELEASE);
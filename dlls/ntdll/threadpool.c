@@ -26,6 +26,7 @@
 #include <limits.h>
 
 #define NONAMELESSUNION
+#define NONAMELESSSTRUCT
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "winternl.h"
@@ -37,24 +38,8 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(threadpool);
 
-#define WORKER_TIMEOUT 30000 /* 30 seconds */
-
-/* threadpool_cs must be held while modifying the following elements */
-static struct list work_item_list = LIST_INIT(work_item_list);
-static LONG num_workers;
-static LONG num_busy_workers;
-static LONG num_items_processed;
-
-static RTL_CONDITION_VARIABLE threadpool_cond = RTL_CONDITION_VARIABLE_INIT;
-
-static RTL_CRITICAL_SECTION threadpool_cs;
-static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
-{
-    0, 0, &threadpool_cs,
-    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
-    0, 0, { (DWORD_PTR)(__FILE__ ": threadpool_cs") }
-};
-static RTL_CRITICAL_SECTION threadpool_cs = { &critsect_debug, -1, 0, 0, 0, 0 };
+#define THREADPOOL_WORKER_TIMEOUT 5000
+#define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
 static HANDLE compl_port = NULL;
 static RTL_CRITICAL_SECTION threadpool_compl_cs;
@@ -66,13 +51,277 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_compl_debug =
 };
 static RTL_CRITICAL_SECTION threadpool_compl_cs = { &critsect_compl_debug, -1, 0, 0, 0, 0 };
 
-struct work_item
+/* internal threadpool representation */
+struct threadpool
 {
-    struct list entry;
-    PRTL_WORK_ITEM_ROUTINE function;
-    PVOID context;
+    LONG                    refcount;
+    LONG                    objcount;
+    BOOL                    shutdown;
+    RTL_CRITICAL_SECTION    cs;
+    /* queue of objects with pending callbacks, locked via .cs */
+    struct list             pool;
+    RTL_CONDITION_VARIABLE  update_event;
+    /* information about worker threads, locked via .cs */
+    int                     max_workers;
+    int                     min_workers;
+    int                     num_workers;
+    int                     num_busy_workers;
+};
+
+enum threadpool_objtype
+{
+    TP_OBJECT_TYPE_SIMPLE,
+    TP_OBJECT_TYPE_WORK,
+    TP_OBJECT_TYPE_TIMER,
+    TP_OBJECT_TYPE_WAIT,
+    TP_OBJECT_TYPE_IO
+};
+
+struct io_completion
+{
+    IO_STATUS_BLOCK         iosb;
+    ULONG_PTR               cvalue;
+};
+
+/* internal threadpool object representation */
+struct threadpool_object
+{
+    void                   *win32_callback; /* leave space for kernel32 to store the win32 callback */
+    LONG                    refcount;
+    BOOL                    shutdown;
+    /* read-only information */
+    enum threadpool_objtype type;
+    struct threadpool      *pool;
+    struct threadpool_group *group;
+    PVOID                   userdata;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK group_cancel_callback;
+    PTP_SIMPLE_CALLBACK     finalization_callback;
+    BOOL                    may_run_long;
+    HMODULE                 race_dll;
+    /* information about the group, locked via .group->cs */
+    struct list             group_entry;
+    BOOL                    is_group_member;
+    /* information about the pool, locked via .pool->cs */
+    struct list             pool_entry;
+    RTL_CONDITION_VARIABLE  finished_event;
+    RTL_CONDITION_VARIABLE  group_finished_event;
+    HANDLE                  completed_event;
+    LONG                    num_pending_callbacks;
+    LONG                    num_running_callbacks;
+    LONG                    num_associated_callbacks;
+    /* arguments for callback */
+    union
+    {
+        struct
+        {
+            PTP_SIMPLE_CALLBACK callback;
+        } simple;
+        struct
+        {
+            PTP_WORK_CALLBACK callback;
+        } work;
+        struct
+        {
+            PTP_TIMER_CALLBACK callback;
+            /* information about the timer, locked via timerqueue.cs */
+            BOOL            timer_initialized;
+            BOOL            timer_pending;
+            struct list     timer_entry;
+            BOOL            timer_set;
+            ULONGLONG       timeout;
+            LONG            period;
+            LONG            window_length;
+        } timer;
+        struct
+        {
+            PTP_WAIT_CALLBACK callback;
+            LONG            signaled;
+            /* information about the wait object, locked via waitqueue.cs */
+            struct waitqueue_bucket *bucket;
+            BOOL            wait_pending;
+            struct list     wait_entry;
+            ULONGLONG       timeout;
+            HANDLE          handle;
+            /* used by RtlRegisterWait */
+            RTL_WAITORTIMERCALLBACKFUNC rtl_callback;
+            ULONG           rtl_flags;
+            ULONG           rtl_milliseconds;
+        } wait;
+        struct
+        {
+            PTP_IO_CALLBACK callback;
+            /* information about the I/O object, locked via .pool->cs */
+            unsigned int    pending_count;
+            BOOL            shutting_down;
+            BOOL            queued;
+            unsigned int    completion_count;
+            unsigned int    completion_max;
+            struct io_completion *completions;
+        } io;
+    } u;
+};
+
+/* internal threadpool instance representation */
+struct threadpool_instance
+{
+    struct threadpool_object *object;
+    DWORD                   threadid;
+    BOOL                    associated;
+    BOOL                    may_run_long;
+    struct
+    {
+        RTL_CRITICAL_SECTION *critical_section;
+        HANDLE              mutex;
+        HANDLE              semaphore;
+        LONG                semaphore_count;
+        HANDLE              event;
+        HMODULE             library;
+    } cleanup;
+};
+
+/* internal threadpool group representation */
+struct threadpool_group
+{
+    LONG                    refcount;
+    BOOL                    shutdown;
+    RTL_CRITICAL_SECTION    cs;
+    /* list of group members, locked via .cs */
+    struct list             members;
+};
+
+/* global timerqueue object */
+static RTL_CRITICAL_SECTION_DEBUG timerqueue_debug;
+
+static struct
+{
+    RTL_CRITICAL_SECTION    cs;
+    LONG                    objcount;
+    BOOL                    thread_running;
+    struct list             pending_timers;
+    RTL_CONDITION_VARIABLE  update_event;
+}
+timerqueue =
+{
+    { &timerqueue_debug, -1, 0, 0, 0, 0 },      /* cs */
+    0,                                          /* objcount */
+    FALSE,                                      /* thread_running */
+    LIST_INIT( timerqueue.pending_timers ),     /* pending_timers */
+    RTL_CONDITION_VARIABLE_INIT                 /* update_event */
+};
+
+static RTL_CRITICAL_SECTION_DEBUG timerqueue_debug =
+{
+    0, 0, &timerqueue.cs,
+    { &timerqueue_debug.ProcessLocksList, &timerqueue_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": timerqueue.cs") }
+};
+
+/* global waitqueue object */
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug;
+
+static struct
+{
+    RTL_CRITICAL_SECTION    cs;
+    LONG                    num_buckets;
+    struct list             buckets;
+}
+waitqueue =
+{
+    { &waitqueue_debug, -1, 0, 0, 0, 0 },       /* cs */
+    0,                                          /* num_buckets */
+    LIST_INIT( waitqueue.buckets )              /* buckets */
+};
+
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug =
+{
+    0, 0, &waitqueue.cs,
+    { &waitqueue_debug.ProcessLocksList, &waitqueue_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": waitqueue.cs") }
 };
 
+/* a wait queue thread, multiplexing up to MAXIMUM_WAITQUEUE_OBJECTS wait objects */
+struct waitqueue_bucket
+{
+    struct list             bucket_entry;
+    LONG                    objcount;
+    struct list             reserved;
+    struct list             waiting;
+    HANDLE                  update_event;
+};
+
+/* global I/O completion queue object */
+static RTL_CRITICAL_SECTION_DEBUG ioqueue_debug;
+
+static struct
+{
+    RTL_CRITICAL_SECTION    cs;
+    LONG                    objcount;
+    BOOL                    thread_running;
+    HANDLE                  port;
+    RTL_CONDITION_VARIABLE  update_event;
+}
+ioqueue =
+{
+    { &ioqueue_debug, -1, 0, 0, 0, 0 },         /* cs */
+    0,                                          /* objcount */
+    FALSE,                                      /* thread_running */
+    NULL,                                       /* port */
+    RTL_CONDITION_VARIABLE_INIT                 /* update_event */
+};
+
+static RTL_CRITICAL_SECTION_DEBUG ioqueue_debug =
+{
+    0, 0, &ioqueue.cs,
+    { &ioqueue_debug.ProcessLocksList, &ioqueue_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": ioqueue.cs") }
+};
+
+static struct threadpool *default_threadpool = NULL;
+static struct threadpool *persistent_threadpool = NULL;
+
+static inline struct threadpool *impl_from_TP_POOL( TP_POOL *pool )
+{
+    return (struct threadpool *)pool;
+}
+
+static inline struct threadpool_object *impl_from_TP_WORK( TP_WORK *work )
+{
+    struct threadpool_object *object = (struct threadpool_object *)work;
+    assert( object->type == TP_OBJECT_TYPE_WORK );
+    return object;
+}
+
+static inline struct threadpool_object *impl_from_TP_TIMER( TP_TIMER *timer )
+{
+    struct threadpool_object *object = (struct threadpool_object *)timer;
+    assert( object->type == TP_OBJECT_TYPE_TIMER );
+    return object;
+}
+
+static inline struct threadpool_object *impl_from_TP_WAIT( TP_WAIT *wait )
+{
+    struct threadpool_object *object = (struct threadpool_object *)wait;
+    assert( object->type == TP_OBJECT_TYPE_WAIT );
+    return object;
+}
+
+static inline struct threadpool_object *impl_from_TP_IO( TP_IO *io )
+{
+    struct threadpool_object *object = (struct threadpool_object *)io;
+    assert( object->type == TP_OBJECT_TYPE_IO );
+    return object;
+}
+
+static inline struct threadpool_group *impl_from_TP_CLEANUP_GROUP( TP_CLEANUP_GROUP *group )
+{
+    return (struct threadpool_group *)group;
+}
+
+static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CALLBACK_INSTANCE *instance )
+{
+    return (struct threadpool_instance *)instance;
+}
+
 static inline LONG interlocked_inc( PLONG dest )
 {
     return interlocked_xchg_add( dest, 1 ) + 1;
@@ -83,44 +332,29 @@ static inline LONG interlocked_dec( PLONG dest )
     return interlocked_xchg_add( dest, -1 ) - 1;
 }
 
-static void WINAPI worker_thread_proc(void * param)
-{
-    struct list *item;
-    struct work_item *work_item_ptr, work_item;
-    LARGE_INTEGER timeout;
-    timeout.QuadPart = -(WORKER_TIMEOUT * (ULONGLONG)10000);
+static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON *environment );
+static void tp_object_initialize( struct threadpool_object *object, struct threadpool *pool,
+                                  PVOID userdata, TP_CALLBACK_ENVIRON *environment );
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
+static void tp_object_prepare_shutdown( struct threadpool_object *object );
+static BOOL tp_object_release( struct threadpool_object *object );
+static void tp_object_cancel( struct threadpool_object *object );
+static void tp_object_set_wait( struct threadpool_object *wait, HANDLE handle, LARGE_INTEGER *timeout );
 
-    RtlEnterCriticalSection( &threadpool_cs );
-    num_workers++;
+struct rtl_work_item
+{
+    PRTL_WORK_ITEM_ROUTINE function;
+    PVOID context;
+};
 
-    for (;;)
-    {
-        if ((item = list_head( &work_item_list )))
-        {
-            work_item_ptr = LIST_ENTRY( item, struct work_item, entry );
-            list_remove( &work_item_ptr->entry );
-            num_busy_workers++;
-            num_items_processed++;
-            RtlLeaveCriticalSection( &threadpool_cs );
-
-            /* copy item to stack and do the work */
-            work_item = *work_item_ptr;
-            RtlFreeHeap( GetProcessHeap(), 0, work_item_ptr );
-            TRACE("executing %p(%p)\n", work_item.function, work_item.context);
-            work_item.function( work_item.context );
-
-            RtlEnterCriticalSection( &threadpool_cs );
-            num_busy_workers--;
-        }
-        else if (RtlSleepConditionVariableCS( &threadpool_cond, &threadpool_cs, &timeout ) != STATUS_SUCCESS)
-            break;
-    }
+static void CALLBACK process_rtl_work_item( TP_CALLBACK_INSTANCE *instance, void *userdata )
+{
+    struct rtl_work_item *item = userdata;
 
-    num_workers--;
-    RtlLeaveCriticalSection( &threadpool_cs );
-    RtlExitUserThread( 0 );
+    TRACE("executing %p(%p)\n", item->function, item->context);
+    item->function( item->context );
 
-    /* never reached */
+    RtlFreeHeap( GetProcessHeap(), 0, item );
 }
 
 /***********************************************************************
@@ -147,52 +381,27 @@ static void WINAPI worker_thread_proc(void * param)
  */
 NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context, ULONG Flags)
 {
-    HANDLE thread;
+    TP_CALLBACK_ENVIRON environment;
+    struct rtl_work_item *item;
     NTSTATUS status;
-    LONG items_processed;
-    struct work_item *work_item = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(struct work_item));
-
-    if (!work_item)
-        return STATUS_NO_MEMORY;
-
-    work_item->function = Function;
-    work_item->context = Context;
 
-    if (Flags & ~WT_EXECUTELONGFUNCTION)
-        FIXME("Flags 0x%x not supported\n", Flags);
+    TRACE( "%p %p %u\n", Function, Context, Flags );
 
-    RtlEnterCriticalSection( &threadpool_cs );
-    list_add_tail( &work_item_list, &work_item->entry );
-    status = (num_workers > num_busy_workers) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
-    items_processed = num_items_processed;
-    RtlLeaveCriticalSection( &threadpool_cs );
+    item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*item) );
+    if (!item)
+        return STATUS_NO_MEMORY;
 
-    /* FIXME: tune this algorithm to not be as aggressive with creating threads
-     * if WT_EXECUTELONGFUNCTION isn't specified */
-    if (status == STATUS_SUCCESS)
-        RtlWakeConditionVariable( &threadpool_cond );
-    else
-    {
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                      worker_thread_proc, NULL, &thread, NULL );
+    memset( &environment, 0, sizeof(environment) );
+    environment.Version = 1;
+    environment.u.s.LongFunction = (Flags & WT_EXECUTELONGFUNCTION) != 0;
+    environment.u.s.Persistent   = (Flags & WT_EXECUTEINPERSISTENTTHREAD) != 0;
 
-        /* NOTE: we don't care if we couldn't create the thread if there is at
-         * least one other available to process the request */
-        if (status == STATUS_SUCCESS)
-            NtClose( thread );
-        else
-        {
-            RtlEnterCriticalSection( &threadpool_cs );
-            if (num_workers > 0 || num_items_processed != items_processed)
-                status = STATUS_SUCCESS;
-            else
-                list_remove( &work_item->entry );
-            RtlLeaveCriticalSection( &threadpool_cs );
+    item->function = Function;
+    item->context  = Context;
 
-            if (status != STATUS_SUCCESS)
-                RtlFreeHeap( GetProcessHeap(), 0, work_item );
-        }
-    }
+    status = TpSimpleTryPost( process_rtl_work_item, item, &environment );
+    if (status)
+        RtlFreeHeap( GetProcessHeap(), 0, item );
 
     return status;
 }
@@ -200,7 +409,7 @@ NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context,
 /***********************************************************************
  * iocp_poller - get completion events and run callbacks
  */
-static DWORD CALLBACK iocp_poller(LPVOID Arg)
+static void CALLBACK iocp_poller(LPVOID Arg)
 {
     HANDLE cport = Arg;
 
@@ -227,7 +436,6 @@ static DWORD CALLBACK iocp_poller(LPVOID Arg)
             callback( err, transferred, overlapped );
         }
     }
-    return 0;
 }
 
 /***********************************************************************
@@ -260,15 +468,20 @@ NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_CO
         RtlEnterCriticalSection(&threadpool_compl_cs);
         if (!compl_port)
         {
-            HANDLE cport;
+            HANDLE cport, thread;
 
             res = NtCreateIoCompletion( &cport, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
             if (!res)
             {
-                /* FIXME native can start additional threads in case of e.g. hung callback function. */
-                res = RtlQueueWorkItem( iocp_poller, cport, WT_EXECUTEDEFAULT );
+                /* The poller never returns, so don't tie up a pool worker with it.
+                 * FIXME native can start additional threads in case of e.g. hung callback function. */
+                res = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                           iocp_poller, cport, &thread, NULL );
                 if (!res)
+                {
                     compl_port = cport;
+                    NtClose( thread );
+                }
                 else
                     NtClose( cport );
             }
@@ -290,76 +503,21 @@ static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout
     return pTime;
 }
 
-struct wait_work_item
-{
-    HANDLE Object;
-    HANDLE CancelEvent;
-    WAITORTIMERCALLBACK Callback;
-    PVOID Context;
-    ULONG Milliseconds;
-    ULONG Flags;
-    HANDLE CompletionEvent;
-    LONG DeleteCount;
-    BOOLEAN CallbackInProgress;
-};
-
-static void delete_wait_work_item(struct wait_work_item *wait_work_item)
-{
-    NtClose( wait_work_item->CancelEvent );
-    RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
-}
-
-static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
+static void CALLBACK rtl_wait_callback( TP_CALLBACK_INSTANCE *instance, void *userdata,
+                                        TP_WAIT *wait, TP_WAIT_RESULT result )
 {
-    struct wait_work_item *wait_work_item = Arg;
-    NTSTATUS status;
-    BOOLEAN alertable = (wait_work_item->Flags & WT_EXECUTEINIOTHREAD) != 0;
-    HANDLE handles[2] = { wait_work_item->Object, wait_work_item->CancelEvent };
+    struct threadpool_object *object = impl_from_TP_WAIT( wait );
     LARGE_INTEGER timeout;
-    HANDLE completion_event;
-
-    TRACE("\n");
-
-    while (TRUE)
-    {
-        status = NtWaitForMultipleObjects( 2, handles, TRUE, alertable,
-                                           get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
-        if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT)
-        {
-            BOOLEAN TimerOrWaitFired;
-
-            if (status == STATUS_WAIT_0)
-            {
-                TRACE( "object %p signaled, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = FALSE;
-            }
-            else
-            {
-                TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = TRUE;
-            }
-            wait_work_item->CallbackInProgress = TRUE;
-            wait_work_item->Callback( wait_work_item->Context, TimerOrWaitFired );
-            wait_work_item->CallbackInProgress = FALSE;
-
-            if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
-                break;
-        }
-        else
-            break;
-    }
 
-    completion_event = wait_work_item->CompletionEvent;
-    if (completion_event) NtSetEvent( completion_event, NULL );
+    TRACE( "wait for object %p %s, calling callback %p with context %p\n", object->u.wait.handle,
+           result == WAIT_OBJECT_0 ? "signaled" : "timed out", object->u.wait.rtl_callback, userdata );
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
-        delete_wait_work_item( wait_work_item );
+    object->u.wait.rtl_callback( userdata, result != WAIT_OBJECT_0 );
 
-    return 0;
+    /* wait again, unless the object is being deregistered */
+    if (!(object->u.wait.rtl_flags & WT_EXECUTEONLYONCE))
+        tp_object_set_wait( object, object->u.wait.handle,
+                            get_nt_timeout( &timeout, object->u.wait.rtl_milliseconds ) );
 }
 
 /***********************************************************************
@@ -386,47 +544,42 @@ static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
  *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
  *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
  *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ *
+ *  The waits are multiplexed onto the wait threads of the thread pool, and
+ *  the callbacks are executed in its worker threads. Callbacks registered
+ *  with WT_EXECUTEINWAITTHREAD or WT_EXECUTEINPERSISTENTTHREAD are executed
+ *  one at a time in a dedicated persistent thread instead.
  */
 NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
                                 RTL_WAITORTIMERCALLBACKFUNC Callback,
                                 PVOID Context, ULONG Milliseconds, ULONG Flags)
 {
-    struct wait_work_item *wait_work_item;
+    TP_CALLBACK_ENVIRON environment;
+    struct threadpool_object *object;
+    LARGE_INTEGER timeout;
+    TP_WAIT *wait;
     NTSTATUS status;
 
     TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
 
-    wait_work_item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*wait_work_item) );
-    if (!wait_work_item)
-        return STATUS_NO_MEMORY;
-
-    wait_work_item->Object = Object;
-    wait_work_item->Callback = Callback;
-    wait_work_item->Context = Context;
-    wait_work_item->Milliseconds = Milliseconds;
-    wait_work_item->Flags = Flags;
-    wait_work_item->CallbackInProgress = FALSE;
-    wait_work_item->DeleteCount = 0;
-    wait_work_item->CompletionEvent = NULL;
+    memset( &environment, 0, sizeof(environment) );
+    environment.Version = 1;
+    environment.u.s.LongFunction = (Flags & WT_EXECUTELONGFUNCTION) != 0;
+    environment.u.s.Persistent   = (Flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINPERSISTENTTHREAD)) != 0;
 
-    status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
+    status = TpAllocWait( &wait, rtl_wait_callback, Context, &environment );
     if (status != STATUS_SUCCESS)
-    {
-        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
         return status;
-    }
 
-    Flags = Flags & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD |
-                     WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION);
-    status = RtlQueueWorkItem( wait_thread_proc, wait_work_item, Flags );
-    if (status != STATUS_SUCCESS)
-    {
-        delete_wait_work_item( wait_work_item );
-        return status;
-    }
+    object = impl_from_TP_WAIT( wait );
+    object->u.wait.rtl_callback     = Callback;
+    object->u.wait.rtl_flags        = Flags;
+    object->u.wait.rtl_milliseconds = Milliseconds;
 
-    *NewWaitObject = wait_work_item;
-    return status;
+    tp_object_set_wait( object, Object, get_nt_timeout( &timeout, Milliseconds ) );
+
+    *NewWaitObject = object;
+    return STATUS_SUCCESS;
 }
 
 /***********************************************************************
@@ -444,43 +597,36 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
  */
 NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
 {
-    struct wait_work_item *wait_work_item = WaitHandle;
+    struct threadpool_object *object = WaitHandle;
     NTSTATUS status = STATUS_SUCCESS;
+    BOOL running;
 
     TRACE( "(%p)\n", WaitHandle );
 
-    NtSetEvent( wait_work_item->CancelEvent, NULL );
-    if (wait_work_item->CallbackInProgress)
-    {
-        if (CompletionEvent != NULL)
-        {
-            if (CompletionEvent == INVALID_HANDLE_VALUE)
-            {
-                status = NtCreateEvent( &CompletionEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
-                if (status != STATUS_SUCCESS)
-                    return status;
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    NtWaitForSingleObject( CompletionEvent, FALSE, NULL );
-                NtClose( CompletionEvent );
-            }
-            else
-            {
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    status = STATUS_PENDING;
-            }
-        }
-        else
-            status = STATUS_PENDING;
-    }
+    if (!object || object->type != TP_OBJECT_TYPE_WAIT || !object->u.wait.rtl_callback)
+        return STATUS_INVALID_HANDLE;
+
+    /* stop waiting, and drop the callbacks that didn't start yet */
+    tp_object_prepare_shutdown( object );
+    object->shutdown = TRUE;
+    tp_object_cancel( object );
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
+    RtlEnterCriticalSection( &object->pool->cs );
+    running = object->num_running_callbacks != 0;
+    if (running && CompletionEvent == INVALID_HANDLE_VALUE)
     {
-        status = STATUS_SUCCESS;
-        delete_wait_work_item( wait_work_item );
+        while (object->num_running_callbacks)
+            RtlSleepConditionVariableCS( &object->group_finished_event, &object->pool->cs, NULL );
+        running = FALSE;
     }
+    else if (CompletionEvent != INVALID_HANDLE_VALUE)
+        object->completed_event = CompletionEvent;
+    RtlLeaveCriticalSection( &object->pool->cs );
+
+    if (running) status = STATUS_PENDING;
 
+    /* the completion event is signaled when the last reference is gone */
+    tp_object_release( object );
     return status;
 }
 
@@ -1024,3 +1170,2120 @@ NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
 
     return status;
 }
+
+
+/************************** Thread pool objects **************************/
+
+/***********************************************************************
+ *           timerqueue_thread_proc    (internal)
+ */
+static void CALLBACK timerqueue_thread_proc( void *param )
+{
+    ULONGLONG timeout_lower, timeout_upper, new_timeout;
+    struct threadpool_object *other_timer;
+    LARGE_INTEGER now, timeout;
+    struct list *ptr;
+
+    TRACE( "starting timer queue thread\n" );
+
+    RtlEnterCriticalSection( &timerqueue.cs );
+    for (;;)
+    {
+        NtQuerySystemTime( &now );
+
+        /* Check for expired timers. */
+        while ((ptr = list_head( &timerqueue.pending_timers )))
+        {
+            struct threadpool_object *timer = LIST_ENTRY( ptr, struct threadpool_object, u.timer.timer_entry );
+            assert( timer->type == TP_OBJECT_TYPE_TIMER );
+            assert( timer->u.timer.timer_pending );
+            if (timer->u.timer.timeout > now.QuadPart)
+                break;
+
+            /* Queue a new callback in one of the worker threads. */
+            list_remove( &timer->u.timer.timer_entry );
+            timer->u.timer.timer_pending = FALSE;
+            tp_object_submit( timer, FALSE );
+
+            /* Insert the timer back into the queue, except it's marked for shutdown. */
+            if (timer->u.timer.period && !timer->shutdown)
+            {
+                timer->u.timer.timeout += (ULONGLONG)timer->u.timer.period * 10000;
+                if (timer->u.timer.timeout <= now.QuadPart)
+                    timer->u.timer.timeout = now.QuadPart + 1;
+
+                LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                                     struct threadpool_object, u.timer.timer_entry )
+                {
+                    assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
+                    if (timer->u.timer.timeout < other_timer->u.timer.timeout)
+                        break;
+                }
+                list_add_before( &other_timer->u.timer.timer_entry, &timer->u.timer.timer_entry );
+                timer->u.timer.timer_pending = TRUE;
+            }
+        }
+
+        timeout_lower = TIMEOUT_INFINITE;
+        timeout_upper = TIMEOUT_INFINITE;
+
+        /* Determine next timeout and use the window length to optimize wakeup times. */
+        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                             struct threadpool_object, u.timer.timer_entry )
+        {
+            assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
+            if (other_timer->u.timer.timeout >= timeout_upper)
+                break;
+
+            timeout_lower = other_timer->u.timer.timeout;
+            new_timeout   = timeout_lower + (ULONGLONG)other_timer->u.timer.window_length * 10000;
+            if (new_timeout < timeout_upper)
+                timeout_upper = new_timeout;
+        }
+
+        /* Wait for timer update events or until the next timer expires. */
+        if (timerqueue.objcount)
+        {
+            timeout.QuadPart = timeout_lower;
+            RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs, &timeout );
+            continue;
+        }
+
+        /* All timers have been destroyed, if no new timers are created
+         * within some amount of time, then we can shutdown this thread. */
+        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        if (RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs,
+            &timeout ) == STATUS_TIMEOUT && !timerqueue.objcount)
+        {
+            break;
+        }
+    }
+
+    timerqueue.thread_running = FALSE;
+    RtlLeaveCriticalSection( &timerqueue.cs );
+
+    TRACE( "terminating timer queue thread\n" );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_timerqueue_lock    (internal)
+ *
+ * Acquires a lock on the global timerqueue. When the lock is acquired
+ * successfully, it is guaranteed that the timer thread is running.
+ */
+static NTSTATUS tp_timerqueue_lock( struct threadpool_object *timer )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    assert( timer->type == TP_OBJECT_TYPE_TIMER );
+
+    timer->u.timer.timer_initialized    = FALSE;
+    timer->u.timer.timer_pending        = FALSE;
+    timer->u.timer.timer_set            = FALSE;
+    timer->u.timer.timeout              = 0;
+    timer->u.timer.period               = 0;
+    timer->u.timer.window_length        = 0;
+
+    RtlEnterCriticalSection( &timerqueue.cs );
+
+    /* Make sure that the timerqueue thread is running. */
+    if (!timerqueue.thread_running)
+    {
+        HANDLE thread;
+        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                      timerqueue_thread_proc, NULL, &thread, NULL );
+        if (status == STATUS_SUCCESS)
+        {
+            timerqueue.thread_running = TRUE;
+            NtClose( thread );
+        }
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        timer->u.timer.timer_initialized = TRUE;
+        timerqueue.objcount++;
+    }
+
+    RtlLeaveCriticalSection( &timerqueue.cs );
+    return status;
+}
+
+/***********************************************************************
+ *           tp_timerqueue_unlock    (internal)
+ *
+ * Releases a lock on the global timerqueue.
+ */
+static void tp_timerqueue_unlock( struct threadpool_object *timer )
+{
+    assert( timer->type == TP_OBJECT_TYPE_TIMER );
+
+    RtlEnterCriticalSection( &timerqueue.cs );
+    if (timer->u.timer.timer_initialized)
+    {
+        /* If timer was pending, remove it. */
+        if (timer->u.timer.timer_pending)
+        {
+            list_remove( &timer->u.timer.timer_entry );
+            timer->u.timer.timer_pending = FALSE;
+        }
+
+        /* If the last timer object was destroyed, then wake up the thread. */
+        if (!--timerqueue.objcount)
+        {
+            assert( list_empty( &timerqueue.pending_timers ) );
+            RtlWakeAllConditionVariable( &timerqueue.update_event );
+        }
+
+        timer->u.timer.timer_initialized = FALSE;
+    }
+    RtlLeaveCriticalSection( &timerqueue.cs );
+}
+
+/***********************************************************************
+ *           waitqueue_thread_proc    (internal)
+ */
+static void CALLBACK waitqueue_thread_proc( void *param )
+{
+    struct threadpool_object *objects[MAXIMUM_WAITQUEUE_OBJECTS];
+    HANDLE handles[MAXIMUM_WAITQUEUE_OBJECTS + 1];
+    struct waitqueue_bucket *bucket = param;
+    struct threadpool_object *wait, *next;
+    LARGE_INTEGER now, timeout;
+    DWORD num_handles;
+    NTSTATUS status;
+
+    TRACE( "starting wait queue thread\n" );
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    for (;;)
+    {
+        NtQuerySystemTime( &now );
+        timeout.QuadPart = TIMEOUT_INFINITE;
+        num_handles = 0;
+
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object,
+                                  u.wait.wait_entry )
+        {
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
+            if (wait->u.wait.timeout <= now.QuadPart)
+            {
+                /* Wait object timed out. */
+                list_remove( &wait->u.wait.wait_entry );
+                list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+                wait->u.wait.wait_pending = FALSE;
+                tp_object_submit( wait, FALSE );
+            }
+            else
+            {
+                if (wait->u.wait.timeout < timeout.QuadPart)
+                    timeout.QuadPart = wait->u.wait.timeout;
+
+                assert( num_handles < MAXIMUM_WAITQUEUE_OBJECTS );
+                interlocked_inc( &wait->refcount );
+                objects[num_handles] = wait;
+                handles[num_handles] = wait->u.wait.handle;
+                num_handles++;
+            }
+        }
+
+        if (!bucket->objcount)
+        {
+            /* All wait objects have been destroyed, if no new wait objects are created
+             * within some amount of time, then we can shutdown this thread. */
+            assert( num_handles == 0 );
+            RtlLeaveCriticalSection( &waitqueue.cs );
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            status = NtWaitForMultipleObjects( 1, &bucket->update_event, TRUE, FALSE, &timeout );
+            RtlEnterCriticalSection( &waitqueue.cs );
+
+            if (status == STATUS_TIMEOUT && !bucket->objcount)
+                break;
+        }
+        else
+        {
+            handles[num_handles] = bucket->update_event;
+            RtlLeaveCriticalSection( &waitqueue.cs );
+            status = NtWaitForMultipleObjects( num_handles + 1, handles, TRUE, FALSE, &timeout );
+            RtlEnterCriticalSection( &waitqueue.cs );
+
+            if (status >= STATUS_WAIT_0 && status < STATUS_WAIT_0 + num_handles)
+            {
+                wait = objects[status - STATUS_WAIT_0];
+                assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                if (wait->u.wait.bucket && wait->u.wait.wait_pending)
+                {
+                    /* Wait object signaled. */
+                    assert( wait->u.wait.bucket == bucket );
+                    list_remove( &wait->u.wait.wait_entry );
+                    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+                    wait->u.wait.wait_pending = FALSE;
+                    tp_object_submit( wait, TRUE );
+                }
+                else
+                    WARN( "wait object %p triggered while object was destroyed\n", wait );
+            }
+
+            /* Release temporary references to wait objects. */
+            while (num_handles)
+            {
+                wait = objects[--num_handles];
+                assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                tp_object_release( wait );
+            }
+        }
+
+        /* Try to merge bucket with other threads. */
+        if (waitqueue.num_buckets > 1 && bucket->objcount &&
+            bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 1 / 3)
+        {
+            struct waitqueue_bucket *other_bucket;
+            LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+            {
+                if (other_bucket != bucket && other_bucket->objcount &&
+                    other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
+                {
+                    other_bucket->objcount += bucket->objcount;
+                    bucket->objcount = 0;
+
+                    /* Update reserved list. */
+                    LIST_FOR_EACH_ENTRY( wait, &bucket->reserved, struct threadpool_object, u.wait.wait_entry )
+                    {
+                        assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                        wait->u.wait.bucket = other_bucket;
+                    }
+                    list_move_tail( &other_bucket->reserved, &bucket->reserved );
+
+                    /* Update waiting list. */
+                    LIST_FOR_EACH_ENTRY( wait, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+                    {
+                        assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                        wait->u.wait.bucket = other_bucket;
+                    }
+                    list_move_tail( &other_bucket->waiting, &bucket->waiting );
+
+                    /* Move bucket to the end, to keep the probability of
+                     * newly added wait objects as small as possible. */
+                    list_remove( &bucket->bucket_entry );
+                    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+
+                    NtSetEvent( other_bucket->update_event, NULL );
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Remove this bucket from the list. */
+    list_remove( &bucket->bucket_entry );
+    if (!--waitqueue.num_buckets)
+        assert( list_empty( &waitqueue.buckets ) );
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+    TRACE( "terminating wait queue thread\n" );
+
+    NtClose( bucket->update_event );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_waitqueue_lock    (internal)
+ *
+ * Assigns the wait object to a wait queue bucket with a free slot, starting
+ * a new wait thread if all existing ones are full.
+ */
+static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
+
+    wait->u.wait.signaled       = 0;
+    wait->u.wait.bucket         = NULL;
+    wait->u.wait.wait_pending   = FALSE;
+    wait->u.wait.timeout        = 0;
+    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    /* Try to assign to existing bucket if possible. */
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+    {
+        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS)
+        {
+            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+            wait->u.wait.bucket = bucket;
+            bucket->objcount++;
+
+            status = STATUS_SUCCESS;
+            goto out;
+        }
+    }
+
+    /* Create a new bucket and corresponding worker thread. */
+    bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
+    if (!bucket)
+    {
+        status = STATUS_NO_MEMORY;
+        goto out;
+    }
+
+    bucket->objcount = 0;
+    list_init( &bucket->reserved );
+    list_init( &bucket->waiting );
+
+    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
+                            NULL, SynchronizationEvent, FALSE );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        goto out;
+    }
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  waitqueue_thread_proc, bucket, &thread, NULL );
+    if (status == STATUS_SUCCESS)
+    {
+        list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+        waitqueue.num_buckets++;
+
+        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+        wait->u.wait.bucket = bucket;
+        bucket->objcount++;
+
+        NtClose( thread );
+    }
+    else
+    {
+        NtClose( bucket->update_event );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    }
+
+out:
+    RtlLeaveCriticalSection( &waitqueue.cs );
+    return status;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_unlock    (internal)
+ */
+static void tp_waitqueue_unlock( struct threadpool_object *wait )
+{
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+    if (wait->u.wait.bucket)
+    {
+        struct waitqueue_bucket *bucket = wait->u.wait.bucket;
+        assert( bucket->objcount > 0 );
+
+        list_remove( &wait->u.wait.wait_entry );
+        wait->u.wait.bucket = NULL;
+        wait->u.wait.wait_pending = FALSE;
+        bucket->objcount--;
+
+        NtSetEvent( bucket->update_event, NULL );
+    }
+    RtlLeaveCriticalSection( &waitqueue.cs );
+}
+
+/***********************************************************************
+ *           ioqueue_thread_proc    (internal)
+ */
+static void CALLBACK ioqueue_thread_proc( void *param )
+{
+    struct threadpool_object *io;
+    struct io_completion *completion;
+    IO_STATUS_BLOCK iosb;
+    ULONG_PTR key, value;
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+
+    TRACE( "starting I/O completion thread\n" );
+
+    for (;;)
+    {
+        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        status = NtRemoveIoCompletion( ioqueue.port, &key, &value, &iosb, &timeout );
+
+        if (status == STATUS_SUCCESS && key)
+        {
+            io = (struct threadpool_object *)key;
+            assert( io->type == TP_OBJECT_TYPE_IO );
+
+            RtlEnterCriticalSection( &io->pool->cs );
+
+            if (io->u.io.completion_count == io->u.io.completion_max)
+            {
+                unsigned int new_max = max( 4, io->u.io.completion_max * 2 );
+                struct io_completion *new_completions;
+
+                if (io->u.io.completions)
+                    new_completions = RtlReAllocateHeap( GetProcessHeap(), 0, io->u.io.completions,
+                                                         new_max * sizeof(*new_completions) );
+                else
+                    new_completions = RtlAllocateHeap( GetProcessHeap(), 0,
+                                                       new_max * sizeof(*new_completions) );
+                if (!new_completions)
+                {
+                    ERR( "failed to allocate memory for completion of %p\n", io );
+                    RtlLeaveCriticalSection( &io->pool->cs );
+                    continue;
+                }
+                io->u.io.completions    = new_completions;
+                io->u.io.completion_max = new_max;
+            }
+
+            completion = &io->u.io.completions[io->u.io.completion_count++];
+            completion->iosb   = iosb;
+            completion->cvalue = value;
+
+            tp_object_submit( io, FALSE );
+
+            RtlLeaveCriticalSection( &io->pool->cs );
+        }
+        else if (status != STATUS_SUCCESS && status != STATUS_TIMEOUT)
+            ERR( "NtRemoveIoCompletion failed, status %#x\n", status );
+
+        /* All I/O objects have been destroyed, if no new objects are created
+         * within some amount of time, then we can shutdown this thread. */
+        if (status == STATUS_TIMEOUT)
+        {
+            RtlEnterCriticalSection( &ioqueue.cs );
+            if (!ioqueue.objcount)
+            {
+                ioqueue.thread_running = FALSE;
+                RtlLeaveCriticalSection( &ioqueue.cs );
+                break;
+            }
+            RtlLeaveCriticalSection( &ioqueue.cs );
+        }
+    }
+
+    TRACE( "terminating I/O completion thread\n" );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_ioqueue_lock    (internal)
+ *
+ * Associates the file with the completion port of the global I/O queue,
+ * and makes sure that the I/O completion thread is running.
+ */
+static NTSTATUS tp_ioqueue_lock( struct threadpool_object *io, HANDLE file )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    assert( io->type == TP_OBJECT_TYPE_IO );
+
+    RtlEnterCriticalSection( &ioqueue.cs );
+
+    if (!ioqueue.port)
+        status = NtCreateIoCompletion( &ioqueue.port, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
+
+    if (status == STATUS_SUCCESS && !ioqueue.thread_running)
+    {
+        HANDLE thread;
+        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                      ioqueue_thread_proc, NULL, &thread, NULL );
+        if (status == STATUS_SUCCESS)
+        {
+            ioqueue.thread_running = TRUE;
+            NtClose( thread );
+        }
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        FILE_COMPLETION_INFORMATION info;
+        IO_STATUS_BLOCK iosb;
+
+        info.CompletionPort = ioqueue.port;
+        info.CompletionKey  = (ULONG_PTR)io;
+
+        status = NtSetInformationFile( file, &iosb, &info, sizeof(info), FileCompletionInformation );
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        io->u.io.queued = TRUE;
+        ioqueue.objcount++;
+    }
+
+    RtlLeaveCriticalSection( &ioqueue.cs );
+    return status;
+}
+
+/***********************************************************************
+ *           tp_ioqueue_unlock    (internal)
+ */
+static void tp_ioqueue_unlock( struct threadpool_object *io )
+{
+    assert( io->type == TP_OBJECT_TYPE_IO );
+
+    RtlEnterCriticalSection( &ioqueue.cs );
+    if (io->u.io.queued)
+    {
+        assert( ioqueue.objcount > 0 );
+        ioqueue.objcount--;
+        io->u.io.queued = FALSE;
+    }
+    RtlLeaveCriticalSection( &ioqueue.cs );
+}
+
+/***********************************************************************
+ *           tp_threadpool_alloc    (internal)
+ *
+ * Allocates a new threadpool object.
+ */
+static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
+{
+    struct threadpool *pool;
+
+    pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
+    if (!pool)
+        return STATUS_NO_MEMORY;
+
+    pool->refcount              = 1;
+    pool->objcount              = 0;
+    pool->shutdown              = FALSE;
+
+    RtlInitializeCriticalSection( &pool->cs );
+    pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
+
+    list_init( &pool->pool );
+    RtlInitializeConditionVariable( &pool->update_event );
+
+    pool->max_workers           = 500;
+    pool->min_workers           = 0;
+    pool->num_workers           = 0;
+    pool->num_busy_workers      = 0;
+
+    TRACE( "allocated threadpool %p\n", pool );
+
+    *out = pool;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_threadpool_shutdown    (internal)
+ *
+ * Prepares the shutdown of a threadpool object and notifies all worker
+ * threads to terminate (after all remaining work items have been
+ * processed).
+ */
+static void tp_threadpool_shutdown( struct threadpool *pool )
+{
+    assert( pool != default_threadpool && pool != persistent_threadpool );
+
+    pool->shutdown = TRUE;
+    RtlWakeAllConditionVariable( &pool->update_event );
+}
+
+/***********************************************************************
+ *           tp_threadpool_release    (internal)
+ *
+ * Releases a reference to a threadpool object.
+ */
+static BOOL tp_threadpool_release( struct threadpool *pool )
+{
+    if (interlocked_dec( &pool->refcount ))
+        return FALSE;
+
+    TRACE( "destroying threadpool %p\n", pool );
+
+    assert( pool->shutdown );
+    assert( !pool->objcount );
+    assert( list_empty( &pool->pool ) );
+
+    pool->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &pool->cs );
+
+    RtlFreeHeap( GetProcessHeap(), 0, pool );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           threadpool_worker_proc    (internal)
+ */
+static void CALLBACK threadpool_worker_proc( void *param );
+
+/***********************************************************************
+ *           tp_new_worker_thread    (internal)
+ *
+ * Create and account a new worker thread for the desired pool.
+ */
+static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
+{
+    HANDLE thread;
+    NTSTATUS status;
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  threadpool_worker_proc, pool, &thread, NULL );
+    if (status == STATUS_SUCCESS)
+    {
+        interlocked_inc( &pool->refcount );
+        pool->num_workers++;
+        NtClose( thread );
+    }
+    return status;
+}
+
+/***********************************************************************
+ *           tp_threadpool_lock    (internal)
+ *
+ * Acquires a lock on a threadpool, specified with an TP_CALLBACK_ENVIRON
+ * block. When the lock is acquired successfully, it is guaranteed that
+ * there is at least one worker thread to process tasks.
+ */
+static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool *pool = NULL;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (environment)
+        pool = (struct threadpool *)environment->Pool;
+
+    if (!pool && environment && environment->u.s.Persistent)
+    {
+        /* Persistent callbacks run in a single dedicated thread which never
+         * terminates, so that APCs queued from them are not lost. */
+        if (!persistent_threadpool)
+        {
+            status = tp_threadpool_alloc( &pool );
+            if (status != STATUS_SUCCESS)
+                return status;
+
+            pool->max_workers = 1;
+            pool->min_workers = 1;
+
+            if (interlocked_cmpxchg_ptr( (void *)&persistent_threadpool, pool, NULL ) != NULL)
+            {
+                pool->shutdown = TRUE;
+                tp_threadpool_release( pool );
+            }
+        }
+
+        pool = persistent_threadpool;
+    }
+    else if (!pool)
+    {
+        if (!default_threadpool)
+        {
+            status = tp_threadpool_alloc( &pool );
+            if (status != STATUS_SUCCESS)
+                return status;
+
+            if (interlocked_cmpxchg_ptr( (void *)&default_threadpool, pool, NULL ) != NULL)
+            {
+                pool->shutdown = TRUE;
+                tp_threadpool_release( pool );
+            }
+        }
+
+        pool = default_threadpool;
+    }
+
+    RtlEnterCriticalSection( &pool->cs );
+
+    /* Make sure that the threadpool has at least one thread. */
+    if (!pool->num_workers)
+        status = tp_new_worker_thread( pool );
+
+    /* Keep a reference, and increment objcount to ensure that the
+     * last thread doesn't terminate. */
+    if (status == STATUS_SUCCESS)
+    {
+        interlocked_inc( &pool->refcount );
+        pool->objcount++;
+    }
+
+    RtlLeaveCriticalSection( &pool->cs );
+
+    if (status != STATUS_SUCCESS)
+        return status;
+
+    *out = pool;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_threadpool_unlock    (internal)
+ *
+ * Releases a lock on a threadpool.
+ */
+static void tp_threadpool_unlock( struct threadpool *pool )
+{
+    RtlEnterCriticalSection( &pool->cs );
+    pool->objcount--;
+    RtlLeaveCriticalSection( &pool->cs );
+    tp_threadpool_release( pool );
+}
+
+/***********************************************************************
+ *           tp_group_alloc    (internal)
+ *
+ * Allocates a new threadpool group object.
+ */
+static NTSTATUS tp_group_alloc( struct threadpool_group **out )
+{
+    struct threadpool_group *group;
+
+    group = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*group) );
+    if (!group)
+        return STATUS_NO_MEMORY;
+
+    group->refcount     = 1;
+    group->shutdown     = FALSE;
+
+    RtlInitializeCriticalSection( &group->cs );
+    group->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool_group.cs");
+
+    list_init( &group->members );
+
+    TRACE( "allocated group %p\n", group );
+
+    *out = group;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_group_shutdown    (internal)
+ *
+ * Marks the group object for shutdown.
+ */
+static void tp_group_shutdown( struct threadpool_group *group )
+{
+    group->shutdown = TRUE;
+}
+
+/***********************************************************************
+ *           tp_group_release    (internal)
+ *
+ * Releases a reference to a group object.
+ */
+static BOOL tp_group_release( struct threadpool_group *group )
+{
+    if (interlocked_dec( &group->refcount ))
+        return FALSE;
+
+    TRACE( "destroying group %p\n", group );
+
+    assert( group->shutdown );
+    assert( list_empty( &group->members ) );
+
+    group->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &group->cs );
+
+    RtlFreeHeap( GetProcessHeap(), 0, group );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_object_initialize    (internal)
+ *
+ * Initializes members of a threadpool object.
+ */
+static void tp_object_initialize( struct threadpool_object *object, struct threadpool *pool,
+                                  PVOID userdata, TP_CALLBACK_ENVIRON *environment )
+{
+    BOOL is_simple_callback = (object->type == TP_OBJECT_TYPE_SIMPLE);
+
+    object->win32_callback          = NULL;
+    object->refcount                = 1;
+    object->shutdown                = FALSE;
+
+    object->pool                    = pool;
+    object->group                   = NULL;
+    object->userdata                = userdata;
+    object->group_cancel_callback   = NULL;
+    object->finalization_callback   = NULL;
+    object->may_run_long            = 0;
+    object->race_dll                = NULL;
+
+    memset( &object->group_entry, 0, sizeof(object->group_entry) );
+    object->is_group_member         = FALSE;
+
+    memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+    RtlInitializeConditionVariable( &object->finished_event );
+    RtlInitializeConditionVariable( &object->group_finished_event );
+    object->completed_event         = NULL;
+    object->num_pending_callbacks   = 0;
+    object->num_running_callbacks   = 0;
+    object->num_associated_callbacks = 0;
+
+    if (environment)
+    {
+        if (environment->Version != 1)
+            FIXME( "unsupported environment version %u\n", environment->Version );
+
+        object->group = impl_from_TP_CLEANUP_GROUP( environment->CleanupGroup );
+        object->group_cancel_callback   = environment->CleanupGroupCancelCallback;
+        object->finalization_callback   = environment->FinalizationCallback;
+        object->may_run_long            = environment->u.s.LongFunction != 0;
+        object->race_dll                = environment->RaceDll;
+
+        if (environment->ActivationContext)
+            FIXME( "activation context not supported yet\n" );
+
+    }
+
+    if (object->race_dll)
+        LdrAddRefDll( 0, object->race_dll );
+
+    TRACE( "allocated object %p of type %u\n", object, object->type );
+
+    /* For simple callbacks we have to run tp_object_submit before adding this object
+     * to the cleanup group. As soon as the cleanup group members are released ->shutdown
+     * will be set, and tp_object_submit would fail with an assertion. */
+
+    if (is_simple_callback)
+        tp_object_submit( object, FALSE );
+
+    if (object->group)
+    {
+        struct threadpool_group *group = object->group;
+        interlocked_inc( &group->refcount );
+
+        RtlEnterCriticalSection( &group->cs );
+        list_add_tail( &group->members, &object->group_entry );
+        object->is_group_member = TRUE;
+        RtlLeaveCriticalSection( &group->cs );
+    }
+
+    if (is_simple_callback)
+    {
+        tp_object_prepare_shutdown( object );
+        object->shutdown = TRUE;
+        tp_object_release( object );
+    }
+}
+
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    struct threadpool *pool = object->pool;
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    assert( !object->shutdown || object->type == TP_OBJECT_TYPE_TIMER || object->type == TP_OBJECT_TYPE_IO );
+    assert( !pool->shutdown );
+
+    RtlEnterCriticalSection( &pool->cs );
+
+    /* Start new worker threads if required. */
+    if (pool->num_busy_workers >= pool->num_workers &&
+        pool->num_workers < pool->max_workers)
+        status = tp_new_worker_thread( pool );
+
+    /* Queue work item and increment refcount. */
+    interlocked_inc( &object->refcount );
+    if (!object->num_pending_callbacks++)
+        list_add_tail( &pool->pool, &object->pool_entry );
+
+    /* Count how often the object was signaled. */
+    if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
+        object->u.wait.signaled++;
+
+    /* No new thread started - wake up one existing thread. */
+    if (status != STATUS_SUCCESS)
+    {
+        assert( pool->num_workers > 0 );
+        RtlWakeConditionVariable( &pool->update_event );
+    }
+
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_object_cancel    (internal)
+ *
+ * Cancels all currently pending callbacks for a specific object.
+ */
+static void tp_object_cancel( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+    LONG pending_callbacks = 0;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (object->num_pending_callbacks)
+    {
+        pending_callbacks = object->num_pending_callbacks;
+        object->num_pending_callbacks = 0;
+        list_remove( &object->pool_entry );
+
+        if (object->type == TP_OBJECT_TYPE_WAIT)
+            object->u.wait.signaled = 0;
+    }
+    if (object->type == TP_OBJECT_TYPE_IO)
+    {
+        object->u.io.pending_count = 0;
+        object->u.io.completion_count = 0;
+    }
+    if (!object->num_associated_callbacks)
+        RtlWakeAllConditionVariable( &object->finished_event );
+    if (!object->num_running_callbacks)
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+    RtlLeaveCriticalSection( &pool->cs );
+
+    while (pending_callbacks--)
+        tp_object_release( object );
+}
+
+/***********************************************************************
+ *           tp_object_wait    (internal)
+ *
+ * Waits until all pending and running callbacks of a specific object
+ * have been processed.
+ */
+static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
+{
+    struct threadpool *pool = object->pool;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (group_wait)
+    {
+        while (object->num_pending_callbacks || object->num_running_callbacks)
+            RtlSleepConditionVariableCS( &object->group_finished_event, &pool->cs, NULL );
+    }
+    else
+    {
+        while (object->num_pending_callbacks || object->num_associated_callbacks)
+            RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_object_prepare_shutdown    (internal)
+ *
+ * Prepares a threadpool object for shutdown.
+ */
+static void tp_object_prepare_shutdown( struct threadpool_object *object )
+{
+    if (object->type == TP_OBJECT_TYPE_TIMER)
+        tp_timerqueue_unlock( object );
+    else if (object->type == TP_OBJECT_TYPE_WAIT)
+        tp_waitqueue_unlock( object );
+    else if (object->type == TP_OBJECT_TYPE_IO)
+        tp_ioqueue_unlock( object );
+}
+
+/***********************************************************************
+ *           tp_object_release    (internal)
+ *
+ * Releases a reference to a threadpool object.
+ */
+static BOOL tp_object_release( struct threadpool_object *object )
+{
+    if (interlocked_dec( &object->refcount ))
+        return FALSE;
+
+    TRACE( "destroying object %p of type %u\n", object, object->type );
+
+    assert( object->shutdown );
+    assert( !object->num_pending_callbacks );
+    assert( !object->num_running_callbacks );
+    assert( !object->num_associated_callbacks );
+
+    /* release reference to the group */
+    if (object->group)
+    {
+        struct threadpool_group *group = object->group;
+
+        RtlEnterCriticalSection( &group->cs );
+        if (object->is_group_member)
+        {
+            list_remove( &object->group_entry );
+            object->is_group_member = FALSE;
+        }
+        RtlLeaveCriticalSection( &group->cs );
+
+        tp_group_release( group );
+    }
+
+    tp_threadpool_unlock( object->pool );
+
+    if (object->race_dll)
+        LdrUnloadDll( object->race_dll );
+
+    if (object->completed_event && object->completed_event != INVALID_HANDLE_VALUE)
+        NtSetEvent( object->completed_event, NULL );
+
+    if (object->type == TP_OBJECT_TYPE_IO)
+        RtlFreeHeap( GetProcessHeap(), 0, object->u.io.completions );
+
+    RtlFreeHeap( GetProcessHeap(), 0, object );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_object_execute    (internal)
+ *
+ * Executes a callback of a threadpool object. Called with the pool lock
+ * held, which is temporarily released while the callback runs. Returns
+ * TRUE if the caller has to destroy a released I/O object.
+ */
+static BOOL tp_object_execute( struct threadpool_object *object )
+{
+    TP_CALLBACK_INSTANCE *callback_instance;
+    struct threadpool_instance instance;
+    struct io_completion completion;
+    struct threadpool *pool = object->pool;
+    TP_WAIT_RESULT wait_result = 0;
+    NTSTATUS status;
+
+    assert( object->num_pending_callbacks > 0 );
+
+    /* If further pending callbacks are queued, move the work item to
+     * the end of the pool list. Otherwise remove it from the pool. */
+    list_remove( &object->pool_entry );
+    if (--object->num_pending_callbacks)
+        list_add_tail( &pool->pool, &object->pool_entry );
+
+    /* For wait objects check if they were signaled or have timed out. */
+    if (object->type == TP_OBJECT_TYPE_WAIT)
+    {
+        wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+        if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+    }
+    else if (object->type == TP_OBJECT_TYPE_IO)
+    {
+        assert( object->u.io.completion_count );
+        completion = object->u.io.completions[0];
+        memmove( object->u.io.completions, object->u.io.completions + 1,
+                 --object->u.io.completion_count * sizeof(*object->u.io.completions) );
+        if (object->u.io.pending_count) object->u.io.pending_count--;
+    }
+
+    /* Leave critical section and do the actual callback. */
+    object->num_associated_callbacks++;
+    object->num_running_callbacks++;
+    pool->num_busy_workers++;
+    RtlLeaveCriticalSection( &pool->cs );
+
+    /* Initialize threadpool instance struct. */
+    callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
+    instance.object                     = object;
+    instance.threadid                   = GetCurrentThreadId();
+    instance.associated                 = TRUE;
+    instance.may_run_long               = object->may_run_long;
+    instance.cleanup.critical_section   = NULL;
+    instance.cleanup.mutex              = NULL;
+    instance.cleanup.semaphore          = NULL;
+    instance.cleanup.semaphore_count    = 0;
+    instance.cleanup.event              = NULL;
+    instance.cleanup.library            = NULL;
+
+    switch (object->type)
+    {
+        case TP_OBJECT_TYPE_SIMPLE:
+        {
+            TRACE( "executing simple callback %p(%p, %p)\n",
+                   object->u.simple.callback, callback_instance, object->userdata );
+            object->u.simple.callback( callback_instance, object->userdata );
+            TRACE( "callback %p returned\n", object->u.simple.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WORK:
+        {
+            TRACE( "executing work callback %p(%p, %p, %p)\n",
+                   object->u.work.callback, callback_instance, object->userdata, object );
+            object->u.work.callback( callback_instance, object->userdata, (TP_WORK *)object );
+            TRACE( "callback %p returned\n", object->u.work.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_TIMER:
+        {
+            TRACE( "executing timer callback %p(%p, %p, %p)\n",
+                   object->u.timer.callback, callback_instance, object->userdata, object );
+            object->u.timer.callback( callback_instance, object->userdata, (TP_TIMER *)object );
+            TRACE( "callback %p returned\n", object->u.timer.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WAIT:
+        {
+            TRACE( "executing wait callback %p(%p, %p, %p, %u)\n",
+                   object->u.wait.callback, callback_instance, object->userdata, object, wait_result );
+            object->u.wait.callback( callback_instance, object->userdata, (TP_WAIT *)object, wait_result );
+            TRACE( "callback %p returned\n", object->u.wait.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_IO:
+        {
+            TRACE( "executing I/O callback %p(%p, %p, %#lx, %p, %p)\n",
+                   object->u.io.callback, callback_instance, object->userdata,
+                   completion.cvalue, &completion.iosb, object );
+            object->u.io.callback( callback_instance, object->userdata,
+                                   (void *)completion.cvalue, &completion.iosb, (TP_IO *)object );
+            TRACE( "callback %p returned\n", object->u.io.callback );
+            break;
+        }
+
+        default:
+            assert(0);
+            break;
+    }
+
+    /* Execute finalization callback. */
+    if (object->finalization_callback)
+    {
+        TRACE( "executing finalization callback %p(%p, %p)\n",
+               object->finalization_callback, callback_instance, object->userdata );
+        object->finalization_callback( callback_instance, object->userdata );
+        TRACE( "callback %p returned\n", object->finalization_callback );
+    }
+
+    /* Execute cleanup tasks. */
+    if (instance.cleanup.critical_section)
+    {
+        RtlLeaveCriticalSection( instance.cleanup.critical_section );
+    }
+    if (instance.cleanup.mutex)
+    {
+        status = NtReleaseMutant( instance.cleanup.mutex, NULL );
+        if (status != STATUS_SUCCESS) goto skip_cleanup;
+    }
+    if (instance.cleanup.semaphore)
+    {
+        status = NtReleaseSemaphore( instance.cleanup.semaphore, instance.cleanup.semaphore_count, NULL );
+        if (status != STATUS_SUCCESS) goto skip_cleanup;
+    }
+    if (instance.cleanup.event)
+    {
+        status = NtSetEvent( instance.cleanup.event, NULL );
+        if (status != STATUS_SUCCESS) goto skip_cleanup;
+    }
+    if (instance.cleanup.library)
+    {
+        LdrUnloadDll( instance.cleanup.library );
+    }
+
+skip_cleanup:
+    RtlEnterCriticalSection( &pool->cs );
+    pool->num_busy_workers--;
+
+    object->num_running_callbacks--;
+    if (!object->num_pending_callbacks && !object->num_running_callbacks)
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+
+    if (instance.associated)
+    {
+        object->num_associated_callbacks--;
+        if (!object->num_pending_callbacks && !object->num_associated_callbacks)
+            RtlWakeAllConditionVariable( &object->finished_event );
+    }
+
+    /* I/O objects released while operations were still pending are
+     * destroyed once the last completion has been processed. */
+    if (object->type == TP_OBJECT_TYPE_IO && object->u.io.shutting_down && !object->shutdown &&
+        !object->u.io.pending_count && !object->u.io.completion_count)
+    {
+        object->shutdown = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/***********************************************************************
+ *           threadpool_worker_proc    (internal)
+ */
+static void CALLBACK threadpool_worker_proc( void *param )
+{
+    struct threadpool *pool = param;
+    LARGE_INTEGER timeout;
+    struct list *ptr;
+
+    TRACE( "starting worker thread for pool %p\n", pool );
+
+    RtlEnterCriticalSection( &pool->cs );
+    for (;;)
+    {
+        while ((ptr = list_head( &pool->pool )))
+        {
+            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+
+            BOOL destroy = tp_object_execute( object );
+
+            /* Release reference to the object. The pool lock is not held here,
+             * destroying the object may need the group and queue locks. */
+            RtlLeaveCriticalSection( &pool->cs );
+            if (destroy)
+            {
+                tp_object_prepare_shutdown( object );
+                tp_object_release( object );
+            }
+            tp_object_release( object );
+            RtlEnterCriticalSection( &pool->cs );
+        }
+
+        /* Shutdown worker thread if requested. */
+        if (pool->shutdown)
+            break;
+
+        /* Wait for new tasks or until the timeout expires. A thread only terminates
+         * when no new tasks are available, and the number of threads can be
+         * decreased without violating the min_workers limit. An exception is when
+         * min_workers == 0, then objcount is used to detect if the last thread
+         * can be terminated. */
+        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
+            !list_head( &pool->pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
+            (!pool->min_workers && !pool->objcount)))
+        {
+            break;
+        }
+    }
+    pool->num_workers--;
+    RtlLeaveCriticalSection( &pool->cs );
+
+    TRACE( "terminating worker thread for pool %p\n", pool );
+    tp_threadpool_release( pool );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_object_set_wait    (internal)
+ *
+ * Starts or stops waiting on an object; does nothing if the wait object
+ * is being destroyed concurrently.
+ */
+static void tp_object_set_wait( struct threadpool_object *wait, HANDLE handle, LARGE_INTEGER *timeout )
+{
+    ULONGLONG timestamp = TIMEOUT_INFINITE;
+    BOOL submit_wait = FALSE, signaled = FALSE;
+
+    /* A zero timeout only checks the current state of the object. */
+    if (handle && timeout && !timeout->QuadPart)
+    {
+        signaled = (NtWaitForSingleObject( handle, FALSE, timeout ) == STATUS_WAIT_0);
+        submit_wait = TRUE;
+        handle = NULL;
+    }
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    if (!wait->u.wait.bucket)
+    {
+        RtlLeaveCriticalSection( &waitqueue.cs );
+        return;
+    }
+
+    wait->u.wait.handle = handle;
+    if (handle || wait->u.wait.wait_pending)
+    {
+        struct waitqueue_bucket *bucket = wait->u.wait.bucket;
+        list_remove( &wait->u.wait.wait_entry );
+
+        /* Convert relative timeout to absolute timestamp. */
+        if (handle && timeout)
+        {
+            timestamp = timeout->QuadPart;
+            if ((LONGLONG)timestamp < 0)
+            {
+                LARGE_INTEGER now;
+                NtQuerySystemTime( &now );
+                timestamp = now.QuadPart - timestamp;
+            }
+        }
+
+        /* Add wait object back into one of the queues. */
+        if (handle)
+        {
+            list_add_tail( &bucket->waiting, &wait->u.wait.wait_entry );
+            wait->u.wait.wait_pending = TRUE;
+            wait->u.wait.timeout = timestamp;
+        }
+        else
+        {
+            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+            wait->u.wait.wait_pending = FALSE;
+        }
+
+        /* Wake up the wait queue thread. */
+        NtSetEvent( bucket->update_event, NULL );
+    }
+
+    if (submit_wait)
+        tp_object_submit( wait, signaled );
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
+}
+
+/***********************************************************************
+ *           TpAllocCleanupGroup    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocCleanupGroup( TP_CLEANUP_GROUP **out )
+{
+    TRACE( "%p\n", out );
+
+    return tp_group_alloc( (struct threadpool_group **)out );
+}
+
+/***********************************************************************
+ *           TpAllocIoCompletion    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocIoCompletion( TP_IO **out, HANDLE file, PTP_IO_CALLBACK callback,
+                                     PVOID userdata, TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p %p\n", out, file, callback, userdata, environment );
+
+    object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) );
+    if (!object)
+        return STATUS_NO_MEMORY;
+
+    status = tp_threadpool_lock( &pool, environment );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    object->type = TP_OBJECT_TYPE_IO;
+    object->u.io.callback         = callback;
+    object->u.io.pending_count    = 0;
+    object->u.io.shutting_down    = FALSE;
+    object->u.io.queued           = FALSE;
+    object->u.io.completion_count = 0;
+    object->u.io.completion_max   = 0;
+    object->u.io.completions      = NULL;
+
+    status = tp_ioqueue_lock( object, file );
+    if (status)
+    {
+        tp_threadpool_unlock( pool );
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    tp_object_initialize( object, pool, userdata, environment );
+
+    *out = (TP_IO *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocPool    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocPool( TP_POOL **out, PVOID reserved )
+{
+    TRACE( "%p %p\n", out, reserved );
+
+    if (reserved)
+        FIXME( "reserved argument is nonzero (%p)\n", reserved );
+
+    return tp_threadpool_alloc( (struct threadpool **)out );
+}
+
+/***********************************************************************
+ *           TpAllocTimer    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocTimer( TP_TIMER **out, PTP_TIMER_CALLBACK callback, PVOID userdata,
+                              TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) );
+    if (!object)
+        return STATUS_NO_MEMORY;
+
+    status = tp_threadpool_lock( &pool, environment );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    object->type = TP_OBJECT_TYPE_TIMER;
+    object->u.timer.callback = callback;
+
+    status = tp_timerqueue_lock( object );
+    if (status)
+    {
+        tp_threadpool_unlock( pool );
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    tp_object_initialize( object, pool, userdata, environment );
+
+    *out = (TP_TIMER *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocWait     (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWait( TP_WAIT **out, PTP_WAIT_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) );
+    if (!object)
+        return STATUS_NO_MEMORY;
+
+    status = tp_threadpool_lock( &pool, environment );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    object->type = TP_OBJECT_TYPE_WAIT;
+    object->u.wait.callback         = callback;
+    object->u.wait.rtl_callback     = NULL;
+    object->u.wait.rtl_flags        = 0;
+    object->u.wait.rtl_milliseconds = INFINITE;
+
+    status = tp_waitqueue_lock( object );
+    if (status)
+    {
+        tp_threadpool_unlock( pool );
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    tp_object_initialize( object, pool, userdata, environment );
+
+    *out = (TP_WAIT *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocWork    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWork( TP_WORK **out, PTP_WORK_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) );
+    if (!object)
+        return STATUS_NO_MEMORY;
+
+    status = tp_threadpool_lock( &pool, environment );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    object->type = TP_OBJECT_TYPE_WORK;
+    object->u.work.callback = callback;
+    tp_object_initialize( object, pool, userdata, environment );
+
+    *out = (TP_WORK *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpCallbackLeaveCriticalSectionOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackLeaveCriticalSectionOnCompletion( TP_CALLBACK_INSTANCE *instance, RTL_CRITICAL_SECTION *crit )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, crit );
+
+    if (!this->cleanup.critical_section)
+        this->cleanup.critical_section = crit;
+}
+
+/***********************************************************************
+ *           TpCallbackMayRunLong    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpCallbackMayRunLong( TP_CALLBACK_INSTANCE *instance )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+    struct threadpool_object *object = this->object;
+    struct threadpool *pool;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "%p\n", instance );
+
+    if (this->threadid != GetCurrentThreadId())
+    {
+        ERR("called from wrong thread, ignoring\n");
+        return STATUS_UNSUCCESSFUL; /* FIXME */
+    }
+
+    if (this->may_run_long)
+        return STATUS_SUCCESS;
+
+    pool = object->pool;
+    RtlEnterCriticalSection( &pool->cs );
+
+    /* Start new worker threads if required. */
+    if (pool->num_busy_workers >= pool->num_workers)
+    {
+        if (pool->num_workers < pool->max_workers)
+        {
+            status = tp_new_worker_thread( pool );
+        }
+        else
+        {
+            status = STATUS_TOO_MANY_THREADS;
+        }
+    }
+
+    RtlLeaveCriticalSection( &pool->cs );
+    this->may_run_long = TRUE;
+    return status;
+}
+
+/***********************************************************************
+ *           TpCallbackReleaseMutexOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackReleaseMutexOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE mutex )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, mutex );
+
+    if (!this->cleanup.mutex)
+        this->cleanup.mutex = mutex;
+}
+
+/***********************************************************************
+ *           TpCallbackReleaseSemaphoreOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackReleaseSemaphoreOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE semaphore, DWORD count )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p %u\n", instance, semaphore, count );
+
+    if (!this->cleanup.semaphore)
+    {
+        this->cleanup.semaphore = semaphore;
+        this->cleanup.semaphore_count = count;
+    }
+}
+
+/***********************************************************************
+ *           TpCallbackSetEventOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackSetEventOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE event )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, event );
+
+    if (!this->cleanup.event)
+        this->cleanup.event = event;
+}
+
+/***********************************************************************
+ *           TpCallbackUnloadDllOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackUnloadDllOnCompletion( TP_CALLBACK_INSTANCE *instance, HMODULE module )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, module );
+
+    if (!this->cleanup.library)
+        this->cleanup.library = module;
+}
+
+/***********************************************************************
+ *           TpCancelAsyncIoOperation    (NTDLL.@)
+ */
+VOID WINAPI TpCancelAsyncIoOperation( TP_IO *io )
+{
+    struct threadpool_object *this = impl_from_TP_IO( io );
+
+    TRACE( "%p\n", io );
+
+    RtlEnterCriticalSection( &this->pool->cs );
+    if (this->u.io.pending_count)
+        this->u.io.pending_count--;
+    RtlLeaveCriticalSection( &this->pool->cs );
+}
+
+/***********************************************************************
+ *           TpDisassociateCallback    (NTDLL.@)
+ */
+VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+    struct threadpool_object *object = this->object;
+    struct threadpool *pool;
+
+    TRACE( "%p\n", instance );
+
+    if (this->threadid != GetCurrentThreadId())
+    {
+        ERR("called from wrong thread, ignoring\n");
+        return;
+    }
+
+    if (!this->associated)
+        return;
+
+    pool = object->pool;
+    RtlEnterCriticalSection( &pool->cs );
+
+    object->num_associated_callbacks--;
+    if (!object->num_pending_callbacks && !object->num_associated_callbacks)
+        RtlWakeAllConditionVariable( &object->finished_event );
+
+    RtlLeaveCriticalSection( &pool->cs );
+    this->associated = FALSE;
+}
+
+/***********************************************************************
+ *           TpIsTimerSet    (NTDLL.@)
+ */
+BOOL WINAPI TpIsTimerSet( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    return this->u.timer.timer_set;
+}
+
+/***********************************************************************
+ *           TpPostWork    (NTDLL.@)
+ */
+VOID WINAPI TpPostWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p\n", work );
+
+    tp_object_submit( this, FALSE );
+}
+
+/***********************************************************************
+ *           TpReleaseCleanupGroup    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseCleanupGroup( TP_CLEANUP_GROUP *group )
+{
+    struct threadpool_group *this = impl_from_TP_CLEANUP_GROUP( group );
+
+    TRACE( "%p\n", group );
+
+    tp_group_shutdown( this );
+    tp_group_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseCleanupGroupMembers    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseCleanupGroupMembers( TP_CLEANUP_GROUP *group, BOOL cancel_pending, PVOID userdata )
+{
+    struct threadpool_group *this = impl_from_TP_CLEANUP_GROUP( group );
+    struct threadpool_object *object, *next;
+    struct list members;
+
+    TRACE( "%p %u %p\n", group, cancel_pending, userdata );
+
+    RtlEnterCriticalSection( &this->cs );
+
+    /* Unset group, increase references, and mark objects for shutdown */
+    LIST_FOR_EACH_ENTRY_SAFE( object, next, &this->members, struct threadpool_object, group_entry )
+    {
+        assert( object->group == this );
+        assert( object->is_group_member );
+
+        if (interlocked_inc( &object->refcount ) == 1)
+        {
+            /* Object is basically already destroyed, but group reference
+             * was not deleted yet. We can safely ignore this object. */
+            interlocked_dec( &object->refcount );
+            list_remove( &object->group_entry );
+            object->is_group_member = FALSE;
+            continue;
+        }
+
+        object->is_group_member = FALSE;
+    }
+
+    /* Move members to a new temporary list */
+    list_init( &members );
+    list_move_tail( &members, &this->members );
+
+    RtlLeaveCriticalSection( &this->cs );
+
+    /* Stop timers, waits and I/O from queueing new callbacks */
+    LIST_FOR_EACH_ENTRY( object, &members, struct threadpool_object, group_entry )
+    {
+        tp_object_prepare_shutdown( object );
+    }
+
+    /* Cancel pending callbacks if requested */
+    if (cancel_pending)
+    {
+        LIST_FOR_EACH_ENTRY( object, &members, struct threadpool_object, group_entry )
+        {
+            tp_object_cancel( object );
+        }
+    }
+
+    /* Wait for remaining callbacks to finish */
+    LIST_FOR_EACH_ENTRY_SAFE( object, next, &members, struct threadpool_object, group_entry )
+    {
+        tp_object_wait( object, TRUE );
+
+        if (!object->shutdown)
+        {
+            /* Execute group cancellation callback if defined, and if this was actually a group cancel. */
+            if (cancel_pending && object->group_cancel_callback)
+            {
+                TRACE( "executing group cancel callback %p(%p, %p)\n",
+                       object->group_cancel_callback, object->userdata, userdata );
+                object->group_cancel_callback( object->userdata, userdata );
+                TRACE( "callback %p returned\n", object->group_cancel_callback );
+            }
+
+            if (object->type != TP_OBJECT_TYPE_SIMPLE)
+                tp_object_release( object );
+        }
+
+        object->shutdown = TRUE;
+        tp_object_release( object );
+    }
+}
+
+/***********************************************************************
+ *           TpReleaseIoCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseIoCompletion( TP_IO *io )
+{
+    struct threadpool_object *this = impl_from_TP_IO( io );
+    BOOL can_destroy;
+
+    TRACE( "%p\n", io );
+
+    RtlEnterCriticalSection( &this->pool->cs );
+    this->u.io.shutting_down = TRUE;
+    can_destroy = !this->u.io.pending_count && !this->u.io.completion_count &&
+                  !this->num_running_callbacks;
+    if (can_destroy) this->shutdown = TRUE;
+    RtlLeaveCriticalSection( &this->pool->cs );
+
+    if (can_destroy)
+    {
+        tp_object_prepare_shutdown( this );
+        tp_object_release( this );
+    }
+}
+
+/***********************************************************************
+ *           TpReleasePool    (NTDLL.@)
+ */
+VOID WINAPI TpReleasePool( TP_POOL *pool )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p\n", pool );
+
+    tp_threadpool_shutdown( this );
+    tp_threadpool_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseTimer     (NTDLL.@)
+ */
+VOID WINAPI TpReleaseTimer( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    tp_object_prepare_shutdown( this );
+    this->shutdown = TRUE;
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWait    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWait( TP_WAIT *wait )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p\n", wait );
+
+    tp_object_prepare_shutdown( this );
+    this->shutdown = TRUE;
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWork    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p\n", work );
+
+    tp_object_prepare_shutdown( this );
+    this->shutdown = TRUE;
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpSetPoolMaxThreads    (NTDLL.@)
+ */
+VOID WINAPI TpSetPoolMaxThreads( TP_POOL *pool, DWORD maximum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p %u\n", pool, maximum );
+
+    RtlEnterCriticalSection( &this->cs );
+    this->max_workers = max( maximum, 1 );
+    this->min_workers = min( this->min_workers, this->max_workers );
+    RtlLeaveCriticalSection( &this->cs );
+}
+
+/***********************************************************************
+ *           TpSetPoolMinThreads    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "%p %u\n", pool, minimum );
+
+    RtlEnterCriticalSection( &this->cs );
+
+    while (this->num_workers < minimum)
+    {
+        status = tp_new_worker_thread( this );
+        if (status != STATUS_SUCCESS)
+            break;
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        this->min_workers = minimum;
+        this->max_workers = max( this->min_workers, this->max_workers );
+    }
+
+    RtlLeaveCriticalSection( &this->cs );
+    return status;
+}
+
+/***********************************************************************
+ *           TpSetTimer    (NTDLL.@)
+ */
+VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+    struct threadpool_object *other_timer;
+    BOOL submit_timer = FALSE;
+    ULONGLONG timestamp;
+
+    TRACE( "%p %p %u %u\n", timer, timeout, period, window_length );
+
+    RtlEnterCriticalSection( &timerqueue.cs );
+
+    assert( this->u.timer.timer_initialized );
+    this->u.timer.timer_set = timeout != NULL;
+
+    /* Convert relative timeout to absolute timestamp and handle a timeout
+     * of zero, which means that the timer is submitted immediately. */
+    if (timeout)
+    {
+        timestamp = timeout->QuadPart;
+        if ((LONGLONG)timestamp < 0)
+        {
+            LARGE_INTEGER now;
+            NtQuerySystemTime( &now );
+            timestamp = now.QuadPart - timestamp;
+        }
+        else if (!timestamp)
+        {
+            if (!period)
+                timeout = NULL;
+            else
+            {
+                LARGE_INTEGER now;
+                NtQuerySystemTime( &now );
+                timestamp = now.QuadPart + (ULONGLONG)period * 10000;
+            }
+            submit_timer = TRUE;
+        }
+    }
+
+    /* First remove existing timeout. */
+    if (this->u.timer.timer_pending)
+    {
+        list_remove( &this->u.timer.timer_entry );
+        this->u.timer.timer_pending = FALSE;
+    }
+
+    /* If the timer was enabled, then add it back to the queue. */
+    if (timeout)
+    {
+        this->u.timer.timeout       = timestamp;
+        this->u.timer.period        = period;
+        this->u.timer.window_length = window_length;
+
+        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                             struct threadpool_object, u.timer.timer_entry )
+        {
+            assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
+            if (this->u.timer.timeout < other_timer->u.timer.timeout)
+                break;
+        }
+        list_add_before( &other_timer->u.timer.timer_entry, &this->u.timer.timer_entry );
+
+        /* Wake up the timer thread when the timeout has to be updated. */
+        if (list_head( &timerqueue.pending_timers ) == &this->u.timer.timer_entry )
+            RtlWakeAllConditionVariable( &timerqueue.update_event );
+
+        this->u.timer.timer_pending = TRUE;
+    }
+
+    RtlLeaveCriticalSection( &timerqueue.cs );
+
+    if (submit_timer)
+       tp_object_submit( this, FALSE );
+}
+
+/***********************************************************************
+ *           TpSetWait    (NTDLL.@)
+ */
+VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p %p %p\n", wait, handle, timeout );
+
+    tp_object_set_wait( this, handle, timeout );
+}
+
+/***********************************************************************
+ *           TpSimpleTryPost    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpSimpleTryPost( PTP_SIMPLE_CALLBACK callback, PVOID userdata,
+                                 TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p\n", callback, userdata, environment );
+
+    object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) );
+    if (!object)
+        return STATUS_NO_MEMORY;
+
+    status = tp_threadpool_lock( &pool, environment );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    object->type = TP_OBJECT_TYPE_SIMPLE;
+    object->u.simple.callback = callback;
+    tp_object_initialize( object, pool, userdata, environment );
+
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpStartAsyncIoOperation    (NTDLL.@)
+ */
+VOID WINAPI TpStartAsyncIoOperation( TP_IO *io )
+{
+    struct threadpool_object *this = impl_from_TP_IO( io );
+
+    TRACE( "%p\n", io );
+
+    RtlEnterCriticalSection( &this->pool->cs );
+    this->u.io.pending_count++;
+    RtlLeaveCriticalSection( &this->pool->cs );
+}
+
+/***********************************************************************
+ *           TpWaitForIoCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForIoCompletion( TP_IO *io, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_IO( io );
+
+    TRACE( "%p %d\n", io, cancel_pending );
+
+    if (cancel_pending)
+        tp_object_cancel( this );
+    tp_object_wait( this, FALSE );
+}
+
+/***********************************************************************
+ *           TpWaitForTimer    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForTimer( TP_TIMER *timer, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p %d\n", timer, cancel_pending );
+
+    if (cancel_pending)
+        tp_object_cancel( this );
+    tp_object_wait( this, FALSE );
+}
+
+/***********************************************************************
+ *           TpWaitForWait    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForWait( TP_WAIT *wait, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p %d\n", wait, cancel_pending );
+
+    if (cancel_pending)
+        tp_object_cancel( this );
+    tp_object_wait( this, FALSE );
+}
+
+/***********************************************************************
+ *           TpWaitForWork    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForWork( TP_WORK *work, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p %u\n", work, cancel_pending );
+
+    if (cancel_pending)
+        tp_object_cancel( this );
+    tp_object_wait( this, FALSE );
+}
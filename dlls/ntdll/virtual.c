@@ -52,6 +52,7 @@
 #include "wine/server.h"
 #include "wine/exception.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -66,6 +67,11 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 struct file_view
 {
     struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry tree_entry;       /* Entry in global view tree */
+    struct file_view *free_left;   /* Children in free ranges tree */
+    struct file_view *free_right;
+    size_t        free_size;   /* Size of the free space following the view, 0 if none */
+    size_t        max_free_size; /* Largest free space in the free ranges subtree */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
     HANDLE        mapping;     /* Handle to the file mapping */
@@ -98,6 +104,13 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 
 static struct list views_list = LIST_INIT(views_list);
 
+/* views sorted by base address, for fast lookups */
+static struct wine_rb_tree views_tree;
+
+/* views that are followed by unallocated space, as a treap sorted by base address
+ * where each node also records the largest free space found in its subtree */
+static struct file_view *free_ranges_root;
+
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 {
@@ -242,6 +255,255 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+static void *rb_alloc( size_t size )
+{
+    return RtlAllocateHeap( virtual_heap, 0, size );
+}
+
+static void *rb_realloc( void *ptr, size_t size )
+{
+    return RtlReAllocateHeap( virtual_heap, 0, ptr, size );
+}
+
+static void rb_free( void *ptr )
+{
+    RtlFreeHeap( virtual_heap, 0, ptr );
+}
+
+static int compare_view( const void *addr, const struct wine_rb_entry *entry )
+{
+    const struct file_view *view = WINE_RB_ENTRY_VALUE( entry, const struct file_view, tree_entry );
+
+    if ((const char *)addr < (const char *)view->base) return -1;
+    if ((const char *)addr > (const char *)view->base) return 1;
+    return 0;
+}
+
+static const struct wine_rb_functions views_tree_functions =
+{
+    rb_alloc,
+    rb_realloc,
+    rb_free,
+    compare_view
+};
+
+
+
+/***********************************************************************
+ *           first_view / next_view / prev_view
+ *
+ * Walk the views in address order.
+ */
+static inline struct file_view *first_view(void)
+{
+    struct list *ptr = list_head( &views_list );
+    return ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
+}
+
+static inline struct file_view *next_view( struct file_view *view )
+{
+    struct list *ptr = list_next( &views_list, &view->entry );
+    return ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
+}
+
+static inline struct file_view *prev_view( struct file_view *view )
+{
+    struct list *ptr = list_prev( &views_list, &view->entry );
+    return ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
+}
+
+
+/***********************************************************************
+ *           find_view_before
+ *
+ * Find the last view starting at or below a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_view_before( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *view, *ret = NULL;
+
+    while (ptr)
+    {
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+        if ((const char *)view->base > (const char *)addr) ptr = ptr->left;
+        else
+        {
+            ret = view;
+            ptr = ptr->right;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           free_tree_priority
+ *
+ * Treap priority of a view, derived from its base address.
+ */
+static inline unsigned int free_tree_priority( const struct file_view *view )
+{
+    unsigned int x = (UINT_PTR)view->base >> page_shift;
+
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+
+/***********************************************************************
+ *           free_tree_update
+ *
+ * Recompute the largest free space of a free ranges subtree.
+ */
+static inline void free_tree_update( struct file_view *view )
+{
+    size_t max = view->free_size;
+
+    if (view->free_left && view->free_left->max_free_size > max) max = view->free_left->max_free_size;
+    if (view->free_right && view->free_right->max_free_size > max) max = view->free_right->max_free_size;
+    view->max_free_size = max;
+}
+
+
+/***********************************************************************
+ *           free_tree_insert
+ *
+ * Insert a view in a free ranges subtree.
+ */
+static void free_tree_insert( struct file_view **root, struct file_view *view )
+{
+    struct file_view *node = *root;
+
+    if (!node)
+    {
+        view->free_left = view->free_right = NULL;
+        view->max_free_size = view->free_size;
+        *root = view;
+        return;
+    }
+    if ((char *)view->base < (char *)node->base)
+    {
+        free_tree_insert( &node->free_left, view );
+        if (free_tree_priority( node->free_left ) > free_tree_priority( node ))
+        {
+            *root = node->free_left;
+            node->free_left = (*root)->free_right;
+            (*root)->free_right = node;
+        }
+    }
+    else
+    {
+        free_tree_insert( &node->free_right, view );
+        if (free_tree_priority( node->free_right ) > free_tree_priority( node ))
+        {
+            *root = node->free_right;
+            node->free_right = (*root)->free_left;
+            (*root)->free_left = node;
+        }
+    }
+    free_tree_update( node );
+    if (*root != node) free_tree_update( *root );
+}
+
+
+/***********************************************************************
+ *           free_tree_merge
+ *
+ * Merge two free ranges subtrees, all the views of the first one being
+ * below the views of the second one.
+ */
+static struct file_view *free_tree_merge( struct file_view *left, struct file_view *right )
+{
+    if (!left) return right;
+    if (!right) return left;
+    if (free_tree_priority( left ) > free_tree_priority( right ))
+    {
+        left->free_right = free_tree_merge( left->free_right, right );
+        free_tree_update( left );
+        return left;
+    }
+    right->free_left = free_tree_merge( left, right->free_left );
+    free_tree_update( right );
+    return right;
+}
+
+
+/***********************************************************************
+ *           free_tree_remove
+ *
+ * Remove a view from a free ranges subtree.
+ */
+static void free_tree_remove( struct file_view **root, struct file_view *view )
+{
+    struct file_view *node = *root;
+
+    if (!node) return;
+    if (node == view) *root = free_tree_merge( view->free_left, view->free_right );
+    else
+    {
+        if ((char *)view->base < (char *)node->base) free_tree_remove( &node->free_left, view );
+        else free_tree_remove( &node->free_right, view );
+        free_tree_update( node );
+    }
+}
+
+
+/***********************************************************************
+ *           free_tree_resize
+ *
+ * Update the free ranges subtrees containing a view after its free space changed.
+ */
+static void free_tree_resize( struct file_view *node, struct file_view *view )
+{
+    if (!node) return;
+    if (node != view)
+    {
+        if ((char *)view->base < (char *)node->base) free_tree_resize( node->free_left, view );
+        else free_tree_resize( node->free_right, view );
+    }
+    free_tree_update( node );
+}
+
+
+/***********************************************************************
+ *           update_free_range
+ *
+ * Add or remove a view from the free ranges index, depending on whether
+ * it is followed by unallocated space, and record the size of that space.
+ * The csVirtual section must be held by caller.
+ */
+static void update_free_range( struct file_view *view )
+{
+    struct file_view *next = next_view( view );
+    char *end = (char *)view->base + view->size;
+    size_t free_size = next ? (char *)next->base - end : (size_t)0 - (UINT_PTR)end;
+
+    if (free_size == view->free_size) return;
+
+    if (!view->free_size)
+    {
+        view->free_size = free_size;
+        free_tree_insert( &free_ranges_root, view );
+    }
+    else if (!free_size)
+    {
+        free_tree_remove( &free_ranges_root, view );
+        view->free_size = 0;
+    }
+    else
+    {
+        view->free_size = free_size;
+        free_tree_resize( free_ranges_root, view );
+    }
+}
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -256,17 +518,13 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct file_view *view = find_view_before( addr );
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if (view->base > addr) break;  /* no matching view */
-        if ((const char *)view->base + view->size <= (const char *)addr) continue;
-        if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        if ((const char *)addr + size < (const char *)addr) break; /* overflow */
-        return view;
-    }
-    return NULL;
+    if (!view) return NULL;  /* no matching view */
+    if ((const char *)view->base + view->size <= (const char *)addr) return NULL;
+    if ((const char *)view->base + view->size < (const char *)addr + size) return NULL;  /* size too large */
+    if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
+    return view;
 }
 
 
@@ -289,17 +547,85 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct file_view *view = find_view_before( addr );
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
-    }
+    if (view && (const char *)view->base + view->size > (const char *)addr) return view;
+    view = view ? next_view( view ) : first_view();
+    if (view && (const char *)view->base < (const char *)addr + size) return view;
     return NULL;
 }
 
 
+/***********************************************************************
+ *           free_area_top_down / free_area_bottom_up
+ *
+ * Find the highest or lowest suitable address in a free range, clipped
+ * to the specified range.
+ */
+static void *free_area_top_down( char *free_start, size_t free_size, char *base, char *end,
+                                 size_t size, size_t mask )
+{
+    char *start;
+
+    if (free_start >= end) return NULL;
+    if (free_size > (size_t)(end - free_start)) free_size = end - free_start;
+    if (free_size < size) return NULL;
+    start = ROUND_ADDR( free_start + free_size - size, mask );
+    if (!start || start < free_start || start < base) return NULL;
+    return start;
+}
+
+static void *free_area_bottom_up( char *free_start, size_t free_size, char *base, char *end,
+                                  size_t size, size_t mask )
+{
+    char *free_end, *start;
+
+    if (free_start >= end) return NULL;
+    if (free_size > (size_t)(end - free_start)) free_size = end - free_start;
+    free_end = free_start + free_size;
+    start = ROUND_ADDR( (free_start > base ? free_start : base) + mask, mask );
+    if (!start || start < free_start || start >= free_end || (size_t)(free_end - start) < size) return NULL;
+    return start;
+}
+
+
+/***********************************************************************
+ *           find_free_range_top_down / find_free_range_bottom_up
+ *
+ * Search a free ranges subtree for the highest or lowest suitable address,
+ * skipping the subtrees whose free ranges are all too small or out of range.
+ */
+static void *find_free_range_top_down( struct file_view *view, char *base, char *end,
+                                       size_t size, size_t mask )
+{
+    char *free_start;
+    void *ret;
+
+    if (!view || view->max_free_size < size) return NULL;
+    free_start = (char *)view->base + view->size;
+    if (free_start < end &&
+        (ret = find_free_range_top_down( view->free_right, base, end, size, mask ))) return ret;
+    if ((ret = free_area_top_down( free_start, view->free_size, base, end, size, mask ))) return ret;
+    if ((char *)view->base <= base) return NULL;
+    return find_free_range_top_down( view->free_left, base, end, size, mask );
+}
+
+static void *find_free_range_bottom_up( struct file_view *view, char *base, char *end,
+                                        size_t size, size_t mask )
+{
+    char *free_start;
+    void *ret;
+
+    if (!view || view->max_free_size < size) return NULL;
+    free_start = (char *)view->base + view->size;
+    if ((char *)view->base > base &&
+        (ret = find_free_range_bottom_up( view->free_left, base, end, size, mask ))) return ret;
+    if ((ret = free_area_bottom_up( free_start, view->free_size, base, end, size, mask ))) return ret;
+    if (free_start >= end) return NULL;
+    return find_free_range_bottom_up( view->free_right, base, end, size, mask );
+}
+
+
 /***********************************************************************
  *           find_free_area
  *
@@ -308,7 +634,7 @@ static struct file_view *find_view_range( const void *addr, size_t size )
  */
 static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
 {
-    struct list *ptr;
+    struct file_view *view, *first = first_view();
     void *start;
 
     if (top_down)
@@ -316,34 +642,26 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
         start = ROUND_ADDR( (char *)end - size, mask );
         if (start >= end || start < base) return NULL;
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
+        /* check the space following the last view below the area end */
+        view = find_view_before( (char *)start + size - 1 );
+        if (!view || (char *)view->base + view->size <= (char *)start) return start;
 
-            if ((char *)view->base + view->size <= (char *)start) break;
-            if ((char *)view->base >= (char *)start + size) continue;
-            start = ROUND_ADDR( (char *)view->base - size, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || start < base) return NULL;
-        }
+        if ((start = find_free_range_top_down( free_ranges_root, base, end, size, mask ))) return start;
+
+        /* check the space preceding the first view */
+        return free_area_top_down( NULL, (UINT_PTR)first->base, base, end, size, mask );
     }
     else
     {
         start = ROUND_ADDR( (char *)base + mask, mask );
         if (start >= end || (char *)end - (char *)start < size) return NULL;
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
+        /* check the space preceding the first view */
+        if (!find_view_before( start ) && (!first || (char *)first->base >= (char *)start + size))
+            return start;
 
-            if ((char *)view->base >= (char *)start + size) break;
-            if ((char *)view->base + view->size <= (char *)start) continue;
-            start = ROUND_ADDR( (char *)view->base + view->size + mask, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || (char *)end - (char *)start < size) return NULL;
-        }
+        return find_free_range_bottom_up( free_ranges_root, start, end, size, mask );
     }
-    return start;
 }
 
 
@@ -436,8 +754,13 @@ static inline void unmap_area( void *addr, size_t size )
  */
 static void delete_view( struct file_view *view ) /* [in] View */
 {
+    struct file_view *prev = prev_view( view );
+
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
+    if (view->free_size) free_tree_remove( &free_ranges_root, view );
+    wine_rb_remove( &views_tree, view->base );
     list_remove( &view->entry );
+    if (prev) update_free_range( prev );
     if (view->mapping) close_handle( view->mapping );
     RtlFreeHeap( virtual_heap, 0, view );
 }
@@ -450,8 +773,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, unsigned int vprot )
 {
-    struct file_view *view;
-    struct list *ptr;
+    struct file_view *view, *prev;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
     assert( !((UINT_PTR)base & page_mask) );
@@ -472,43 +794,32 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->protect = vprot;
     memset( view->prot, vprot, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
     /* Check for overlapping views. This can happen if the previous view
      * was a system view that got unmapped behind our back. In that case
      * we recover by simply deleting it. */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
+    while ((prev = find_view_range( base, size )))
     {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)prev->base + prev->size > (char *)base)
-        {
-            TRACE( "overlapping prev view %p-%p for %p-%p\n",
-                   prev->base, (char *)prev->base + prev->size,
-                   base, (char *)base + view->size );
-            assert( prev->protect & VPROT_SYSTEM );
-            delete_view( prev );
-        }
+        TRACE( "overlapping view %p-%p for %p-%p\n",
+               prev->base, (char *)prev->base + prev->size, base, (char *)base + size );
+        assert( prev->protect & VPROT_SYSTEM );
+        delete_view( prev );
     }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
+
+    /* Insert it in the tree and the linked list */
+
+    prev = find_view_before( base );
+    if (wine_rb_put( &views_tree, base, &view->tree_entry ) == -1)
     {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)base + view->size > (char *)next->base)
-        {
-            TRACE( "overlapping next view %p-%p for %p-%p\n",
-                   next->base, (char *)next->base + next->size,
-                   base, (char *)base + view->size );
-            assert( next->protect & VPROT_SYSTEM );
-            delete_view( next );
-        }
+        FIXME( "out of memory in virtual heap for %p-%p\n", base, (char *)base + size );
+        RtlFreeHeap( virtual_heap, 0, view );
+        return STATUS_NO_MEMORY;
     }
+    list_add_after( prev ? &prev->entry : &views_list, &view->entry );
+    view->free_size = 0;
+
+    update_free_range( view );
+    if (prev) update_free_range( prev );
 
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -1377,6 +1688,11 @@ void virtual_init(void)
     assert( heap_base != (void *)-1 );
     virtual_heap = RtlCreateHeap( HEAP_NO_SERIALIZE, heap_base, VIRTUAL_HEAP_SIZE,
                                   VIRTUAL_HEAP_SIZE, NULL, NULL );
+    if (wine_rb_init( &views_tree, &views_tree_functions ) == -1)
+    {
+        MESSAGE( "wine: failed to initialize the virtual memory view tree\n" );
+        exit(1);
+    }
     create_view( &heap_view, heap_base, VIRTUAL_HEAP_SIZE, VPROT_COMMITTED | VPROT_READ | VPROT_WRITE );
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
@@ -2263,7 +2579,6 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
 {
     struct file_view *view;
     char *base, *alloc_base = 0;
-    struct list *ptr;
     SIZE_T size = 0;
     MEMORY_BASIC_INFORMATION *info = buffer;
     sigset_t sigset;
@@ -2319,31 +2634,27 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = list_head( &views_list );
-    for (;;)
+    if ((view = find_view_before( base )))
     {
-        if (!ptr)
-        {
-            size = (char *)working_set_limit - alloc_base;
-            view = NULL;
-            break;
-        }
-        view = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            size = (char *)view->base - alloc_base;
-            view = NULL;
-            break;
-        }
         if ((char *)view->base + view->size > base)
         {
             alloc_base = view->base;
             size = view->size;
-            break;
         }
-        alloc_base = (char *)view->base + view->size;
-        ptr = list_next( &views_list, ptr );
+        else
+        {
+            alloc_base = (char *)view->base + view->size;
+            view = next_view( view );
+        }
+    }
+    else view = first_view();
+
+    if (view && (char *)view->base > base)
+    {
+        size = (char *)view->base - alloc_base;
+        view = NULL;
     }
+    else if (!view) size = (char *)working_set_limit - alloc_base;
 
     /* Fill the info structure */
 
@@ -20,104 +20,1807 @@
  */
 
 #include "config.h"
+#include "wine/port.h"
 
 #include <stdarg.h>
+#include <assert.h>
 
 #include "windef.h"
 #include "winbase.h"
 #include "wine/debug.h"
+#include "wine/list.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(vcomp);
 
+typedef CRITICAL_SECTION *omp_lock_t;
+typedef CRITICAL_SECTION *omp_nest_lock_t;
+
+static struct list vcomp_idle_threads = LIST_INIT(vcomp_idle_threads);
+static DWORD   vcomp_context_tls = TLS_OUT_OF_INDEXES;
+static HMODULE vcomp_module;
+static int     vcomp_max_threads;
+static int     vcomp_num_threads;
+static BOOL    vcomp_nested_fork = FALSE;
+
+static RTL_CRITICAL_SECTION vcomp_section;
+static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
+{
+    0, 0, &vcomp_section,
+    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": vcomp_section") }
+};
+static RTL_CRITICAL_SECTION vcomp_section = { &critsect_debug, -1, 0, 0, 0, 0 };
+
+static RTL_CRITICAL_SECTION vcomp_ordered_section;
+static RTL_CRITICAL_SECTION_DEBUG ordered_critsect_debug =
+{
+    0, 0, &vcomp_ordered_section,
+    { &ordered_critsect_debug.ProcessLocksList, &ordered_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": vcomp_ordered_section") }
+};
+static RTL_CRITICAL_SECTION vcomp_ordered_section = { &ordered_critsect_debug, -1, 0, 0, 0, 0 };
+
+#define VCOMP_DYNAMIC_FLAGS_STATIC      0x01
+#define VCOMP_DYNAMIC_FLAGS_CHUNKED     0x02
+#define VCOMP_DYNAMIC_FLAGS_GUIDED      0x03
+#define VCOMP_DYNAMIC_FLAGS_INCREMENT   0x40
+
+/* idle worker threads exit after this many milliseconds */
+#define VCOMP_IDLE_TIMEOUT  5000
+
+struct vcomp_thread_data
+{
+    struct vcomp_team_data  *team;
+    struct vcomp_task_data  *task;
+    int                     thread_num;
+    BOOL                    parallel;
+    int                     fork_threads;
+
+    /* only used for concurrent tasks */
+    struct list             entry;
+    CONDITION_VARIABLE      cond;
+
+    /* single */
+    unsigned int            single;
+
+    /* section */
+    unsigned int            section;
+
+    /* dynamic */
+    unsigned int            dynamic;
+    unsigned int            dynamic_type;
+    ULONG64                 dynamic_begin;
+    ULONG64                 dynamic_end;
+};
+
+struct vcomp_team_data
+{
+    CONDITION_VARIABLE      cond;
+    int                     num_threads;
+    int                     finished_threads;
+
+    /* callback arguments */
+    int                     nargs;
+    void                    *wrapper;
+    __ms_va_list            valist;
+
+    /* barrier */
+    unsigned int            barrier;
+    int                     barrier_count;
+
+    /* copyprivate */
+    void                    *broadcast_data;
+};
+
+struct vcomp_task_data
+{
+    /* single */
+    unsigned int            single;
+
+    /* section */
+    unsigned int            section;
+    int                     num_sections;
+    int                     section_index;
+
+    /* dynamic */
+    unsigned int            dynamic;
+    ULONG64                 dynamic_first;
+    ULONG64                 dynamic_last;
+    ULONG64                 dynamic_iterations;
+    LONG64                  dynamic_step;
+    ULONG64                 dynamic_chunksize;
+};
+
+#if defined(__i386__)
+
+extern void CDECL _vcomp_fork_call_wrapper(void *wrapper, int nargs, __ms_va_list args);
+__ASM_GLOBAL_FUNC( _vcomp_fork_call_wrapper,
+                   "pushl %ebp\n\t"
+                   __ASM_CFI(".cfi_adjust_cfa_offset 4\n\t")
+                   __ASM_CFI(".cfi_rel_offset %ebp,0\n\t")
+                   "movl %esp,%ebp\n\t"
+                   __ASM_CFI(".cfi_def_cfa_register %ebp\n\t")
+                   "pushl %esi\n\t"
+                   __ASM_CFI(".cfi_rel_offset %esi,-4\n\t")
+                   "pushl %edi\n\t"
+                   __ASM_CFI(".cfi_rel_offset %edi,-8\n\t")
+                   "movl 12(%ebp),%edx\n\t"
+                   "movl %esp,%edi\n\t"
+                   "shll $2,%edx\n\t"
+                   "jz 1f\n\t"
+                   "subl %edx,%edi\n\t"
+                   "andl $~15,%edi\n\t"
+                   "movl %edi,%esp\n\t"
+                   "movl 12(%ebp),%ecx\n\t"
+                   "movl 16(%ebp),%esi\n\t"
+                   "cld\n\t"
+                   "rep; movsl\n"
+                   "1:\tcall *8(%ebp)\n\t"
+                   "leal -8(%ebp),%esp\n\t"
+                   "popl %edi\n\t"
+                   __ASM_CFI(".cfi_same_value %edi\n\t")
+                   "popl %esi\n\t"
+                   __ASM_CFI(".cfi_same_value %esi\n\t")
+                   "popl %ebp\n\t"
+                   __ASM_CFI(".cfi_def_cfa %esp,4\n\t")
+                   __ASM_CFI(".cfi_same_value %ebp\n\t")
+                   "ret" )
+
+#elif defined(__x86_64__)
+
+extern void CDECL _vcomp_fork_call_wrapper(void *wrapper, int nargs, __ms_va_list args);
+__ASM_GLOBAL_FUNC( _vcomp_fork_call_wrapper,
+                   "pushq %rbp\n\t"
+                   __ASM_CFI(".cfi_adjust_cfa_offset 8\n\t")
+                   __ASM_CFI(".cfi_rel_offset %rbp,0\n\t")
+                   "movq %rsp,%rbp\n\t"
+                   __ASM_CFI(".cfi_def_cfa_register %rbp\n\t")
+                   "pushq %rsi\n\t"
+                   __ASM_CFI(".cfi_rel_offset %rsi,-8\n\t")
+                   "pushq %rdi\n\t"
+                   __ASM_CFI(".cfi_rel_offset %rdi,-16\n\t")
+                   "movq %rcx,%rax\n\t"
+                   "movq $4,%rcx\n\t"
+                   "cmp %rcx,%rdx\n\t"
+                   "cmovgq %rdx,%rcx\n\t"
+                   "leaq 0(,%rcx,8),%rdx\n\t"
+                   "subq %rdx,%rsp\n\t"
+                   "andq $~15,%rsp\n\t"
+                   "movq %rsp,%rdi\n\t"
+                   "movq %r8,%rsi\n\t"
+                   "rep; movsq\n\t"
+                   "movq 0(%rsp),%rcx\n\t"
+                   "movq 8(%rsp),%rdx\n\t"
+                   "movq 16(%rsp),%r8\n\t"
+                   "movq 24(%rsp),%r9\n\t"
+                   "callq *%rax\n\t"
+                   "leaq -16(%rbp),%rsp\n\t"
+                   "popq %rdi\n\t"
+                   __ASM_CFI(".cfi_same_value %rdi\n\t")
+                   "popq %rsi\n\t"
+                   __ASM_CFI(".cfi_same_value %rsi\n\t")
+                   __ASM_CFI(".cfi_def_cfa_register %rsp\n\t")
+                   "popq %rbp\n\t"
+                   __ASM_CFI(".cfi_adjust_cfa_offset -8\n\t")
+                   __ASM_CFI(".cfi_same_value %rbp\n\t")
+                   "ret")
+
+#else
+
+static void CDECL _vcomp_fork_call_wrapper(void *wrapper, int nargs, __ms_va_list args)
+{
+    ERR("Not implemented for this architecture\n");
+}
+
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+static inline char interlocked_cmpxchg8(char *dest, char xchg, char compare)
+{
+    char ret;
+    __asm__ __volatile__( "lock; cmpxchgb %2,(%1)"
+                          : "=a" (ret) : "r" (dest), "q" (xchg), "0" (compare) : "memory" );
+    return ret;
+}
+
+static inline short interlocked_cmpxchg16(short *dest, short xchg, short compare)
+{
+    short ret;
+    __asm__ __volatile__( "lock; cmpxchgw %2,(%1)"
+                          : "=a" (ret) : "r" (dest), "r" (xchg), "0" (compare) : "memory" );
+    return ret;
+}
+
+#else  /* __GNUC__ */
+
+static RTL_CRITICAL_SECTION vcomp_atomic_section;
+static RTL_CRITICAL_SECTION_DEBUG atomic_critsect_debug =
+{
+    0, 0, &vcomp_atomic_section,
+    { &atomic_critsect_debug.ProcessLocksList, &atomic_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": vcomp_atomic_section") }
+};
+static RTL_CRITICAL_SECTION vcomp_atomic_section = { &atomic_critsect_debug, -1, 0, 0, 0, 0 };
+
+static char interlocked_cmpxchg8(char *dest, char xchg, char compare)
+{
+    char ret;
+    EnterCriticalSection(&vcomp_atomic_section);
+    if ((ret = *dest) == compare) *dest = xchg;
+    LeaveCriticalSection(&vcomp_atomic_section);
+    return ret;
+}
+
+static short interlocked_cmpxchg16(short *dest, short xchg, short compare)
+{
+    short ret;
+    EnterCriticalSection(&vcomp_atomic_section);
+    if ((ret = *dest) == compare) *dest = xchg;
+    LeaveCriticalSection(&vcomp_atomic_section);
+    return ret;
+}
+
+#endif  /* __GNUC__ */
+
+static inline struct vcomp_thread_data *vcomp_get_thread_data(void)
+{
+    return (struct vcomp_thread_data *)TlsGetValue(vcomp_context_tls);
+}
+
+static inline void vcomp_set_thread_data(struct vcomp_thread_data *thread_data)
+{
+    TlsSetValue(vcomp_context_tls, thread_data);
+}
+
+static void vcomp_init_thread_task(struct vcomp_thread_data *thread_data,
+                                   struct vcomp_team_data *team, struct vcomp_task_data *task,
+                                   int thread_num, BOOL parallel)
+{
+    thread_data->team           = team;
+    thread_data->task           = task;
+    thread_data->thread_num     = thread_num;
+    thread_data->parallel       = parallel;
+    thread_data->fork_threads   = 0;
+    thread_data->single         = 1;
+    thread_data->section        = 1;
+    thread_data->dynamic        = 1;
+    thread_data->dynamic_type   = 0;
+}
+
+static struct vcomp_thread_data *vcomp_init_thread_data(void)
+{
+    struct vcomp_thread_data *thread_data = vcomp_get_thread_data();
+    struct
+    {
+        struct vcomp_thread_data thread;
+        struct vcomp_task_data   task;
+    } *data;
+
+    if (thread_data) return thread_data;
+    if (!(data = HeapAlloc(GetProcessHeap(), 0, sizeof(*data))))
+    {
+        ERR("could not create thread data\n");
+        ExitProcess(1);
+    }
+
+    data->task.single  = 0;
+    data->task.section = 0;
+    data->task.dynamic = 0;
+
+    thread_data = &data->thread;
+    vcomp_init_thread_task(thread_data, NULL, &data->task, 0, FALSE);
+    list_init(&thread_data->entry);
+    InitializeConditionVariable(&thread_data->cond);
+
+    vcomp_set_thread_data(thread_data);
+    return thread_data;
+}
+
+static void vcomp_free_thread_data(void)
+{
+    struct vcomp_thread_data *thread_data = vcomp_get_thread_data();
+    if (!thread_data) return;
+
+    HeapFree(GetProcessHeap(), 0, thread_data);
+    vcomp_set_thread_data(NULL);
+}
+
+static inline int vcomp_team_size(struct vcomp_thread_data *thread_data)
+{
+    return thread_data->team ? thread_data->team->num_threads : 1;
+}
+
+void CDECL _vcomp_atomic_add_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old + val, old) != old);
+}
+
+void CDECL _vcomp_atomic_and_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old & val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_i1(signed char *dest, signed char val)
+{
+    signed char old;
+    do old = *dest; while ((signed char)interlocked_cmpxchg8((char *)dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_ui1(unsigned char *dest, unsigned char val)
+{
+    unsigned char old;
+    do old = *dest; while ((unsigned char)interlocked_cmpxchg8((char *)dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old * val, old) != old);
+}
+
+void CDECL _vcomp_atomic_or_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old | val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shl_i1(char *dest, unsigned int val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old << val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_i1(signed char *dest, unsigned int val)
+{
+    signed char old;
+    do old = *dest; while ((signed char)interlocked_cmpxchg8((char *)dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_ui1(unsigned char *dest, unsigned int val)
+{
+    unsigned char old;
+    do old = *dest; while ((unsigned char)interlocked_cmpxchg8((char *)dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old - val, old) != old);
+}
+
+void CDECL _vcomp_atomic_xor_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old ^ val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old && val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_i1(char *dest, char val)
+{
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old ? old : (val != 0), old) != old);
+}
+
+void CDECL _vcomp_reduction_i1(unsigned int flags, char *dest, char val)
+{
+    static void (CDECL * const funcs[])(char *, char) =
+    {
+        _vcomp_atomic_add_i1,
+        _vcomp_atomic_add_i1,
+        _vcomp_atomic_mul_i1,
+        _vcomp_atomic_and_i1,
+        _vcomp_atomic_or_i1,
+        _vcomp_atomic_xor_i1,
+        _vcomp_atomic_bool_and_i1,
+        _vcomp_atomic_bool_or_i1,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
+void CDECL _vcomp_atomic_add_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old + val, old) != old);
+}
+
+void CDECL _vcomp_atomic_and_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old & val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_ui2(unsigned short *dest, unsigned short val)
+{
+    unsigned short old;
+    do old = *dest; while ((unsigned short)interlocked_cmpxchg16((short *)dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old * val, old) != old);
+}
+
+void CDECL _vcomp_atomic_or_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old | val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shl_i2(short *dest, unsigned int val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old << val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_i2(short *dest, unsigned int val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_ui2(unsigned short *dest, unsigned int val)
+{
+    unsigned short old;
+    do old = *dest; while ((unsigned short)interlocked_cmpxchg16((short *)dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old - val, old) != old);
+}
+
+void CDECL _vcomp_atomic_xor_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old ^ val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old && val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_i2(short *dest, short val)
+{
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old ? old : (val != 0), old) != old);
+}
+
+void CDECL _vcomp_reduction_i2(unsigned int flags, short *dest, short val)
+{
+    static void (CDECL * const funcs[])(short *, short) =
+    {
+        _vcomp_atomic_add_i2,
+        _vcomp_atomic_add_i2,
+        _vcomp_atomic_mul_i2,
+        _vcomp_atomic_and_i2,
+        _vcomp_atomic_or_i2,
+        _vcomp_atomic_xor_i2,
+        _vcomp_atomic_bool_and_i2,
+        _vcomp_atomic_bool_or_i2,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
+void CDECL _vcomp_atomic_add_i4(int *dest, int val)
+{
+    interlocked_xchg_add(dest, val);
+}
+
+void CDECL _vcomp_atomic_and_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old & val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_ui4(unsigned int *dest, unsigned int val)
+{
+    unsigned int old;
+    do old = *dest; while (interlocked_cmpxchg((int *)dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old * val, old) != old);
+}
+
+void CDECL _vcomp_atomic_or_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old | val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shl_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old << val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_ui4(unsigned int *dest, unsigned int val)
+{
+    unsigned int old;
+    do old = *dest; while (interlocked_cmpxchg((int *)dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_i4(int *dest, int val)
+{
+    interlocked_xchg_add(dest, -val);
+}
+
+void CDECL _vcomp_atomic_xor_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old ^ val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old && val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_i4(int *dest, int val)
+{
+    int old;
+    do old = *dest; while (interlocked_cmpxchg(dest, old ? old : (val != 0), old) != old);
+}
+
+void CDECL _vcomp_reduction_i4(unsigned int flags, int *dest, int val)
+{
+    static void (CDECL * const funcs[])(int *, int) =
+    {
+        _vcomp_atomic_add_i4,
+        _vcomp_atomic_add_i4,
+        _vcomp_atomic_mul_i4,
+        _vcomp_atomic_and_i4,
+        _vcomp_atomic_or_i4,
+        _vcomp_atomic_xor_i4,
+        _vcomp_atomic_bool_and_i4,
+        _vcomp_atomic_bool_or_i4,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
+void CDECL _vcomp_atomic_add_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old + val, old) != old);
+}
+
+void CDECL _vcomp_atomic_and_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old & val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_ui8(ULONG64 *dest, ULONG64 val)
+{
+    ULONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64((LONG64 *)dest, old / val, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old * val, old) != old);
+}
+
+void CDECL _vcomp_atomic_or_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old | val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shl_i8(LONG64 *dest, unsigned int val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old << val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_i8(LONG64 *dest, unsigned int val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_shr_ui8(ULONG64 *dest, unsigned int val)
+{
+    ULONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64((LONG64 *)dest, old >> val, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old - val, old) != old);
+}
+
+void CDECL _vcomp_atomic_xor_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old ^ val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old && val, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_i8(LONG64 *dest, LONG64 val)
+{
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64(dest, old ? old : (val != 0), old) != old);
+}
+
+void CDECL _vcomp_reduction_i8(unsigned int flags, LONG64 *dest, LONG64 val)
+{
+    static void (CDECL * const funcs[])(LONG64 *, LONG64) =
+    {
+        _vcomp_atomic_add_i8,
+        _vcomp_atomic_add_i8,
+        _vcomp_atomic_mul_i8,
+        _vcomp_atomic_and_i8,
+        _vcomp_atomic_or_i8,
+        _vcomp_atomic_xor_i8,
+        _vcomp_atomic_bool_and_i8,
+        _vcomp_atomic_bool_or_i8,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
+void CDECL _vcomp_atomic_add_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = *(float *)&old + val;
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = *(float *)&old / val;
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = *(float *)&old * val;
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = *(float *)&old - val;
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = (*(float *)&old != 0.0) ? (val != 0.0) : 0.0;
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_r4(float *dest, float val)
+{
+    int old, new;
+    do
+    {
+        old = *(int *)dest;
+        *(float *)&new = (*(float *)&old != 0.0) ? *(float *)&old : (val != 0.0);
+    }
+    while (interlocked_cmpxchg((int *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_reduction_r4(unsigned int flags, float *dest, float val)
+{
+    static void (CDECL * const funcs[])(float *, float) =
+    {
+        _vcomp_atomic_add_r4,
+        _vcomp_atomic_add_r4,
+        _vcomp_atomic_mul_r4,
+        _vcomp_atomic_bool_or_r4,
+        _vcomp_atomic_bool_or_r4,
+        _vcomp_atomic_bool_or_r4,
+        _vcomp_atomic_bool_and_r4,
+        _vcomp_atomic_bool_or_r4,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
+void CDECL _vcomp_atomic_add_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = *(double *)&old + val;
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_div_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = *(double *)&old / val;
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_mul_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = *(double *)&old * val;
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_atomic_sub_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = *(double *)&old - val;
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_and_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = (*(double *)&old != 0.0) ? (val != 0.0) : 0.0;
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+static void CDECL _vcomp_atomic_bool_or_r8(double *dest, double val)
+{
+    LONG64 old, new;
+    do
+    {
+        old = *(LONG64 *)dest;
+        *(double *)&new = (*(double *)&old != 0.0) ? *(double *)&old : (val != 0.0);
+    }
+    while (interlocked_cmpxchg64((LONG64 *)dest, new, old) != old);
+}
+
+void CDECL _vcomp_reduction_r8(unsigned int flags, double *dest, double val)
+{
+    static void (CDECL * const funcs[])(double *, double) =
+    {
+        _vcomp_atomic_add_r8,
+        _vcomp_atomic_add_r8,
+        _vcomp_atomic_mul_r8,
+        _vcomp_atomic_bool_or_r8,
+        _vcomp_atomic_bool_or_r8,
+        _vcomp_atomic_bool_or_r8,
+        _vcomp_atomic_bool_and_r8,
+        _vcomp_atomic_bool_or_r8,
+    };
+    unsigned int op = (flags >> 8) & 0xf;
+    op = min(op, sizeof(funcs)/sizeof(funcs[0]) - 1);
+    funcs[op](dest, val);
+}
+
 int CDECL omp_get_dynamic(void)
 {
-    TRACE("stub\n");
-    return 0;
+    TRACE("stub\n");
+    return 0;
+}
+
+int CDECL omp_get_max_threads(void)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    TRACE("()\n");
+    return thread_data->fork_threads ? thread_data->fork_threads : vcomp_num_threads;
+}
+
+int CDECL omp_get_nested(void)
+{
+    TRACE("()\n");
+    return vcomp_nested_fork;
+}
+
+int CDECL omp_get_num_procs(void)
+{
+    TRACE("()\n");
+    return vcomp_max_threads;
+}
+
+int CDECL omp_get_num_threads(void)
+{
+    TRACE("()\n");
+    return vcomp_team_size(vcomp_init_thread_data());
+}
+
+int CDECL omp_get_thread_num(void)
+{
+    TRACE("()\n");
+    return vcomp_init_thread_data()->thread_num;
+}
+
+/* Time in seconds since "some time in the past" */
+double CDECL omp_get_wtime(void)
+{
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart / (double)frequency.QuadPart;
+}
+
+double CDECL omp_get_wtick(void)
+{
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    return 1.0 / frequency.QuadPart;
+}
+
+int CDECL omp_in_parallel(void)
+{
+    TRACE("()\n");
+    return vcomp_init_thread_data()->parallel;
+}
+
+void CDECL omp_set_dynamic(int val)
+{
+    TRACE("(%d): stub\n", val);
+}
+
+void CDECL omp_set_nested(int nested)
+{
+    TRACE("(%d)\n", nested);
+    vcomp_nested_fork = (nested != 0);
+}
+
+void CDECL omp_set_num_threads(int num_threads)
+{
+    TRACE("(%d)\n", num_threads);
+    if (num_threads >= 1)
+        vcomp_num_threads = num_threads;
+}
+
+void CDECL _vcomp_barrier(void)
+{
+    struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+
+    TRACE("()\n");
+
+    if (!team_data || team_data->num_threads == 1)
+        return;
+
+    EnterCriticalSection(&vcomp_section);
+    if (++team_data->barrier_count >= team_data->num_threads)
+    {
+        team_data->barrier++;
+        team_data->barrier_count = 0;
+        WakeAllConditionVariable(&team_data->cond);
+    }
+    else
+    {
+        unsigned int barrier = team_data->barrier;
+        while (team_data->barrier == barrier)
+            SleepConditionVariableCS(&team_data->cond, &vcomp_section, INFINITE);
+    }
+    LeaveCriticalSection(&vcomp_section);
+}
+
+void CDECL _vcomp_set_num_threads(int num_threads)
+{
+    TRACE("(%d)\n", num_threads);
+    if (num_threads >= 1)
+        vcomp_init_thread_data()->fork_threads = num_threads;
+}
+
+int CDECL _vcomp_master_begin(void)
+{
+    TRACE("()\n");
+    return !vcomp_init_thread_data()->thread_num;
+}
+
+void CDECL _vcomp_master_end(void)
+{
+    TRACE("()\n");
+    /* nothing to do here */
+}
+
+int CDECL _vcomp_single_begin(int flags)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    struct vcomp_task_data *task_data = thread_data->task;
+    int ret = FALSE;
+
+    TRACE("(%x)\n", flags);
+
+    if (vcomp_team_size(thread_data) == 1)
+        return TRUE;
+
+    EnterCriticalSection(&vcomp_section);
+    thread_data->single++;
+    if ((int)(thread_data->single - task_data->single) > 0)
+    {
+        task_data->single = thread_data->single;
+        ret = TRUE;
+    }
+    LeaveCriticalSection(&vcomp_section);
+
+    return ret;
+}
+
+void CDECL _vcomp_single_end(void)
+{
+    TRACE("()\n");
+    /* nothing to do here */
+}
+
+void CDECL _vcomp_sections_init(int n)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    struct vcomp_task_data *task_data = thread_data->task;
+
+    TRACE("(%d)\n", n);
+
+    EnterCriticalSection(&vcomp_section);
+    thread_data->section++;
+    if ((int)(thread_data->section - task_data->section) > 0)
+    {
+        task_data->section       = thread_data->section;
+        task_data->num_sections  = n;
+        task_data->section_index = 0;
+    }
+    LeaveCriticalSection(&vcomp_section);
+}
+
+int CDECL _vcomp_sections_next(void)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    struct vcomp_task_data *task_data = thread_data->task;
+    int i = -1;
+
+    TRACE("()\n");
+
+    EnterCriticalSection(&vcomp_section);
+    if (thread_data->section == task_data->section &&
+        task_data->section_index != task_data->num_sections)
+    {
+        i = task_data->section_index++;
+    }
+    LeaveCriticalSection(&vcomp_section);
+    return i;
+}
+
+/* Split iterations evenly between the team, the first threads get one more if
+ * the count doesn't divide. Returns FALSE if this thread has nothing to do. */
+static BOOL vcomp_static_range(struct vcomp_thread_data *thread_data, ULONG64 first, ULONG64 iterations,
+                               LONG64 step, ULONG64 *begin, ULONG64 *end)
+{
+    int num_threads = vcomp_team_size(thread_data);
+    unsigned int thread_num = thread_data->thread_num;
+    ULONG64 per_thread = iterations / num_threads;
+    ULONG64 remaining  = iterations - per_thread * num_threads;
+
+    if (thread_num < remaining)
+        per_thread++;
+    else if (per_thread)
+        first += remaining * step;
+    else
+        return FALSE;
+
+    *begin = first + per_thread * thread_num * step;
+    *end   = *begin + (per_thread - 1) * step;
+    return TRUE;
 }
 
-int CDECL omp_get_max_threads(void)
+void CDECL _vcomp_for_static_simple_init(unsigned int first, unsigned int last, int step,
+                                         BOOL increment, unsigned int *begin, unsigned int *end)
 {
-    TRACE("stub\n");
-    return 1;
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    unsigned int iterations;
+    ULONG64 begin64, end64;
+
+    TRACE("(%u, %u, %d, %u, %p, %p)\n", first, last, step, increment, begin, end);
+
+    if (vcomp_team_size(thread_data) == 1)
+    {
+        *begin = first;
+        *end   = last;
+        return;
+    }
+
+    if (step <= 0)
+    {
+        *begin = 0;
+        *end   = increment ? -1 : 1;
+        return;
+    }
+
+    if (increment)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    if (!vcomp_static_range(thread_data, first, iterations, step, &begin64, &end64))
+    {
+        *begin = first;
+        *end   = first - step;
+        return;
+    }
+    *begin = begin64;
+    *end   = end64;
 }
 
-int CDECL omp_get_nested(void)
+void CDECL _vcomp_for_static_simple_init_i8(ULONG64 first, ULONG64 last, LONG64 step,
+                                            BOOL increment, ULONG64 *begin, ULONG64 *end)
 {
-    TRACE("stub\n");
-    return 0;
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    ULONG64 iterations;
+
+    TRACE("(%s, %s, %s, %u, %p, %p)\n", wine_dbgstr_longlong(first), wine_dbgstr_longlong(last),
+          wine_dbgstr_longlong(step), increment, begin, end);
+
+    if (vcomp_team_size(thread_data) == 1)
+    {
+        *begin = first;
+        *end   = last;
+        return;
+    }
+
+    if (step <= 0)
+    {
+        *begin = 0;
+        *end   = increment ? -1 : 1;
+        return;
+    }
+
+    if (increment)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    if (!vcomp_static_range(thread_data, first, iterations, step, begin, end))
+    {
+        *begin = first;
+        *end   = first - step;
+    }
 }
 
-int CDECL omp_get_num_procs(void)
+void CDECL _vcomp_for_static_init(int first, int last, int step, int chunksize, unsigned int *loops,
+                                  int *begin, int *end, int *next, int *lastchunk)
 {
-    TRACE("stub\n");
-    return 1;
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    unsigned int iterations, num_chunks, per_thread, remaining;
+    int num_threads = vcomp_team_size(thread_data);
+    int thread_num = thread_data->thread_num;
+    int no_begin, no_lastchunk;
+
+    TRACE("(%d, %d, %d, %d, %p, %p, %p, %p, %p)\n",
+          first, last, step, chunksize, loops, begin, end, next, lastchunk);
+
+    if (!begin)
+    {
+        begin = &no_begin;
+        lastchunk = &no_lastchunk;
+    }
+
+    if (num_threads == 1 && chunksize != 1)
+    {
+        *loops      = 1;
+        *begin      = first;
+        *end        = last;
+        *next       = 0;
+        *lastchunk  = first;
+        return;
+    }
+
+    if (first == last)
+    {
+        *loops = !thread_num;
+        if (!thread_num)
+        {
+            *begin      = first;
+            *end        = last;
+            *next       = 0;
+            *lastchunk  = first;
+        }
+        return;
+    }
+
+    if (step <= 0)
+    {
+        *loops = 0;
+        return;
+    }
+
+    if (first < last)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    if (chunksize < 1)
+        chunksize = 1;
+
+    num_chunks  = ((DWORD64)iterations + chunksize - 1) / chunksize;
+    per_thread  = num_chunks / num_threads;
+    remaining   = num_chunks - per_thread * num_threads;
+
+    *loops      = per_thread + (thread_num < remaining);
+    *begin      = first + thread_num * chunksize * step;
+    *end        = *begin + (chunksize - 1) * step;
+    *next       = chunksize * num_threads * step;
+    *lastchunk  = first + (num_chunks - 1) * chunksize * step;
 }
 
-int CDECL omp_get_num_threads(void)
+void CDECL _vcomp_for_static_init_i8(LONG64 first, LONG64 last, LONG64 step, LONG64 chunksize, ULONG64 *loops,
+                                     LONG64 *begin, LONG64 *end, LONG64 *next, LONG64 *lastchunk)
 {
-    TRACE("stub\n");
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    ULONG64 iterations, num_chunks, per_thread, remaining;
+    int num_threads = vcomp_team_size(thread_data);
+    int thread_num = thread_data->thread_num;
+    LONG64 no_begin, no_lastchunk;
+
+    TRACE("(%s, %s, %s, %s, %p, %p, %p, %p, %p)\n",
+          wine_dbgstr_longlong(first), wine_dbgstr_longlong(last), wine_dbgstr_longlong(step),
+          wine_dbgstr_longlong(chunksize), loops, begin, end, next, lastchunk);
+
+    if (!begin)
+    {
+        begin = &no_begin;
+        lastchunk = &no_lastchunk;
+    }
+
+    if (num_threads == 1 && chunksize != 1)
+    {
+        *loops      = 1;
+        *begin      = first;
+        *end        = last;
+        *next       = 0;
+        *lastchunk  = first;
+        return;
+    }
+
+    if (first == last)
+    {
+        *loops = !thread_num;
+        if (!thread_num)
+        {
+            *begin      = first;
+            *end        = last;
+            *next       = 0;
+            *lastchunk  = first;
+        }
+        return;
+    }
+
+    if (step <= 0)
+    {
+        *loops = 0;
+        return;
+    }
+
+    if (first < last)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    if (chunksize < 1)
+        chunksize = 1;
+
+    num_chunks  = iterations / chunksize;
+    if (iterations % chunksize) num_chunks++;
+    per_thread  = num_chunks / num_threads;
+    remaining   = num_chunks - per_thread * num_threads;
+
+    *loops      = per_thread + (thread_num < remaining);
+    *begin      = first + thread_num * chunksize * step;
+    *end        = *begin + (chunksize - 1) * step;
+    *next       = chunksize * num_threads * step;
+    *lastchunk  = first + (num_chunks - 1) * chunksize * step;
+}
+
+void CDECL _vcomp_for_static_end(void)
+{
+    TRACE("()\n");
+    /* nothing to do here */
+}
+
+static void vcomp_dynamic_init(struct vcomp_thread_data *thread_data, unsigned int flags, ULONG64 first,
+                               ULONG64 last, ULONG64 iterations, LONG64 step, ULONG64 chunksize)
+{
+    struct vcomp_task_data *task_data = thread_data->task;
+    unsigned int type = flags & ~VCOMP_DYNAMIC_FLAGS_INCREMENT;
+
+    if (type == VCOMP_DYNAMIC_FLAGS_STATIC)
+    {
+        if (vcomp_static_range(thread_data, first, iterations, step,
+                               &thread_data->dynamic_begin, &thread_data->dynamic_end))
+            thread_data->dynamic_type = VCOMP_DYNAMIC_FLAGS_STATIC;
+        else
+            thread_data->dynamic_type = 0;
+        return;
+    }
+
+    if (type != VCOMP_DYNAMIC_FLAGS_CHUNKED &&
+        type != VCOMP_DYNAMIC_FLAGS_GUIDED)
+    {
+        FIXME("unsupported flags %u\n", flags);
+        type = VCOMP_DYNAMIC_FLAGS_GUIDED;
+    }
+
+    if (!chunksize) chunksize = 1;
+
+    /* the first thread to get here sets up the shared iteration space, the
+     * others only have to catch up with the loop counter */
+    EnterCriticalSection(&vcomp_section);
+    thread_data->dynamic++;
+    thread_data->dynamic_type = type;
+    if ((int)(thread_data->dynamic - task_data->dynamic) > 0)
+    {
+        task_data->dynamic            = thread_data->dynamic;
+        task_data->dynamic_first      = first;
+        task_data->dynamic_last       = last;
+        task_data->dynamic_iterations = iterations;
+        task_data->dynamic_step       = step;
+        task_data->dynamic_chunksize  = chunksize;
+    }
+    LeaveCriticalSection(&vcomp_section);
+}
+
+static int vcomp_dynamic_next(struct vcomp_thread_data *thread_data, ULONG64 *begin, ULONG64 *end)
+{
+    struct vcomp_task_data *task_data = thread_data->task;
+    int num_threads = vcomp_team_size(thread_data);
+    ULONG64 iterations = 0;
+
+    if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_STATIC)
+    {
+        *begin = thread_data->dynamic_begin;
+        *end   = thread_data->dynamic_end;
+        thread_data->dynamic_type = 0;
+        return 1;
+    }
+
+    if (thread_data->dynamic_type != VCOMP_DYNAMIC_FLAGS_CHUNKED &&
+        thread_data->dynamic_type != VCOMP_DYNAMIC_FLAGS_GUIDED)
+        return 0;
+
+    EnterCriticalSection(&vcomp_section);
+    if (thread_data->dynamic == task_data->dynamic &&
+        task_data->dynamic_iterations != 0)
+    {
+        iterations = min(task_data->dynamic_iterations, task_data->dynamic_chunksize);
+        if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
+            task_data->dynamic_iterations > num_threads * task_data->dynamic_chunksize)
+        {
+            iterations = (task_data->dynamic_iterations + num_threads - 1) / num_threads;
+        }
+        *begin = task_data->dynamic_first;
+        *end   = task_data->dynamic_first + (iterations - 1) * task_data->dynamic_step;
+        task_data->dynamic_iterations -= iterations;
+        task_data->dynamic_first      += iterations * task_data->dynamic_step;
+        if (!task_data->dynamic_iterations)
+            *end = task_data->dynamic_last;
+    }
+    LeaveCriticalSection(&vcomp_section);
+    return iterations != 0;
+}
+
+void CDECL _vcomp_for_dynamic_init(unsigned int flags, unsigned int first, unsigned int last,
+                                   int step, unsigned int chunksize)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    unsigned int iterations;
+
+    TRACE("(%u, %u, %u, %d, %u)\n", flags, first, last, step, chunksize);
+
+    if (step <= 0)
+    {
+        thread_data->dynamic_type = 0;
+        return;
+    }
+
+    if (flags & VCOMP_DYNAMIC_FLAGS_INCREMENT)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    vcomp_dynamic_init(thread_data, flags, first, last, iterations, step, chunksize);
+}
+
+void CDECL _vcomp_for_dynamic_init_i8(unsigned int flags, ULONG64 first, ULONG64 last,
+                                      LONG64 step, ULONG64 chunksize)
+{
+    struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
+    ULONG64 iterations;
+
+    TRACE("(%u, %s, %s, %s, %s)\n", flags, wine_dbgstr_longlong(first), wine_dbgstr_longlong(last),
+          wine_dbgstr_longlong(step), wine_dbgstr_longlong(chunksize));
+
+    if (step <= 0)
+    {
+        thread_data->dynamic_type = 0;
+        return;
+    }
+
+    if (flags & VCOMP_DYNAMIC_FLAGS_INCREMENT)
+        iterations = 1 + (last - first) / step;
+    else
+    {
+        iterations = 1 + (first - last) / step;
+        step *= -1;
+    }
+
+    vcomp_dynamic_init(thread_data, flags, first, last, iterations, step, chunksize);
+}
+
+int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
+{
+    ULONG64 begin64, end64;
+
+    TRACE("(%p, %p)\n", begin, end);
+
+    if (!vcomp_dynamic_next(vcomp_init_thread_data(), &begin64, &end64)) return 0;
+    *begin = begin64;
+    *end   = end64;
     return 1;
 }
 
-int CDECL omp_get_thread_num(void)
+int CDECL _vcomp_for_dynamic_next_i8(ULONG64 *begin, ULONG64 *end)
 {
-    TRACE("stub\n");
+    TRACE("(%p, %p)\n", begin, end);
+
+    return vcomp_dynamic_next(vcomp_init_thread_data(), begin, end);
+}
+
+void CDECL _vcomp_ordered_begin(void)
+{
+    static int once;
+
+    TRACE("()\n");
+
+    /* iterations are not serialized in loop order, only one runs the ordered block at a time */
+    if (!once++) FIXME("ordered loops are not executed in order\n");
+    EnterCriticalSection(&vcomp_ordered_section);
+}
+
+void CDECL _vcomp_ordered_end(void)
+{
+    TRACE("()\n");
+    LeaveCriticalSection(&vcomp_ordered_section);
+}
+
+void CDECL _vcomp_ordered_loop_end(void)
+{
+    TRACE("()\n");
+    /* nothing to do here */
+}
+
+void CDECL _vcomp_copyprivate_broadcast(void *value)
+{
+    struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+
+    TRACE("(%p)\n", value);
+
+    if (team_data) team_data->broadcast_data = value;
+}
+
+void * CDECL _vcomp_copyprivate_receive(void)
+{
+    struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+
+    TRACE("()\n");
+
+    return team_data ? team_data->broadcast_data : NULL;
+}
+
+void CDECL _vcomp_flush(void)
+{
+    static LONG flush;
+
+    TRACE("()\n");
+    /* any locked instruction acts as a full memory barrier */
+    interlocked_xchg_add(&flush, 0);
+}
+
+static DWORD WINAPI _vcomp_fork_worker(void *param)
+{
+    struct vcomp_thread_data *thread_data = param;
+    vcomp_set_thread_data(thread_data);
+
+    TRACE("starting worker thread for %p\n", thread_data);
+
+    EnterCriticalSection(&vcomp_section);
+    for (;;)
+    {
+        struct vcomp_team_data *team = thread_data->team;
+        if (team != NULL)
+        {
+            LeaveCriticalSection(&vcomp_section);
+            _vcomp_fork_call_wrapper(team->wrapper, team->nargs, team->valist);
+            EnterCriticalSection(&vcomp_section);
+
+            thread_data->team = NULL;
+            list_remove(&thread_data->entry);
+            list_add_tail(&vcomp_idle_threads, &thread_data->entry);
+            if (++team->finished_threads >= team->num_threads)
+                WakeAllConditionVariable(&team->cond);
+        }
+
+        if (!SleepConditionVariableCS(&thread_data->cond, &vcomp_section, VCOMP_IDLE_TIMEOUT) &&
+            GetLastError() == ERROR_TIMEOUT && !thread_data->team)
+        {
+            break;
+        }
+    }
+    list_remove(&thread_data->entry);
+    LeaveCriticalSection(&vcomp_section);
+
+    TRACE("terminating worker thread for %p\n", thread_data);
+
+    HeapFree(GetProcessHeap(), 0, thread_data);
+    vcomp_set_thread_data(NULL);
+    FreeLibraryAndExitThread(vcomp_module, 0);
     return 0;
 }
 
-/* Time in seconds since "some time in the past" */
-double CDECL omp_get_wtime(void)
+void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
+{
+    struct vcomp_thread_data *prev_thread_data = vcomp_init_thread_data();
+    struct vcomp_thread_data thread_data;
+    struct vcomp_team_data team_data;
+    struct vcomp_task_data task_data;
+    int num_threads;
+
+    TRACE("(%d, %d, %p, ...)\n", ifval, nargs, wrapper);
+
+    if (prev_thread_data->parallel && !vcomp_nested_fork)
+        ifval = FALSE;
+
+    if (!ifval)
+        num_threads = 1;
+    else if (prev_thread_data->fork_threads)
+        num_threads = prev_thread_data->fork_threads;
+    else
+        num_threads = vcomp_num_threads;
+
+    InitializeConditionVariable(&team_data.cond);
+    team_data.num_threads       = 1;
+    team_data.finished_threads  = 0;
+    team_data.nargs             = nargs;
+    team_data.wrapper           = wrapper;
+    __ms_va_start(team_data.valist, wrapper);
+    team_data.barrier           = 0;
+    team_data.barrier_count     = 0;
+    team_data.broadcast_data    = NULL;
+
+    task_data.single            = 0;
+    task_data.section           = 0;
+    task_data.dynamic           = 0;
+
+    vcomp_init_thread_task(&thread_data, &team_data, &task_data, 0, ifval || prev_thread_data->parallel);
+    list_init(&thread_data.entry);
+    InitializeConditionVariable(&thread_data.cond);
+
+    if (num_threads > 1)
+    {
+        struct list *ptr;
+        EnterCriticalSection(&vcomp_section);
+
+        /* reuse existing threads (if any) */
+        while (team_data.num_threads < num_threads && (ptr = list_head(&vcomp_idle_threads)))
+        {
+            struct vcomp_thread_data *data = LIST_ENTRY(ptr, struct vcomp_thread_data, entry);
+            vcomp_init_thread_task(data, &team_data, &task_data, team_data.num_threads++,
+                                   thread_data.parallel);
+            list_remove(&data->entry);
+            list_add_tail(&thread_data.entry, &data->entry);
+            WakeAllConditionVariable(&data->cond);
+        }
+
+        /* spawn additional threads */
+        while (team_data.num_threads < num_threads)
+        {
+            struct vcomp_thread_data *data;
+            HMODULE module;
+            HANDLE thread;
+
+            data = HeapAlloc(GetProcessHeap(), 0, sizeof(*data));
+            if (!data) break;
+
+            vcomp_init_thread_task(data, &team_data, &task_data, team_data.num_threads,
+                                   thread_data.parallel);
+            InitializeConditionVariable(&data->cond);
+
+            thread = CreateThread(NULL, 0, _vcomp_fork_worker, data, 0, NULL);
+            if (!thread)
+            {
+                HeapFree(GetProcessHeap(), 0, data);
+                break;
+            }
+
+            /* the worker releases this reference when it exits */
+            GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,
+                               (const WCHAR *)vcomp_module, &module);
+            team_data.num_threads++;
+            list_add_tail(&thread_data.entry, &data->entry);
+            CloseHandle(thread);
+        }
+
+        LeaveCriticalSection(&vcomp_section);
+    }
+
+    vcomp_set_thread_data(&thread_data);
+    _vcomp_fork_call_wrapper(team_data.wrapper, team_data.nargs, team_data.valist);
+    vcomp_set_thread_data(prev_thread_data);
+    prev_thread_data->fork_threads = 0;
+
+    if (team_data.num_threads > 1)
+    {
+        EnterCriticalSection(&vcomp_section);
+
+        team_data.finished_threads++;
+        while (team_data.finished_threads < team_data.num_threads)
+            SleepConditionVariableCS(&team_data.cond, &vcomp_section, INFINITE);
+
+        LeaveCriticalSection(&vcomp_section);
+        assert(list_empty(&thread_data.entry));
+    }
+
+    __ms_va_end(team_data.valist);
+}
+
+static CRITICAL_SECTION *alloc_critsect(void)
 {
-    return GetTickCount() / 1000.0;
+    CRITICAL_SECTION *critsect;
+    if (!(critsect = HeapAlloc(GetProcessHeap(), 0, sizeof(*critsect))))
+    {
+        ERR("could not allocate critical section\n");
+        ExitProcess(1);
+    }
+
+    InitializeCriticalSection(critsect);
+    critsect->DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": critsect");
+    return critsect;
 }
 
-void CDECL omp_set_dynamic(int val)
+static void destroy_critsect(CRITICAL_SECTION *critsect)
 {
-    TRACE("(%d): stub\n", val);
+    if (!critsect) return;
+    critsect->DebugInfo->Spare[0] = 0;
+    DeleteCriticalSection(critsect);
+    HeapFree(GetProcessHeap(), 0, critsect);
 }
 
-void CDECL omp_set_nested(int nested)
+static inline BOOL critsect_owned(CRITICAL_SECTION *critsect)
 {
-    TRACE("(%d): stub\n", nested);
+    return critsect->OwningThread == ULongToHandle(GetCurrentThreadId());
 }
 
-void CDECL omp_set_num_threads(int num_threads)
+void CDECL omp_init_lock(omp_lock_t *lock)
 {
-    TRACE("(%d): stub\n", num_threads);
+    TRACE("(%p)\n", lock);
+    *lock = alloc_critsect();
 }
 
-void CDECL _vcomp_barrier(void)
+void CDECL omp_destroy_lock(omp_lock_t *lock)
 {
-    TRACE("stub\n");
+    TRACE("(%p)\n", lock);
+    destroy_critsect(*lock);
 }
 
-void CDECL _vcomp_set_num_threads(int num_threads)
+void CDECL omp_set_lock(omp_lock_t *lock)
 {
-    TRACE("(%d): stub\n", num_threads);
+    TRACE("(%p)\n", lock);
+
+    if (critsect_owned(*lock))
+    {
+        ERR("omp_set_lock called while holding lock %p\n", *lock);
+        ExitProcess(1);
+    }
+
+    EnterCriticalSection(*lock);
 }
 
-int CDECL _vcomp_single_begin(int flags)
+void CDECL omp_unset_lock(omp_lock_t *lock)
 {
-    TRACE("(%x): stub\n", flags);
-    return TRUE;
+    TRACE("(%p)\n", lock);
+    LeaveCriticalSection(*lock);
 }
 
-void CDECL _vcomp_single_end(void)
+int CDECL omp_test_lock(omp_lock_t *lock)
 {
-    TRACE("stub\n");
+    TRACE("(%p)\n", lock);
+
+    if (critsect_owned(*lock))
+        return 0;
+
+    return TryEnterCriticalSection(*lock);
+}
+
+void CDECL omp_init_nest_lock(omp_nest_lock_t *lock)
+{
+    TRACE("(%p)\n", lock);
+    *lock = alloc_critsect();
+}
+
+void CDECL omp_destroy_nest_lock(omp_nest_lock_t *lock)
+{
+    TRACE("(%p)\n", lock);
+    destroy_critsect(*lock);
+}
+
+void CDECL omp_set_nest_lock(omp_nest_lock_t *lock)
+{
+    TRACE("(%p)\n", lock);
+    EnterCriticalSection(*lock);
+}
+
+void CDECL omp_unset_nest_lock(omp_nest_lock_t *lock)
+{
+    TRACE("(%p)\n", lock);
+    LeaveCriticalSection(*lock);
+}
+
+int CDECL omp_test_nest_lock(omp_nest_lock_t *lock)
+{
+    TRACE("(%p)\n", lock);
+    return TryEnterCriticalSection(*lock) ? (*lock)->RecursionCount : 0;
 }
 
-BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
+void CDECL _vcomp_enter_critsect(CRITICAL_SECTION **critsect)
 {
-    TRACE("(0x%p, %d, %p)\n", hinstDLL, fdwReason, lpvReserved);
+    TRACE("(%p)\n", critsect);
 
-    switch (fdwReason)
+    if (!*critsect)
+    {
+        CRITICAL_SECTION *new_critsect = alloc_critsect();
+        if (interlocked_cmpxchg_ptr((void **)critsect, new_critsect, NULL) != NULL)
+            destroy_critsect(new_critsect);  /* someone beat us to it */
+    }
+
+    EnterCriticalSection(*critsect);
+}
+
+void CDECL _vcomp_leave_critsect(CRITICAL_SECTION *critsect)
+{
+    TRACE("(%p)\n", critsect);
+    LeaveCriticalSection(critsect);
+}
+
+BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
+{
+    TRACE("(%p, %d, %p)\n", instance, reason, reserved);
+
+    switch (reason)
     {
-        case DLL_WINE_PREATTACH:
-            return FALSE;    /* prefer native version */
         case DLL_PROCESS_ATTACH:
-            DisableThreadLibraryCalls(hinstDLL);
+        {
+            SYSTEM_INFO sysinfo;
+
+            if ((vcomp_context_tls = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+            {
+                ERR("Failed to allocate TLS index\n");
+                return FALSE;
+            }
+
+            GetSystemInfo(&sysinfo);
+            vcomp_module      = instance;
+            vcomp_max_threads = sysinfo.dwNumberOfProcessors;
+            vcomp_num_threads = sysinfo.dwNumberOfProcessors;
+            break;
+        }
+
+        case DLL_PROCESS_DETACH:
+        {
+            if (reserved) break;
+            if (vcomp_context_tls != TLS_OUT_OF_INDEXES)
+            {
+                vcomp_free_thread_data();
+                TlsFree(vcomp_context_tls);
+            }
+            break;
+        }
+
+        case DLL_THREAD_DETACH:
+        {
+            vcomp_free_thread_data();
             break;
+        }
     }
 
     return TRUE;
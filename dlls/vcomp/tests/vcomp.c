@@ -0,0 +1,459 @@
+/*
+ * Unit tests for vcomp (OpenMP runtime)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+
+#include "windef.h"
+#include "winbase.h"
+#include "wine/test.h"
+
+typedef CRITICAL_SECTION *omp_lock_t;
+typedef CRITICAL_SECTION *omp_nest_lock_t;
+
+static HMODULE hvcomp;
+
+static void  (CDECL   *p_vcomp_atomic_add_i4)(int *dest, int val);
+static void  (CDECL   *p_vcomp_atomic_add_i8)(LONG64 *dest, LONG64 val);
+static void  (CDECL   *p_vcomp_atomic_add_r8)(double *dest, double val);
+static void  (CDECL   *p_vcomp_atomic_mul_i2)(short *dest, short val);
+static void  (CDECL   *p_vcomp_atomic_sub_i1)(char *dest, char val);
+static void  (CDECL   *p_vcomp_barrier)(void);
+static void  (CDECL   *p_vcomp_for_dynamic_init)(unsigned int flags, unsigned int first, unsigned int last,
+                                                 int step, unsigned int chunksize);
+static int   (CDECL   *p_vcomp_for_dynamic_next)(unsigned int *begin, unsigned int *end);
+static void  (CDECL   *p_vcomp_for_static_end)(void);
+static void  (CDECL   *p_vcomp_for_static_init)(int first, int last, int step, int chunksize, unsigned int *loops,
+                                                int *begin, int *end, int *next, int *lastchunk);
+static void  (CDECL   *p_vcomp_for_static_simple_init)(unsigned int first, unsigned int last, int step,
+                                                       BOOL increment, unsigned int *begin, unsigned int *end);
+static void  (WINAPIV *p_vcomp_fork)(BOOL ifval, int nargs, void *wrapper, ...);
+static void  (CDECL   *p_vcomp_reduction_i4)(unsigned int flags, int *dest, int val);
+static int   (CDECL   *p_vcomp_sections_next)(void);
+static void  (CDECL   *p_vcomp_sections_init)(int n);
+static void  (CDECL   *p_vcomp_set_num_threads)(int num_threads);
+static int   (CDECL   *p_vcomp_single_begin)(int flags);
+static void  (CDECL   *p_vcomp_single_end)(void);
+static void  (CDECL   *p_omp_destroy_lock)(omp_lock_t *lock);
+static int   (CDECL   *p_omp_get_max_threads)(void);
+static int   (CDECL   *p_omp_get_num_procs)(void);
+static int   (CDECL   *p_omp_get_num_threads)(void);
+static int   (CDECL   *p_omp_get_thread_num)(void);
+static double (CDECL  *p_omp_get_wtime)(void);
+static int   (CDECL   *p_omp_in_parallel)(void);
+static void  (CDECL   *p_omp_init_lock)(omp_lock_t *lock);
+static void  (CDECL   *p_omp_set_lock)(omp_lock_t *lock);
+static void  (CDECL   *p_omp_set_num_threads)(int num_threads);
+static int   (CDECL   *p_omp_test_lock)(omp_lock_t *lock);
+static void  (CDECL   *p_omp_unset_lock)(omp_lock_t *lock);
+
+#define VCOMP_DYNAMIC_FLAGS_CHUNKED     0x02
+#define VCOMP_DYNAMIC_FLAGS_GUIDED      0x03
+#define VCOMP_DYNAMIC_FLAGS_INCREMENT   0x40
+
+#define VCOMP_REDUCTION_FLAGS_ADD       0x100
+
+static BOOL init_vcomp(void)
+{
+    hvcomp = LoadLibraryA("vcomp.dll");
+    if (!hvcomp)
+    {
+        win_skip("vcomp.dll not available\n");
+        return FALSE;
+    }
+
+#define VCOMP_GET_PROC(func) \
+    do \
+    { \
+        p ## func = (void *)GetProcAddress(hvcomp, #func); \
+        if (!p ## func) trace("Failed to get address for %s\n", #func); \
+    } \
+    while (0)
+#define OMP_GET_PROC(func) \
+    do \
+    { \
+        p_ ## func = (void *)GetProcAddress(hvcomp, #func); \
+        if (!p_ ## func) trace("Failed to get address for %s\n", #func); \
+    } \
+    while (0)
+
+    VCOMP_GET_PROC(_vcomp_atomic_add_i4);
+    VCOMP_GET_PROC(_vcomp_atomic_add_i8);
+    VCOMP_GET_PROC(_vcomp_atomic_add_r8);
+    VCOMP_GET_PROC(_vcomp_atomic_mul_i2);
+    VCOMP_GET_PROC(_vcomp_atomic_sub_i1);
+    VCOMP_GET_PROC(_vcomp_barrier);
+    VCOMP_GET_PROC(_vcomp_for_dynamic_init);
+    VCOMP_GET_PROC(_vcomp_for_dynamic_next);
+    VCOMP_GET_PROC(_vcomp_for_static_end);
+    VCOMP_GET_PROC(_vcomp_for_static_init);
+    VCOMP_GET_PROC(_vcomp_for_static_simple_init);
+    VCOMP_GET_PROC(_vcomp_fork);
+    VCOMP_GET_PROC(_vcomp_reduction_i4);
+    VCOMP_GET_PROC(_vcomp_sections_init);
+    VCOMP_GET_PROC(_vcomp_sections_next);
+    VCOMP_GET_PROC(_vcomp_set_num_threads);
+    VCOMP_GET_PROC(_vcomp_single_begin);
+    VCOMP_GET_PROC(_vcomp_single_end);
+    OMP_GET_PROC(omp_destroy_lock);
+    OMP_GET_PROC(omp_get_max_threads);
+    OMP_GET_PROC(omp_get_num_procs);
+    OMP_GET_PROC(omp_get_num_threads);
+    OMP_GET_PROC(omp_get_thread_num);
+    OMP_GET_PROC(omp_get_wtime);
+    OMP_GET_PROC(omp_in_parallel);
+    OMP_GET_PROC(omp_init_lock);
+    OMP_GET_PROC(omp_set_lock);
+    OMP_GET_PROC(omp_set_num_threads);
+    OMP_GET_PROC(omp_test_lock);
+    OMP_GET_PROC(omp_unset_lock);
+
+#undef VCOMP_GET_PROC
+#undef OMP_GET_PROC
+
+    return TRUE;
+}
+
+static void CDECL fork_ptr_cb(LONG *a, LONG *b, LONG *c, LONG *d, LONG *e)
+{
+    InterlockedIncrement(a);
+    InterlockedIncrement(b);
+    InterlockedIncrement(c);
+    InterlockedIncrement(d);
+    InterlockedIncrement(e);
+}
+
+static void CDECL fork_uintptr_cb(UINT_PTR a, UINT_PTR b, UINT_PTR c, UINT_PTR d, UINT_PTR e)
+{
+    ok(a == 1, "expected a == 1, got %p\n", (void *)a);
+    ok(b == MAXUINT_PTR - 2, "expected b == MAXUINT_PTR - 2, got %p\n", (void *)b);
+    ok(c == 3, "expected c == 3, got %p\n", (void *)c);
+    ok(d == MAXUINT_PTR - 4, "expected d == MAXUINT_PTR - 4, got %p\n", (void *)d);
+    ok(e == 5, "expected e == 5, got %p\n", (void *)e);
+}
+
+static void CDECL fork_thread_num_cb(LONG *count, LONG *mask)
+{
+    int num_threads = p_omp_get_num_threads();
+    int thread_num = p_omp_get_thread_num();
+    LONG old;
+
+    ok(num_threads == 4, "expected num_threads == 4, got %d\n", num_threads);
+    ok(thread_num >= 0 && thread_num < 4, "expected thread_num in [0, 4), got %d\n", thread_num);
+    ok(p_omp_in_parallel(), "expected to be in a parallel region\n");
+    if (thread_num >= 0 && thread_num < 4)
+    {
+        do old = *mask;
+        while (InterlockedCompareExchange(mask, old | (1 << thread_num), old) != old);
+    }
+    InterlockedIncrement(count);
+}
+
+static void test_vcomp_fork(void)
+{
+    LONG a, b, c, d, e, count, mask;
+    int max_threads = p_omp_get_max_threads();
+
+    ok(!p_omp_in_parallel(), "expected not to be in a parallel region\n");
+
+    p_omp_set_num_threads(4);
+
+    a = b = c = d = e = 0;
+    p_vcomp_fork(TRUE, 5, fork_ptr_cb, &a, &b, &c, &d, &e);
+    ok(a == 4, "expected a == 4, got %d\n", a);
+    ok(b == 4, "expected b == 4, got %d\n", b);
+    ok(c == 4, "expected c == 4, got %d\n", c);
+    ok(d == 4, "expected d == 4, got %d\n", d);
+    ok(e == 4, "expected e == 4, got %d\n", e);
+
+    a = b = c = d = e = 0;
+    p_vcomp_fork(FALSE, 5, fork_ptr_cb, &a, &b, &c, &d, &e);
+    ok(a == 1, "expected a == 1, got %d\n", a);
+    ok(e == 1, "expected e == 1, got %d\n", e);
+
+    p_vcomp_fork(TRUE, 5, fork_uintptr_cb, (UINT_PTR)1, (UINT_PTR)(MAXUINT_PTR - 2),
+                 (UINT_PTR)3, (UINT_PTR)(MAXUINT_PTR - 4), (UINT_PTR)5);
+
+    count = mask = 0;
+    p_vcomp_fork(TRUE, 2, fork_thread_num_cb, &count, &mask);
+    ok(count == 4, "expected count == 4, got %d\n", count);
+    ok(mask == 0xf, "expected mask == 0xf, got %x\n", mask);
+
+    /* _vcomp_set_num_threads only applies to the next parallel region */
+    p_omp_set_num_threads(2);
+    p_vcomp_set_num_threads(4);
+    count = mask = 0;
+    p_vcomp_fork(TRUE, 2, fork_thread_num_cb, &count, &mask);
+    ok(count == 4, "expected count == 4, got %d\n", count);
+    a = 0;
+    p_vcomp_fork(TRUE, 5, fork_ptr_cb, &a, &a, &a, &a, &a);
+    ok(a == 10, "expected a == 10, got %d\n", a);
+
+    p_omp_set_num_threads(max_threads);
+}
+
+#define LOOP_SIZE 1000
+
+static void CDECL for_static_simple_cb(LONG *hits)
+{
+    unsigned int begin, end, i;
+
+    p_vcomp_for_static_simple_init(0, LOOP_SIZE - 1, 1, TRUE, &begin, &end);
+    for (i = begin; (int)i <= (int)end; i++)
+        InterlockedIncrement(&hits[i]);
+    p_vcomp_for_static_end();
+    p_vcomp_barrier();
+
+    /* decrementing loop with a step of 3 */
+    p_vcomp_for_static_simple_init(LOOP_SIZE - 1, 0, 3, FALSE, &begin, &end);
+    for (i = begin; (int)i >= (int)end; i -= 3)
+        InterlockedIncrement(&hits[i]);
+    p_vcomp_for_static_end();
+}
+
+static void CDECL for_static_chunked_cb(LONG *hits)
+{
+    unsigned int loops, i;
+    int begin, end, next, lastchunk, j;
+
+    p_vcomp_for_static_init(0, LOOP_SIZE - 1, 1, 7, &loops, &begin, &end, &next, &lastchunk);
+    for (i = 0; i < loops; i++, begin += next, end += next)
+    {
+        if (end > LOOP_SIZE - 1) end = LOOP_SIZE - 1;
+        for (j = begin; j <= end; j++)
+            InterlockedIncrement(&hits[j]);
+    }
+    p_vcomp_for_static_end();
+}
+
+static void CDECL for_dynamic_cb(LONG *hits, unsigned int flags)
+{
+    unsigned int begin, end, i;
+
+    p_vcomp_for_dynamic_init(flags, 0, LOOP_SIZE - 1, 1, 5);
+    while (p_vcomp_for_dynamic_next(&begin, &end))
+    {
+        for (i = begin; i <= end; i++)
+            InterlockedIncrement(&hits[i]);
+    }
+}
+
+static void check_hits(LONG *hits, const char *name, LONG expected_even, LONG expected_odd)
+{
+    int i, wrong = 0;
+    for (i = 0; i < LOOP_SIZE; i++)
+    {
+        LONG expected = (LOOP_SIZE - 1 - i) % 3 ? expected_odd : expected_even;
+        if (hits[i] != expected && !wrong++)
+            ok(0, "%s: iteration %d executed %d times, expected %d\n", name, i, hits[i], expected);
+    }
+    ok(!wrong, "%s: %d iterations had the wrong count\n", name, wrong);
+}
+
+static void test_vcomp_for(void)
+{
+    static LONG hits[LOOP_SIZE];
+    int max_threads = p_omp_get_max_threads();
+    int threads[] = {1, 3, 4, 16};
+    int i;
+
+    for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++)
+    {
+        p_omp_set_num_threads(threads[i]);
+
+        memset(hits, 0, sizeof(hits));
+        p_vcomp_fork(TRUE, 1, for_static_simple_cb, hits);
+        check_hits(hits, "static simple", 2, 1);
+
+        memset(hits, 0, sizeof(hits));
+        p_vcomp_fork(TRUE, 1, for_static_chunked_cb, hits);
+        check_hits(hits, "static chunked", 1, 1);
+
+        memset(hits, 0, sizeof(hits));
+        p_vcomp_fork(TRUE, 2, for_dynamic_cb, hits,
+                     VCOMP_DYNAMIC_FLAGS_CHUNKED | VCOMP_DYNAMIC_FLAGS_INCREMENT);
+        check_hits(hits, "dynamic", 1, 1);
+
+        memset(hits, 0, sizeof(hits));
+        p_vcomp_fork(TRUE, 2, for_dynamic_cb, hits,
+                     VCOMP_DYNAMIC_FLAGS_GUIDED | VCOMP_DYNAMIC_FLAGS_INCREMENT);
+        check_hits(hits, "guided", 1, 1);
+    }
+
+    p_omp_set_num_threads(max_threads);
+}
+
+static void CDECL single_sections_cb(LONG *single, LONG *sections)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+    {
+        if (p_vcomp_single_begin(0))
+            InterlockedIncrement(single);
+        p_vcomp_single_end();
+    }
+
+    p_vcomp_sections_init(7);
+    while ((i = p_vcomp_sections_next()) != -1)
+    {
+        ok(i >= 0 && i < 7, "got unexpected section %d\n", i);
+        InterlockedIncrement(sections);
+    }
+    p_vcomp_barrier();
+}
+
+static void test_vcomp_single_sections(void)
+{
+    int max_threads = p_omp_get_max_threads();
+    LONG single = 0, sections = 0;
+
+    p_omp_set_num_threads(4);
+    p_vcomp_fork(TRUE, 2, single_sections_cb, &single, &sections);
+    ok(single == 10, "expected single == 10, got %d\n", single);
+    ok(sections == 7, "expected sections == 7, got %d\n", sections);
+    p_omp_set_num_threads(max_threads);
+}
+
+static void CDECL atomic_cb(int *i4, LONG64 *i8, double *r8, char *i1, int *red)
+{
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        p_vcomp_atomic_add_i4(i4, 3);
+        p_vcomp_atomic_add_i8(i8, (LONG64)1 << 33);
+        p_vcomp_atomic_add_r8(r8, 0.5);
+        p_vcomp_atomic_sub_i1(i1, 1);
+    }
+    p_vcomp_reduction_i4(VCOMP_REDUCTION_FLAGS_ADD, red, p_omp_get_thread_num() + 1);
+}
+
+static void test_atomic(void)
+{
+    int max_threads = p_omp_get_max_threads();
+    LONG64 i8 = 0;
+    double r8 = 0.0;
+    int i4 = 0, red = 0;
+    short i2 = 3;
+    char i1 = 0;
+
+    p_omp_set_num_threads(4);
+    p_vcomp_fork(TRUE, 5, atomic_cb, &i4, &i8, &r8, &i1, &red);
+    ok(i4 == 12000, "expected i4 == 12000, got %d\n", i4);
+    ok(i8 == (LONG64)4000 << 33, "expected i8 == 4000 << 33, got %x%08x\n",
+       (DWORD)(i8 >> 32), (DWORD)i8);
+    ok(r8 == 2000.0, "expected r8 == 2000.0, got %f\n", r8);
+    ok(i1 == (char)-4000, "expected i1 == %d, got %d\n", (char)-4000, i1);
+    ok(red == 10, "expected red == 10, got %d\n", red);
+
+    p_vcomp_atomic_mul_i2(&i2, -7);
+    ok(i2 == -21, "expected i2 == -21, got %d\n", i2);
+
+    p_omp_set_num_threads(max_threads);
+}
+
+static void CDECL lock_cb(omp_lock_t *lock, int *counter)
+{
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        p_omp_set_lock(lock);
+        (*counter)++;
+        p_omp_unset_lock(lock);
+    }
+}
+
+static void test_locks(void)
+{
+    int max_threads = p_omp_get_max_threads();
+    omp_lock_t lock;
+    int counter = 0;
+
+    p_omp_init_lock(&lock);
+    ok(p_omp_test_lock(&lock), "expected to acquire the lock\n");
+    ok(!p_omp_test_lock(&lock), "expected the lock to be busy\n");
+    p_omp_unset_lock(&lock);
+
+    p_omp_set_num_threads(4);
+    p_vcomp_fork(TRUE, 2, lock_cb, &lock, &counter);
+    ok(counter == 4000, "expected counter == 4000, got %d\n", counter);
+    p_omp_set_num_threads(max_threads);
+
+    p_omp_destroy_lock(&lock);
+}
+
+#define BENCHMARK_SIZE 2000000
+
+static void CDECL benchmark_cb(double *result)
+{
+    unsigned int begin, end, i;
+    double sum = 0.0;
+
+    p_vcomp_for_static_simple_init(0, BENCHMARK_SIZE - 1, 1, TRUE, &begin, &end);
+    for (i = begin; (int)i <= (int)end; i++)
+        sum += 1.0 / ((double)i * i + 1.0);
+    p_vcomp_for_static_end();
+    p_vcomp_atomic_add_r8(result, sum);
+}
+
+static double benchmark_for(int num_threads)
+{
+    double start, result = 0.0;
+    int i;
+
+    p_omp_set_num_threads(num_threads);
+    start = p_omp_get_wtime();
+    for (i = 0; i < 10; i++)
+        p_vcomp_fork(TRUE, 1, benchmark_cb, &result);
+    ok(result > 20.0 && result < 21.0, "got unexpected result %f\n", result);
+    return p_omp_get_wtime() - start;
+}
+
+static void test_performance(void)
+{
+    int max_threads = p_omp_get_max_threads();
+    int num_procs = p_omp_get_num_procs();
+    double serial, parallel;
+
+    if (!winetest_interactive)
+    {
+        skip("parallel for benchmark only runs in interactive mode\n");
+        return;
+    }
+
+    serial = benchmark_for(1);
+    parallel = benchmark_for(num_procs);
+    trace("parallel for: %.3fs with 1 thread, %.3fs with %d threads (speedup %.2f)\n",
+          serial, parallel, num_procs, parallel > 0.0 ? serial / parallel : 0.0);
+
+    p_omp_set_num_threads(max_threads);
+}
+
+START_TEST(vcomp)
+{
+    if (!init_vcomp())
+        return;
+
+    test_vcomp_fork();
+    test_vcomp_for();
+    test_vcomp_single_sections();
+    test_atomic();
+    test_locks();
+    test_performance();
+
+    FreeLibrary(hvcomp);
+}
@@ -19,6 +19,7 @@
 #include "config.h"
 
 #include <stdarg.h>
+#include <string.h>
 
 #define COBJMACROS
 
@@ -34,6 +35,7 @@
 WINE_DEFAULT_DEBUG_CHANNEL(wincodecs);
 
 struct FormatConverter;
+struct pixelconverter;
 
 enum pixelformat {
     format_1bppIndexed,
@@ -75,6 +77,8 @@ typedef struct FormatConverter {
     WICBitmapDitherType dither;
     double alpha_threshold;
     WICBitmapPaletteType palette_type;
+    const struct pixelconverter *converter;
+    BYTE *buffer; /* strip buffer of the last conversion, swapped atomically */
     CRITICAL_SECTION lock; /* must be held when initialized */
 } FormatConverter;
 
@@ -994,6 +998,265 @@ static HRESULT copypixels_to_24bppRGB(struct FormatConverter *This, const WICRec
     }
 }
 
+/* Direct row converters for the common format pairs, used instead of going
+ * through 32bppBGRA. A row may be converted in place, so the converters that
+ * widen the pixels work from right to left. */
+typedef void (*convert_row_func)(BYTE *dst, const BYTE *src, UINT width);
+
+struct pixelconverter {
+    enum pixelformat src_format, dst_format;
+    UINT src_bpp, dst_bpp;
+    convert_row_func convert_row;
+};
+
+/* source rows read at once when the source pixels are larger */
+#define CONVERT_STRIP_SIZE 0x40000
+
+static inline BYTE premultiply(BYTE value, BYTE alpha)
+{
+    UINT x = value * alpha;
+    return (x + 1 + (x >> 8)) >> 8; /* x / 255, exact for 0 <= x <= 255 * 255 */
+}
+
+static void convert_row_8bppGray_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x = width;
+
+    while (x--) dstpixel[x] = 0xff000000 | src[x] * 0x010101;
+}
+
+static void convert_row_24bppBGR_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x = width;
+
+    while (x--)
+    {
+        const BYTE *srcpixel = src + 3 * x;
+        dstpixel[x] = 0xff000000 | srcpixel[2] << 16 | srcpixel[1] << 8 | srcpixel[0];
+    }
+}
+
+static void convert_row_24bppRGB_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x = width;
+
+    while (x--)
+    {
+        const BYTE *srcpixel = src + 3 * x;
+        dstpixel[x] = 0xff000000 | srcpixel[0] << 16 | srcpixel[1] << 8 | srcpixel[2];
+    }
+}
+
+static void convert_row_32bppBGR_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    const DWORD *srcpixel = (const DWORD *)src;
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
+
+    for (x = 0; x < width; x++) dstpixel[x] = srcpixel[x] | 0xff000000;
+}
+
+static void convert_row_32bppBGRA_to_32bppPBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        BYTE alpha = src[3];
+        dst[0] = premultiply(src[0], alpha);
+        dst[1] = premultiply(src[1], alpha);
+        dst[2] = premultiply(src[2], alpha);
+        dst[3] = alpha;
+    }
+}
+
+static void convert_row_32bppPBGRA_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        BYTE alpha = src[3];
+        if (alpha != 0 && alpha != 255)
+        {
+            dst[0] = src[0] * 255 / alpha;
+            dst[1] = src[1] * 255 / alpha;
+            dst[2] = src[2] * 255 / alpha;
+        }
+        else
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+        dst[3] = alpha;
+    }
+}
+
+static void convert_row_32bppBGRA_to_24bppBGR(BYTE *dst, const BYTE *src, UINT width)
+{
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 4, dst += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+static void convert_row_32bppBGRA_to_24bppRGB(BYTE *dst, const BYTE *src, UINT width)
+{
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 4, dst += 3)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+
+/* like copypixels_to_32bppBGRA, these keep the first byte of each sample */
+static void convert_row_48bppRGB_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 6)
+        dstpixel[x] = 0xff000000 | src[0] << 16 | src[2] << 8 | src[4];
+}
+
+static void convert_row_64bppRGBA_to_32bppBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 8)
+        dstpixel[x] = src[6] << 24 | src[0] << 16 | src[2] << 8 | src[4];
+}
+
+static void convert_row_64bppRGBA_to_32bppPBGRA(BYTE *dst, const BYTE *src, UINT width)
+{
+    UINT x;
+
+    for (x = 0; x < width; x++, src += 8, dst += 4)
+    {
+        BYTE alpha = src[6];
+        dst[0] = premultiply(src[4], alpha);
+        dst[1] = premultiply(src[2], alpha);
+        dst[2] = premultiply(src[0], alpha);
+        dst[3] = alpha;
+    }
+}
+
+static const struct pixelconverter pixelconverters[] = {
+    {format_8bppGray, format_32bppBGR, 8, 32, convert_row_8bppGray_to_32bppBGRA},
+    {format_8bppGray, format_32bppBGRA, 8, 32, convert_row_8bppGray_to_32bppBGRA},
+    {format_8bppGray, format_32bppPBGRA, 8, 32, convert_row_8bppGray_to_32bppBGRA},
+    {format_24bppBGR, format_32bppBGR, 24, 32, convert_row_24bppBGR_to_32bppBGRA},
+    {format_24bppBGR, format_32bppBGRA, 24, 32, convert_row_24bppBGR_to_32bppBGRA},
+    {format_24bppBGR, format_32bppPBGRA, 24, 32, convert_row_24bppBGR_to_32bppBGRA},
+    {format_24bppRGB, format_32bppBGR, 24, 32, convert_row_24bppRGB_to_32bppBGRA},
+    {format_24bppRGB, format_32bppBGRA, 24, 32, convert_row_24bppRGB_to_32bppBGRA},
+    {format_24bppRGB, format_32bppPBGRA, 24, 32, convert_row_24bppRGB_to_32bppBGRA},
+    {format_32bppBGR, format_32bppBGRA, 32, 32, convert_row_32bppBGR_to_32bppBGRA},
+    {format_32bppBGR, format_32bppPBGRA, 32, 32, convert_row_32bppBGR_to_32bppBGRA},
+    {format_32bppBGRA, format_32bppPBGRA, 32, 32, convert_row_32bppBGRA_to_32bppPBGRA},
+    {format_32bppPBGRA, format_32bppBGRA, 32, 32, convert_row_32bppPBGRA_to_32bppBGRA},
+    {format_32bppBGR, format_24bppBGR, 32, 24, convert_row_32bppBGRA_to_24bppBGR},
+    {format_32bppBGRA, format_24bppBGR, 32, 24, convert_row_32bppBGRA_to_24bppBGR},
+    {format_32bppPBGRA, format_24bppBGR, 32, 24, convert_row_32bppBGRA_to_24bppBGR},
+    {format_32bppBGR, format_24bppRGB, 32, 24, convert_row_32bppBGRA_to_24bppRGB},
+    {format_32bppBGRA, format_24bppRGB, 32, 24, convert_row_32bppBGRA_to_24bppRGB},
+    {format_32bppPBGRA, format_24bppRGB, 32, 24, convert_row_32bppBGRA_to_24bppRGB},
+    {format_48bppRGB, format_32bppBGR, 48, 32, convert_row_48bppRGB_to_32bppBGRA},
+    {format_48bppRGB, format_32bppBGRA, 48, 32, convert_row_48bppRGB_to_32bppBGRA},
+    {format_48bppRGB, format_32bppPBGRA, 48, 32, convert_row_48bppRGB_to_32bppBGRA},
+    {format_64bppRGBA, format_32bppBGR, 64, 32, convert_row_64bppRGBA_to_32bppBGRA},
+    {format_64bppRGBA, format_32bppBGRA, 64, 32, convert_row_64bppRGBA_to_32bppBGRA},
+    {format_64bppRGBA, format_32bppPBGRA, 64, 32, convert_row_64bppRGBA_to_32bppPBGRA},
+};
+
+static const struct pixelconverter *get_pixelconverter(enum pixelformat src_format,
+    enum pixelformat dst_format)
+{
+    UINT i;
+
+    for (i = 0; i < sizeof(pixelconverters)/sizeof(pixelconverters[0]); i++)
+        if (pixelconverters[i].src_format == src_format &&
+            pixelconverters[i].dst_format == dst_format)
+            return &pixelconverters[i];
+
+    return NULL;
+}
+
+static HRESULT copypixels_convert(struct FormatConverter *This, const WICRect *prc,
+    UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, const struct pixelconverter *converter)
+{
+    const BYTE *srcrow;
+    BYTE *dstrow, *buffer;
+    UINT srcstride, dststride, strip_height, y;
+    WICRect rc;
+    HRESULT hr;
+
+    if (prc->Width <= 0 || prc->Height <= 0)
+        return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
+
+    srcstride = prc->Width * converter->src_bpp / 8;
+    dststride = prc->Width * converter->dst_bpp / 8;
+
+    if (cbStride < dststride || cbBufferSize < dststride ||
+        (cbBufferSize - dststride) / cbStride < (UINT)prc->Height - 1)
+        return E_INVALIDARG;
+
+    if (converter->src_bpp <= converter->dst_bpp)
+    {
+        /* the source rows fit in the destination, convert them in place */
+        hr = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
+        if (FAILED(hr)) return hr;
+
+        for (y = 0, dstrow = pbBuffer; y < (UINT)prc->Height; y++, dstrow += cbStride)
+            converter->convert_row(dstrow, dstrow, prc->Width);
+
+        return S_OK;
+    }
+
+    /* read the source in strips, reusing the buffer of the previous call */
+    strip_height = max(1, min(CONVERT_STRIP_SIZE / srcstride, (UINT)prc->Height));
+
+    buffer = InterlockedExchangePointer((void **)&This->buffer, NULL);
+    if (!buffer || HeapSize(GetProcessHeap(), 0, buffer) < srcstride * strip_height)
+    {
+        HeapFree(GetProcessHeap(), 0, buffer);
+        buffer = HeapAlloc(GetProcessHeap(), 0, srcstride * strip_height);
+        if (!buffer) return E_OUTOFMEMORY;
+    }
+
+    hr = S_OK;
+    rc = *prc;
+    dstrow = pbBuffer;
+    for (y = 0; y < (UINT)prc->Height; y += rc.Height)
+    {
+        rc.Y = prc->Y + y;
+        rc.Height = min(strip_height, (UINT)prc->Height - y);
+
+        hr = IWICBitmapSource_CopyPixels(This->source, &rc, srcstride, srcstride * rc.Height, buffer);
+        if (FAILED(hr)) break;
+
+        for (srcrow = buffer; srcrow < buffer + srcstride * rc.Height; srcrow += srcstride, dstrow += cbStride)
+            converter->convert_row(dstrow, srcrow, prc->Width);
+    }
+
+    buffer = InterlockedExchangePointer((void **)&This->buffer, buffer);
+    HeapFree(GetProcessHeap(), 0, buffer);
+
+    return hr;
+}
+
 static const struct pixelformatinfo supported_formats[] = {
     {format_1bppIndexed, &GUID_WICPixelFormat1bppIndexed, NULL},
     {format_2bppIndexed, &GUID_WICPixelFormat2bppIndexed, NULL},
@@ -1074,6 +1337,7 @@ static ULONG WINAPI FormatConverter_Release(IWICFormatConverter *iface)
         This->lock.DebugInfo->Spare[0] = 0;
         DeleteCriticalSection(&This->lock);
         if (This->source) IWICBitmapSource_Release(This->source);
+        HeapFree(GetProcessHeap(), 0, This->buffer);
         HeapFree(GetProcessHeap(), 0, This);
     }
 
@@ -1150,6 +1414,9 @@ static HRESULT WINAPI FormatConverter_CopyPixels(IWICFormatConverter *iface,
             prc = &rc;
         }
 
+        if (This->converter)
+            return copypixels_convert(This, prc, cbStride, cbBufferSize, pbBuffer, This->converter);
+
         return This->dst_format->copy_function(This, prc, cbStride, cbBufferSize,
             pbBuffer, This->src_format->format);
     }
@@ -1207,6 +1474,7 @@ static HRESULT WINAPI FormatConverter_Initialize(IWICFormatConverter *iface,
         This->dither = dither;
         This->alpha_threshold = alphaThresholdPercent;
         This->palette_type = paletteTranslate;
+        This->converter = get_pixelconverter(srcinfo->format, dstinfo->format);
         This->source = pISource;
     }
     else
@@ -1286,6 +1554,8 @@ HRESULT FormatConverter_CreateInstance(REFIID iid, void** ppv)
     This->IWICFormatConverter_iface.lpVtbl = &FormatConverter_Vtbl;
     This->ref = 1;
     This->source = NULL;
+    This->converter = NULL;
+    This->buffer = NULL;
     InitializeCriticalSection(&This->lock);
     This->lock.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": FormatConverter.lock");
 
@@ -295,6 +295,47 @@ static const BYTE bits_32bppBGRA[] = {
 static const struct bitmap_data testdata_32bppBGRA = {
     &GUID_WICPixelFormat32bppBGRA, 32, bits_32bppBGRA, 4, 2, 96.0, 96.0};
 
+static const struct bitmap_data testdata_32bppPBGRA_opaque = {
+    &GUID_WICPixelFormat32bppPBGRA, 32, bits_32bppBGRA, 4, 2, 96.0, 96.0};
+
+static const BYTE bits_8bppGray[] = {
+    0, 64, 128, 255,
+    255, 128, 64, 0};
+static const struct bitmap_data testdata_8bppGray = {
+    &GUID_WICPixelFormat8bppGray, 8, bits_8bppGray, 4, 2, 96.0, 96.0};
+
+static const BYTE bits_8bppGray_32bppBGRA[] = {
+    0,0,0,255, 64,64,64,255, 128,128,128,255, 255,255,255,255,
+    255,255,255,255, 128,128,128,255, 64,64,64,255, 0,0,0,255};
+static const struct bitmap_data testdata_8bppGray_32bppBGRA = {
+    &GUID_WICPixelFormat32bppBGRA, 32, bits_8bppGray_32bppBGRA, 4, 2, 96.0, 96.0};
+
+/* premultiplying these values doesn't need any rounding */
+static const BYTE bits_32bppBGRA_alpha[] = {
+    255,0,0,255, 100,50,0,51, 0,0,0,0, 255,255,255,51,
+    0,0,0,255, 0,0,0,0, 5,10,15,51, 255,0,255,153};
+static const struct bitmap_data testdata_32bppBGRA_alpha = {
+    &GUID_WICPixelFormat32bppBGRA, 32, bits_32bppBGRA_alpha, 4, 2, 96.0, 96.0};
+
+static const BYTE bits_32bppPBGRA[] = {
+    255,0,0,255, 20,10,0,51, 0,0,0,0, 51,51,51,51,
+    0,0,0,255, 0,0,0,0, 1,2,3,51, 153,0,153,153};
+static const struct bitmap_data testdata_32bppPBGRA = {
+    &GUID_WICPixelFormat32bppPBGRA, 32, bits_32bppPBGRA, 4, 2, 96.0, 96.0};
+
+/* both bytes of each sample are the same, so it doesn't matter which one is used */
+static const BYTE bits_64bppRGBA[] = {
+    0,0,0,0,255,255,255,255, 0,0,255,255,0,0,255,255, 255,255,0,0,0,0,255,255, 0,0,0,0,0,0,255,255,
+    255,255,255,255,0,0,255,255, 255,255,0,0,255,255,255,255, 0,0,255,255,255,255,255,255, 255,255,255,255,255,255,255,255};
+static const struct bitmap_data testdata_64bppRGBA = {
+    &GUID_WICPixelFormat64bppRGBA, 64, bits_64bppRGBA, 4, 2, 96.0, 96.0};
+
+static const BYTE bits_48bppRGB[] = {
+    0,0,0,0,255,255, 0,0,255,255,0,0, 255,255,0,0,0,0, 0,0,0,0,0,0,
+    255,255,255,255,0,0, 255,255,0,0,255,255, 0,0,255,255,255,255, 255,255,255,255,255,255};
+static const struct bitmap_data testdata_48bppRGB = {
+    &GUID_WICPixelFormat48bppRGB, 48, bits_48bppRGB, 4, 2, 96.0, 96.0};
+
 static void test_conversion(const struct bitmap_data *src, const struct bitmap_data *dst, const char *name, BOOL todo)
 {
     BitmapTestSrc *src_obj;
@@ -334,6 +375,71 @@ static void test_invalid_conversion(void)
     DeleteTestBitmap(src_obj);
 }
 
+static BYTE *create_test_bits(UINT bpp, UINT width, UINT height)
+{
+    UINT i, size = (bpp * width + 7) / 8 * height;
+    BYTE *bits = HeapAlloc(GetProcessHeap(), 0, size);
+
+    for (i = 0; i < size; i++)
+        bits[i] = i * 7 + i / 13;
+
+    return bits;
+}
+
+static void test_large_conversion(void)
+{
+    static const UINT width = 256, height = 1100;
+    struct bitmap_data data = {&GUID_WICPixelFormat32bppBGRA, 32, NULL, width, height, 96.0, 96.0};
+    BitmapTestSrc *src_obj;
+    IWICBitmapSource *dst_bitmap;
+    BYTE *bits, *converted_bits;
+    UINT x, y, errors = 0;
+    WICRect rc;
+    HRESULT hr;
+
+    bits = create_test_bits(32, width, height);
+    data.bits = bits;
+    CreateTestBitmap(&data, &src_obj);
+
+    hr = WICConvertBitmapSource(&GUID_WICPixelFormat24bppBGR, &src_obj->IWICBitmapSource_iface, &dst_bitmap);
+    ok(SUCCEEDED(hr), "WICConvertBitmapSource failed, hr=%x\n", hr);
+    if (FAILED(hr))
+    {
+        DeleteTestBitmap(src_obj);
+        HeapFree(GetProcessHeap(), 0, bits);
+        return;
+    }
+
+    /* the stride of the destination is larger than a row */
+    converted_bits = HeapAlloc(GetProcessHeap(), 0, 800 * height);
+    hr = IWICBitmapSource_CopyPixels(dst_bitmap, NULL, 800, 800 * height, converted_bits);
+    ok(SUCCEEDED(hr), "CopyPixels failed, hr=%x\n", hr);
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            if (memcmp(converted_bits + 800 * y + 3 * x, bits + 4 * (width * y + x), 3)) errors++;
+    ok(!errors, "%u pixels differ\n", errors);
+
+    rc.X = 3;
+    rc.Y = 5;
+    rc.Width = 100;
+    rc.Height = 1000;
+    errors = 0;
+    hr = IWICBitmapSource_CopyPixels(dst_bitmap, &rc, 300, 300 * 1000, converted_bits);
+    ok(SUCCEEDED(hr), "CopyPixels failed, hr=%x\n", hr);
+    for (y = 0; y < rc.Height; y++)
+        for (x = 0; x < rc.Width; x++)
+            if (memcmp(converted_bits + 300 * y + 3 * x, bits + 4 * (width * (y + rc.Y) + x + rc.X), 3)) errors++;
+    ok(!errors, "%u pixels differ\n", errors);
+
+    hr = IWICBitmapSource_CopyPixels(dst_bitmap, &rc, 299, 300 * 1000, converted_bits);
+    ok(FAILED(hr), "CopyPixels with a short stride succeeded\n");
+
+    IWICBitmapSource_Release(dst_bitmap);
+    DeleteTestBitmap(src_obj);
+    HeapFree(GetProcessHeap(), 0, converted_bits);
+    HeapFree(GetProcessHeap(), 0, bits);
+}
+
 static void test_default_converter(void)
 {
     BitmapTestSrc *src_obj;
@@ -719,6 +825,67 @@ static const struct setting png_interlace_settings[] = {
     {NULL}
 };
 
+static void test_conversion_performance(void)
+{
+    static const struct
+    {
+        const WICPixelFormatGUID *src, *dst;
+        UINT bpp;
+        const char *name;
+    } tests[] =
+    {
+        {&GUID_WICPixelFormat24bppBGR, &GUID_WICPixelFormat32bppBGRA, 24, "24bppBGR -> 32bppBGRA"},
+        {&GUID_WICPixelFormat32bppBGRA, &GUID_WICPixelFormat24bppBGR, 32, "32bppBGRA -> 24bppBGR"},
+        {&GUID_WICPixelFormat32bppBGRA, &GUID_WICPixelFormat32bppPBGRA, 32, "32bppBGRA -> 32bppPBGRA"},
+        {&GUID_WICPixelFormat32bppPBGRA, &GUID_WICPixelFormat32bppBGRA, 32, "32bppPBGRA -> 32bppBGRA"},
+        {&GUID_WICPixelFormat8bppGray, &GUID_WICPixelFormat32bppBGRA, 8, "8bppGray -> 32bppBGRA"},
+        {&GUID_WICPixelFormat64bppRGBA, &GUID_WICPixelFormat32bppPBGRA, 64, "64bppRGBA -> 32bppPBGRA"},
+    };
+    static const UINT width = 1024, height = 1024, count = 10;
+    struct bitmap_data data = {NULL, 0, NULL, width, height, 96.0, 96.0};
+    LARGE_INTEGER freq, start, end;
+    IWICBitmapSource *dst_bitmap;
+    BitmapTestSrc *src_obj;
+    BYTE *converted_bits;
+    UINT i, j;
+    HRESULT hr;
+
+    if (!winetest_interactive)
+    {
+        skip("conversion benchmark only runs in interactive mode\n");
+        return;
+    }
+
+    converted_bits = HeapAlloc(GetProcessHeap(), 0, 4 * width * height);
+    QueryPerformanceFrequency(&freq);
+
+    for (i = 0; i < sizeof(tests)/sizeof(tests[0]); i++)
+    {
+        data.format = tests[i].src;
+        data.bpp = tests[i].bpp;
+        data.bits = create_test_bits(data.bpp, width, height);
+        CreateTestBitmap(&data, &src_obj);
+
+        hr = WICConvertBitmapSource(tests[i].dst, &src_obj->IWICBitmapSource_iface, &dst_bitmap);
+        ok(SUCCEEDED(hr), "WICConvertBitmapSource(%s) failed, hr=%x\n", tests[i].name, hr);
+        if (SUCCEEDED(hr))
+        {
+            QueryPerformanceCounter(&start);
+            for (j = 0; j < count; j++)
+                IWICBitmapSource_CopyPixels(dst_bitmap, NULL, 4 * width, 4 * width * height, converted_bits);
+            QueryPerformanceCounter(&end);
+            trace("%s %.0f Mpixels/s\n", tests[i].name,
+                  (double)width * height * count * freq.QuadPart / (end.QuadPart - start.QuadPart) / 1e6);
+            IWICBitmapSource_Release(dst_bitmap);
+        }
+
+        DeleteTestBitmap(src_obj);
+        HeapFree(GetProcessHeap(), 0, (BYTE *)data.bits);
+    }
+
+    HeapFree(GetProcessHeap(), 0, converted_bits);
+}
+
 START_TEST(converter)
 {
     CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
@@ -736,6 +903,15 @@ START_TEST(converter)
     test_conversion(&testdata_32bppBGR, &testdata_24bppRGB, "32bppBGR -> 24bppRGB", FALSE);
     test_conversion(&testdata_24bppRGB, &testdata_32bppBGR, "24bppRGB -> 32bppBGR", FALSE);
 
+    test_conversion(&testdata_32bppBGRA, &testdata_24bppBGR, "32bppBGRA -> 24bppBGR", FALSE);
+    test_conversion(&testdata_24bppBGR, &testdata_32bppPBGRA_opaque, "24bppBGR -> 32bppPBGRA", FALSE);
+    test_conversion(&testdata_8bppGray, &testdata_8bppGray_32bppBGRA, "8bppGray -> 32bppBGRA", FALSE);
+    test_conversion(&testdata_32bppBGRA_alpha, &testdata_32bppPBGRA, "32bppBGRA -> 32bppPBGRA", FALSE);
+    test_conversion(&testdata_32bppPBGRA, &testdata_32bppBGRA_alpha, "32bppPBGRA -> 32bppBGRA", FALSE);
+    test_conversion(&testdata_64bppRGBA, &testdata_32bppPBGRA_opaque, "64bppRGBA -> 32bppPBGRA", FALSE);
+    test_conversion(&testdata_48bppRGB, &testdata_32bppBGR, "48bppRGB -> 32bppBGR", FALSE);
+    test_large_conversion();
+
     test_invalid_conversion();
     test_default_converter();
 
@@ -752,6 +928,7 @@ START_TEST(converter)
                        multiple_frames, &CLSID_WICTiffDecoder, NULL, NULL, "TIFF encoder multi-frame");
 
     test_encoder_rects();
+    test_conversion_performance();
 
     test_multi_encoder(single_frame, &CLSID_WICPngEncoder,
                        single_frame, &CLSID_WICPngDecoder, NULL, png_interlace_settings, "PNG encoder interlaced");
@@ -36,6 +36,9 @@
 #ifdef HAVE_SYS_IPC_H
 # include <sys/ipc.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 # include <sys/ioctl.h>
 #endif
@@ -63,6 +66,9 @@
 #ifdef HAVE_SYS_UIO_H
 # include <sys/uio.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -346,6 +352,7 @@ typedef struct ws2_async
     DWORD                               flags;
     DWORD                              *lpFlags;
     WSABUF                             *control;
+    LONG                               *queued;     /* counter the async was added to */
     unsigned int                        n_iovecs;
     unsigned int                        first_iovec;
     struct iovec                        iovec[1];
@@ -364,6 +371,25 @@ typedef struct ws2_accept_async
     struct ws2_async    *read;
 } ws2_accept_async;
 
+struct ws2_transmit_element
+{
+    HANDLE              file;     /* file to send from, NULL for a memory buffer */
+    char               *buffer;   /* memory buffer to send from */
+    ULONGLONG           offset;   /* current file offset */
+    ULONGLONG           length;   /* number of bytes left to send */
+};
+
+typedef struct ws2_transmit_async
+{
+    HANDLE              hSocket;
+    DWORD               flags;          /* TF_* flags */
+    DWORD               send_size;      /* maximum size of a single send, 0 for no limit */
+    LONG               *queued;         /* counter the async was added to */
+    unsigned int        n_elements;
+    unsigned int        first_element;
+    struct ws2_transmit_element elements[1];
+} ws2_transmit_async;
+
 /****************************************************************/
 
 /* ----------------------------------- internal data */
@@ -416,7 +442,8 @@ static int ws_protocol_info(SOCKET s, int unicode, WSAPROTOCOL_INFOW *buffer, in
 int WSAIOCTL_GetInterfaceCount(void);
 int WSAIOCTL_GetInterfaceName(int intNumber, char *intName);
 
-static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS CompletionStatus, ULONG Information );
+static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS CompletionStatus, ULONG Information,
+                              BOOL async );
 
 #define MAP_OPTION(opt) { WS_##opt, opt }
 
@@ -866,18 +893,176 @@ static void _enable_event( HANDLE s, unsigned int event,
     SERVER_END_REQ;
 }
 
-static NTSTATUS _is_blocking(SOCKET s, BOOL *ret)
+/* Client side view of the socket state, indexed like the handle table. It lets
+ * the recv and send paths avoid server requests that only matter once events
+ * have been selected, and keep new requests behind the asyncs already queued
+ * in the server. The mask and state belong to the socket object, which may be
+ * reachable through other handles: changing them through any handle of the
+ * process invalidates every cached entry, and sockets shared with other
+ * processes are never cached. */
+struct sock_cache_entry
+{
+    unsigned int queue;      /* index of the queued asyncs counters plus one, 0 if unknown */
+    LONG         serial;     /* odd when mask and state are up to date */
+    LONG         generation; /* value of sock_state_generation when mask and state were fetched */
+    BOOL         shared;     /* socket shared with another process */
+    unsigned int mask;       /* event mask set by WSAEventSelect or WSAAsyncSelect */
+    unsigned int state;      /* socket state flags */
+};
+
+#define SOCK_CACHE_BLOCK_SIZE  (65536 / sizeof(struct sock_cache_entry))
+#define SOCK_CACHE_ENTRIES     128
+
+static struct sock_cache_entry *sock_cache[SOCK_CACHE_ENTRIES];
+static BOOL sock_direct_io = TRUE;
+static LONG sock_state_generation;  /* incremented when the mask or state of any socket changes */
+
+/* Read and write asyncs queued in the server by this process. They are
+ * counted per socket object rather than per handle, so that requests made
+ * through a duplicated handle stay behind them too. The object is found from
+ * the inode of the unix socket; sockets sharing a counter merely lose the
+ * direct path while one of them has queued asyncs. */
+#define SOCK_QUEUE_COUNTERS    256
+
+static LONG sock_queued[SOCK_QUEUE_COUNTERS][2];
+
+static struct sock_cache_entry *get_sock_cache_entry( SOCKET s )
 {
+    unsigned int idx = ((ULONG_PTR)s >> 2) - 1;
+    unsigned int entry = idx / SOCK_CACHE_BLOCK_SIZE;
+    struct sock_cache_entry *block;
+
+    if (!sock_direct_io || entry >= SOCK_CACHE_ENTRIES) return NULL;
+    if (!(block = sock_cache[entry]))
+    {
+        block = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, SOCK_CACHE_BLOCK_SIZE * sizeof(*block) );
+        if (!block) return NULL;
+        if (InterlockedCompareExchangePointer( (void **)&sock_cache[entry], block, NULL ))
+        {
+            HeapFree( GetProcessHeap(), 0, block );
+            block = sock_cache[entry];
+        }
+    }
+    return &block[idx % SOCK_CACHE_BLOCK_SIZE];
+}
+
+/* forget the cached state of a new or closed handle, it is fetched again from the server on next use */
+static void invalidate_sock_state( SOCKET s )
+{
+    struct sock_cache_entry *cache = get_sock_cache_entry( s );
+    LONG serial;
+
+    if (!cache) return;
+    cache->queue = 0;
+    cache->shared = FALSE;
+    do serial = cache->serial;
+    while (InterlockedCompareExchange( &cache->serial, (serial | 1) + 1, serial ) != serial);
+}
+
+/* the mask or state of a socket changed; it may be cached for other handles too */
+static void invalidate_all_sock_states(void)
+{
+    InterlockedIncrement( &sock_state_generation );
+}
+
+/* the socket is now shared with another process, which can change its state behind our back */
+static void set_sock_shared( SOCKET s )
+{
+    struct sock_cache_entry *cache = get_sock_cache_entry( s );
+    if (cache) cache->shared = TRUE;
+}
+
+static NTSTATUS get_sock_state( SOCKET s, unsigned int *mask, unsigned int *state )
+{
+    struct sock_cache_entry *cache = get_sock_cache_entry( s );
+    LONG serial = cache ? cache->serial : 0;
+    LONG generation = sock_state_generation;
     NTSTATUS status;
+
+    if ((serial & 1) && cache->generation == generation && !cache->shared)
+    {
+        *mask = cache->mask;
+        *state = cache->state;
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( get_socket_event )
     {
         req->handle  = wine_server_obj_handle( SOCKET2HANDLE(s) );
         req->service = FALSE;
         req->c_event = 0;
         status = wine_server_call( req );
-        *ret = (reply->state & FD_WINE_NONBLOCKING) == 0;
+        *mask  = reply->mask;
+        *state = reply->state;
     }
     SERVER_END_REQ;
+
+    if (!status && cache)
+    {
+        cache->mask       = *mask;
+        cache->state      = *state;
+        cache->generation = generation;
+        /* a stale entry stays odd, it was up to date for an older generation */
+        InterlockedCompareExchange( &cache->serial, (serial & 1) ? serial + 2 : serial + 1, serial );
+    }
+    return status;
+}
+
+/* re-enable an event after a recv or send; this only matters if it can be reported */
+static void _reenable_event( SOCKET s, unsigned int event )
+{
+    unsigned int mask, state;
+
+    if (sock_direct_io && !get_sock_state( s, &mask, &state ) && !(mask & event)) return;
+    _enable_event( SOCKET2HANDLE(s), event, 0, 0 );
+}
+
+/* get the queued asyncs counter of the socket object behind a handle */
+static LONG *get_queued_asyncs( SOCKET s, int type )
+{
+    struct sock_cache_entry *cache = get_sock_cache_entry( s );
+    unsigned int queue = cache ? cache->queue : 0;
+    struct stat st;
+    int fd;
+
+    if (!sock_direct_io) return NULL;
+    if (!queue)
+    {
+        if (wine_server_handle_to_fd( SOCKET2HANDLE(s), 0, &fd, NULL )) return NULL;
+        if (!fstat( fd, &st )) queue = st.st_ino % SOCK_QUEUE_COUNTERS + 1;
+        wine_server_release_fd( SOCKET2HANDLE(s), fd );
+        if (!queue) return NULL;
+        if (cache) cache->queue = queue;
+    }
+    return &sock_queued[queue - 1][type - ASYNC_TYPE_READ];
+}
+
+/* account for an async about to be queued in the server, the returned counter is passed to release_queued_async */
+static LONG *add_queued_async( SOCKET s, int type )
+{
+    LONG *queued = get_queued_asyncs( s, type );
+    if (queued) InterlockedIncrement( queued );
+    return queued;
+}
+
+static void release_queued_async( LONG *queued )
+{
+    if (queued) InterlockedDecrement( queued );
+}
+
+/* check if data could overtake an async already queued in the server */
+static BOOL has_queued_async( SOCKET s, int type )
+{
+    LONG *queued = get_queued_asyncs( s, type );
+    return !queued || *queued > 0;
+}
+
+static NTSTATUS _is_blocking(SOCKET s, BOOL *ret)
+{
+    unsigned int mask, state;
+    NTSTATUS status = get_sock_state( s, &mask, &state );
+
+    *ret = (state & FD_WINE_NONBLOCKING) == 0;
     return status;
 }
 
@@ -898,10 +1083,9 @@ static unsigned int _get_sock_mask(SOCKET s)
 
 static void _sync_sock_state(SOCKET s)
 {
-    BOOL dummy;
     /* do a dummy wineserver request in order to let
        the wineserver run through its select loop once */
-    (void)_is_blocking(s, &dummy);
+    (void)_get_sock_mask(s);
 }
 
 static int _get_sock_error(SOCKET s, unsigned int bit)
@@ -958,7 +1142,11 @@ BOOL WINAPI DllMain(HINSTANCE hInstDLL, DWORD fdwReason, LPVOID fImpLoad)
     TRACE("%p 0x%x %p\n", hInstDLL, fdwReason, fImpLoad);
     switch (fdwReason) {
     case DLL_PROCESS_ATTACH:
+    {
+        const char *env = getenv( "WINESOCKDIRECT" );
+        if (env && !atoi( env )) sock_direct_io = FALSE;
         break;
+    }
     case DLL_PROCESS_DETACH:
         if (fImpLoad) break;
         free_per_thread_data();
@@ -1654,6 +1842,7 @@ static INT WS_DuplicateSocket(BOOL unicode, SOCKET s, DWORD dwProcessId, LPWSAPR
                     hProcess, (LPHANDLE)&lpProtocolInfo->dwServiceFlags3,
                     0, FALSE, DUPLICATE_SAME_ACCESS);
     CloseHandle(hProcess);
+    set_sock_shared( s );
     lpProtocolInfo->dwServiceFlags4 = 0xff00ff00; /* magic */
     return 0;
 }
@@ -1987,14 +2176,14 @@ static NTSTATUS WS2_async_recv( void* user, IO_STATUS_BLOCK* iosb, NTSTATUS stat
         if (result >= 0)
         {
             status = STATUS_SUCCESS;
-            _enable_event( wsa->hSocket, FD_READ, 0, 0 );
+            _reenable_event( HANDLE2SOCKET(wsa->hSocket), FD_READ );
         }
         else
         {
             if (errno == EAGAIN)
             {
                 status = STATUS_PENDING;
-                _enable_event( wsa->hSocket, FD_READ, 0, 0 );
+                _reenable_event( HANDLE2SOCKET(wsa->hSocket), FD_READ );
             }
             else
             {
@@ -2006,6 +2195,7 @@ static NTSTATUS WS2_async_recv( void* user, IO_STATUS_BLOCK* iosb, NTSTATUS stat
     }
     if (status != STATUS_PENDING)
     {
+        release_queued_async( wsa->queued );
         iosb->u.Status = status;
         iosb->Information = result;
         *apc = ws2_async_apc;
@@ -2040,7 +2230,7 @@ static NTSTATUS WS2_async_accept_recv( void *arg, IO_STATUS_BLOCK *iosb, NTSTATU
     if (wsa->user_overlapped->hEvent)
         SetEvent(wsa->user_overlapped->hEvent);
     if (wsa->cvalue)
-        WS_AddCompletion( HANDLE2SOCKET(wsa->listen_socket), wsa->cvalue, iosb->u.Status, iosb->Information );
+        WS_AddCompletion( HANDLE2SOCKET(wsa->listen_socket), wsa->cvalue, iosb->u.Status, iosb->Information, TRUE );
 
     *apc = ws2_async_accept_apc;
     return status;
@@ -2100,6 +2290,7 @@ static NTSTATUS WS2_async_accept( void *arg, IO_STATUS_BLOCK *iosb, NTSTATUS sta
     if (!wsa->read)
         goto finish;
 
+    wsa->read->queued = add_queued_async( HANDLE2SOCKET(wsa->accept_socket), ASYNC_TYPE_READ );
     SERVER_START_REQ( register_async )
     {
         req->type           = ASYNC_TYPE_READ;
@@ -2112,7 +2303,10 @@ static NTSTATUS WS2_async_accept( void *arg, IO_STATUS_BLOCK *iosb, NTSTATUS sta
     SERVER_END_REQ;
 
     if (status != STATUS_PENDING)
+    {
+        release_queued_async( wsa->read->queued );
         goto finish;
+    }
 
     /* The APC has finished but no completion should be sent for the operation yet, additional processing
      * needs to be performed by WS2_async_accept_recv() first. */
@@ -2246,6 +2440,7 @@ static NTSTATUS WS2_async_send(void* user, IO_STATUS_BLOCK* iosb, NTSTATUS statu
     }
     if (status != STATUS_PENDING)
     {
+        release_queued_async( wsa->queued );
         iosb->u.Status = status;
         *apc = ws2_async_apc;
     }
@@ -2353,6 +2548,7 @@ SOCKET WINAPI WS_accept(SOCKET s, struct WS_sockaddr *addr, int *addrlen32)
         SERVER_END_REQ;
         if (!status)
         {
+            invalidate_sock_state( as );
             if (addr && WS_getpeername(as, addr, addrlen32))
             {
                 WS_closesocket(as);
@@ -2507,6 +2703,353 @@ static void WINAPI WS2_GetAcceptExSockaddrs(PVOID buffer, DWORD data_size, DWORD
     *remote_addr = (struct WS_sockaddr *)(cbuf + sizeof(int));
 }
 
+/***********************************************************************
+ *              WS2_send_file           (INTERNAL)
+ *
+ * Send part of a file over a socket, if possible without copying it
+ * through user space.
+ */
+static ssize_t WS2_send_file( int fd, int file_fd, ULONGLONG offset, size_t len )
+{
+#ifdef HAVE_SYS_SENDFILE_H
+    off_t off = offset;
+
+    if (len > 0x40000000) len = 0x40000000;
+    return sendfile( fd, file_fd, &off, len );
+#elif defined(HAVE_SENDFILE) && (defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__DragonFly__))
+    off_t sent = 0;
+
+    if (len > 0x40000000) len = 0x40000000;
+    /* a partial send still fails with EAGAIN, but reports what was sent */
+    if (sendfile( file_fd, fd, offset, len, NULL, &sent, 0 ) == -1 && !sent) return -1;
+    return sent;
+#elif defined(HAVE_SENDFILE) && defined(__APPLE__)
+    off_t sent = len;
+
+    if (sent > 0x40000000) sent = 0x40000000;
+    if (sendfile( file_fd, fd, offset, &sent, NULL, 0 ) == -1 && !sent) return -1;
+    return sent;
+#else
+    char buffer[16384];
+    ssize_t ret;
+
+    if (len > sizeof(buffer)) len = sizeof(buffer);
+    if ((ret = pread( file_fd, buffer, len, offset )) <= 0) return ret;
+    /* anything the socket doesn't take is read again next time */
+    return send( fd, buffer, ret, 0 );
+#endif
+}
+
+/***********************************************************************
+ *              WS2_transmit            (INTERNAL)
+ *
+ * Workhorse for both synchronous and asynchronous TransmitFile() and
+ * TransmitPackets() operations: send as much of the remaining elements
+ * as the socket takes without blocking.
+ */
+static NTSTATUS WS2_transmit( int fd, struct ws2_transmit_async *wsa, ULONG_PTR *total )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    HANDLE file = 0;
+    int file_fd = -1;
+
+    while (wsa->first_element < wsa->n_elements)
+    {
+        struct ws2_transmit_element *elem = &wsa->elements[wsa->first_element];
+        ULONGLONG len = elem->length;
+        ssize_t ret;
+
+        if (!len)
+        {
+            wsa->first_element++;
+            continue;
+        }
+        if (wsa->send_size && len > wsa->send_size) len = wsa->send_size;
+        /* file elements can be larger than a size_t, clamp them before narrowing */
+        if (len > 0x40000000) len = 0x40000000;
+
+        if (elem->file)
+        {
+            if (elem->file != file)
+            {
+                if (file_fd != -1) wine_server_release_fd( file, file_fd );
+                file = elem->file;
+                if ((status = wine_server_handle_to_fd( file, FILE_READ_DATA, &file_fd, NULL )))
+                {
+                    file_fd = -1;
+                    break;
+                }
+            }
+            ret = WS2_send_file( fd, file_fd, elem->offset, len );
+            /* the file is shorter than we were told, skip what's missing */
+            if (!ret) elem->length = 0;
+        }
+        else ret = send( fd, elem->buffer, len, 0 );
+
+        if (ret == -1)
+        {
+            if (errno == EINTR) continue;
+            status = (errno == EAGAIN) ? STATUS_PENDING : wsaErrStatus();
+            break;
+        }
+        if (!elem->file) elem->buffer += ret;
+        elem->offset += ret;
+        elem->length -= ret;
+        *total += ret;
+    }
+
+    if (file_fd != -1) wine_server_release_fd( file, file_fd );
+    return status;
+}
+
+/***********************************************************************
+ *              WS2_transmit_disconnect (INTERNAL)
+ *
+ * Handle TF_DISCONNECT and TF_REUSE_SOCKET once all the data has been sent.
+ */
+static NTSTATUS WS2_transmit_disconnect( int fd, struct ws2_transmit_async *wsa )
+{
+    IO_STATUS_BLOCK io;
+
+    if (!(wsa->flags & TF_DISCONNECT)) return STATUS_SUCCESS;
+    if (shutdown( fd, SHUT_WR ) == -1) return wsaErrStatus();
+    if (!(wsa->flags & TF_REUSE_SOCKET)) return STATUS_SUCCESS;
+
+    /* this goes through ntdll so that the old unix fd is dropped from its cache */
+    return NtDeviceIoControlFile( wsa->hSocket, NULL, NULL, NULL, &io, IOCTL_WINE_SOCKET_REUSE,
+                                  NULL, 0, NULL, 0 );
+}
+
+/***********************************************************************
+ *              WS2_async_transmit      (INTERNAL)
+ *
+ * Handler for overlapped TransmitFile() and TransmitPackets() operations.
+ */
+static NTSTATUS WS2_async_transmit( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS status, void **apc )
+{
+    struct ws2_transmit_async *wsa = user;
+    int fd;
+
+    if (status == STATUS_ALERTED)
+    {
+        if (!(status = wine_server_handle_to_fd( wsa->hSocket, FILE_WRITE_DATA, &fd, NULL )))
+        {
+            status = WS2_transmit( fd, wsa, &iosb->Information );
+            if (status == STATUS_SUCCESS) status = WS2_transmit_disconnect( fd, wsa );
+            wine_server_release_fd( wsa->hSocket, fd );
+        }
+    }
+    if (status != STATUS_PENDING)
+    {
+        release_queued_async( wsa->queued );
+        iosb->u.Status = status;
+        HeapFree( GetProcessHeap(), 0, wsa );
+    }
+    return status;
+}
+
+/* resolve the file offset and length of a TransmitPackets() element */
+static NTSTATUS init_transmit_element( struct ws2_transmit_element *elem, const TRANSMIT_PACKETS_ELEMENT *src )
+{
+    FILE_POSITION_INFORMATION pos;
+    FILE_STANDARD_INFORMATION info;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+
+    elem->length = src->cLength;
+    if (src->dwElFlags & TP_ELEMENT_MEMORY)
+    {
+        if (src->cLength && !src->u.pBuffer) return STATUS_INVALID_PARAMETER;
+        elem->file   = 0;
+        elem->buffer = src->u.pBuffer;
+        elem->offset = 0;
+        return STATUS_SUCCESS;
+    }
+    if (!(src->dwElFlags & TP_ELEMENT_FILE)) return STATUS_INVALID_PARAMETER;
+
+    elem->file   = src->u.s.hFile;
+    elem->buffer = NULL;
+    elem->offset = src->u.s.nFileOffset.QuadPart;
+    if (src->u.s.nFileOffset.QuadPart == -1)  /* send from the current position */
+    {
+        if ((status = NtQueryInformationFile( src->u.s.hFile, &io, &pos, sizeof(pos), FilePositionInformation )))
+            return status;
+        elem->offset = pos.CurrentByteOffset.QuadPart;
+    }
+    if (!src->cLength)  /* send up to the end of the file */
+    {
+        if ((status = NtQueryInformationFile( src->u.s.hFile, &io, &info, sizeof(info), FileStandardInformation )))
+            return status;
+        if (info.EndOfFile.QuadPart > elem->offset) elem->length = info.EndOfFile.QuadPart - elem->offset;
+    }
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *     TransmitPackets
+ */
+static BOOL WINAPI WS2_TransmitPackets( SOCKET s, LPTRANSMIT_PACKETS_ELEMENT elements, DWORD count,
+                                        DWORD send_size, LPOVERLAPPED overlapped, DWORD flags )
+{
+    struct ws2_transmit_async *wsa = NULL;
+    ULONG_PTR total = 0;
+    unsigned int i, options;
+    NTSTATUS status;
+    BOOL is_overlapped;
+    int fd;
+
+    TRACE( "(%lx, %p, %u, %u, %p, %x)\n", s, elements, count, send_size, overlapped, flags );
+
+    if ((count && !elements) || ((flags & TF_REUSE_SOCKET) && !(flags & TF_DISCONNECT)))
+    {
+        SetLastError( WSAEINVAL );
+        return FALSE;
+    }
+
+    fd = get_sock_fd( s, FILE_WRITE_DATA, &options );
+    if (fd == -1) return FALSE;
+
+    if (!(wsa = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET(struct ws2_transmit_async, elements[count]) )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto done;
+    }
+    wsa->hSocket       = SOCKET2HANDLE(s);
+    wsa->flags         = flags;
+    wsa->send_size     = send_size;
+    wsa->n_elements    = count;
+    wsa->first_element = 0;
+    for (i = 0; i < count; i++)
+        if ((status = init_transmit_element( &wsa->elements[i], &elements[i] ))) goto done;
+
+    is_overlapped = overlapped && !(options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT));
+    status = WS2_transmit( fd, wsa, &total );
+
+    if (!is_overlapped)
+    {
+        /* a synchronous transmission blocks until all the data is sent */
+        DWORD timeout_start = GetTickCount();
+
+        while (status == STATUS_PENDING)
+        {
+            struct pollfd pfd;
+            int timeout = GET_SNDTIMEO(fd);
+
+            if (timeout != -1)
+            {
+                timeout -= GetTickCount() - timeout_start;
+                if (timeout < 0) timeout = 0;
+            }
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            if (!timeout || !poll( &pfd, 1, timeout ))
+            {
+                status = STATUS_IO_TIMEOUT;
+                break;
+            }
+            status = WS2_transmit( fd, wsa, &total );
+        }
+    }
+    if (status == STATUS_SUCCESS) status = WS2_transmit_disconnect( fd, wsa );
+
+    if (is_overlapped)
+    {
+        IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)overlapped;
+        ULONG_PTR cvalue = ((ULONG_PTR)overlapped->hEvent & 1) == 0 ? (ULONG_PTR)overlapped : 0;
+
+        iosb->Information = total;
+        if (status == STATUS_PENDING)
+        {
+            release_sock_fd( s, fd );
+            iosb->u.Status = STATUS_PENDING;
+
+            wsa->queued = add_queued_async( s, ASYNC_TYPE_WRITE );
+            SERVER_START_REQ( register_async )
+            {
+                req->type           = ASYNC_TYPE_WRITE;
+                req->async.handle   = wine_server_obj_handle( wsa->hSocket );
+                req->async.callback = wine_server_client_ptr( WS2_async_transmit );
+                req->async.iosb     = wine_server_client_ptr( iosb );
+                req->async.arg      = wine_server_client_ptr( wsa );
+                req->async.event    = wine_server_obj_handle( overlapped->hEvent );
+                req->async.cvalue   = cvalue;
+                status = wine_server_call( req );
+            }
+            SERVER_END_REQ;
+
+            /* Enable the event only after starting the async. The server will deliver it as soon as
+               the async is done. */
+            _reenable_event( s, FD_WRITE );
+
+            if (status != STATUS_PENDING)
+            {
+                release_queued_async( wsa->queued );
+                HeapFree( GetProcessHeap(), 0, wsa );
+            }
+            SetLastError( NtStatusToWSAError( status ) );
+            return FALSE;
+        }
+        iosb->u.Status = status;
+        if (status == STATUS_SUCCESS)
+        {
+            if (cvalue) WS_AddCompletion( s, cvalue, status, total, FALSE );
+            if (overlapped->hEvent) SetEvent( overlapped->hEvent );
+        }
+    }
+
+done:
+    release_sock_fd( s, fd );
+    HeapFree( GetProcessHeap(), 0, wsa );
+    if (status)
+    {
+        SetLastError( NtStatusToWSAError( status ) );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *     TransmitFile
+ */
+static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE file, DWORD file_bytes, DWORD bytes_per_send,
+                                     LPOVERLAPPED overlapped, LPTRANSMIT_FILE_BUFFERS buffers, DWORD flags )
+{
+    TRANSMIT_PACKETS_ELEMENT elements[3];
+    DWORD count = 0;
+
+    TRACE( "(%lx, %p, %u, %u, %p, %p, %x)\n", s, file, file_bytes, bytes_per_send, overlapped, buffers, flags );
+
+    if (buffers && buffers->HeadLength)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_MEMORY;
+        elements[count].cLength   = buffers->HeadLength;
+        elements[count].u.pBuffer   = buffers->Head;
+        count++;
+    }
+    if (file)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_FILE;
+        elements[count].cLength   = file_bytes;
+        elements[count].u.s.hFile     = file;
+        /* overlapped transmissions start at the given offset, others at the file pointer */
+        if (overlapped)
+        {
+            elements[count].u.s.nFileOffset.u.LowPart  = overlapped->u.s.Offset;
+            elements[count].u.s.nFileOffset.u.HighPart = overlapped->u.s.OffsetHigh;
+        }
+        else elements[count].u.s.nFileOffset.QuadPart = -1;
+        count++;
+    }
+    if (buffers && buffers->TailLength)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_MEMORY;
+        elements[count].cLength   = buffers->TailLength;
+        elements[count].u.pBuffer   = buffers->Tail;
+        count++;
+    }
+    return WS2_TransmitPackets( s, elements, count, bytes_per_send, overlapped, flags );
+}
+
 /***********************************************************************
  *     WSASendMsg
  */
@@ -2730,6 +3273,7 @@ int WINAPI WS_bind(SOCKET s, const struct WS_sockaddr* name, int namelen)
 int WINAPI WS_closesocket(SOCKET s)
 {
     TRACE("socket %04lx\n", s);
+    invalidate_sock_state( s );
     if (CloseHandle(SOCKET2HANDLE(s))) return 0;
     return SOCKET_ERROR;
 }
@@ -2924,6 +3468,7 @@ static BOOL WINAPI WS2_ConnectEx(SOCKET s, const struct WS_sockaddr* name, int n
             wsa->iovec[0].iov_base = sendBuf;
             wsa->iovec[0].iov_len  = sendBufLen;
 
+            wsa->queued = add_queued_async( s, ASYNC_TYPE_WRITE );
             SERVER_START_REQ( register_async )
             {
                 req->type           = ASYNC_TYPE_WRITE;
@@ -2937,7 +3482,11 @@ static BOOL WINAPI WS2_ConnectEx(SOCKET s, const struct WS_sockaddr* name, int n
             }
             SERVER_END_REQ;
 
-            if (status != STATUS_PENDING) HeapFree(GetProcessHeap(), 0, wsa);
+            if (status != STATUS_PENDING)
+            {
+                release_queued_async( wsa->queued );
+                HeapFree(GetProcessHeap(), 0, wsa);
+            }
 
             /* If the connect already failed */
             if (status == STATUS_PIPE_DISCONNECTED)
@@ -3842,6 +4391,7 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
             _enable_event(SOCKET2HANDLE(s), 0, FD_WINE_NONBLOCKING, 0);
         else
             _enable_event(SOCKET2HANDLE(s), 0, 0, FD_WINE_NONBLOCKING);
+        invalidate_all_sock_states();
         break;
 
     case WS_FIONREAD:
@@ -4112,11 +4662,13 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
         }
         else if ( IsEqualGUID(&transmitfile_guid, in_buff) )
         {
-            FIXME("SIO_GET_EXTENSION_FUNCTION_POINTER: unimplemented TransmitFile\n");
+            *(LPFN_TRANSMITFILE *)out_buff = WS2_TransmitFile;
+            break;
         }
         else if ( IsEqualGUID(&transmitpackets_guid, in_buff) )
         {
-            FIXME("SIO_GET_EXTENSION_FUNCTION_POINTER: unimplemented TransmitPackets\n");
+            *(LPFN_TRANSMITPACKETS *)out_buff = WS2_TransmitPackets;
+            break;
         }
         else if ( IsEqualGUID(&wsarecvmsg_guid, in_buff) )
         {
@@ -4272,7 +4824,7 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
         overlapped->Internal = status;
         overlapped->InternalHigh = total;
         if (overlapped->hEvent) NtSetEvent( overlapped->hEvent, NULL );
-        if (cvalue) WS_AddCompletion( HANDLE2SOCKET(s), cvalue, status, total );
+        if (cvalue) WS_AddCompletion( HANDLE2SOCKET(s), cvalue, status, total, FALSE );
     }
 
     if (!status)
@@ -4554,14 +5106,27 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
 
 /* helper to send completion messages for client-only i/o operation case */
 static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS CompletionStatus,
-                              ULONG Information )
+                              ULONG Information, BOOL async )
 {
+    /* operations that completed immediately don't need a packet in skip mode */
+    if (!async)
+    {
+        FILE_IO_COMPLETION_NOTIFICATION_INFORMATION info;
+        IO_STATUS_BLOCK io;
+
+        if (!NtQueryInformationFile( SOCKET2HANDLE(sock), &io, &info, sizeof(info),
+                                     FileIoCompletionNotificationInformation ) &&
+            (info.Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS))
+            return;
+    }
+
     SERVER_START_REQ( add_fd_completion )
     {
         req->handle      = wine_server_obj_handle( SOCKET2HANDLE(sock) );
         req->cvalue      = CompletionValue;
         req->status      = CompletionStatus;
         req->information = Information;
+        req->async       = async;
         wine_server_call( req );
     }
     SERVER_END_REQ;
@@ -4662,8 +5227,10 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         totalLength += lpBuffers[i].len;
     }
 
-    n = WS2_send( fd, wsa );
-    if (n == -1 && errno != EAGAIN)
+    /* don't let the data overtake the writes already queued in the server */
+    if (overlapped && has_queued_async( s, ASYNC_TYPE_WRITE ))
+        n = -1;
+    else if ((n = WS2_send( fd, wsa )) == -1 && errno != EAGAIN)
     {
         err = wsaErrno();
         goto error;
@@ -4683,6 +5250,7 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             iosb->u.Status = STATUS_PENDING;
             iosb->Information = n == -1 ? 0 : n;
 
+            wsa->queued = add_queued_async( s, ASYNC_TYPE_WRITE );
             SERVER_START_REQ( register_async )
             {
                 req->type           = ASYNC_TYPE_WRITE;
@@ -4698,9 +5266,13 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
             /* Enable the event only after starting the async. The server will deliver it as soon as
                the async is done. */
-            _enable_event(SOCKET2HANDLE(s), FD_WRITE, 0, 0);
+            _reenable_event(s, FD_WRITE);
 
-            if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+            if (err != STATUS_PENDING)
+            {
+                release_queued_async( wsa->queued );
+                HeapFree( GetProcessHeap(), 0, wsa );
+            }
             SetLastError(NtStatusToWSAError( err ));
             return SOCKET_ERROR;
         }
@@ -4710,7 +5282,7 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         if (lpNumberOfBytesSent) *lpNumberOfBytesSent = n;
         if (!wsa->completion_func)
         {
-            if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n );
+            if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n, FALSE );
             if (lpOverlapped->hEvent) SetEvent( lpOverlapped->hEvent );
             HeapFree( GetProcessHeap(), 0, wsa );
         }
@@ -4768,7 +5340,7 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     else  /* non-blocking */
     {
         if (n < totalLength)
-            _enable_event(SOCKET2HANDLE(s), FD_WRITE, 0, 0);
+            _reenable_event(s, FD_WRITE);
         if (n == -1)
         {
             err = WSAEWOULDBLOCK;
@@ -6062,6 +6634,7 @@ int WINAPI WSAEventSelect(SOCKET s, WSAEVENT hEvent, LONG lEvent)
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
+    invalidate_all_sock_states();
     if (!ret) return 0;
     SetLastError(WSAEINVAL);
     return SOCKET_ERROR;
@@ -6131,6 +6704,7 @@ INT WINAPI WSAAsyncSelect(SOCKET s, HWND hWnd, UINT uMsg, LONG lEvent)
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
+    invalidate_all_sock_states();
     if (!ret) return 0;
     SetLastError(WSAEINVAL);
     return SOCKET_ERROR;
@@ -6218,6 +6792,8 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (lpProtocolInfo && lpProtocolInfo->dwServiceFlags4 == 0xff00ff00) {
       ret = lpProtocolInfo->dwServiceFlags3;
       TRACE("\tgot duplicate %04lx\n", ret);
+      invalidate_sock_state( ret );
+      set_sock_shared( ret );
       return ret;
     }
 
@@ -6316,6 +6892,7 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (ret)
     {
         TRACE("\tcreated %04lx\n", ret );
+        invalidate_sock_state( ret );
         if (ipxptype > 0)
             set_ipx_packettype(ret, ipxptype);
        return ret;
@@ -6684,14 +7261,16 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
     for (;;)
     {
-        n = WS2_recv( fd, wsa );
-        if (n == -1)
+        /* don't let the data overtake the reads already queued in the server */
+        if (overlapped && has_queued_async( s, ASYNC_TYPE_READ ))
+            n = -1;
+        else if ((n = WS2_recv( fd, wsa )) == -1)
         {
             if (errno != EAGAIN)
             {
                 int loc_errno = errno;
                 err = wsaErrno();
-                if (cvalue) WS_AddCompletion( s, cvalue, sock_get_ntstatus(loc_errno), 0 );
+                if (cvalue) WS_AddCompletion( s, cvalue, sock_get_ntstatus(loc_errno), 0, FALSE );
                 goto error;
             }
         }
@@ -6710,6 +7289,7 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                 iosb->u.Status = STATUS_PENDING;
                 iosb->Information = 0;
 
+                wsa->queued = add_queued_async( s, ASYNC_TYPE_READ );
                 SERVER_START_REQ( register_async )
                 {
                     req->type           = ASYNC_TYPE_READ;
@@ -6723,7 +7303,11 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                 }
                 SERVER_END_REQ;
 
-                if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+                if (err != STATUS_PENDING)
+                {
+                    release_queued_async( wsa->queued );
+                    HeapFree( GetProcessHeap(), 0, wsa );
+                }
                 SetLastError(NtStatusToWSAError( err ));
                 return SOCKET_ERROR;
             }
@@ -6732,13 +7316,13 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             iosb->Information = n;
             if (!wsa->completion_func)
             {
-                if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n );
+                if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n, FALSE );
                 if (lpOverlapped->hEvent) SetEvent( lpOverlapped->hEvent );
                 HeapFree( GetProcessHeap(), 0, wsa );
             }
             else NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)ws2_async_apc,
                                    (ULONG_PTR)wsa, (ULONG_PTR)iosb, 0 );
-            _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+            _reenable_event(s, FD_READ);
             return 0;
         }
 
@@ -6768,13 +7352,13 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             {
                 err = WSAETIMEDOUT;
                 /* a timeout is not fatal */
-                _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+                _reenable_event(s, FD_READ);
                 goto error;
             }
         }
         else
         {
-            _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+            _reenable_event(s, FD_READ);
             err = WSAEWOULDBLOCK;
             goto error;
         }
@@ -6783,7 +7367,7 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     TRACE(" -> %i bytes\n", n);
     if (wsa != &localwsa) HeapFree( GetProcessHeap(), 0, wsa );
     release_sock_fd( s, fd );
-    _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+    _reenable_event(s, FD_READ);
     SetLastError(ERROR_SUCCESS);
 
     return 0;
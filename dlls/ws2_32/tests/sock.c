@@ -71,6 +71,7 @@ static int   (WINAPI *pInetPton)(INT,LPSTR,LPVOID);
 static int   (WINAPI *pWSALookupServiceBeginW)(LPWSAQUERYSETW,DWORD,LPHANDLE);
 static int   (WINAPI *pWSALookupServiceEnd)(HANDLE);
 static int   (WINAPI *pWSALookupServiceNextW)(HANDLE,DWORD,LPDWORD,LPWSAQUERYSETW);
+static BOOL  (WINAPI *pSetFileCompletionNotificationModes)(HANDLE,UCHAR);
 
 /**************** Structs and typedefs ***************/
 
@@ -1144,6 +1145,8 @@ static void Init (void)
     pWSALookupServiceBeginW = (void *)GetProcAddress(hws2_32, "WSALookupServiceBeginW");
     pWSALookupServiceEnd = (void *)GetProcAddress(hws2_32, "WSALookupServiceEnd");
     pWSALookupServiceNextW = (void *)GetProcAddress(hws2_32, "WSALookupServiceNextW");
+    pSetFileCompletionNotificationModes = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"),
+                                                                 "SetFileCompletionNotificationModes");
 
     ok ( WSAStartup ( ver, &data ) == 0, "WSAStartup failed\n" );
     tls = TlsAlloc();
@@ -5861,6 +5864,205 @@ end:
         WSACloseEvent(ov.hEvent);
 }
 
+static void test_WSARecv_order(BOOL duplicate)
+{
+    SOCKET src, dest, sock[2];
+    OVERLAPPED ov[2];
+    WSABUF bufs[2];
+    char buffers[2][4];
+    DWORD bytes, flags[2];
+    int i, iret;
+    BOOL bret;
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+    sock[0] = sock[1] = dest;
+    /* the second read goes through another handle to the same socket */
+    if (duplicate && !DuplicateHandle(GetCurrentProcess(), (HANDLE)dest, GetCurrentProcess(),
+                                      (HANDLE *)&sock[1], 0, FALSE, DUPLICATE_SAME_ACCESS))
+    {
+        skip("failed to duplicate the socket handle, error %u\n", GetLastError());
+        closesocket(src);
+        closesocket(dest);
+        return;
+    }
+
+    memset(ov, 0, sizeof(ov));
+    for (i = 0; i < 2; i++)
+    {
+        ov[i].hEvent = WSACreateEvent();
+        bufs[i].buf = buffers[i];
+        bufs[i].len = sizeof(buffers[i]);
+        flags[i] = 0;
+    }
+
+    iret = WSARecv(sock[0], &bufs[0], 1, NULL, &flags[0], &ov[0], NULL);
+    ok(iret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING, "WSARecv returned %d, error %d\n", iret, WSAGetLastError());
+
+    iret = send(src, "abcdefgh", 8, 0);
+    ok(iret == 8, "send returned %d\n", iret);
+    Sleep(50);
+
+    /* the second read must not overtake the pending one, even if data is available */
+    iret = WSARecv(sock[1], &bufs[1], 1, NULL, &flags[1], &ov[1], NULL);
+    ok(!iret || WSAGetLastError() == ERROR_IO_PENDING, "WSARecv returned %d, error %d\n", iret, WSAGetLastError());
+
+    for (i = 0; i < 2; i++)
+    {
+        iret = WaitForSingleObject(ov[i].hEvent, 1000);
+        ok(iret == WAIT_OBJECT_0, "%d: wait failed, ret %d\n", i, iret);
+        bret = WSAGetOverlappedResult(sock[i], &ov[i], &bytes, FALSE, &flags[i]);
+        ok(bret && bytes == 4, "%d: got %d, %u bytes, error %d\n", i, bret, bytes, WSAGetLastError());
+        WSACloseEvent(ov[i].hEvent);
+    }
+    ok(!memcmp(buffers[0], "abcd", 4), "wrong data %.4s\n", buffers[0]);
+    ok(!memcmp(buffers[1], "efgh", 4), "wrong data %.4s\n", buffers[1]);
+
+    if (duplicate) closesocket(sock[1]);
+    closesocket(src);
+    closesocket(dest);
+}
+
+static BOOL echo_message(SOCKET s, char *buffer, DWORD size, OVERLAPPED *ov, BOOL do_send)
+{
+    WSABUF wsabuf;
+    DWORD bytes, flags = 0;
+    int ret;
+
+    wsabuf.buf = buffer;
+    wsabuf.len = size;
+    if (do_send) ret = WSASend(s, &wsabuf, 1, &bytes, 0, ov, NULL);
+    else ret = WSARecv(s, &wsabuf, 1, &bytes, &flags, ov, NULL);
+    if (ret && WSAGetLastError() != ERROR_IO_PENDING) return FALSE;
+    if (!WSAGetOverlappedResult(s, ov, &bytes, TRUE, &flags)) return FALSE;
+    return bytes == size;
+}
+
+static void benchmark_echo(const char *label)
+{
+    static const int count = 20000;
+    LARGE_INTEGER freq, start, end;
+    SOCKET src, dest;
+    OVERLAPPED ov;
+    char message[64], reply[64];
+    int i;
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = WSACreateEvent();
+    memset(message, 'x', sizeof(message));
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        if (!echo_message(src, message, sizeof(message), &ov, TRUE)) break;
+        if (!echo_message(dest, reply, sizeof(reply), &ov, FALSE)) break;
+        if (!echo_message(dest, reply, sizeof(reply), &ov, TRUE)) break;
+        if (!echo_message(src, reply, sizeof(reply), &ov, FALSE)) break;
+    }
+    QueryPerformanceCounter(&end);
+    ok(i == count, "echo failed after %d messages, error %d\n", i, WSAGetLastError());
+
+    trace("%s: %.0f overlapped echo messages/s\n", label,
+          i * (double)freq.QuadPart / (end.QuadPart - start.QuadPart));
+
+    WSACloseEvent(ov.hEvent);
+    closesocket(src);
+    closesocket(dest);
+}
+
+static void test_echo_performance(char **argv)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH];
+    BOOL ret;
+
+    if (!winetest_interactive)
+    {
+        skip("echo benchmark only runs in interactive mode\n");
+        return;
+    }
+    benchmark_echo("default");
+
+    /* compare with a process that always queues the requests in the server in Wine */
+    SetEnvironmentVariableA("WINESOCKDIRECT", "0");
+    sprintf(cmdline, "\"%s\" sock benchmark", argv[0]);
+    ret = CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed %u\n", GetLastError());
+    SetEnvironmentVariableA("WINESOCKDIRECT", NULL);
+    if (!ret) return;
+    winetest_wait_child_process(pi.hProcess);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+}
+
+static void test_event_select_duplicate(void)
+{
+    SOCKET src, dest, dup;
+    WSANETWORKEVENTS events;
+    HANDLE event;
+    char buf[16];
+    int ret;
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+
+    /* receive through the original handle before any events are selected */
+    ret = send(dest, "a", 1, 0);
+    ok(ret == 1, "send returned %d\n", ret);
+    ret = recv(src, buf, sizeof(buf), 0);
+    ok(ret == 1, "recv returned %d\n", ret);
+
+    /* select the events through another handle to the same socket */
+    if (!DuplicateHandle(GetCurrentProcess(), (HANDLE)src, GetCurrentProcess(), (HANDLE *)&dup,
+                         0, FALSE, DUPLICATE_SAME_ACCESS))
+    {
+        skip("failed to duplicate the socket handle, error %u\n", GetLastError());
+        closesocket(src);
+        closesocket(dest);
+        return;
+    }
+    event = WSACreateEvent();
+    ret = WSAEventSelect(dup, event, FD_READ);
+    ok(!ret, "WSAEventSelect failed, error %d\n", WSAGetLastError());
+
+    ret = send(dest, "b", 1, 0);
+    ok(ret == 1, "send returned %d\n", ret);
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "wait returned %d\n", ret);
+    ret = WSAEnumNetworkEvents(dup, event, &events);
+    ok(!ret, "WSAEnumNetworkEvents failed, error %d\n", WSAGetLastError());
+    ok(events.lNetworkEvents == FD_READ, "got events %x\n", events.lNetworkEvents);
+
+    /* a recv through the original handle re-enables FD_READ */
+    ret = recv(src, buf, sizeof(buf), 0);
+    ok(ret == 1, "recv returned %d\n", ret);
+    ret = send(dest, "c", 1, 0);
+    ok(ret == 1, "send returned %d\n", ret);
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "wait returned %d\n", ret);
+    ret = WSAEnumNetworkEvents(dup, event, &events);
+    ok(!ret, "WSAEnumNetworkEvents failed, error %d\n", WSAGetLastError());
+    ok(events.lNetworkEvents == FD_READ, "got events %x\n", events.lNetworkEvents);
+
+    WSACloseEvent(event);
+    closesocket(dup);
+    closesocket(src);
+    closesocket(dest);
+}
+
 static void test_GetAddrInfoW(void)
 {
     static const WCHAR port[] = {'8','0',0};
@@ -6396,6 +6598,211 @@ end:
         closesocket(connector);
 }
 
+static void test_TransmitFile(void)
+{
+    GUID transmitFileGuid = WSAID_TRANSMITFILE;
+    LPFN_TRANSMITFILE pTransmitFile = NULL;
+    TRANSMIT_FILE_BUFFERS buffers;
+    char header[] = "header", footer[] = "footer";
+    char data[4096], buffer[sizeof(data) + 64];
+    char path[MAX_PATH], filename[MAX_PATH];
+    SOCKET src = INVALID_SOCKET, dest = INVALID_SOCKET;
+    OVERLAPPED overlapped;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    DWORD num_bytes, flags, i;
+    int iret, total;
+    BOOL bret;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+
+    iret = WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitFileGuid, sizeof(transmitFileGuid),
+                    &pTransmitFile, sizeof(pTransmitFile), &num_bytes, NULL, NULL);
+    if (iret)
+    {
+        win_skip("TransmitFile not supported\n");
+        goto end;
+    }
+
+    for (i = 0; i < sizeof(data); i++) data[i] = i * 7;
+    GetTempPathA(MAX_PATH, path);
+    GetTempFileNameA(path, "wst", 0, filename);
+    file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to create file, error %u\n", GetLastError());
+    bret = WriteFile(file, data, sizeof(data), &num_bytes, NULL);
+    ok(bret && num_bytes == sizeof(data), "WriteFile failed, error %u\n", GetLastError());
+
+    /* the whole file is sent from the current position */
+    SetFilePointer(file, 0, NULL, FILE_BEGIN);
+    SetLastError(0xdeadbeef);
+    bret = pTransmitFile(src, file, 0, 0, NULL, NULL, 0);
+    ok(bret, "TransmitFile failed, error %d\n", WSAGetLastError());
+    for (total = 0; total < sizeof(data); total += iret)
+    {
+        iret = recv(dest, buffer + total, sizeof(buffer) - total, 0);
+        if (iret <= 0) break;
+    }
+    ok(total == sizeof(data), "received %d bytes\n", total);
+    ok(!memcmp(buffer, data, sizeof(data)), "received data doesn't match\n");
+
+    /* head and tail buffers, explicit length and an offset through the overlapped structure */
+    buffers.Head = header;
+    buffers.HeadLength = strlen(header);
+    buffers.Tail = footer;
+    buffers.TailLength = strlen(footer);
+    overlapped.hEvent = WSACreateEvent();
+    overlapped.Offset = 16;
+    bret = pTransmitFile(src, file, 100, 0, &overlapped, &buffers, 0);
+    ok(bret || WSAGetLastError() == ERROR_IO_PENDING,
+       "TransmitFile failed, error %d\n", WSAGetLastError());
+    iret = WaitForSingleObject(overlapped.hEvent, 1000);
+    ok(iret == WAIT_OBJECT_0, "wait failed, ret %d\n", iret);
+    bret = WSAGetOverlappedResult(src, &overlapped, &num_bytes, FALSE, &flags);
+    ok(bret, "WSAGetOverlappedResult failed, error %d\n", WSAGetLastError());
+    ok(num_bytes == 112, "got %u bytes\n", num_bytes);
+    for (total = 0; total < 112; total += iret)
+    {
+        iret = recv(dest, buffer + total, sizeof(buffer) - total, 0);
+        if (iret <= 0) break;
+    }
+    ok(total == 112, "received %d bytes\n", total);
+    ok(!memcmp(buffer, header, 6), "wrong header\n");
+    ok(!memcmp(buffer + 6, data + 16, 100), "wrong file data\n");
+    ok(!memcmp(buffer + 106, footer, 6), "wrong footer\n");
+
+    /* TF_DISCONNECT shuts the sending side down */
+    bret = pTransmitFile(src, NULL, 0, 0, NULL, &buffers, TF_DISCONNECT);
+    ok(bret, "TransmitFile failed, error %d\n", WSAGetLastError());
+    for (total = 0; total < 12; total += iret)
+    {
+        iret = recv(dest, buffer + total, sizeof(buffer) - total, 0);
+        if (iret <= 0) break;
+    }
+    ok(total == 12, "received %d bytes\n", total);
+    iret = recv(dest, buffer, sizeof(buffer), 0);
+    ok(iret == 0, "expected end of stream, got %d\n", iret);
+
+    /* TF_REUSE_SOCKET requires TF_DISCONNECT */
+    SetLastError(0xdeadbeef);
+    bret = pTransmitFile(src, NULL, 0, 0, NULL, NULL, TF_REUSE_SOCKET);
+    ok(!bret && WSAGetLastError() == WSAEINVAL, "got %d, error %d\n", bret, WSAGetLastError());
+
+end:
+    if (overlapped.hEvent)
+        WSACloseEvent(overlapped.hEvent);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    closesocket(src);
+    closesocket(dest);
+}
+
+static void test_TransmitFile_reuse(void)
+{
+    GUID transmitFileGuid = WSAID_TRANSMITFILE, acceptExGuid = WSAID_ACCEPTEX;
+    LPFN_TRANSMITFILE pTransmitFile = NULL;
+    LPFN_ACCEPTEX pAcceptEx = NULL;
+    TRANSMIT_FILE_BUFFERS buffers;
+    SOCKET src, dest, listener = INVALID_SOCKET, connector = INVALID_SOCKET;
+    struct sockaddr_in addr;
+    char buffer[256];
+    OVERLAPPED overlapped;
+    DWORD num_bytes, flags;
+    int iret, len;
+    BOOL bret;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+
+    iret = WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitFileGuid, sizeof(transmitFileGuid),
+                    &pTransmitFile, sizeof(pTransmitFile), &num_bytes, NULL, NULL);
+    if (!iret)
+        iret = WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &acceptExGuid, sizeof(acceptExGuid),
+                        &pAcceptEx, sizeof(pAcceptEx), &num_bytes, NULL, NULL);
+    if (iret)
+    {
+        win_skip("TransmitFile or AcceptEx not supported\n");
+        goto end;
+    }
+
+    /* use the socket once, so that the client has its fd */
+    iret = send(src, "first", 5, 0);
+    ok(iret == 5, "send returned %d, error %d\n", iret, WSAGetLastError());
+    iret = recv(dest, buffer, sizeof(buffer), 0);
+    ok(iret == 5, "recv returned %d\n", iret);
+
+    buffers.Head = (char *)"last";
+    buffers.HeadLength = 4;
+    buffers.Tail = NULL;
+    buffers.TailLength = 0;
+    bret = pTransmitFile(src, NULL, 0, 0, NULL, &buffers, TF_DISCONNECT | TF_REUSE_SOCKET);
+    ok(bret, "TransmitFile failed, error %d\n", WSAGetLastError());
+    iret = recv(dest, buffer, sizeof(buffer), 0);
+    ok(iret == 4 && !memcmp(buffer, "last", 4), "recv returned %d\n", iret);
+    iret = recv(dest, buffer, sizeof(buffer), 0);
+    ok(iret == 0, "expected end of stream, got %d\n", iret);
+    closesocket(dest);
+    dest = INVALID_SOCKET;
+
+    /* the reused socket can be accepted into */
+    listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(listener != INVALID_SOCKET, "failed to create listener, error %d\n", WSAGetLastError());
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    iret = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    ok(!iret, "bind failed, error %d\n", WSAGetLastError());
+    len = sizeof(addr);
+    iret = getsockname(listener, (struct sockaddr *)&addr, &len);
+    ok(!iret, "getsockname failed, error %d\n", WSAGetLastError());
+    iret = listen(listener, 1);
+    ok(!iret, "listen failed, error %d\n", WSAGetLastError());
+
+    overlapped.hEvent = WSACreateEvent();
+    bret = pAcceptEx(listener, src, buffer, 0, sizeof(struct sockaddr_in) + 16,
+                     sizeof(struct sockaddr_in) + 16, &num_bytes, &overlapped);
+    ok(!bret && WSAGetLastError() == ERROR_IO_PENDING, "AcceptEx returned %d, error %d\n",
+       bret, WSAGetLastError());
+
+    connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(connector != INVALID_SOCKET, "failed to create connector, error %d\n", WSAGetLastError());
+    iret = connect(connector, (struct sockaddr *)&addr, sizeof(addr));
+    ok(!iret, "connect failed, error %d\n", WSAGetLastError());
+
+    iret = WaitForSingleObject(overlapped.hEvent, 1000);
+    ok(iret == WAIT_OBJECT_0, "wait failed, ret %d\n", iret);
+    bret = WSAGetOverlappedResult(listener, &overlapped, &num_bytes, FALSE, &flags);
+    ok(bret, "WSAGetOverlappedResult failed, error %d\n", WSAGetLastError());
+
+    /* and carries data over the new connection */
+    iret = send(connector, "again", 5, 0);
+    ok(iret == 5, "send returned %d, error %d\n", iret, WSAGetLastError());
+    iret = recv(src, buffer, sizeof(buffer), 0);
+    ok(iret == 5 && !memcmp(buffer, "again", 5), "recv returned %d, error %d\n", iret, WSAGetLastError());
+    iret = send(src, "reply", 5, 0);
+    ok(iret == 5, "send returned %d, error %d\n", iret, WSAGetLastError());
+    iret = recv(connector, buffer, sizeof(buffer), 0);
+    ok(iret == 5 && !memcmp(buffer, "reply", 5), "recv returned %d, error %d\n", iret, WSAGetLastError());
+
+end:
+    if (overlapped.hEvent)
+        WSACloseEvent(overlapped.hEvent);
+    closesocket(src);
+    if (dest != INVALID_SOCKET) closesocket(dest);
+    if (listener != INVALID_SOCKET) closesocket(listener);
+    if (connector != INVALID_SOCKET) closesocket(connector);
+}
+
 static void test_AcceptEx(void)
 {
     SOCKET listener = INVALID_SOCKET;
@@ -7876,6 +8283,110 @@ static void test_completion_port(void)
     CloseHandle(previous_port);
 }
 
+static void test_completion_notification_modes(void)
+{
+    HANDLE io_port, event;
+    WSAOVERLAPPED ov, *olp;
+    SOCKET src, dest;
+    char buf[16];
+    WSABUF bufs;
+    DWORD num_bytes, flags;
+    ULONG_PTR key;
+    int iret;
+    BOOL bret;
+
+    if (!pSetFileCompletionNotificationModes)
+    {
+        win_skip("SetFileCompletionNotificationModes is not available\n");
+        return;
+    }
+
+    if (tcp_socketpair(&src, &dest) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+
+    io_port = CreateIoCompletionPort((HANDLE)src, NULL, 125, 0);
+    ok(io_port != NULL, "failed to create completion port %u\n", GetLastError());
+
+    bret = pSetFileCompletionNotificationModes((HANDLE)src,
+                                               FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE);
+    ok(bret, "SetFileCompletionNotificationModes failed %u\n", GetLastError());
+
+    event = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    /* an immediate success queues no packet, but still signals the overlapped event */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = event;
+    bufs.buf = (char *)"test";
+    bufs.len = 4;
+    num_bytes = 0xdeadbeef;
+    iret = WSASend(src, &bufs, 1, &num_bytes, 0, &ov, NULL);
+    ok(!iret, "WSASend failed - %d\n", WSAGetLastError());
+    ok(num_bytes == 4, "wrong size %u\n", num_bytes);
+    ok(!WaitForSingleObject(event, 0), "event not signaled\n");
+
+    olp = (WSAOVERLAPPED *)0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    bret = GetQueuedCompletionStatus(io_port, &num_bytes, &key, &olp, 100);
+    ok(!bret, "GetQueuedCompletionStatus succeeded\n");
+    ok(GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError());
+    ok(olp == NULL, "wrong overlapped %p\n", olp);
+
+    /* so does an immediate receive */
+    iret = recv(dest, buf, sizeof(buf), 0);
+    ok(iret == 4, "recv returned %d\n", iret);
+    iret = send(dest, "data", 4, 0);
+    ok(iret == 4, "send returned %d\n", iret);
+    Sleep(100);
+
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = event;
+    ResetEvent(event);
+    bufs.buf = buf;
+    bufs.len = sizeof(buf);
+    flags = 0;
+    num_bytes = 0xdeadbeef;
+    iret = WSARecv(src, &bufs, 1, &num_bytes, &flags, &ov, NULL);
+    ok(!iret, "WSARecv failed - %d\n", WSAGetLastError());
+    ok(num_bytes == 4, "wrong size %u\n", num_bytes);
+    ok(!WaitForSingleObject(event, 0), "event not signaled\n");
+
+    olp = (WSAOVERLAPPED *)0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    bret = GetQueuedCompletionStatus(io_port, &num_bytes, &key, &olp, 100);
+    ok(!bret, "GetQueuedCompletionStatus succeeded\n");
+    ok(GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError());
+    ok(olp == NULL, "wrong overlapped %p\n", olp);
+
+    /* operations that have to wait still queue a packet */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = event;
+    ResetEvent(event);
+    flags = 0;
+    iret = WSARecv(src, &bufs, 1, &num_bytes, &flags, &ov, NULL);
+    ok(iret == SOCKET_ERROR, "WSARecv succeeded\n");
+    ok(WSAGetLastError() == ERROR_IO_PENDING, "wrong error %d\n", WSAGetLastError());
+
+    iret = send(dest, "more", 4, 0);
+    ok(iret == 4, "send returned %d\n", iret);
+
+    olp = NULL;
+    bret = GetQueuedCompletionStatus(io_port, &num_bytes, &key, &olp, 1000);
+    ok(bret, "GetQueuedCompletionStatus failed %u\n", GetLastError());
+    ok(key == 125, "wrong key %lu\n", key);
+    ok(num_bytes == 4, "wrong size %u\n", num_bytes);
+    ok(olp == &ov, "wrong overlapped %p\n", olp);
+    ok(!WaitForSingleObject(event, 0), "event not signaled\n");
+    ok(!memcmp(buf, "more", 4), "wrong data\n");
+
+    closesocket(src);
+    closesocket(dest);
+    CloseHandle(event);
+    CloseHandle(io_port);
+}
+
 static void test_address_list_query(void)
 {
     SOCKET_ADDRESS_LIST *address_list;
@@ -8143,7 +8654,17 @@ todo_wine
 
 START_TEST( sock )
 {
-    int i;
+    char **argv;
+    int i, argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3 && !strcmp( argv[2], "benchmark" ))
+    {
+        Init();
+        benchmark_echo( "server asyncs only" );
+        Exit();
+        return;
+    }
 
 /* Leave these tests at the beginning. They depend on WSAStartup not having been
  * called, which is done by Init() below. */
@@ -8193,6 +8714,9 @@ START_TEST( sock )
     test_WSASendMsg();
     test_WSASendTo();
     test_WSARecv();
+    test_WSARecv_order(FALSE);
+    test_WSARecv_order(TRUE);
+    test_event_select_duplicate();
 
     test_events(0);
     test_events(1);
@@ -8202,6 +8726,8 @@ START_TEST( sock )
     test_getaddrinfo();
     test_AcceptEx();
     test_ConnectEx();
+    test_TransmitFile();
+    test_TransmitFile_reuse();
 
     test_sioRoutingInterfaceQuery();
 
@@ -8211,11 +8737,13 @@ START_TEST( sock )
     test_WSAAsyncGetServByName();
 
     test_completion_port();
+    test_completion_notification_modes();
     test_address_list_query();
 
     /* this is an io heavy test, do it at the end so the kernel doesn't start dropping packets */
     test_send();
     test_synchronous_WSAIoctl();
+    test_echo_performance( argv );
 
     Exit();
 }
@@ -0,0 +1,70 @@
+/*
+ * Wine-specific heap information classes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_HEAP_H
+#define __WINE_WINE_HEAP_H
+
+#include <windef.h>
+#include <winnt.h>
+
+/* information classes for RtlQueryHeapInformation */
+#define HeapWineStatistics          ((HEAP_INFORMATION_CLASS)0x57480001)
+#define HeapWineAllocationSamples   ((HEAP_INFORMATION_CLASS)0x57480002)
+
+#define HEAP_WINE_NB_FREE_LISTS  11
+
+/* HeapWineStatistics */
+typedef struct _HEAP_WINE_STATISTICS
+{
+    ULONGLONG AllocCount;       /* successful allocations */
+    ULONGLONG FreeCount;        /* successful frees */
+    ULONGLONG ReallocCount;     /* successful reallocations */
+    ULONGLONG FailedCount;      /* failed allocations */
+    ULONGLONG LargeAllocCount;  /* allocations that needed a separate large block */
+    SIZE_T    ReservedSize;     /* address space reserved for the sub-heaps */
+    SIZE_T    CommittedSize;    /* committed memory, including large blocks */
+    SIZE_T    InUseSize;        /* size of the in-use blocks, including large blocks */
+    SIZE_T    FreeSize;         /* size of the blocks on the free lists */
+    SIZE_T    CachedSize;       /* size of freed blocks not yet on the free lists */
+    ULONG     SubHeapCount;
+    ULONG     InUseBlocks;
+    ULONG     FreeBlocks;
+    ULONG     CachedBlocks;
+    ULONG     LargeBlocks;      /* large blocks currently allocated */
+    ULONG     ContentionCount;  /* waits on the heap critical section */
+    SIZE_T    FreeListMaxSize[HEAP_WINE_NB_FREE_LISTS];  /* size limit of each free list */
+    ULONG     FreeListBlocks[HEAP_WINE_NB_FREE_LISTS];   /* blocks in each free list */
+    SIZE_T    FreeListBytes[HEAP_WINE_NB_FREE_LISTS];    /* bytes in each free list */
+} HEAP_WINE_STATISTICS, *PHEAP_WINE_STATISTICS;
+
+/* HeapWineAllocationSamples */
+typedef struct _HEAP_WINE_ALLOCATION_SAMPLE
+{
+    PVOID     Caller;           /* return address of the allocation call */
+    SIZE_T    MaxSize;          /* upper limit of the size class */
+    ULONG     Count;            /* number of samples */
+} HEAP_WINE_ALLOCATION_SAMPLE, *PHEAP_WINE_ALLOCATION_SAMPLE;
+
+typedef struct _HEAP_WINE_ALLOCATION_SAMPLES
+{
+    ULONG     SampleRate;       /* one allocation out of SampleRate is sampled, 0 if disabled */
+    ULONG     Count;            /* number of entries in Samples */
+    HEAP_WINE_ALLOCATION_SAMPLE Samples[1];
+} HEAP_WINE_ALLOCATION_SAMPLES, *PHEAP_WINE_ALLOCATION_SAMPLES;
+
+#endif  /* __WINE_WINE_HEAP_H */
@@ -50,6 +50,22 @@ struct request_max_size
     int pad[16];
 };
 
+
+
+#define REQUEST_SHM_SIZE       0x10000
+#define REQUEST_SHM_DATA_SIZE  0x7f00
+
+struct request_shm
+{
+    unsigned int            request_seq;
+    unsigned int            reply_seq;
+    int                     client_waiting;
+    int                     __pad;
+    struct request_max_size request;
+    struct request_max_size reply;
+    char                    reply_data[REQUEST_SHM_DATA_SIZE];
+};
+
 #define FIRST_USER_HANDLE 0x0020
 #define LAST_USER_HANDLE  0xffef
 
@@ -640,6 +656,23 @@ struct rawinput_device
     user_handle_t  target;
 };
 
+struct completion_entry
+{
+    apc_param_t      ckey;
+    apc_param_t      cvalue;
+    apc_param_t      information;
+    unsigned int     status;
+    unsigned int     __pad;
+};
+
+struct request_stats
+{
+    unsigned int     req;
+    unsigned int     max_time;
+    unsigned __int64 count;
+    unsigned __int64 time;
+};
+
 
 
 
@@ -764,6 +797,20 @@ struct init_thread_reply
 
 
 
+struct set_request_shm_request
+{
+    struct request_header __header;
+    int          fd;
+    data_size_t  size;
+    char __pad_20[4];
+};
+struct set_request_shm_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct terminate_process_request
 {
     struct request_header __header;
@@ -1382,6 +1429,8 @@ struct get_handle_fd_reply
     int          cacheable;
     unsigned int access;
     unsigned int options;
+    unsigned int comp_flags;
+    char __pad_28[4];
 };
 enum server_fd_type
 {
@@ -1572,6 +1621,8 @@ struct set_socket_deferred_reply
     struct reply_header __header;
 };
 
+#define IOCTL_WINE_SOCKET_REUSE  0x0012a000
+
 
 struct alloc_console_request
 {
@@ -2513,7 +2564,7 @@ struct save_registry_request
     struct request_header __header;
     obj_handle_t hkey;
     obj_handle_t file;
-    char __pad_20[4];
+    unsigned int flags;
 };
 struct save_registry_reply
 {
@@ -4892,6 +4943,19 @@ struct remove_completion_reply
 
 
 
+struct remove_completions_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct remove_completions_reply
+{
+    struct reply_header __header;
+    /* VARARG(entries,completion_entries); */
+};
+
+
+
 struct query_completion_request
 {
     struct request_header __header;
@@ -4928,7 +4992,7 @@ struct add_fd_completion_request
     apc_param_t    cvalue;
     apc_param_t    information;
     unsigned int   status;
-    char __pad_36[4];
+    int            async;
 };
 struct add_fd_completion_reply
 {
@@ -4937,6 +5001,20 @@ struct add_fd_completion_reply
 
 
 
+struct set_fd_completion_mode_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    unsigned int   flags;
+    char __pad_20[4];
+};
+struct set_fd_completion_mode_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct get_window_layered_info_request
 {
     struct request_header __header;
@@ -5066,6 +5144,24 @@ struct set_suspend_context_reply
 };
 
 
+
+struct get_request_stats_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_request_stats_reply
+{
+    struct reply_header __header;
+    timeout_t    start_time;
+    data_size_t  total;
+    unsigned int timeouts;
+    unsigned int max_timeouts;
+    /* VARARG(stats,request_stats); */
+    char __pad_28[4];
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -5074,6 +5170,7 @@ enum request
     REQ_get_startup_info,
     REQ_init_process_done,
     REQ_init_thread,
+    REQ_set_request_shm,
     REQ_terminate_process,
     REQ_terminate_thread,
     REQ_get_process_info,
@@ -5312,9 +5409,11 @@ enum request
     REQ_open_completion,
     REQ_add_completion,
     REQ_remove_completion,
+    REQ_remove_completions,
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
+    REQ_set_fd_completion_mode,
     REQ_get_window_layered_info,
     REQ_set_window_layered_info,
     REQ_alloc_user_handle,
@@ -5323,6 +5422,7 @@ enum request
     REQ_update_rawinput_devices,
     REQ_get_suspend_context,
     REQ_set_suspend_context,
+    REQ_get_request_stats,
     REQ_NB_REQUESTS
 };
 
@@ -5336,6 +5436,7 @@ union generic_request
     struct get_startup_info_request get_startup_info_request;
     struct init_process_done_request init_process_done_request;
     struct init_thread_request init_thread_request;
+    struct set_request_shm_request set_request_shm_request;
     struct terminate_process_request terminate_process_request;
     struct terminate_thread_request terminate_thread_request;
     struct get_process_info_request get_process_info_request;
@@ -5574,9 +5675,11 @@ union generic_request
     struct open_completion_request open_completion_request;
     struct add_completion_request add_completion_request;
     struct remove_completion_request remove_completion_request;
+    struct remove_completions_request remove_completions_request;
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
+    struct set_fd_completion_mode_request set_fd_completion_mode_request;
     struct get_window_layered_info_request get_window_layered_info_request;
     struct set_window_layered_info_request set_window_layered_info_request;
     struct alloc_user_handle_request alloc_user_handle_request;
@@ -5585,6 +5688,7 @@ union generic_request
     struct update_rawinput_devices_request update_rawinput_devices_request;
     struct get_suspend_context_request get_suspend_context_request;
     struct set_suspend_context_request set_suspend_context_request;
+    struct get_request_stats_request get_request_stats_request;
 };
 union generic_reply
 {
@@ -5596,6 +5700,7 @@ union generic_reply
     struct get_startup_info_reply get_startup_info_reply;
     struct init_process_done_reply init_process_done_reply;
     struct init_thread_reply init_thread_reply;
+    struct set_request_shm_reply set_request_shm_reply;
     struct terminate_process_reply terminate_process_reply;
     struct terminate_thread_reply terminate_thread_reply;
     struct get_process_info_reply get_process_info_reply;
@@ -5834,9 +5939,11 @@ union generic_reply
     struct open_completion_reply open_completion_reply;
     struct add_completion_reply add_completion_reply;
     struct remove_completion_reply remove_completion_reply;
+    struct remove_completions_reply remove_completions_reply;
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
+    struct set_fd_completion_mode_reply set_fd_completion_mode_reply;
     struct get_window_layered_info_reply get_window_layered_info_reply;
     struct set_window_layered_info_reply set_window_layered_info_reply;
     struct alloc_user_handle_reply alloc_user_handle_reply;
@@ -5845,8 +5952,9 @@ union generic_reply
     struct update_rawinput_devices_reply update_rawinput_devices_reply;
     struct get_suspend_context_reply get_suspend_context_reply;
     struct set_suspend_context_reply set_suspend_context_reply;
+    struct get_request_stats_reply get_request_stats_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 458
+#define SERVER_PROTOCOL_VERSION 467
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
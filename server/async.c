@@ -27,6 +27,7 @@
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winternl.h"
+#include "winbase.h"
 
 #include "object.h"
 #include "file.h"
@@ -226,7 +227,8 @@ struct async *create_async( struct thread *thread, struct async_queue *queue, co
     list_add_tail( &queue->queue, &async->queue_entry );
     grab_object( async );
 
-    if (queue->fd) set_fd_signaled( queue->fd, 0 );
+    if (queue->fd && !(fd_get_comp_flags( queue->fd ) & FILE_SKIP_SET_EVENT_ON_HANDLE))
+        set_fd_signaled( queue->fd, 0 );
     if (event) reset_event( event );
     return async;
 }
@@ -299,7 +301,8 @@ void async_set_result( struct object *obj, unsigned int status, apc_param_t tota
             thread_queue_apc( async->thread, NULL, &data );
         }
         if (async->event) set_event( async->event );
-        else if (async->queue->fd) set_fd_signaled( async->queue->fd, 1 );
+        else if (async->queue->fd && !(fd_get_comp_flags( async->queue->fd ) & FILE_SKIP_SET_EVENT_ON_HANDLE))
+            set_fd_signaled( async->queue->fd, 1 );
     }
 }
 
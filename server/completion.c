@@ -253,6 +253,38 @@ DECL_HANDLER(remove_completion)
     release_object( completion );
 }
 
+/* get multiple completions from completion port */
+DECL_HANDLER(remove_completions)
+{
+    struct completion* completion = get_completion_obj( current->process, req->handle, IO_COMPLETION_MODIFY_STATE );
+    struct completion_entry *entries;
+    struct comp_msg *msg;
+    unsigned int i, count;
+
+    if (!completion) return;
+
+    count = min( completion->depth, get_reply_max_size() / sizeof(*entries) );
+    if (!count)
+        set_error( STATUS_PENDING );
+    else if ((entries = set_reply_data_size( count * sizeof(*entries) )))
+    {
+        for (i = 0; i < count; i++)
+        {
+            msg = LIST_ENTRY( list_head( &completion->queue ), struct comp_msg, queue_entry );
+            list_remove( &msg->queue_entry );
+            completion->depth--;
+            entries[i].ckey = msg->ckey;
+            entries[i].cvalue = msg->cvalue;
+            entries[i].information = msg->information;
+            entries[i].status = msg->status;
+            entries[i].__pad = 0;
+            free( msg );
+        }
+    }
+
+    release_object( completion );
+}
+
 /* get queue depth for completion port */
 DECL_HANDLER(query_completion)
 {
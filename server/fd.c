@@ -101,6 +101,7 @@
 #include "request.h"
 
 #include "winternl.h"
+#include "winbase.h"
 #include "winioctl.h"
 
 #if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE)
@@ -191,6 +192,7 @@ struct fd
     struct async_queue  *wait_q;      /* other async waiters of this fd */
     struct completion   *completion;  /* completion object attached to this fd */
     apc_param_t          comp_key;    /* completion key to set in completion events */
+    unsigned int         comp_flags;  /* completion notification modes (FILE_SKIP_*) */
 };
 
 static void fd_dump( struct object *obj, int verbose );
@@ -347,13 +349,19 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    unsigned int          index;      /* index in the timeout heap */
+    unsigned __int64      serial;     /* insertion order, for timeouts expiring at the same time */
     timeout_t             when;       /* timeout expiry (absolute time) */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list timeout_list = LIST_INIT(timeout_list);   /* sorted timeouts list */
+/* pending timeouts are kept in a binary min-heap ordered by expiry time */
+static struct timeout_user **timeout_heap;
+static unsigned int timeout_count;       /* number of pending timeouts */
+static unsigned int timeout_alloc;       /* allocated size of the heap */
+static unsigned int timeout_max_count;   /* highest number of pending timeouts */
+static unsigned __int64 timeout_serial; /* serial number of the next timeout, never wraps */
 timeout_t current_time;
 
 static inline void set_current_time(void)
@@ -364,35 +372,106 @@ static inline void set_current_time(void)
     current_time = (timeout_t)now.tv_sec * TICKS_PER_SEC + now.tv_usec * 10 + ticks_1601_to_1970;
 }
 
+static inline int timeout_before( const struct timeout_user *a, const struct timeout_user *b )
+{
+    if (a->when != b->when) return a->when < b->when;
+    return a->serial < b->serial;
+}
+
+static inline void set_heap_entry( unsigned int index, struct timeout_user *user )
+{
+    timeout_heap[index] = user;
+    user->index = index;
+}
+
+/* move a heap entry towards the root until the heap is ordered again */
+static void timeout_heap_up( unsigned int index, struct timeout_user *user )
+{
+    while (index)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (!timeout_before( user, timeout_heap[parent] )) break;
+        set_heap_entry( index, timeout_heap[parent] );
+        index = parent;
+    }
+    set_heap_entry( index, user );
+}
+
+/* move a heap entry towards the leaves until the heap is ordered again */
+static void timeout_heap_down( unsigned int index, struct timeout_user *user )
+{
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+        if (child >= timeout_count) break;
+        if (child + 1 < timeout_count && timeout_before( timeout_heap[child + 1], timeout_heap[child] ))
+            child++;
+        if (!timeout_before( timeout_heap[child], user )) break;
+        set_heap_entry( index, timeout_heap[child] );
+        index = child;
+    }
+    set_heap_entry( index, user );
+}
+
+/* remove an entry from the timeout heap */
+static void timeout_heap_remove( struct timeout_user *user )
+{
+    unsigned int index = user->index;
+    struct timeout_user *last;
+
+    assert( index < timeout_count && timeout_heap[index] == user );
+    last = timeout_heap[--timeout_count];
+    if (last == user) return;
+    if (index && timeout_before( last, timeout_heap[(index - 1) / 2] ))
+        timeout_heap_up( index, last );
+    else
+        timeout_heap_down( index, last );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
+
+    if (timeout_count == timeout_alloc)
+    {
+        unsigned int new_alloc = max( 64, timeout_alloc * 2 );
+        struct timeout_user **new_heap;
+
+        if (!(new_heap = realloc( timeout_heap, new_alloc * sizeof(*new_heap) )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return NULL;
+        }
+        timeout_heap = new_heap;
+        timeout_alloc = new_alloc;
+    }
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = (when > 0) ? when : current_time - when;
+    user->serial   = timeout_serial++;
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &timeout_list )
-    {
-        struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-        if (timeout->when >= user->when) break;
-    }
-    list_add_before( ptr, &user->entry );
+    timeout_heap_up( timeout_count++, user );
+    if (timeout_count > timeout_max_count) timeout_max_count = timeout_count;
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    timeout_heap_remove( user );
     free( user );
 }
 
+/* retrieve the current and highest number of pending timeouts */
+unsigned int get_timeout_count( unsigned int *max_count )
+{
+    if (max_count) *max_count = timeout_max_count;
+    return timeout_count;
+}
+
 /* return a text description of a timeout for debugging purposes */
 const char *get_timeout_str( timeout_t timeout )
 {
@@ -439,6 +518,18 @@ static int active_users;                    /* current number of active users */
 static int allocated_users;                 /* count of allocated entries in the array */
 static struct fd **freelist;                /* list of free entries in the array */
 
+/* main loop statistics, collected when debugging is enabled */
+static struct
+{
+    unsigned int       wakeups;       /* number of wakeups with at least one event */
+    unsigned int       idle_wakeups;  /* number of wakeups without events (timeouts) */
+    unsigned int       max_events;    /* largest number of events in a single wakeup */
+    unsigned long long events;        /* total number of events processed */
+    unsigned long long ctl_calls;     /* epoll_ctl calls issued */
+    unsigned long long ctl_saved;     /* event changes that didn't need an epoll_ctl call */
+    timeout_t          handler_time;  /* time spent in the event handlers */
+} poll_stats;
+
 static int get_next_timeout(void);
 
 static inline void fd_poll_event( struct fd *fd, int event )
@@ -446,69 +537,168 @@ static inline void fd_poll_event( struct fd *fd, int event )
     fd->fd_ops->poll_event( fd, event );
 }
 
+/* account for the events processed in a main loop iteration; current_time must be the wakeup time */
+static void update_poll_stats( int count )
+{
+    timeout_t start = current_time;
+
+    if (count <= 0)
+    {
+        poll_stats.idle_wakeups++;
+        return;
+    }
+    set_current_time();
+    poll_stats.handler_time += current_time - start;
+    poll_stats.wakeups++;
+    poll_stats.events += count;
+    if (count > poll_stats.max_events) poll_stats.max_events = count;
+}
+
+/* print the main loop statistics */
+void dump_poll_stats(void)
+{
+    if (!poll_stats.wakeups) return;
+    fprintf( stderr, "wineserver: %u wakeups (%u idle), %llu events, %.2f events/wakeup (max %u)\n",
+             poll_stats.wakeups, poll_stats.idle_wakeups, poll_stats.events,
+             (double)poll_stats.events / poll_stats.wakeups, poll_stats.max_events );
+    fprintf( stderr, "wineserver: %llu ms in handlers, %.1f us/wakeup, %llu epoll_ctl calls (%llu saved)\n",
+             (unsigned long long)poll_stats.handler_time / 10000,
+             (double)poll_stats.handler_time / 10 / poll_stats.wakeups,
+             poll_stats.ctl_calls, poll_stats.ctl_saved );
+}
+
 #ifdef USE_EPOLL
 
 static int epoll_fd = -1;
+static struct epoll_user
+{
+    int                 registered;         /* events registered in the kernel, -1 if none */
+    int                 dirty;              /* events changed since the last flush */
+} *epoll_users;                             /* epoll state of each poll user */
+static int *epoll_dirty;                    /* users whose events have changed since the last flush */
+static int nb_epoll_dirty;                  /* count of entries in the dirty array */
+static struct epoll_event *epoll_events;    /* buffer for epoll_wait */
+static int nb_epoll_events;                 /* size of the epoll_wait buffer */
 
 static inline void init_epoll(void)
 {
     epoll_fd = epoll_create( 128 );
 }
 
-/* set the events that epoll waits for on this fd; helper for set_fd_events */
-static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
+/* grow the epoll arrays along with the poll array */
+static int grow_epoll_users( int old_count, int new_count )
+{
+    struct epoll_user *new_users;
+    int i, *new_dirty;
+
+    if (!(new_users = realloc( epoll_users, new_count * sizeof(*epoll_users) ))) return 0;
+    epoll_users = new_users;
+    for (i = old_count; i < new_count; i++)
+    {
+        epoll_users[i].registered = -1;
+        epoll_users[i].dirty = 0;
+    }
+    if (!(new_dirty = realloc( epoll_dirty, new_count * sizeof(*epoll_dirty) ))) return 0;
+    epoll_dirty = new_dirty;
+    return 1;
+}
+
+/* update the kernel epoll set for a user */
+static void epoll_ctl_user( int user, int unix_fd, int ctl, int events )
 {
     struct epoll_event ev;
-    int ctl;
 
+    ev.events = events;
+    memset(&ev.data, 0, sizeof(ev.data));
+    ev.data.u32 = user;
+    poll_stats.ctl_calls++;
+
+    if (epoll_ctl( epoll_fd, ctl, unix_fd, &ev ) == -1)
+    {
+        if (errno == ENOMEM)  /* not enough memory, give up on epoll */
+        {
+            close( epoll_fd );
+            epoll_fd = -1;
+        }
+        else perror( "epoll_ctl" );  /* should not happen */
+        return;
+    }
+    epoll_users[user].registered = (ctl == EPOLL_CTL_DEL) ? -1 : events;
+}
+
+/* set the events that epoll waits for on this fd; helper for set_fd_events */
+/* the change is only recorded here, flush_epoll_events applies it before the next wait */
+static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
+{
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
     {
-        if (pollfd[user].fd == -1) return;  /* already removed */
-        ctl = EPOLL_CTL_DEL;
+        /* this can't be deferred, the unix fd is about to be closed */
+        if (epoll_users[user].registered != -1) epoll_ctl_user( user, fd->unix_fd, EPOLL_CTL_DEL, 0 );
+        return;
     }
-    else if (pollfd[user].fd == -1)
+    if (pollfd[user].fd == -1)
     {
         if (pollfd[user].events) return;  /* stopped waiting on it, don't restart */
-        ctl = EPOLL_CTL_ADD;
     }
+    else if (pollfd[user].events == events) return;  /* nothing to do */
+
+    if (epoll_users[user].dirty)
+        poll_stats.ctl_saved++;  /* already pending, only the final state matters */
     else
     {
-        if (pollfd[user].events == events) return;  /* nothing to do */
-        ctl = EPOLL_CTL_MOD;
+        epoll_users[user].dirty = 1;
+        epoll_dirty[nb_epoll_dirty++] = user;
     }
+}
 
-    ev.events = events;
-    memset(&ev.data, 0, sizeof(ev.data));
-    ev.data.u32 = user;
+/* apply the event changes recorded since the last wait, one epoll_ctl call per fd at most */
+static void flush_epoll_events(void)
+{
+    int i, user;
 
-    if (epoll_ctl( epoll_fd, ctl, fd->unix_fd, &ev ) == -1)
+    for (i = 0; i < nb_epoll_dirty && epoll_fd != -1; i++)
     {
-        if (errno == ENOMEM)  /* not enough memory, give up on epoll */
+        user = epoll_dirty[i];
+        epoll_users[user].dirty = 0;
+        if (pollfd[user].fd == -1) continue;  /* removed in the meantime */
+        if (pollfd[user].events == epoll_users[user].registered)
         {
-            close( epoll_fd );
-            epoll_fd = -1;
+            poll_stats.ctl_saved++;  /* changed back to the registered state */
+            continue;
         }
-        else perror( "epoll_ctl" );  /* should not happen */
+        epoll_ctl_user( user, pollfd[user].fd,
+                        epoll_users[user].registered == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                        pollfd[user].events );
     }
+    nb_epoll_dirty = 0;
 }
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+    int i;
+
     if (epoll_fd == -1) return;
 
-    if (pollfd[user].fd != -1)
+    if (epoll_users[user].registered != -1)
     {
         struct epoll_event dummy;
         epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd->unix_fd, &dummy );
+        epoll_users[user].registered = -1;
+    }
+    if (epoll_users[user].dirty)  /* the index can be reused before the next flush */
+    {
+        for (i = 0; i < nb_epoll_dirty; i++) if (epoll_dirty[i] == user) break;
+        epoll_dirty[i] = epoll_dirty[--nb_epoll_dirty];
+        epoll_users[user].dirty = 0;
     }
 }
 
 static inline void main_loop_epoll(void)
 {
     int i, ret, timeout;
-    struct epoll_event events[128];
+    struct epoll_event *new_events;
 
     assert( POLLIN == EPOLLIN );
     assert( POLLOUT == EPOLLOUT );
@@ -517,29 +707,42 @@ static inline void main_loop_epoll(void)
 
     if (epoll_fd == -1) return;
 
+    nb_epoll_events = 128;
+    if (!(epoll_events = malloc( nb_epoll_events * sizeof(*epoll_events) ))) return;
+
     while (active_users)
     {
         timeout = get_next_timeout();
 
         if (!active_users) break;  /* last user removed by a timeout */
+        flush_epoll_events();
         if (epoll_fd == -1) break;  /* an error occurred with epoll */
 
-        ret = epoll_wait( epoll_fd, events, sizeof(events)/sizeof(events[0]), timeout );
+        ret = epoll_wait( epoll_fd, epoll_events, nb_epoll_events, timeout );
         set_current_time();
 
         /* put the events into the pollfd array first, like poll does */
         for (i = 0; i < ret; i++)
         {
-            int user = events[i].data.u32;
-            pollfd[user].revents = events[i].events;
+            int user = epoll_events[i].data.u32;
+            pollfd[user].revents = epoll_events[i].events;
         }
 
         /* read events from the pollfd array, as set_fd_events may modify them */
         for (i = 0; i < ret; i++)
         {
-            int user = events[i].data.u32;
+            int user = epoll_events[i].data.u32;
             if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
         }
+        if (debug_level) update_poll_stats( ret );
+
+        /* a full buffer means more events are probably pending, fetch them in larger batches */
+        if (ret == nb_epoll_events && nb_epoll_events < allocated_users &&
+            (new_events = realloc( epoll_events, 2 * nb_epoll_events * sizeof(*epoll_events) )))
+        {
+            epoll_events = new_events;
+            nb_epoll_events *= 2;
+        }
     }
 }
 
@@ -562,6 +765,8 @@ static inline void init_epoll(void)
     kqueue_fd = kqueue();
 }
 
+static inline int grow_epoll_users( int old_count, int new_count ) { return 1; }
+
 static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 {
     struct kevent ev[2];
@@ -675,6 +880,8 @@ static inline void init_epoll(void)
     port_fd = port_create();
 }
 
+static inline int grow_epoll_users( int old_count, int new_count ) { return 1; }
+
 static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 {
     int ret;
@@ -770,6 +977,7 @@ static inline void main_loop_epoll(void)
 #else /* HAVE_KQUEUE */
 
 static inline void init_epoll(void) { }
+static inline int grow_epoll_users( int old_count, int new_count ) { return 1; }
 static inline void set_fd_epoll_events( struct fd *fd, int user, int events ) { }
 static inline void remove_epoll_user( struct fd *fd, int user ) { }
 static inline void main_loop_epoll(void) { }
@@ -804,6 +1012,7 @@ static int add_poll_user( struct fd *fd )
             }
             poll_users = newusers;
             pollfd = newpoll;
+            if (!grow_epoll_users( allocated_users, new_count )) return -1;
             if (!allocated_users) init_epoll();
             allocated_users = new_count;
         }
@@ -835,38 +1044,26 @@ static void remove_poll_user( struct fd *fd, int user )
 /* process pending timeouts and return the time until the next timeout, in milliseconds */
 static int get_next_timeout(void)
 {
-    if (!list_empty( &timeout_list ))
+    if (timeout_count)
     {
-        struct list expired_list, *ptr;
+        unsigned __int64 serial = timeout_serial;
 
-        /* first remove all expired timers from the list */
+        /* call the callback for all expired timers; the ones added by the callbacks
+         * themselves are only processed on the next iteration of the main loop */
 
-        list_init( &expired_list );
-        while ((ptr = list_head( &timeout_list )) != NULL)
+        while (timeout_count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
-        }
-
-        /* now call the callback for all the removed timers */
+            struct timeout_user *timeout = timeout_heap[0];
 
-        while ((ptr = list_head( &expired_list )) != NULL)
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            list_remove( &timeout->entry );
+            if (timeout->when > current_time || timeout->serial >= serial) break;
+            timeout_heap_remove( timeout );
             timeout->callback( timeout->private );
             free( timeout );
         }
 
-        if ((ptr = list_head( &timeout_list )) != NULL)
+        if (timeout_count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = timeout_heap[0];
             int diff = (timeout->when - current_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             return diff;
@@ -897,15 +1094,18 @@ void main_loop(void)
 
         if (ret > 0)
         {
+            int count = ret;
+
             for (i = 0; i < nb_users; i++)
             {
                 if (pollfd[i].revents)
                 {
                     fd_poll_event( poll_users[i], pollfd[i].revents );
-                    if (!--ret) break;
+                    if (!--count) break;
                 }
             }
         }
+        if (debug_level) update_poll_stats( ret );
     }
 }
 
@@ -1593,6 +1793,7 @@ static struct fd *alloc_fd_object(void)
     fd->write_q    = NULL;
     fd->wait_q     = NULL;
     fd->completion = NULL;
+    fd->comp_flags = 0;
     list_init( &fd->inode_entry );
     list_init( &fd->locks );
 
@@ -1628,6 +1829,7 @@ struct fd *alloc_pseudo_fd( const struct fd_ops *fd_user_ops, struct object *use
     fd->write_q    = NULL;
     fd->wait_q     = NULL;
     fd->completion = NULL;
+    fd->comp_flags = 0;
     fd->no_fd_status = STATUS_BAD_DEVICE_TYPE;
     list_init( &fd->inode_entry );
     list_init( &fd->locks );
@@ -2211,6 +2413,12 @@ void fd_copy_completion( struct fd *src, struct fd *dst )
 {
     assert( !dst->completion );
     dst->completion = fd_get_completion( src, &dst->comp_key );
+    dst->comp_flags = src->comp_flags;
+}
+
+unsigned int fd_get_comp_flags( struct fd *fd )
+{
+    return fd->comp_flags;
 }
 
 /* flush a file buffers */
@@ -2286,6 +2494,7 @@ DECL_HANDLER(get_handle_fd)
             reply->type = fd->fd_ops->get_fd_type( fd );
             reply->cacheable = fd->cacheable;
             reply->options = fd->options;
+            reply->comp_flags = fd->comp_flags;
             reply->access = get_handle_access( current->process, req->handle );
             send_client_fd( current->process, unix_fd, req->handle );
         }
@@ -2370,8 +2579,23 @@ DECL_HANDLER(add_fd_completion)
     struct fd *fd = get_handle_fd_obj( current->process, req->handle, 0 );
     if (fd)
     {
-        if (fd->completion)
+        if (fd->completion && (req->async || !(fd->comp_flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)))
             add_completion( fd->completion, fd->comp_key, req->cvalue, req->status, req->information );
         release_object( fd );
     }
 }
+
+/* set the completion notification modes of a fd */
+DECL_HANDLER(set_fd_completion_mode)
+{
+    struct fd *fd = get_handle_fd_obj( current->process, req->handle, 0 );
+    if (fd)
+    {
+        /* like on Windows, modes can only be added, never removed */
+        if (!(fd->options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)))
+            fd->comp_flags |= req->flags & (FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE);
+        else
+            set_error( STATUS_INVALID_PARAMETER );
+        release_object( fd );
+    }
+}
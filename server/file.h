@@ -96,6 +96,7 @@ extern void default_fd_reselect_async( struct fd *fd, struct async_queue *queue
 extern void default_fd_cancel_async( struct fd *fd, struct process *process, struct thread *thread, client_ptr_t iosb );
 extern void no_flush( struct fd *fd, struct event **event );
 extern void main_loop(void);
+extern void dump_poll_stats(void);
 extern void remove_process_locks( struct process *process );
 
 static inline struct fd *get_obj_fd( struct object *obj ) { return obj->ops->get_fd( obj ); }
@@ -111,6 +112,7 @@ typedef void (*timeout_callback)( void *private );
 
 extern struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private );
 extern void remove_timeout_user( struct timeout_user *user );
+extern unsigned int get_timeout_count( unsigned int *max_count );
 extern const char *get_timeout_str( timeout_t timeout );
 
 /* file functions */
@@ -168,6 +170,7 @@ extern int async_wake_up_by( struct async_queue *queue, struct process *process,
 extern void async_wake_up( struct async_queue *queue, unsigned int status );
 extern struct completion *fd_get_completion( struct fd *fd, apc_param_t *p_key );
 extern void fd_copy_completion( struct fd *src, struct fd *dst );
+extern unsigned int fd_get_comp_flags( struct fd *fd );
 
 /* access rights that require Unix read permission */
 #define FILE_UNIX_READ_ACCESS (FILE_READ_DATA|FILE_READ_ATTRIBUTES|FILE_READ_EA)
@@ -45,6 +45,8 @@ struct object_name
     struct list         entry;           /* entry in the hash list */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
+    struct namespace   *namespace;       /* namespace containing the name */
+    unsigned int        hash;            /* full hash value of the name */
     data_size_t         len;             /* name length in bytes */
     WCHAR               name[1];
 };
@@ -52,9 +54,12 @@ struct object_name
 struct namespace
 {
     unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        count;           /* number of names in the table */
+    struct list        *names;           /* array of hash entry lists */
 };
 
+#define NAMESPACE_MAX_LOAD  2            /* average names per bucket before growing */
+
 
 #ifdef DEBUG_OBJECTS
 static struct list object_list = LIST_INIT(object_list);
@@ -120,12 +125,40 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
-static int get_name_hash( const struct namespace *namespace, const WCHAR *name, data_size_t len )
+/* case-insensitive FNV-1a hash of a name */
+static unsigned int get_name_hash( const WCHAR *name, data_size_t len )
 {
-    WCHAR hash = 0;
+    unsigned int hash = 2166136261u;
     len /= sizeof(WCHAR);
-    while (len--) hash ^= tolowerW(*name++);
-    return hash % namespace->hash_size;
+    while (len--)
+    {
+        WCHAR ch = tolowerW( *name++ );
+        hash = (hash ^ (ch & 0xff)) * 16777619;
+        hash = (hash ^ (ch >> 8)) * 16777619;
+    }
+    return hash;
+}
+
+/* grow the hash table of a namespace, keeping the order of the entries within a bucket */
+static void grow_namespace( struct namespace *namespace )
+{
+    unsigned int i, new_size = namespace->hash_size * 2 + 1;
+    struct object_name *ptr, *next;
+    struct list *names;
+
+    if (!(names = malloc( new_size * sizeof(*names) ))) return;  /* keep the current table */
+    for (i = 0; i < new_size; i++) list_init( &names[i] );
+    for (i = 0; i < namespace->hash_size; i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( ptr, next, &namespace->names[i], struct object_name, entry )
+        {
+            list_remove( &ptr->entry );
+            list_add_tail( &names[ptr->hash % new_size], &ptr->entry );
+        }
+    }
+    free( namespace->names );
+    namespace->names = names;
+    namespace->hash_size = new_size;
 }
 
 /* allocate a name for an object */
@@ -137,6 +170,7 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     {
         ptr->len = name->len;
         ptr->parent = NULL;
+        ptr->namespace = NULL;
         memcpy( ptr->name, name->str, name->len );
     }
     return ptr;
@@ -147,6 +181,7 @@ static void free_name( struct object *obj )
 {
     struct object_name *ptr = obj->name;
     list_remove( &ptr->entry );
+    if (ptr->namespace) ptr->namespace->count--;
     if (ptr->parent) release_object( ptr->parent );
     free( ptr );
 }
@@ -155,9 +190,12 @@ static void free_name( struct object *obj )
 static void set_object_name( struct namespace *namespace,
                              struct object *obj, struct object_name *ptr )
 {
-    int hash = get_name_hash( namespace, ptr->name, ptr->len );
+    if (namespace->count >= namespace->hash_size * NAMESPACE_MAX_LOAD) grow_namespace( namespace );
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+    ptr->hash = get_name_hash( ptr->name, ptr->len );
+    ptr->namespace = namespace;
+    list_add_head( &namespace->names[ptr->hash % namespace->hash_size], &ptr->entry );
+    namespace->count++;
     ptr->obj = obj;
     obj->name = ptr;
 }
@@ -325,14 +363,16 @@ struct object *find_object( const struct namespace *namespace, const struct unic
 {
     const struct list *list;
     struct list *p;
+    unsigned int hash;
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ get_name_hash( namespace, name->str, name->len ) ];
+    hash = get_name_hash( name->str, name->len );
+    list = &namespace->names[hash % namespace->hash_size];
     LIST_FOR_EACH( p, list )
     {
         const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
-        if (ptr->len != name->len) continue;
+        if (ptr->hash != hash || ptr->len != name->len) continue;
         if (attributes & OBJ_CASE_INSENSITIVE)
         {
             if (!strncmpiW( ptr->name, name->str, name->len/sizeof(WCHAR) ))
@@ -371,15 +411,26 @@ struct namespace *create_namespace( unsigned int hash_size )
     struct namespace *namespace;
     unsigned int i;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->names = mem_alloc( hash_size * sizeof(namespace->names[0]) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    namespace->hash_size = hash_size;
+    namespace->count     = 0;
+    for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
     return namespace;
 }
 
+/* free a namespace; all the names must have been removed from it */
+void free_namespace( struct namespace *namespace )
+{
+    if (!namespace) return;
+    free( namespace->names );
+    free( namespace );
+}
+
 /* functions for unimplemented/default object operations */
 
 struct object_type *no_get_type( struct object *obj )
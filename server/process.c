@@ -336,6 +336,7 @@ struct thread *create_process( int fd, struct thread *parent_thread, int inherit
     process->trace_data      = 0;
     process->rawinput_mouse  = NULL;
     process->rawinput_kbd    = NULL;
+    process->req_stats       = NULL;
     list_init( &process->thread_list );
     list_init( &process->locks );
     list_init( &process->classes );
@@ -429,6 +430,7 @@ static void process_destroy( struct object *obj )
     if (process->idle_event) release_object( process->idle_event );
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
+    free( process->req_stats );
 }
 
 /* dump a process on stdout for debugging purposes */
@@ -91,6 +91,7 @@ struct process
     struct list          rawinput_devices;/* list of registered rawinput devices */
     const struct rawinput_device *rawinput_mouse; /* rawinput mouse device, if any */
     const struct rawinput_device *rawinput_kbd;   /* rawinput keyboard device, if any */
+    struct request_stats *req_stats;      /* statistics of the requests of the process */
 };
 
 struct process_snapshot
@@ -35,6 +35,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -78,6 +81,8 @@ struct key
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    const struct registry_image *image;     /* image the key contents are loaded from */
+    const struct image_key      *image_key; /* key contents in the image, until they are loaded */
 };
 
 /* key flags */
@@ -87,6 +92,7 @@ struct key
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOW64    0x0010  /* key contains a Wow6432Node subkey */
 #define KEY_WOWSHARE 0x0020  /* key is a Wow64 shared key (used for Software\Classes) */
+#define KEY_IMAGE_DIRTY 0x0040  /* key has been modified since the image was saved */
 
 /* a key value */
 struct key_value
@@ -110,6 +116,8 @@ static struct key *root_key;
 static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
 static const timeout_t save_period = 30 * -TICKS_PER_SEC;  /* delay between periodic saves */
 static struct timeout_user *save_timeout_user;  /* saving timer */
+#define TEXT_SAVE_INTERVAL 10  /* number of periodic saves between saves of the text files */
+static unsigned int periodic_save_count;  /* number of periodic saves so far */
 static enum prefix_type { PREFIX_UNKNOWN, PREFIX_32BIT, PREFIX_64BIT } prefix_type;
 
 static const WCHAR root_name[] = { '\\','R','e','g','i','s','t','r','y','\\' };
@@ -118,19 +126,30 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static void set_periodic_save_timer(void);
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void flush_journals( void *arg );
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index );
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    const char  *image_path;
+    const char  *journal_path;
+    unsigned __int64 generation;    /* generation of the current image, 0 if none */
+    int          journal_fd;        /* journal file, -1 if changes are not journaled */
+    size_t       journal_size;      /* size of the journal file */
+    char        *journal;           /* records waiting to be written to the journal */
+    size_t       journal_len;       /* size of the waiting records */
+    size_t       journal_alloc;     /* allocated size of the journal buffer */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
+static int flush_journal( struct save_branch_info *info );
+
 
 /* information about a file being loaded */
 struct file_load_info
@@ -145,6 +164,129 @@ struct file_load_info
 };
 
 
+/* binary registry images
+ *
+ * An image is a snapshot of a registry branch that is mapped in memory at startup
+ * instead of parsing the text file; the values and subkeys of a key are only loaded
+ * from it the first time the key is accessed. It is saved alongside the text file,
+ * and is ignored if the text file has been modified since the image was written.
+ */
+
+#define REGISTRY_IMAGE_MAGIC   0x47455257  /* "WREG" */
+#define REGISTRY_IMAGE_VERSION 2
+#define REGISTRY_IMAGE_ALIGN   8
+#define MAX_IMAGE_DEPTH        512  /* max. depth of the key tree in an image */
+#define IMAGE_KEY_FLAGS        (KEY_SYMLINK | KEY_WOW64)  /* key flags stored in the image */
+
+struct image_header
+{
+    unsigned int     magic;       /* REGISTRY_IMAGE_MAGIC */
+    unsigned int     version;     /* REGISTRY_IMAGE_VERSION */
+    unsigned int     size;        /* total size of the image */
+    unsigned int     root;        /* offset of the root key */
+    unsigned int     prefix_type; /* architecture of the prefix */
+    unsigned int     text_dirty;  /* the text file doesn't contain the latest changes */
+    unsigned __int64 text_size;   /* size of the text file when the image was saved */
+    unsigned __int64 text_mtime;  /* modification time of the text file in ns */
+    unsigned __int64 text_ino;    /* inode of the text file */
+    unsigned __int64 generation;  /* generation number, matching the journal of the image */
+};
+
+struct image_key
+{
+    timeout_t        modif;       /* last modification time */
+    unsigned int     flags;       /* key flags */
+    unsigned short   namelen;     /* length of key name */
+    unsigned short   classlen;    /* length of class name */
+    unsigned int     name;        /* offset of key name */
+    unsigned int     class;       /* offset of class name */
+    unsigned int     nb_subkeys;  /* count of subkeys */
+    unsigned int     subkeys;     /* offset of the array of subkey offsets */
+    unsigned int     nb_values;   /* count of values */
+    unsigned int     values;      /* offset of the array of values */
+};
+
+struct image_value
+{
+    unsigned short   namelen;     /* length of value name */
+    unsigned short   type;        /* value type */
+    data_size_t      len;         /* value data length in bytes */
+    unsigned int     name;        /* offset of value name */
+    unsigned int     data;        /* offset of value data */
+};
+
+/* a mapped registry image */
+struct registry_image
+{
+    const char      *base;        /* start of the mapping */
+    size_t           size;        /* size of the mapping */
+};
+
+/* images are kept mapped as long as the server runs */
+static struct registry_image registry_images[MAX_SAVE_BRANCH_INFO];
+static int registry_image_count;
+
+/* buffer used to build a registry image */
+struct image_buffer
+{
+    char            *data;        /* image data */
+    size_t           size;        /* used size */
+    size_t           alloc;       /* allocated size */
+    int              error;       /* set if the image could not be built */
+};
+
+static inline const void *image_ptr( const struct registry_image *image, unsigned int offset )
+{
+    return image->base + offset;
+}
+
+/* registry journals
+ *
+ * Once a branch has an image, the changes made to it are appended to a journal
+ * instead of saving the whole branch again. At startup the journal is replayed on
+ * top of the image with the same generation, and it is emptied every time a new
+ * image is saved, which happens once it grows too large or when the server exits.
+ */
+
+#define JOURNAL_MAGIC    0x4c4a5257  /* "WRJL" */
+#define JOURNAL_VERSION  1
+#define JOURNAL_ALIGN    8
+#define JOURNAL_MAX_SIZE (1024 * 1024)  /* journal size that triggers saving a new image */
+
+static const timeout_t journal_flush_delay = -TICKS_PER_SEC;  /* delay before writing records to disk */
+static struct timeout_user *journal_timeout_user;  /* journal flush timer */
+
+struct journal_header
+{
+    unsigned int     magic;       /* JOURNAL_MAGIC */
+    unsigned int     version;     /* JOURNAL_VERSION */
+    unsigned __int64 generation;  /* generation of the image the journal applies to */
+};
+
+enum journal_op
+{
+    JOURNAL_CREATE_KEY = 1,
+    JOURNAL_DELETE_KEY,
+    JOURNAL_SET_VALUE,
+    JOURNAL_DELETE_VALUE
+};
+
+struct journal_record
+{
+    unsigned int     size;        /* size of the record, including the header and padding */
+    unsigned int     checksum;    /* checksum of the record, computed with this field set to 0 */
+    timeout_t        modif;       /* modification time of the key after the operation */
+    unsigned short   op;          /* operation (enum journal_op) */
+    unsigned short   flags;       /* key flags for JOURNAL_CREATE_KEY */
+    unsigned int     type;        /* value type for JOURNAL_SET_VALUE */
+    data_size_t      pathlen;     /* length of the key path, relative to the branch */
+    data_size_t      namelen;     /* length of the value name, or of the class for JOURNAL_CREATE_KEY */
+    data_size_t      len;         /* length of the value data */
+    unsigned int     __pad;
+    /* followed by the key path, the name and the value data */
+};
+
+
 static void key_dump( struct object *obj, int verbose );
 static unsigned int key_map_access( struct object *obj, unsigned int access );
 static struct security_descriptor *key_get_sd( struct object *obj );
@@ -252,12 +394,83 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
+/* path of a key that hasn't been loaded from its image yet */
+struct image_path
+{
+    const struct image_key  *key;     /* key in the image */
+    const struct image_path *parent;  /* parent path, NULL for the key object itself */
+};
+
+/* dump the full path of a key stored in an image */
+static void dump_image_path( const struct key *key, const struct key *base,
+                             const struct image_path *path, FILE *f )
+{
+    if (!path->parent)
+    {
+        if (key != base) dump_path( key, base, f );
+        return;
+    }
+    dump_image_path( key, base, path->parent, f );
+    if (path->parent->parent || key != base) fprintf( f, "\\\\" );
+    dump_strW( image_ptr( key->image, path->key->name ), path->key->namelen / sizeof(WCHAR), f, "[]" );
+}
+
+/* save a key stored in an image and all its subkeys to a text file */
+static void save_image_subkeys( const struct key *key, const struct key *base,
+                                const struct image_path *path, FILE *f )
+{
+    const struct registry_image *image = key->image;
+    const struct image_key *ik = path->key;
+    const struct image_value *iv = image_ptr( image, ik->values );
+    const unsigned int *subkeys = image_ptr( image, ik->subkeys );
+    timeout_t modif = path->parent ? ik->modif : key->modif;
+    unsigned int flags = path->parent ? ik->flags : key->flags;
+    struct image_path subpath;
+    struct key_value value;
+    unsigned int i;
+
+    if (ik->nb_values || !ik->nb_subkeys || ik->classlen || (flags & KEY_SYMLINK))
+    {
+        fprintf( f, "\n[" );
+        dump_image_path( key, base, path, f );
+        fprintf( f, "] %u\n", (unsigned int)((modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+        if (ik->classlen)
+        {
+            fprintf( f, "#class=\"" );
+            dump_strW( image_ptr( image, ik->class ), ik->classlen / sizeof(WCHAR), f, "\"\"" );
+            fprintf( f, "\"\n" );
+        }
+        if (flags & KEY_SYMLINK) fputs( "#link\n", f );
+        for (i = 0; i < ik->nb_values; i++)
+        {
+            value.name    = (WCHAR *)image_ptr( image, iv[i].name );
+            value.namelen = iv[i].namelen;
+            value.type    = iv[i].type;
+            value.len     = iv[i].len;
+            value.data    = (void *)image_ptr( image, iv[i].data );
+            dump_value( &value, f );
+        }
+    }
+    subpath.parent = path;
+    for (i = 0; i < ik->nb_subkeys; i++)
+    {
+        subpath.key = image_ptr( image, subkeys[i] );
+        save_image_subkeys( key, base, &subpath, f );
+    }
+}
+
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
+    if (key->image_key)
+    {
+        struct image_path path = { key->image_key, NULL };
+        save_image_subkeys( key, base, &path, f );
+        return;
+    }
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
@@ -481,6 +694,8 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->values      = NULL;
         key->modif       = modif;
         key->parent      = NULL;
+        key->image       = NULL;
+        key->image_key   = NULL;
         list_init( &key->notify_list );
         if (name->len && !(key->name = memdup( name->str, name->len )))
         {
@@ -496,21 +711,112 @@ static void make_dirty( struct key *key )
 {
     while (key)
     {
-        if (key->flags & (KEY_DIRTY|KEY_VOLATILE)) return;  /* nothing to do */
-        key->flags |= KEY_DIRTY;
+        if (key->flags & KEY_VOLATILE) return;
+        if ((key->flags & (KEY_DIRTY|KEY_IMAGE_DIRTY)) == (KEY_DIRTY|KEY_IMAGE_DIRTY))
+            return;  /* nothing to do */
+        key->flags |= KEY_DIRTY | KEY_IMAGE_DIRTY;
         key = key->parent;
     }
 }
 
-/* mark a key and all its subkeys as clean (not modified) */
-static void make_clean( struct key *key )
+/* mark a key and all its subkeys as clean (not modified) in the text file and/or the image */
+static void make_clean( struct key *key, unsigned int flags )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
-    if (!(key->flags & KEY_DIRTY)) return;
-    key->flags &= ~KEY_DIRTY;
-    for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
+    if (!(key->flags & flags)) return;
+    key->flags &= ~flags;
+    for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i], flags );
+}
+
+/* load the values and subkeys of a key from its image; return 1 if OK, 0 on error */
+static int load_image_key( struct key *key )
+{
+    const struct registry_image *image = key->image;
+    const struct image_key *ik = key->image_key;
+    const struct image_value *iv;
+    const unsigned int *subkeys;
+    struct unicode_str name;
+    unsigned int i;
+
+    if (!ik) return 1;
+
+    if (ik->nb_values)
+    {
+        /* the array growing code expects at least MIN_VALUES entries */
+        key->nb_values = max( ik->nb_values, MIN_VALUES );
+        if (!(key->values = mem_alloc( key->nb_values * sizeof(*key->values) ))) return 0;
+        iv = image_ptr( image, ik->values );
+        for (i = 0; i < ik->nb_values; i++)
+        {
+            struct key_value *value = &key->values[i];
+
+            value->namelen = iv[i].namelen;
+            value->type    = iv[i].type;
+            value->len     = iv[i].len;
+            value->name    = NULL;
+            value->data    = NULL;
+            key->last_value = i;
+            if (iv[i].namelen && !(value->name = memdup( image_ptr( image, iv[i].name ), iv[i].namelen )))
+                goto failed;
+            if (iv[i].len && !(value->data = memdup( image_ptr( image, iv[i].data ), iv[i].len )))
+                goto failed;
+        }
+    }
+
+    if (ik->nb_subkeys)
+    {
+        key->nb_subkeys = max( ik->nb_subkeys, MIN_SUBKEYS );
+        if (!(key->subkeys = mem_alloc( key->nb_subkeys * sizeof(*key->subkeys) ))) goto failed;
+        subkeys = image_ptr( image, ik->subkeys );
+        for (i = 0; i < ik->nb_subkeys; i++)
+        {
+            const struct image_key *child = image_ptr( image, subkeys[i] );
+            struct key *subkey;
+
+            name.str = image_ptr( image, child->name );
+            name.len = child->namelen;
+            if (!(subkey = alloc_key( &name, child->modif ))) goto failed;
+            subkey->flags     = child->flags;
+            subkey->parent    = key;
+            subkey->image     = image;
+            subkey->image_key = child;
+            key->subkeys[i] = subkey;
+            key->last_subkey = i;
+            if (child->classlen)
+            {
+                if (!(subkey->class = memdup( image_ptr( image, child->class ), child->classlen )))
+                    goto failed;
+                subkey->classlen = child->classlen;
+            }
+        }
+    }
+
+    key->image_key = NULL;
+    return 1;
+
+failed:
+    set_error( STATUS_NO_MEMORY );
+    for (i = 0; (int)i <= key->last_value; i++)
+    {
+        free( key->values[i].name );
+        free( key->values[i].data );
+    }
+    free( key->values );
+    for (i = 0; (int)i <= key->last_subkey; i++)
+    {
+        key->subkeys[i]->parent = NULL;
+        release_object( key->subkeys[i] );
+    }
+    free( key->subkeys );
+    key->values      = NULL;
+    key->nb_values   = 0;
+    key->last_value  = -1;
+    key->subkeys     = NULL;
+    key->nb_subkeys  = 0;
+    key->last_subkey = -1;
+    return 0;
 }
 
 /* go through all the notifications and send them if necessary */
@@ -540,6 +846,102 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change & ~REG_NOTIFY_CHANGE_LAST_SET, 0 );
 }
 
+/* return the branch containing a key if its changes are journaled */
+static struct save_branch_info *get_journal_branch( const struct key *key )
+{
+    const struct key *k;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return NULL;
+    for (k = key; k; k = k->parent)
+        for (i = 0; i < save_branch_count; i++)
+            if (save_branch_info[i].key == k)
+                return save_branch_info[i].journal_fd != -1 ? &save_branch_info[i] : NULL;
+    return NULL;
+}
+
+/* compute the checksum of a journal record */
+static unsigned int get_journal_checksum( const void *data, size_t size )
+{
+    const unsigned char *p = data;
+    unsigned int checksum = 2166136261u;  /* FNV-1a */
+
+    while (size--) checksum = (checksum ^ *p++) * 16777619;
+    return checksum;
+}
+
+/* stop journaling a branch; its changes will be saved in the next image instead */
+static void close_journal( struct save_branch_info *info )
+{
+    if (info->journal_fd == -1) return;
+    close( info->journal_fd );
+    info->journal_fd = -1;
+    info->journal_len = 0;
+}
+
+/* append an operation on a key to the journal of its branch */
+static void journal_operation( const struct key *key, enum journal_op op, unsigned short flags,
+                               timeout_t modif, unsigned int type, const void *name,
+                               data_size_t namelen, const void *data, data_size_t len )
+{
+    static const WCHAR backslash = '\\';
+    struct save_branch_info *info;
+    struct journal_record *rec;
+    const struct key *k;
+    data_size_t pathlen = 0, pos;
+    size_t size;
+    char *ptr;
+
+    if (!(info = get_journal_branch( key ))) return;
+
+    for (k = key; k != info->key; k = k->parent) pathlen += k->namelen + sizeof(WCHAR);
+    if (pathlen) pathlen -= sizeof(WCHAR);
+    size = (sizeof(*rec) + pathlen + namelen + len + JOURNAL_ALIGN - 1) & ~(JOURNAL_ALIGN - 1);
+
+    if (info->journal_len + size > info->journal_alloc)
+    {
+        size_t new_size = max( info->journal_alloc * 2, info->journal_len + size );
+        char *new_journal;
+
+        if (!(new_journal = realloc( info->journal, new_size )))
+        {
+            close_journal( info );
+            return;
+        }
+        info->journal = new_journal;
+        info->journal_alloc = new_size;
+    }
+
+    rec = (struct journal_record *)(info->journal + info->journal_len);
+    memset( rec, 0, size );
+    rec->size    = size;
+    rec->modif   = modif;
+    rec->op      = op;
+    rec->flags   = flags;
+    rec->type    = type;
+    rec->pathlen = pathlen;
+    rec->namelen = namelen;
+    rec->len     = len;
+
+    ptr = (char *)(rec + 1);
+    pos = pathlen;
+    for (k = key; k != info->key; k = k->parent)
+    {
+        pos -= k->namelen;
+        memcpy( ptr + pos, k->name, k->namelen );
+        if (!pos) break;
+        pos -= sizeof(WCHAR);
+        memcpy( ptr + pos, &backslash, sizeof(WCHAR) );
+    }
+    if (namelen) memcpy( ptr + pathlen, name, namelen );
+    if (len) memcpy( ptr + pathlen + namelen, data, len );
+    rec->checksum = get_journal_checksum( rec, size );
+    info->journal_len += size;
+
+    if (!journal_timeout_user)
+        journal_timeout_user = add_timeout_user( journal_flush_delay, flush_journals, NULL );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -577,6 +979,7 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         set_error( STATUS_NAME_TOO_LONG );
         return NULL;
     }
+    if (!load_image_key( parent )) return NULL;
     if (parent->last_subkey + 1 == parent->nb_subkeys)
     {
         /* need to grow the array */
@@ -625,11 +1028,16 @@ static void free_subkey( struct key *parent, int index )
 }
 
 /* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+static struct key *find_subkey( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    if (!load_image_key( key ))
+    {
+        *index = 0;
+        return NULL;
+    }
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -804,7 +1212,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
 
     if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
     if (options & REG_OPTION_VOLATILE) key->flags |= KEY_VOLATILE;
-    else key->flags |= KEY_DIRTY;
+    else key->flags |= KEY_DIRTY | KEY_IMAGE_DIRTY;
 
     if (debug_level > 1) dump_operation( key, NULL, "Create" );
     if (class && class->len)
@@ -813,6 +1221,8 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
         free(key->class);
         if (!(key->class = memdup( class->str, key->classlen ))) key->classlen = 0;
     }
+    journal_operation( key, JOURNAL_CREATE_KEY, key->flags & KEY_SYMLINK, key->modif, 0,
+                       key->class, key->classlen, NULL, 0 );
     grab_object( key );
     return key;
 }
@@ -861,7 +1271,7 @@ static struct key *create_key_recursive( struct key *key, const struct unicode_s
 }
 
 /* query information about a key or a subkey */
-static void enum_key( const struct key *key, int index, int info_class,
+static void enum_key( struct key *key, int index, int info_class,
                       struct enum_key_reply *reply )
 {
     static const WCHAR backslash[] = { '\\' };
@@ -874,6 +1284,7 @@ static void enum_key( const struct key *key, int index, int info_class,
 
     if (index != -1)  /* -1 means use the specified key directly */
     {
+        if (!load_image_key( key )) return;
         if ((index < 0) || (index > key->last_subkey))
         {
             set_error( STATUS_NO_MORE_ENTRIES );
@@ -904,6 +1315,7 @@ static void enum_key( const struct key *key, int index, int info_class,
         reply->max_data   = 0;
         break;
     case KeyFullInformation:
+        if (!load_image_key( key )) return;
         for (i = 0; i <= key->last_subkey; i++)
         {
             struct key *subkey = key->subkeys[i];
@@ -929,8 +1341,16 @@ static void enum_key( const struct key *key, int index, int info_class,
         set_error( STATUS_INVALID_PARAMETER );
         return;
     }
-    reply->subkeys = key->last_subkey + 1;
-    reply->values  = key->last_value + 1;
+    if (key->image_key)  /* no need to load the key only to count its contents */
+    {
+        reply->subkeys = key->image_key->nb_subkeys;
+        reply->values  = key->image_key->nb_values;
+    }
+    else
+    {
+        reply->subkeys = key->last_subkey + 1;
+        reply->values  = key->last_value + 1;
+    }
     reply->modif   = key->modif;
     reply->total   = namelen + classlen;
 
@@ -980,6 +1400,7 @@ static int delete_key( struct key *key, int recurse )
         return -1;
     }
     assert( parent );
+    if (!load_image_key( key )) return -1;
 
     while (recurse && (key->last_subkey>=0))
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
@@ -997,6 +1418,7 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    journal_operation( key, JOURNAL_DELETE_KEY, 0, current_time, 0, NULL, 0, NULL, 0 );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1028,11 +1450,16 @@ static int grow_values( struct key *key )
 }
 
 /* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    if (!load_image_key( key ))
+    {
+        *index = 0;
+        return NULL;
+    }
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1065,6 +1492,7 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
         set_error( STATUS_NAME_TOO_LONG );
         return NULL;
     }
+    if (!load_image_key( key )) return NULL;
     if (key->last_value + 1 == key->nb_values)
     {
         if (!grow_values( key )) return NULL;
@@ -1124,6 +1552,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_operation( key, JOURNAL_SET_VALUE, 0, key->modif, type, name->str, name->len, data, len );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1152,6 +1581,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 {
     struct key_value *value;
 
+    if (!load_image_key( key )) return;
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
@@ -1215,6 +1645,7 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_operation( key, JOURNAL_DELETE_VALUE, 0, key->modif, 0, name->str, name->len, NULL, 0 );
 
     /* try to shrink the array */
     nb_values = key->nb_values;
@@ -1649,12 +2080,22 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
 /* load a part of the registry from a file */
 static void load_registry( struct key *key, obj_handle_t handle )
 {
+    struct save_branch_info *info;
     struct file *file;
     int fd;
 
     if (!(file = get_file_obj( current->process, handle, FILE_READ_DATA ))) return;
     fd = dup( get_file_unix_fd( file ) );
     release_object( file );
+
+    /* the loaded keys are not journaled, the whole branch will be saved in the next image instead */
+    if ((info = get_journal_branch( key )))
+    {
+        flush_journal( info );
+        close_journal( info );
+        make_dirty( key );
+    }
+
     if (fd != -1)
     {
         FILE *f = fdopen( fd, "r" );
@@ -1667,28 +2108,391 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* check that a range of data is inside an image */
+static int check_image_range( const struct registry_image *image, unsigned int offset, size_t size )
+{
+    return offset <= image->size && size <= image->size - offset;
+}
+
+/* check that an array is inside an image and properly aligned */
+static int check_image_array( const struct registry_image *image, unsigned int offset,
+                              unsigned int count, size_t size )
+{
+    if (offset % REGISTRY_IMAGE_ALIGN) return 0;
+    if (count > image->size / size) return 0;
+    return check_image_range( image, offset, count * size );
+}
+
+/* compare two key or value names the same way as find_subkey and find_value */
+static int compare_image_names( const struct registry_image *image, unsigned int name1, data_size_t len1,
+                                unsigned int name2, data_size_t len2 )
+{
+    int res = memicmpW( image_ptr( image, name1 ), image_ptr( image, name2 ),
+                        min( len1, len2 ) / sizeof(WCHAR) );
+    if (!res) res = len1 - len2;
+    return res;
+}
+
+/* check that a key stored in an image and all its subkeys are valid */
+/* subkeys are always stored after their parent, so that the tree cannot contain loops */
+static int check_image_key( const struct registry_image *image, unsigned int offset,
+                            unsigned int min_offset, int depth )
+{
+    const struct image_key *ik;
+    const struct image_value *iv;
+    const unsigned int *subkeys;
+    unsigned int i;
+
+    if (depth > MAX_IMAGE_DEPTH) return 0;
+    if (offset < min_offset) return 0;
+    if (!check_image_array( image, offset, 1, sizeof(*ik) )) return 0;
+    ik = image_ptr( image, offset );
+
+    if (ik->flags & ~IMAGE_KEY_FLAGS) return 0;
+    if (ik->namelen > MAX_NAME_LEN * sizeof(WCHAR) || ik->namelen % sizeof(WCHAR)) return 0;
+    if (ik->classlen % sizeof(WCHAR)) return 0;
+    if (ik->name % sizeof(WCHAR) || !check_image_range( image, ik->name, ik->namelen )) return 0;
+    if (ik->class % sizeof(WCHAR) || !check_image_range( image, ik->class, ik->classlen )) return 0;
+
+    if (ik->nb_values)
+    {
+        if (!check_image_array( image, ik->values, ik->nb_values, sizeof(*iv) )) return 0;
+        iv = image_ptr( image, ik->values );
+        for (i = 0; i < ik->nb_values; i++)
+        {
+            if (iv[i].namelen > MAX_VALUE_LEN * sizeof(WCHAR) || iv[i].namelen % sizeof(WCHAR)) return 0;
+            if (iv[i].name % sizeof(WCHAR) || !check_image_range( image, iv[i].name, iv[i].namelen ))
+                return 0;
+            if (!check_image_range( image, iv[i].data, iv[i].len )) return 0;
+            if (i && compare_image_names( image, iv[i - 1].name, iv[i - 1].namelen,
+                                          iv[i].name, iv[i].namelen ) >= 0) return 0;
+        }
+    }
+
+    if (ik->nb_subkeys)
+    {
+        if (!check_image_array( image, ik->subkeys, ik->nb_subkeys, sizeof(*subkeys) )) return 0;
+        subkeys = image_ptr( image, ik->subkeys );
+        for (i = 0; i < ik->nb_subkeys; i++)
+        {
+            const struct image_key *child;
+
+            if (!check_image_key( image, subkeys[i], offset + sizeof(*ik), depth + 1 )) return 0;
+            child = image_ptr( image, subkeys[i] );
+            if (!child->namelen) return 0;
+            if (i)
+            {
+                const struct image_key *prev = image_ptr( image, subkeys[i - 1] );
+                if (compare_image_names( image, prev->name, prev->namelen,
+                                         child->name, child->namelen ) >= 0) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* return the modification time of a file in nanoseconds */
+static unsigned __int64 get_file_mtime( const struct stat *st )
+{
+    unsigned __int64 ret = (unsigned __int64)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+/* map the image of one of the initial registry files, if it matches the text file */
+static int load_registry_image( const char *path, const char *text_path, struct key *key,
+                                unsigned __int64 *generation )
+{
+#ifdef HAVE_SYS_MMAN_H
+    struct registry_image *image = &registry_images[registry_image_count];
+    const struct image_header *header;
+    struct stat st, text_st;
+    void *base;
+    int fd;
+
+    assert( registry_image_count < MAX_SAVE_BRANCH_INFO );
+    if (key->last_subkey != -1 || key->last_value != -1) return 0;
+    if (stat( text_path, &text_st ) == -1) return 0;
+    if ((fd = open( path, O_RDONLY )) == -1) return 0;
+    if (fstat( fd, &st ) == -1 || st.st_size < (off_t)sizeof(*header) || st.st_size > UINT_MAX)
+    {
+        close( fd );
+        return 0;
+    }
+    base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if (base == MAP_FAILED) return 0;
+
+    image->base = base;
+    image->size = st.st_size;
+    header = base;
+    if (header->magic != REGISTRY_IMAGE_MAGIC || header->version != REGISTRY_IMAGE_VERSION) goto failed;
+    if (header->size != st.st_size) goto failed;
+    if (header->text_size != text_st.st_size || header->text_ino != text_st.st_ino ||
+        header->text_mtime != get_file_mtime( &text_st ))
+    {
+        if (debug_level) fprintf( stderr, "wineserver: %s is out of date, loading %s\n", path, text_path );
+        goto failed;
+    }
+    if (header->prefix_type > PREFIX_64BIT) goto failed;
+    if (header->prefix_type != PREFIX_UNKNOWN && prefix_type != PREFIX_UNKNOWN &&
+        header->prefix_type != prefix_type) goto failed;
+    if (!check_image_key( image, header->root, sizeof(*header), 0 ))
+    {
+        fprintf( stderr, "wineserver: %s is not a valid registry image\n", path );
+        goto failed;
+    }
+
+    if (header->prefix_type != PREFIX_UNKNOWN) prefix_type = header->prefix_type;
+    key->image     = image;
+    key->image_key = image_ptr( image, header->root );
+    key->flags    |= key->image_key->flags;
+    /* make sure changes only saved in the image get written to the text file too */
+    if (header->text_dirty) key->flags |= KEY_DIRTY;
+    *generation = header->generation;
+    registry_image_count++;
+    return 1;
+
+failed:
+    munmap( base, st.st_size );
+#endif
+    return 0;
+}
+
+/* find the key of a journal record, optionally creating it */
+/* the path is followed as is, without going through symlinks or Wow6432Node keys */
+static struct key *get_journal_key( struct key *key, const struct unicode_str *path,
+                                    int create, timeout_t modif )
+{
+    struct unicode_str token;
+    struct key *subkey;
+    int index;
+
+    token.str = NULL;
+    if (!get_path_token( path, &token )) return NULL;
+    while (token.len)
+    {
+        if (!(subkey = find_subkey( key, &token, &index )))
+        {
+            if (!create || !(subkey = alloc_subkey( key, &token, index, modif ))) return NULL;
+            make_dirty( subkey );
+        }
+        key = subkey;
+        get_path_token( path, &token );
+    }
+    return key;
+}
+
+/* replay a journal record on top of the branch image; return 0 if the record is invalid */
+static int replay_journal_record( struct save_branch_info *info, const struct journal_record *rec )
+{
+    const WCHAR *ptr = (const WCHAR *)(rec + 1);
+    struct unicode_str path, name;
+    struct key *key, *parent;
+
+    path.str = ptr;
+    path.len = rec->pathlen;
+    name.str = (const WCHAR *)((const char *)ptr + rec->pathlen);
+    name.len = rec->namelen;
+
+    switch (rec->op)
+    {
+    case JOURNAL_CREATE_KEY:
+        if (!(key = get_journal_key( info->key, &path, 1, rec->modif ))) break;
+        key->flags |= rec->flags & KEY_SYMLINK;
+        if (name.len)
+        {
+            free( key->class );
+            if (!(key->class = memdup( name.str, name.len ))) name.len = 0;
+            key->classlen = name.len;
+        }
+        key->modif = rec->modif;
+        make_dirty( key );
+        break;
+    case JOURNAL_DELETE_KEY:
+        if (!(key = get_journal_key( info->key, &path, 0, rec->modif )) || key == info->key) break;
+        parent = key->parent;
+        if (!delete_key( key, 1 )) parent->modif = rec->modif;
+        break;
+    case JOURNAL_SET_VALUE:
+        if (!(key = get_journal_key( info->key, &path, 1, rec->modif ))) break;
+        set_value( key, &name, rec->type, (const char *)name.str + name.len, rec->len );
+        key->modif = rec->modif;
+        break;
+    case JOURNAL_DELETE_VALUE:
+        if (!(key = get_journal_key( info->key, &path, 0, rec->modif ))) break;
+        delete_value( key, &name );
+        key->modif = rec->modif;
+        break;
+    default:
+        return 0;
+    }
+    clear_error();
+    return 1;
+}
+
+/* replay the journal of a branch; return the size of its valid part */
+static size_t replay_journal( struct save_branch_info *info, int fd )
+{
+    struct journal_header header;
+    struct journal_record *rec;
+    struct stat st;
+    size_t pos, size = 0, count = 0;
+    unsigned int checksum;
+    char *data;
+
+    if (fstat( fd, &st ) == -1 || st.st_size < (off_t)sizeof(header)) return 0;
+    if (pread( fd, &header, sizeof(header), 0 ) != sizeof(header)) return 0;
+    if (header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION) return 0;
+    if (header.generation != info->generation) return 0;  /* already included in the image */
+
+    size = st.st_size - sizeof(header);
+    if (!(data = malloc( size )) || pread( fd, data, size, sizeof(header) ) != (ssize_t)size)
+    {
+        free( data );
+        return 0;
+    }
+
+    for (pos = 0; pos + sizeof(*rec) <= size; pos += rec->size)
+    {
+        rec = (struct journal_record *)(data + pos);
+        if (rec->size < sizeof(*rec) || rec->size % JOURNAL_ALIGN || rec->size > size - pos) break;
+        if (rec->pathlen > rec->size || rec->namelen > rec->size || rec->len > rec->size) break;
+        if (sizeof(*rec) + rec->pathlen + rec->namelen + rec->len > rec->size) break;
+        if ((rec->pathlen | rec->namelen) % sizeof(WCHAR)) break;
+        checksum = rec->checksum;
+        rec->checksum = 0;
+        if (get_journal_checksum( rec, rec->size ) != checksum) break;
+        if (!replay_journal_record( info, rec )) break;
+        count++;
+    }
+    if (debug_level)
+        fprintf( stderr, "wineserver: replayed %lu changes from %s\n", (unsigned long)count, info->journal_path );
+    if (pos < size) fprintf( stderr, "wineserver: ignoring invalid data at the end of %s\n", info->journal_path );
+    free( data );
+    return sizeof(header) + pos;
+}
+
+/* start a new empty journal for the current image of a branch */
+static void reset_journal( struct save_branch_info *info )
+{
+    struct journal_header header;
+
+    info->journal_len = 0;
+    if (info->journal_fd == -1 &&
+        (info->journal_fd = open( info->journal_path, O_WRONLY | O_CREAT | O_APPEND, 0666 )) == -1)
+        return;
+
+    header.magic      = JOURNAL_MAGIC;
+    header.version    = JOURNAL_VERSION;
+    header.generation = info->generation;
+    if (ftruncate( info->journal_fd, 0 ) == -1 ||
+        write( info->journal_fd, &header, sizeof(header) ) != sizeof(header))
+    {
+        close_journal( info );
+        return;
+    }
+    info->journal_size = sizeof(header);
+}
+
+/* replay the journal of a branch that was loaded from its image, and keep it open for new changes */
+static void open_journal( struct save_branch_info *info )
+{
+    struct stat st;
+    size_t size;
+    int fd;
+
+    if ((fd = open( info->journal_path, O_RDWR | O_APPEND )) == -1)
+    {
+        reset_journal( info );
+        return;
+    }
+    if (!(size = replay_journal( info, fd )))
+    {
+        info->journal_fd = fd;
+        reset_journal( info );
+        return;
+    }
+    /* drop a partially written record so that new records can be appended */
+    if (!fstat( fd, &st ) && st.st_size > (off_t)size && ftruncate( fd, size ) == -1)
+    {
+        close( fd );
+        return;
+    }
+    info->journal_fd   = fd;
+    info->journal_size = size;
+}
+
+/* write the waiting records of a branch to its journal; return 0 if the journal had to be closed */
+static int flush_journal( struct save_branch_info *info )
+{
+    size_t pos;
+    ssize_t res;
+
+    if (!info->journal_len) return 1;
+    for (pos = 0; pos < info->journal_len; pos += res)
+        if ((res = write( info->journal_fd, info->journal + pos, info->journal_len - pos )) <= 0) break;
+    if (pos < info->journal_len || fsync( info->journal_fd ) == -1)
+    {
+        close_journal( info );
+        return 0;
+    }
+    info->journal_size += info->journal_len;
+    info->journal_len = 0;
+    return 1;
+}
+
+/* write the waiting journal records to disk */
+static void flush_journals( void *arg )
+{
+    int i;
+
+    journal_timeout_user = NULL;
+    for (i = 0; i < save_branch_count; i++) flush_journal( &save_branch_info[i] );
+}
+
 /* load one of the initial registry files */
-static int load_init_registry_from_file( const char *filename, struct key *key )
+static int load_init_registry_from_file( const char *filename, const char *image_path,
+                                         const char *journal_path, struct key *key )
 {
-    FILE *f;
+    struct save_branch_info *info;
+    unsigned __int64 generation = 0;
+    FILE *f = NULL;
+    int ret = 1;
 
-    if ((f = fopen( filename, "r" )))
+    if (!load_registry_image( image_path, filename, key, &generation ))
     {
-        load_keys( key, filename, f, 0 );
-        fclose( f );
-        if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        if ((f = fopen( filename, "r" )))
         {
-            fprintf( stderr, "%s is not a valid registry file\n", filename );
-            return 1;
+            load_keys( key, filename, f, 0 );
+            fclose( f );
+            if (get_error() == STATUS_NOT_REGISTRY_FILE)
+            {
+                fprintf( stderr, "%s is not a valid registry file\n", filename );
+                return 1;
+            }
+            /* create the image at the next save */
+            key->flags |= KEY_IMAGE_DIRTY;
         }
+        ret = (f != NULL);
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    info->path         = filename;
+    info->image_path   = image_path;
+    info->journal_path = journal_path;
+    info->generation   = generation;
+    info->journal_fd   = -1;
+    info->key = (struct key *)grab_object( key );
     make_object_static( &key->obj );
-    return (f != NULL);
+    if (generation) open_journal( info );
+    return ret;
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1773,7 +2577,7 @@ void init_registry(void)
     if (!(hklm = create_key_recursive( root_key, &HKLM_name, current_time )))
         fatal_error( "could not create Machine registry key\n" );
 
-    if (!load_init_registry_from_file( "system.reg", hklm ))
+    if (!load_init_registry_from_file( "system.reg", "system.reg.bin", "system.reg.journal", hklm ))
         prefix_type = sizeof(void *) > sizeof(int) ? PREFIX_64BIT : PREFIX_32BIT;
     else if (prefix_type == PREFIX_UNKNOWN)
         prefix_type = PREFIX_32BIT;
@@ -1783,7 +2587,7 @@ void init_registry(void)
     if (!(key = create_key_recursive( root_key, &HKU_name, current_time )))
         fatal_error( "could not create User\\.Default registry key\n" );
 
-    load_init_registry_from_file( "userdef.reg", key );
+    load_init_registry_from_file( "userdef.reg", "userdef.reg.bin", "userdef.reg.journal", key );
     release_object( key );
 
     /* load user.reg into HKEY_CURRENT_USER */
@@ -1794,7 +2598,7 @@ void init_registry(void)
         !(hkcu = create_key_recursive( root_key, &current_user_str, current_time )))
         fatal_error( "could not create HKEY_CURRENT_USER registry key\n" );
     free( current_user_path );
-    load_init_registry_from_file( "user.reg", hkcu );
+    load_init_registry_from_file( "user.reg", "user.reg.bin", "user.reg.journal", hkcu );
 
     /* set the shared flag on Software\Classes\Wow6432Node */
     if (prefix_type == PREFIX_64BIT)
@@ -1863,51 +2667,73 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
-/* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+/* open a file to save a registry branch into */
+/* a temp file is used and returned in tmp, unless replace isn't set and the file has to be written directly */
+static int open_save_file( const char *path, char **tmp, int replace )
 {
     struct stat st;
-    char *p, *tmp = NULL;
-    int fd, count = 0, ret = 0;
-    FILE *f;
+    char *p;
+    int fd, count = 0;
 
-    if (!(key->flags & KEY_DIRTY))
-    {
-        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
-        return 1;
-    }
+    *tmp = NULL;
 
     /* test the file type */
 
-    if ((fd = open( path, O_WRONLY )) != -1)
+    if (!replace && (fd = open( path, O_WRONLY )) != -1)
     {
         /* if file is not a regular file or has multiple links or is accessed
          * via symbolic links, write directly into it; otherwise use a temp file */
         if (!lstat( path, &st ) && (!S_ISREG(st.st_mode) || st.st_nlink > 1))
         {
             ftruncate( fd, 0 );
-            goto save;
+            return fd;
         }
         close( fd );
     }
 
     /* create a temp file in the same directory */
 
-    if (!(tmp = malloc( strlen(path) + 20 ))) goto done;
-    strcpy( tmp, path );
-    if ((p = strrchr( tmp, '/' ))) p++;
-    else p = tmp;
+    if (!(*tmp = malloc( strlen(path) + 20 ))) return -1;
+    strcpy( *tmp, path );
+    if ((p = strrchr( *tmp, '/' ))) p++;
+    else p = *tmp;
     for (;;)
     {
         sprintf( p, "reg%lx%04x.tmp", (long) getpid(), count++ );
-        if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
-        if (errno != EEXIST) goto done;
+        if ((fd = open( *tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
+        if (errno != EEXIST) return -1;
         close( fd );
     }
+    return fd;
+}
+
+/* rename the temp file if the branch was successfully written, or remove it */
+static int close_save_file( const char *path, const char *tmp, int ret )
+{
+    if (tmp)
+    {
+        /* if successfully written, rename to final name */
+        if (ret) ret = !rename( tmp, path );
+        if (!ret) unlink( tmp );
+    }
+    return ret;
+}
+
+/* save a registry branch to a file */
+static int save_branch( struct key *key, const char *path )
+{
+    char *tmp;
+    int fd, ret = 0;
+    FILE *f;
+
+    if (!(key->flags & KEY_DIRTY))
+    {
+        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
+        return 1;
+    }
 
-    /* now save to it */
+    if ((fd = open_save_file( path, &tmp, 0 )) == -1) goto done;
 
- save:
     if (!(f = fdopen( fd, "w" )))
     {
         if (tmp) unlink( tmp );
@@ -1922,30 +2748,290 @@ static int save_branch( struct key *key, const char *path )
     }
 
     save_all_subkeys( key, f );
-    ret = !fclose(f);
+    ret = close_save_file( path, tmp, !fclose(f) );
 
-    if (tmp)
+done:
+    free( tmp );
+    if (ret) make_clean( key, KEY_DIRTY );
+    return ret;
+}
+
+/* reserve some space in an image buffer and return its offset */
+static unsigned int alloc_image_data( struct image_buffer *buf, size_t size )
+{
+    size_t offset = (buf->size + REGISTRY_IMAGE_ALIGN - 1) & ~(REGISTRY_IMAGE_ALIGN - 1);
+
+    if (buf->error) return 0;
+    if (size > UINT_MAX - offset)
     {
-        /* if successfully written, rename to final name */
-        if (ret) ret = !rename( tmp, path );
-        if (!ret) unlink( tmp );
+        buf->error = 1;
+        return 0;
+    }
+    if (offset + size > buf->alloc)
+    {
+        size_t alloc = max( buf->alloc * 2, offset + size );
+        char *data;
+
+        if (!(data = realloc( buf->data, alloc )))
+        {
+            buf->error = 1;
+            return 0;
+        }
+        buf->data  = data;
+        buf->alloc = alloc;
+    }
+    memset( buf->data + buf->size, 0, offset + size - buf->size );
+    buf->size = offset + size;
+    return offset;
+}
+
+/* copy some data into an image buffer and return its offset */
+static unsigned int add_image_data( struct image_buffer *buf, const void *data, size_t size )
+{
+    unsigned int offset;
+
+    if (!size) return 0;
+    if ((offset = alloc_image_data( buf, size ))) memcpy( buf->data + offset, data, size );
+    return offset;
+}
+
+/* store a value in an image buffer at the specified offset */
+static void add_image_value( struct image_buffer *buf, unsigned int offset, const WCHAR *name,
+                             unsigned short namelen, unsigned short type, const void *data,
+                             data_size_t len )
+{
+    unsigned int name_offset = add_image_data( buf, name, namelen );
+    unsigned int data_offset = add_image_data( buf, data, len );
+    struct image_value *iv;
+
+    if (buf->error) return;
+    iv = (struct image_value *)(buf->data + offset);
+    iv->namelen = namelen;
+    iv->type    = type;
+    iv->len     = len;
+    iv->name    = name_offset;
+    iv->data    = data_offset;
+}
+
+/* copy a key from an existing image and all its subkeys to an image buffer */
+static unsigned int copy_image_key( struct image_buffer *buf, const struct registry_image *image,
+                                    const struct image_key *src )
+{
+    const struct image_value *iv = image_ptr( image, src->values );
+    const unsigned int *src_subkeys = image_ptr( image, src->subkeys );
+    unsigned int i, offset, subkey, name, class, values = 0, subkeys = 0;
+    struct image_key *ik;
+
+    if (!(offset = alloc_image_data( buf, sizeof(*ik) ))) return 0;
+    name  = add_image_data( buf, image_ptr( image, src->name ), src->namelen );
+    class = add_image_data( buf, image_ptr( image, src->class ), src->classlen );
+
+    if (src->nb_values)
+    {
+        values = alloc_image_data( buf, src->nb_values * sizeof(*iv) );
+        for (i = 0; i < src->nb_values && !buf->error; i++)
+            add_image_value( buf, values + i * sizeof(*iv), image_ptr( image, iv[i].name ),
+                             iv[i].namelen, iv[i].type, image_ptr( image, iv[i].data ), iv[i].len );
+    }
+    if (src->nb_subkeys)
+    {
+        subkeys = alloc_image_data( buf, src->nb_subkeys * sizeof(*src_subkeys) );
+        for (i = 0; i < src->nb_subkeys && !buf->error; i++)
+        {
+            subkey = copy_image_key( buf, image, image_ptr( image, src_subkeys[i] ));
+            if (!buf->error) ((unsigned int *)(buf->data + subkeys))[i] = subkey;
+        }
+    }
+    if (buf->error) return 0;
+
+    ik = (struct image_key *)(buf->data + offset);
+    *ik = *src;
+    ik->name    = name;
+    ik->class   = class;
+    ik->values  = values;
+    ik->subkeys = subkeys;
+    return offset;
+}
+
+/* add a key and all its subkeys to an image buffer */
+static unsigned int add_image_key( struct image_buffer *buf, const struct key *key )
+{
+    unsigned int offset, subkey, name, class, nb_subkeys = 0, values = 0, subkeys = 0;
+    struct image_key *ik;
+    int i;
+
+    if (key->image_key)
+    {
+        /* contents not loaded yet, copy them from the previous image */
+        if (!(offset = copy_image_key( buf, key->image, key->image_key ))) return 0;
+        ik = (struct image_key *)(buf->data + offset);
+        ik->modif = key->modif;
+        ik->flags = key->flags & IMAGE_KEY_FLAGS;
+        return offset;
+    }
+
+    if (!(offset = alloc_image_data( buf, sizeof(*ik) ))) return 0;
+    name  = add_image_data( buf, key->name, key->namelen );
+    class = add_image_data( buf, key->class, key->classlen );
+
+    if (key->last_value >= 0)
+    {
+        values = alloc_image_data( buf, (key->last_value + 1) * sizeof(struct image_value) );
+        for (i = 0; i <= key->last_value && !buf->error; i++)
+            add_image_value( buf, values + i * sizeof(struct image_value), key->values[i].name,
+                             key->values[i].namelen, key->values[i].type,
+                             key->values[i].data, key->values[i].len );
+    }
+
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) nb_subkeys++;
+    if (nb_subkeys)
+    {
+        subkeys = alloc_image_data( buf, nb_subkeys * sizeof(unsigned int) );
+        nb_subkeys = 0;
+        for (i = 0; i <= key->last_subkey && !buf->error; i++)
+        {
+            if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+            subkey = add_image_key( buf, key->subkeys[i] );
+            if (!buf->error) ((unsigned int *)(buf->data + subkeys))[nb_subkeys++] = subkey;
+        }
     }
+    if (buf->error) return 0;
+
+    ik = (struct image_key *)(buf->data + offset);
+    ik->modif      = key->modif;
+    ik->flags      = key->flags & IMAGE_KEY_FLAGS;
+    ik->namelen    = key->namelen;
+    ik->classlen   = key->classlen;
+    ik->name       = name;
+    ik->class      = class;
+    ik->nb_subkeys = nb_subkeys;
+    ik->subkeys    = subkeys;
+    ik->nb_values  = key->last_value + 1;
+    ik->values     = values;
+    return offset;
+}
+
+/* build the image of a key and all its subkeys; return the header, or NULL on error */
+static struct image_header *build_image( struct image_buffer *buf, const struct key *key )
+{
+    struct image_header *header;
+    unsigned int root;
+
+    alloc_image_data( buf, sizeof(*header) );
+    root = add_image_key( buf, key );
+    if (buf->error) return NULL;
+
+    header = (struct image_header *)buf->data;
+    header->magic       = REGISTRY_IMAGE_MAGIC;
+    header->version     = REGISTRY_IMAGE_VERSION;
+    header->size        = buf->size;
+    header->root        = root;
+    header->prefix_type = prefix_type;
+    return header;
+}
+
+/* write an image buffer to a file; return 1 if OK, 0 on error */
+static int write_image( int fd, const struct image_buffer *buf )
+{
+    size_t pos;
+    ssize_t res;
+
+    for (pos = 0; pos < buf->size; pos += res)
+        if ((res = write( fd, buf->data + pos, buf->size - pos )) <= 0) return 0;
+    return 1;
+}
+
+/* save a registry branch to its image, matching the current state of the text file */
+static int save_branch_image( struct save_branch_info *info, int force )
+{
+    struct image_buffer buf = { NULL, 0, 0, 0 };
+    struct image_header *header;
+    struct key *key = info->key;
+    const char *path = info->image_path;
+    unsigned __int64 generation;
+    struct stat st;
+    char *tmp = NULL;
+    int fd, ret = 0;
+
+    if (!force && !(key->flags & KEY_IMAGE_DIRTY)) return 1;
+
+    /* the image is only valid alongside the text file */
+    if (stat( info->path, &st ) == -1) goto done;
+
+    if (!(header = build_image( &buf, key ))) goto done;
+    header->text_dirty  = (key->flags & KEY_DIRTY) != 0;
+    header->text_size   = st.st_size;
+    header->text_mtime  = get_file_mtime( &st );
+    header->text_ino    = st.st_ino;
+    header->generation  = generation = max( (unsigned __int64)current_time, info->generation + 1 );
+
+    /* always replace the file, the previous image may still be mapped */
+    if ((fd = open_save_file( path, &tmp, 1 )) == -1) goto done;
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", path );
+        dump_operation( key, NULL, "saving" );
+    }
+
+    /* the image must be on disk before the journal is emptied */
+    ret = write_image( fd, &buf ) && !fsync( fd );
+    ret = close_save_file( path, tmp, !close( fd ) && ret );
 
 done:
     free( tmp );
-    if (ret) make_clean( key );
+    free( buf.data );
+    if (ret)
+    {
+        make_clean( key, KEY_IMAGE_DIRTY );
+        info->generation = generation;
+        /* the new image contains all the journaled changes, once its new name is on disk too */
+        if (!fsync( config_dir_fd )) reset_journal( info );
+        else close_journal( info );
+    }
     return ret;
 }
 
+/* save a registry branch to its image, and to its text file if requested or if the image cannot be used */
+static int save_branch_files( struct save_branch_info *info, int save_text )
+{
+    struct key *key = info->key;
+    struct stat st;
+    int text_dirty = (key->flags & KEY_DIRTY) != 0;
+
+    if (!save_text && !stat( info->path, &st ) && save_branch_image( info, 0 )) return 1;
+
+    if (!save_branch( key, info->path )) return 0;
+    /* a rewritten text file invalidates the previous image, and the changes journaled for it */
+    if (!save_branch_image( info, text_dirty )) close_journal( info );
+    return 1;
+}
+
 /* periodic saving of the registry */
+/* the images are updated when the changes can't be journaled, and the text files */
+/* are only rewritten every TEXT_SAVE_INTERVAL periods to keep them reasonably current */
 static void periodic_save( void *arg )
 {
-    int i;
+    struct save_branch_info *info;
+    int i, save_text;
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
+    save_text = !(++periodic_save_count % TEXT_SAVE_INTERVAL);
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    {
+        info = &save_branch_info[i];
+        if (save_text && (info->key->flags & KEY_DIRTY))
+        {
+            save_branch_files( info, 1 );
+            continue;
+        }
+        /* journaled changes are safe until the journal gets too large */
+        if (info->journal_fd != -1 && info->journal_size + info->journal_len < JOURNAL_MAX_SIZE)
+            continue;
+        save_branch_files( info, 0 );
+    }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -1963,9 +3049,14 @@ void flush_registry(void)
     int i;
 
     if (fchdir( config_dir_fd ) == -1) return;
+    if (journal_timeout_user)
+    {
+        remove_timeout_user( journal_timeout_user );
+        flush_journals( NULL );
+    }
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        if (!save_branch_files( &save_branch_info[i], 1 ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -2214,6 +3305,13 @@ DECL_HANDLER(save_registry)
         return;
     }
 
+    /* only the text format is supported */
+    if (req->flags != REG_STANDARD_FORMAT)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+
     if ((key = get_hkey_obj( req->hkey, 0 )))
     {
         save_registry( key, req->file );
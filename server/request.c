@@ -128,6 +128,7 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
+static struct request_stats req_stats[REQ_NB_REQUESTS];  /* statistics of each request code */
 
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
@@ -154,15 +155,34 @@ void fatal_error( const char *err, ... )
     exit(1);
 }
 
+/* reply data for the shared memory, built in private memory so that the client
+ * can't change it under the handler, and copied to the shared memory once complete */
+static union
+{
+    char      data[REQUEST_SHM_DATA_SIZE];
+    long long align;
+} shm_reply_buffer;
+
 /* allocate the reply data */
 void *set_reply_data_size( data_size_t size )
 {
     assert( size <= get_reply_max_size() );
-    if (size && !(current->reply_data = mem_alloc( size ))) size = 0;
+    if (current->request_shm_seq && size <= REQUEST_SHM_DATA_SIZE)
+        current->reply_data = shm_reply_buffer.data;
+    else if (size && !(current->reply_data = mem_alloc( size ))) size = 0;
     current->reply_size = size;
     return current->reply_data;
 }
 
+/* free the request and reply data of a thread */
+void free_request_data( struct thread *thread )
+{
+    free( thread->req_data );
+    if (thread->reply_data != shm_reply_buffer.data) free( thread->reply_data );
+    thread->req_data = NULL;
+    thread->reply_data = NULL;
+}
+
 /* write the remaining part of the reply */
 void write_reply( struct thread *thread )
 {
@@ -188,11 +208,72 @@ void write_reply( struct thread *thread )
         fatal_protocol_error( thread, "reply write: %s\n", strerror( errno ));
 }
 
+/* send a reply to the current thread through the shared memory */
+static void send_shm_reply( union generic_reply *reply )
+{
+    struct request_shm *shm = current->request_shm;
+    unsigned int seq = current->request_shm_seq;
+    struct iovec vec[2];
+    int ret, count = 0, size = 0;
+
+    memcpy( &shm->reply, reply, sizeof(*reply) );
+    if (current->reply_size <= REQUEST_SHM_DATA_SIZE)
+    {
+        if (current->reply_size) memcpy( shm->reply_data, current->reply_data, current->reply_size );
+        if (current->reply_data != shm_reply_buffer.data) free( current->reply_data );
+        current->reply_data = NULL;
+        current->reply_size = 0;
+    }
+
+    /* publish the reply before checking if the client went to sleep */
+    interlocked_xchg( (int *)&shm->reply_seq, seq );
+    if (interlocked_xchg( &shm->client_waiting, 0 ))
+    {
+        vec[count].iov_base = &seq;
+        vec[count].iov_len  = sizeof(seq);
+        size += vec[count++].iov_len;
+    }
+    if (current->reply_size)  /* too large for the shared memory, send it on the pipe */
+    {
+        vec[count].iov_base = current->reply_data;
+        vec[count].iov_len  = current->reply_size;
+        size += vec[count++].iov_len;
+    }
+    if (!count) return;
+
+    if ((ret = writev( get_unix_fd( current->reply_fd ), vec, count )) < size - (int)current->reply_size)
+        goto error;
+
+    if ((current->reply_towrite = size - ret))
+    {
+        /* couldn't write it all, wait for POLLOUT */
+        set_fd_events( current->reply_fd, POLLOUT );
+        set_fd_events( current->request_fd, 0 );
+        return;
+    }
+    free( current->reply_data );
+    current->reply_data = NULL;
+    return;
+
+ error:
+    if (ret >= 0)
+        fatal_protocol_error( current, "partial write %d\n", ret );
+    else if (errno == EPIPE)
+        kill_thread( current, 0 );  /* normal death */
+    else
+        fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
+}
+
 /* send a reply to the current thread */
 static void send_reply( union generic_reply *reply )
 {
     int ret;
 
+    if (current->request_shm_seq)
+    {
+        send_shm_reply( reply );
+        return;
+    }
     if (!current->reply_size)
     {
         if ((ret = write( get_unix_fd( current->reply_fd ),
@@ -230,11 +311,48 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* get a monotonic time in nanoseconds for the request statistics */
+static inline unsigned __int64 get_request_time(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return (unsigned __int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+
+    if (!timebase.denom) mach_timebase_info( &timebase );
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#endif
+    return current_time * 100;
+}
+
+static inline void add_request_stats( struct request_stats *stats, unsigned __int64 time )
+{
+    stats->count++;
+    stats->time += time;
+    if (time > stats->max_time) stats->max_time = time > ~0u ? ~0u : time;
+}
+
+/* account for the time spent handling a request */
+static void update_request_stats( struct process *process, enum request req, unsigned __int64 start )
+{
+    unsigned __int64 time = get_request_time() - start;
+
+    add_request_stats( &req_stats[req], time );
+    if (!process->req_stats && !(process->req_stats = calloc( REQ_NB_REQUESTS, sizeof(*req_stats) )))
+        return;
+    add_request_stats( &process->req_stats[req], time );
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    struct process *process = thread->process;
+    unsigned __int64 start = get_request_time();
 
     current = thread;
     current->reply_size = 0;
@@ -248,6 +366,9 @@ static void call_req_handler( struct thread *thread )
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
+    /* the reply isn't included, its cost doesn't depend on the request type */
+    if (req < REQ_NB_REQUESTS) update_request_stats( process, req, start );
+
     if (current)
     {
         if (current->reply_fd)
@@ -271,8 +392,37 @@ void read_request( struct thread *thread )
 {
     int ret;
 
-    if (!thread->req_toread)  /* no pending request */
+    if (!thread->req_toread && thread->request_shm)  /* the pipe only carries a token */
+    {
+        struct request_shm *shm = thread->request_shm;
+        unsigned int seq;
+
+        if ((ret = read( get_unix_fd( thread->request_fd ), &seq, sizeof(seq) )) != sizeof(seq))
+            goto error;
+        if (!seq || seq != shm->request_seq)
+        {
+            fatal_protocol_error( thread, "bad request token %u/%u\n", seq, shm->request_seq );
+            return;
+        }
+        /* work on a private copy, the client can modify the shared memory at any time */
+        memcpy( &thread->req, &shm->request, sizeof(thread->req) );
+        thread->request_shm_seq = seq;
+        if (!(thread->req_toread = thread->req.request_header.request_size))
+        {
+            call_req_handler( thread );
+            return;
+        }
+        /* the variable part follows the token on the pipe */
+        if (!(thread->req_data = malloc( thread->req_toread )))
+        {
+            fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                                  thread->req_toread, thread->req.request_header.req );
+            return;
+        }
+    }
+    else if (!thread->req_toread)  /* no pending request */
     {
+        thread->request_shm_seq = 0;
         if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
                          sizeof(thread->req) )) != sizeof(thread->req)) goto error;
         if (!(thread->req_toread = thread->req.request_header.request_size))
@@ -820,7 +970,11 @@ static void close_socket_timeout( void *arg )
 {
     master_timeout = NULL;
     flush_registry();
-    if (debug_level) fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
+    if (debug_level)
+    {
+        dump_poll_stats();
+        fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
+    }
 
 #ifdef DEBUG_OBJECTS
     close_objects();  /* shut down everything properly */
@@ -841,3 +995,93 @@ void close_master_socket( timeout_t timeout )
 
     master_timeout = add_timeout_user( timeout, close_socket_timeout, NULL );
 }
+
+/* sort request statistics by decreasing time */
+static int compare_request_stats( const void *p1, const void *p2 )
+{
+    const struct request_stats *stats1 = p1, *stats2 = p2;
+
+    if (stats1->time != stats2->time) return stats1->time < stats2->time ? 1 : -1;
+    return stats1->req - stats2->req;
+}
+
+/* print the statistics of the most expensive requests */
+static void print_request_stats( const struct request_stats *stats, unsigned int max_count )
+{
+    struct request_stats sorted[REQ_NB_REQUESTS];
+    unsigned __int64 calls = 0, time = 0;
+    unsigned int i, count = 0;
+
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        if (!stats[i].count) continue;
+        sorted[count] = stats[i];
+        sorted[count++].req = i;
+        calls += stats[i].count;
+        time += stats[i].time;
+    }
+    qsort( sorted, count, sizeof(sorted[0]), compare_request_stats );
+
+    fprintf( stderr, "  %llu calls, %.3f ms\n", (unsigned long long)calls, time / 1000000.0 );
+    for (i = 0; i < count && i < max_count; i++)
+        fprintf( stderr, "  %-32s %10llu calls %12.3f ms %5.1f%% %9.2f us avg %9.2f us max\n",
+                 get_request_name( sorted[i].req ), (unsigned long long)sorted[i].count,
+                 sorted[i].time / 1000000.0, time ? 100.0 * sorted[i].time / time : 0.0,
+                 sorted[i].time / 1000.0 / sorted[i].count, sorted[i].max_time / 1000.0 );
+}
+
+static int dump_process_request_stats( struct process *process, void *arg )
+{
+    if (!process->req_stats) return 0;
+    fprintf( stderr, "wineserver: requests of process %04x (unix pid %d):\n",
+             process->id, process->unix_pid );
+    print_request_stats( process->req_stats, 10 );
+    return 0;
+}
+
+/* print the request statistics of the server and of each process */
+void dump_request_stats(void)
+{
+    unsigned int timeouts, max_timeouts;
+
+    fprintf( stderr, "wineserver: requests since server start:\n" );
+    print_request_stats( req_stats, REQ_NB_REQUESTS );
+    enum_processes( dump_process_request_stats, NULL );
+    timeouts = get_timeout_count( &max_timeouts );
+    fprintf( stderr, "wineserver: %u pending timeouts, %u at most\n", timeouts, max_timeouts );
+}
+
+/* retrieve the request handling statistics of the server */
+DECL_HANDLER(get_request_stats)
+{
+    const struct request_stats *stats = req_stats;
+    struct request_stats *data;
+    struct process *process = NULL;
+    unsigned int i, count = 0;
+
+    reply->start_time = server_start_time;
+    reply->timeouts = get_timeout_count( &reply->max_timeouts );
+    if (req->handle)
+    {
+        if (!(process = get_process_from_handle( req->handle, PROCESS_QUERY_INFORMATION ))) return;
+        stats = process->req_stats;
+        reply->start_time = process->start_time;
+    }
+
+    if (stats)
+        for (i = 0; i < REQ_NB_REQUESTS; i++) if (stats[i].count) count++;
+    reply->total = count;
+
+    count = min( count, get_reply_max_size() / sizeof(*data) );
+    if (count && (data = set_reply_data_size( count * sizeof(*data) )))
+    {
+        for (i = 0; count; i++)
+        {
+            if (!stats[i].count) continue;
+            *data = stats[i];
+            data++->req = i;
+            count--;
+        }
+    }
+    if (process) release_object( process );
+}
@@ -121,6 +121,8 @@ static void sock_destroy( struct object *obj );
 static int sock_get_poll_events( struct fd *fd );
 static void sock_poll_event( struct fd *fd, int event );
 static enum server_fd_type sock_get_fd_type( struct fd *fd );
+static obj_handle_t sock_ioctl( struct fd *fd, ioctl_code_t code, const async_data_t *async,
+                               int blocking, const void *data, data_size_t size );
 static void sock_queue_async( struct fd *fd, const async_data_t *data, int type, int count );
 static void sock_reselect_async( struct fd *fd, struct async_queue *queue );
 static void sock_cancel_async( struct fd *fd, struct process *process, struct thread *thread, client_ptr_t iosb );
@@ -155,7 +157,7 @@ static const struct fd_ops sock_fd_ops =
     sock_poll_event,              /* poll_event */
     no_flush,                     /* flush */
     sock_get_fd_type,             /* get_fd_type */
-    default_fd_ioctl,             /* ioctl */
+    sock_ioctl,                   /* ioctl */
     sock_queue_async,             /* queue_async */
     sock_reselect_async,          /* reselect_async */
     sock_cancel_async             /* cancel_async */
@@ -523,6 +525,61 @@ static enum server_fd_type sock_get_fd_type( struct fd *fd )
     return FD_TYPE_SOCKET;
 }
 
+/* give a socket a fresh unix fd so that it can be connected or accepted into again */
+static void sock_reuse( struct sock *sock )
+{
+    struct fd *newfd;
+    int sockfd;
+
+    if ((sockfd = socket( sock->family, sock->type, sock->proto )) == -1)
+    {
+        sock_set_error();
+        return;
+    }
+    fcntl( sockfd, F_SETFL, O_NONBLOCK ); /* make socket nonblocking */
+    if (!(newfd = create_anonymous_fd( &sock_fd_ops, sockfd, &sock->obj, get_fd_options( sock->fd ) )))
+        return;
+    fd_copy_completion( sock->fd, newfd );
+
+    /* operations still queued on the old fd are terminated with STATUS_HANDLES_CLOSED */
+    free_async_queue( sock->read_q );
+    free_async_queue( sock->write_q );
+    sock->read_q  = NULL;
+    sock->write_q = NULL;
+    release_object( sock->fd );
+    sock->fd = newfd;
+
+    sock->state  = (sock->state & FD_WINE_NONBLOCKING) | ((sock->type != SOCK_STREAM) ? (FD_READ|FD_WRITE) : 0);
+    sock->hmask  = 0;
+    sock->pmask  = 0;
+    sock->polling = 0;
+    sock->connect_time = 0;
+    memset( sock->errors, 0, sizeof(sock->errors) );
+    if (sock->deferred)
+    {
+        release_object( sock->deferred );
+        sock->deferred = NULL;
+    }
+    sock_reselect( sock );
+}
+
+static obj_handle_t sock_ioctl( struct fd *fd, ioctl_code_t code, const async_data_t *async,
+                               int blocking, const void *data, data_size_t size )
+{
+    struct sock *sock = get_fd_user( fd );
+
+    assert( sock->obj.ops == &sock_ops );
+
+    switch (code)
+    {
+    case IOCTL_WINE_SOCKET_REUSE:
+        sock_reuse( sock );
+        return 0;
+    default:
+        return default_fd_ioctl( fd, code, async, blocking, data, size );
+    }
+}
+
 static void sock_queue_async( struct fd *fd, const async_data_t *data, int type, int count )
 {
     struct sock *sock = get_fd_user( fd );
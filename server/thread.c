@@ -30,6 +30,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <unistd.h>
 #include <time.h>
 #ifdef HAVE_POLL_H
@@ -185,6 +188,8 @@ static inline void init_thread_structure( struct thread *thread )
     thread->req_toread      = 0;
     thread->reply_data      = NULL;
     thread->reply_towrite   = 0;
+    thread->request_shm     = NULL;
+    thread->request_shm_seq = 0;
     thread->request_fd      = NULL;
     thread->reply_fd        = NULL;
     thread->wait_fd         = NULL;
@@ -277,8 +282,7 @@ static void cleanup_thread( struct thread *thread )
 
     clear_apc_queue( &thread->system_apc );
     clear_apc_queue( &thread->user_apc );
-    free( thread->req_data );
-    free( thread->reply_data );
+    free_request_data( thread );
     if (thread->request_fd) release_object( thread->request_fd );
     if (thread->reply_fd) release_object( thread->reply_fd );
     if (thread->wait_fd) release_object( thread->wait_fd );
@@ -295,8 +299,6 @@ static void cleanup_thread( struct thread *thread )
             thread->inflight[i].client = thread->inflight[i].server = -1;
         }
     }
-    thread->req_data = NULL;
-    thread->reply_data = NULL;
     thread->request_fd = NULL;
     thread->reply_fd = NULL;
     thread->wait_fd = NULL;
@@ -314,6 +316,7 @@ static void destroy_thread( struct object *obj )
     assert( !thread->debug_ctx );  /* cannot still be debugging something */
     list_remove( &thread->entry );
     cleanup_thread( thread );
+    if (thread->request_shm) munmap( thread->request_shm, REQUEST_SHM_SIZE );
     release_object( thread->process );
     if (thread->id) free_ptid( thread->id );
     if (thread->token) release_object( thread->token );
@@ -1321,6 +1324,34 @@ DECL_HANDLER(init_thread)
     if (wait_fd != -1) close( wait_fd );
 }
 
+/* use a shared memory area for the requests of the current thread */
+DECL_HANDLER(set_request_shm)
+{
+    void *ptr;
+    int fd;
+
+    if ((fd = thread_get_inflight_fd( current, req->fd )) == -1)
+    {
+        set_error( STATUS_TOO_MANY_OPENED_FILES );
+        return;
+    }
+    if (current->request_shm || req->size != REQUEST_SHM_SIZE)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        close( fd );
+        return;
+    }
+    ptr = mmap( NULL, REQUEST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (ptr == MAP_FAILED)
+    {
+        file_set_error();
+        return;
+    }
+    /* this reply still goes through the pipe, the shared memory is used starting with the next request */
+    current->request_shm = ptr;
+}
+
 /* terminate a thread */
 DECL_HANDLER(terminate_thread)
 {
@@ -69,6 +69,8 @@ struct thread
     void                  *reply_data;    /* variable-size data for reply */
     unsigned int           reply_size;    /* size of reply data */
     unsigned int           reply_towrite; /* amount of data still to write in reply */
+    struct request_shm    *request_shm;   /* shared memory for requests and replies, if any */
+    unsigned int           request_shm_seq; /* sequence number of the current request, 0 if sent on the pipe */
     struct fd             *request_fd;    /* fd for receiving client requests */
     struct fd             *reply_fd;      /* fd to send a reply to a client */
     struct fd             *wait_fd;       /* fd to use to wake a sleeping client */
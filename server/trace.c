@@ -114,6 +114,7 @@ static void dump_ioctl_code( const char *prefix, const ioctl_code_t *code )
         CASE(FSCTL_PIPE_DISCONNECT);
         CASE(FSCTL_PIPE_LISTEN);
         CASE(FSCTL_PIPE_WAIT);
+        CASE(IOCTL_WINE_SOCKET_REUSE);
         default: fprintf( stderr, "%s%08x", prefix, *code ); break;
 #undef CASE
     }
@@ -1084,6 +1085,44 @@ static void dump_varargs_rawinput_devices(const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_completion_entries( const char *prefix, data_size_t size )
+{
+    const struct completion_entry *entry;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*entry))
+    {
+        entry = cur_data;
+        dump_uint64( "{ckey=", &entry->ckey );
+        dump_uint64( ",cvalue=", &entry->cvalue );
+        dump_uint64( ",information=", &entry->information );
+        fprintf( stderr, ",status=%08x}", entry->status );
+        size -= sizeof(*entry);
+        remove_data( sizeof(*entry) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
+static void dump_varargs_request_stats( const char *prefix, data_size_t size )
+{
+    const struct request_stats *stats;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*stats))
+    {
+        stats = cur_data;
+        fprintf( stderr, "{req=%u,count=", stats->req );
+        dump_uint64( "", &stats->count );
+        dump_uint64( ",time=", &stats->time );
+        fprintf( stderr, ",max_time=%u}", stats->max_time );
+        size -= sizeof(*stats);
+        remove_data( sizeof(*stats) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1181,6 +1220,12 @@ static void dump_init_thread_reply( const struct init_thread_reply *req )
     fprintf( stderr, ", all_cpus=%08x", req->all_cpus );
 }
 
+static void dump_set_request_shm_request( const struct set_request_shm_request *req )
+{
+    fprintf( stderr, " fd=%d", req->fd );
+    fprintf( stderr, ", size=%u", req->size );
+}
+
 static void dump_terminate_process_request( const struct terminate_process_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -1626,6 +1671,7 @@ static void dump_get_handle_fd_reply( const struct get_handle_fd_reply *req )
     fprintf( stderr, ", cacheable=%d", req->cacheable );
     fprintf( stderr, ", access=%08x", req->access );
     fprintf( stderr, ", options=%08x", req->options );
+    fprintf( stderr, ", comp_flags=%08x", req->comp_flags );
 }
 
 static void dump_flush_file_request( const struct flush_file_request *req )
@@ -2335,6 +2381,7 @@ static void dump_save_registry_request( const struct save_registry_request *req
 {
     fprintf( stderr, " hkey=%04x", req->hkey );
     fprintf( stderr, ", file=%04x", req->file );
+    fprintf( stderr, ", flags=%08x", req->flags );
 }
 
 static void dump_set_registry_notification_request( const struct set_registry_notification_request *req )
@@ -3985,6 +4032,16 @@ static void dump_remove_completion_reply( const struct remove_completion_reply *
     fprintf( stderr, ", status=%08x", req->status );
 }
 
+static void dump_remove_completions_request( const struct remove_completions_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_remove_completions_reply( const struct remove_completions_reply *req )
+{
+    dump_varargs_completion_entries( " entries=", cur_size );
+}
+
 static void dump_query_completion_request( const struct query_completion_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4008,6 +4065,13 @@ static void dump_add_fd_completion_request( const struct add_fd_completion_reque
     dump_uint64( ", cvalue=", &req->cvalue );
     dump_uint64( ", information=", &req->information );
     fprintf( stderr, ", status=%08x", req->status );
+    fprintf( stderr, ", async=%d", req->async );
+}
+
+static void dump_set_fd_completion_mode_request( const struct set_fd_completion_mode_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", flags=%08x", req->flags );
 }
 
 static void dump_get_window_layered_info_request( const struct get_window_layered_info_request *req )
@@ -4086,6 +4150,20 @@ static void dump_set_suspend_context_request( const struct set_suspend_context_r
     dump_varargs_context( " context=", cur_size );
 }
 
+static void dump_get_request_stats_request( const struct get_request_stats_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_request_stats_reply( const struct get_request_stats_reply *req )
+{
+    dump_timeout( " start_time=", &req->start_time );
+    fprintf( stderr, ", total=%u", req->total );
+    fprintf( stderr, ", timeouts=%08x", req->timeouts );
+    fprintf( stderr, ", max_timeouts=%08x", req->max_timeouts );
+    dump_varargs_request_stats( ", stats=", cur_size );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -4093,6 +4171,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_startup_info_request,
     (dump_func)dump_init_process_done_request,
     (dump_func)dump_init_thread_request,
+    (dump_func)dump_set_request_shm_request,
     (dump_func)dump_terminate_process_request,
     (dump_func)dump_terminate_thread_request,
     (dump_func)dump_get_process_info_request,
@@ -4331,9 +4410,11 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_request,
     (dump_func)dump_add_completion_request,
     (dump_func)dump_remove_completion_request,
+    (dump_func)dump_remove_completions_request,
     (dump_func)dump_query_completion_request,
     (dump_func)dump_set_completion_info_request,
     (dump_func)dump_add_fd_completion_request,
+    (dump_func)dump_set_fd_completion_mode_request,
     (dump_func)dump_get_window_layered_info_request,
     (dump_func)dump_set_window_layered_info_request,
     (dump_func)dump_alloc_user_handle_request,
@@ -4342,6 +4423,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_update_rawinput_devices_request,
     (dump_func)dump_get_suspend_context_request,
     (dump_func)dump_set_suspend_context_request,
+    (dump_func)dump_get_request_stats_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -4351,6 +4433,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_startup_info_reply,
     NULL,
     (dump_func)dump_init_thread_reply,
+    NULL,
     (dump_func)dump_terminate_process_reply,
     (dump_func)dump_terminate_thread_reply,
     (dump_func)dump_get_process_info_reply,
@@ -4589,9 +4672,11 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_reply,
     NULL,
     (dump_func)dump_remove_completion_reply,
+    (dump_func)dump_remove_completions_reply,
     (dump_func)dump_query_completion_reply,
     NULL,
     NULL,
+    NULL,
     (dump_func)dump_get_window_layered_info_reply,
     NULL,
     (dump_func)dump_alloc_user_handle_reply,
@@ -4600,6 +4685,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     (dump_func)dump_get_suspend_context_reply,
     NULL,
+    (dump_func)dump_get_request_stats_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -4609,6 +4695,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_startup_info",
     "init_process_done",
     "init_thread",
+    "set_request_shm",
     "terminate_process",
     "terminate_thread",
     "get_process_info",
@@ -4847,9 +4934,11 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "open_completion",
     "add_completion",
     "remove_completion",
+    "remove_completions",
     "query_completion",
     "set_completion_info",
     "add_fd_completion",
+    "set_fd_completion_mode",
     "get_window_layered_info",
     "set_window_layered_info",
     "alloc_user_handle",
@@ -4858,6 +4947,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "update_rawinput_devices",
     "get_suspend_context",
     "set_suspend_context",
+    "get_request_stats",
 };
 
 static const struct
@@ -5030,3 +5120,8 @@ void trace_reply( enum request req, const union generic_reply *reply )
     else fprintf( stderr, "%04x: %d() = %s\n",
                   current->id, req, get_status_name(current->error) );
 }
+
+const char *get_request_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "?";
+}